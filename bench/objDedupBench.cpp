@@ -0,0 +1,210 @@
+// Microbenchmark of the OBJ vertex deduplication map.
+//
+// Compares the node based std::unordered_map (with the old linear hash
+// and the unconditional 1M reserve the loader used to do) against
+// ObjIndexMap, on face index streams shaped like our OBJ files.
+// Peak memory of the maps is tracked by a counting allocator.
+#include "objIndexMap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ===================== //
+//   ALLOCATION TRACKING //
+// ===================== //
+static size_t gCurrentBytes = 0;
+static size_t gPeakBytes = 0;
+
+// Given to both maps, so that only their own storage is counted
+template<class T>
+struct CountingAllocator
+{
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template<class U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        gCurrentBytes += n * sizeof(T);
+        gPeakBytes = std::max(gPeakBytes, gCurrentBytes);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        gCurrentBytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template<class U>
+    bool operator==(const CountingAllocator<U>&) const { return true; }
+};
+
+// ===================== //
+//      WORKLOADS        //
+// ===================== //
+// Hash that the loader used before ObjKeyHash
+struct LinearObjKeyHash
+{
+    size_t operator()(const ObjKeyType& k) const
+    {
+        return (k.posIndex * 7741ull +
+                k.normalIndex * 5113ull +
+                k.uvIndex * 9157ull);
+    }
+};
+
+struct Workload
+{
+    std::string name;
+    std::vector<ObjKeyType> keys;
+    size_t faceCount;
+};
+
+// Latitude/longitude sphere the way our exporters write it: one shared
+// index for pos/uv/normal, except the uv seam column.
+static Workload SphereWorkload(uint32_t n)
+{
+    Workload w = {"sphere_grid_" + std::to_string(n), {}, 0};
+    auto Key = [n](uint32_t i, uint32_t j)
+    {
+        uint32_t pos = j * n + (i % n);
+        uint32_t uv = j * (n + 1) + i;
+        return ObjKeyType{pos, uv, pos};
+    };
+    for(uint32_t j = 0; j + 1 < n; j++)
+    for(uint32_t i = 0; i < n; i++)
+    {
+        ObjKeyType a = Key(i, j), b = Key(i + 1, j);
+        ObjKeyType c = Key(i, j + 1), d = Key(i + 1, j + 1);
+        w.keys.insert(w.keys.end(), {a, b, c, b, d, c});
+    }
+    w.faceCount = w.keys.size() / 3;
+    return w;
+}
+
+// Independent pos/uv/normal streams with small strides, this is
+// where a linear combination hash collides.
+static Workload StridedWorkload(uint32_t n)
+{
+    Workload w = {"strided_" + std::to_string(n), {}, 0};
+    for(uint32_t i = 0; i < n; i++)
+    for(uint32_t k = 0; k < 3; k++)
+    {
+        uint32_t v = i + k;
+        w.keys.push_back(ObjKeyType{v * 2, v * 3, v * 5});
+    }
+    w.faceCount = n;
+    return w;
+}
+
+static Workload RandomWorkload(uint32_t n)
+{
+    Workload w = {"random_" + std::to_string(n), {}, 0};
+    std::mt19937 rng(0x5EED);
+    std::uniform_int_distribution<uint32_t> dist(0, n / 2);
+    for(uint32_t i = 0; i < n * 3; i++)
+        w.keys.push_back(ObjKeyType{dist(rng), dist(rng) % 64, dist(rng) % 64});
+    w.faceCount = n;
+    return w;
+}
+
+// ===================== //
+//       RUNNERS         //
+// ===================== //
+struct Result
+{
+    double ms;
+    size_t peakBytes;
+    size_t unique;
+};
+
+template<class Func>
+static Result Measure(const Workload& w, Func&& f)
+{
+    static constexpr int REPEAT = 7;
+    std::vector<double> times;
+    Result r = {};
+    for(int i = 0; i < REPEAT; i++)
+    {
+        size_t base = gCurrentBytes;
+        gPeakBytes = base;
+        auto start = std::chrono::steady_clock::now();
+        r.unique = f(w);
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        r.peakBytes = gPeakBytes - base;
+    }
+    std::sort(times.begin(), times.end());
+    r.ms = times[times.size() / 2];
+    return r;
+}
+
+static size_t RunUnorderedMap(const Workload& w, bool reserveOneMillion)
+{
+    std::unordered_map<ObjKeyType, uint32_t, LinearObjKeyHash, std::equal_to<ObjKeyType>,
+                       CountingAllocator<std::pair<const ObjKeyType, uint32_t>>> map;
+    if(reserveOneMillion) map.reserve(1024 * 1024);
+    std::vector<uint32_t> indices; indices.reserve(w.keys.size());
+    uint32_t counter = 0;
+    for(const ObjKeyType& k : w.keys)
+    {
+        auto insertR = map.emplace(k, counter);
+        if(insertR.second) counter++;
+        indices.push_back(insertR.first->second);
+    }
+    return map.size();
+}
+
+static size_t RunFlatMap(const Workload& w, bool sized)
+{
+    ObjIndexMap<uint32_t, CountingAllocator<uint32_t>> map;
+    if(sized) map.Reserve(w.faceCount * 3 / 4);
+    std::vector<uint32_t> indices; indices.reserve(w.keys.size());
+    uint32_t counter = 0;
+    for(const ObjKeyType& k : w.keys)
+    {
+        auto [index, inserted] = map.Emplace(k, counter);
+        if(inserted) counter++;
+        indices.push_back(index);
+    }
+    return map.Size();
+}
+
+int main()
+{
+    std::vector<Workload> workloads;
+    workloads.push_back(SphereWorkload(8));
+    workloads.push_back(SphereWorkload(100));
+    workloads.push_back(SphereWorkload(1000));
+    workloads.push_back(StridedWorkload(1000000));
+    workloads.push_back(RandomWorkload(1000000));
+
+    std::printf("%-20s %-28s %10s %12s %12s %10s\n",
+                "workload", "map", "unique", "Minserts/s", "peak MiB", "ms");
+    for(const Workload& w : workloads)
+    {
+        auto Print = [&](const char* name, const Result& r)
+        {
+            double mips = double(w.keys.size()) / (r.ms * 1e3);
+            std::printf("%-20s %-28s %10zu %12.1f %12.2f %10.3f\n",
+                        w.name.c_str(), name, r.unique, mips,
+                        double(r.peakBytes) / (1024.0 * 1024.0), r.ms);
+        };
+        Print("unordered_map + reserve(1M)", Measure(w, [](const Workload& x) { return RunUnorderedMap(x, true); }));
+        Print("unordered_map", Measure(w, [](const Workload& x) { return RunUnorderedMap(x, false); }));
+        Print("ObjIndexMap (estimated)", Measure(w, [](const Workload& x) { return RunFlatMap(x, true); }));
+        Print("ObjIndexMap (unsized)", Measure(w, [](const Workload& x) { return RunFlatMap(x, false); }));
+    }
+    return 0;
+}
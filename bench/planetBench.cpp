@@ -0,0 +1,484 @@
+// Asset pipeline benchmark suite (no window / GL required).
+//
+// Times the CPU side of asset loading:
+//   obj/*      LoadObj of every shipped mesh and of a generated OBJ
+//              (10M triangles by default)
+//   decode/*   stb_image decode of every texture
+//   mips/*     mip chain of every decoded texture with the filter of
+//              the renderer (GenerateMips, sRGB and alpha aware)
+//   mips-box/* the same with a plain box filter, the cost of the
+//              linear space filtering
+//   mips16/*   the same widened to 16 bits per channel
+//   bc/*       block compression of every texture with its mips
+//              (CompressImage, format of the renderer)
+//   ptex/*     mapping and validating the converted container of every
+//              texture (TextureContainer::Open, cold page cache is not
+//              forced)
+//   dedup/*    ObjIndexMap insertion throughput
+//
+// Every case runs its warmup iterations first, then the timed ones;
+// the median, p95, min and mean are reported as a table and written
+// as JSON so that results can be compared across versions.
+//
+// Run it from "working_dir" (meshes/ and textures/ are relative):
+//   planet_bench [--warmup N] [--iterations N] [--json <path>]
+//                [--synthetic-triangles N] [--filter <text>]
+//                [--label <text>]
+#include "blockCompressor.h"
+#include "mipGenerator.h"
+#include "objIndexMap.h"
+#include "objLoader.h"
+#include "textureContainer.h"
+#include "threadPool.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ===================== //
+//       OPTIONS         //
+// ===================== //
+struct Options
+{
+    int         warmup = 2;
+    int         iterations = 10;
+    uint64_t    syntheticTriangles = 10'000'000;
+    std::string jsonPath = "planet_bench.json";
+    std::string filter;
+    std::string label;
+};
+
+static Options ParseOptions(int argc, char** argv)
+{
+    Options o;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if(arg == "--warmup" && hasValue)                   o.warmup = std::atoi(argv[++i]);
+        else if(arg == "--iterations" && hasValue)          o.iterations = std::atoi(argv[++i]);
+        else if(arg == "--json" && hasValue)                o.jsonPath = argv[++i];
+        else if(arg == "--synthetic-triangles" && hasValue) o.syntheticTriangles = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--filter" && hasValue)              o.filter = argv[++i];
+        else if(arg == "--label" && hasValue)               o.label = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "Unknown argument \"%s\"\n", arg.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    o.warmup = std::max(o.warmup, 0);
+    o.iterations = std::max(o.iterations, 1);
+    return o;
+}
+
+// ===================== //
+//       RUNNER          //
+// ===================== //
+// Results are folded into this so that no work is optimized away
+static volatile uint64_t gSink = 0;
+
+struct CaseResult
+{
+    std::string name;
+    int         warmup;
+    int         iterations;
+    double      medianMs;
+    double      p95Ms;
+    double      minMs;
+    double      meanMs;
+    // Work per iteration, throughput is reported per median
+    double      items;
+    const char* itemUnit;
+};
+
+struct Suite
+{
+    const Options&          options;
+    std::vector<CaseResult> results;
+
+    explicit Suite(const Options& o) : options(o) {}
+
+    // "Run" returns a value derived from its work. Heavy cases are
+    // limited to one warmup and three timed iterations.
+    void Add(const std::string& name, double items, const char* itemUnit,
+             const std::function<uint64_t()>& Run, bool heavy = false)
+    {
+        if(!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+
+        CaseResult r = {name, options.warmup, options.iterations, 0.0, 0.0,
+                        0.0, 0.0, items, itemUnit};
+        if(heavy)
+        {
+            r.warmup = std::min(r.warmup, 1);
+            r.iterations = std::min(r.iterations, 3);
+        }
+        for(int i = 0; i < r.warmup; i++)
+            gSink = gSink + Run();
+
+        std::vector<double> times;
+        for(int i = 0; i < r.iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            gSink = gSink + Run();
+            auto end = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        if(times.empty()) return;
+        std::sort(times.begin(), times.end());
+        // Nearest rank percentiles
+        auto Percentile = [&](double p)
+        {
+            size_t rank = size_t(std::ceil(p * double(times.size())));
+            return times[std::clamp<size_t>(rank, 1, times.size()) - 1];
+        };
+        r.medianMs = Percentile(0.5);
+        r.p95Ms = Percentile(0.95);
+        r.minMs = times.front();
+        for(double t : times) r.meanMs += t;
+        r.meanMs /= double(times.size());
+
+        results.push_back(r);
+    }
+
+    // After all cases, the loaders print their own progress
+    void PrintTable() const
+    {
+        std::printf("\n%-44s %10s %10s %10s %14s\n",
+                    "case", "median ms", "p95 ms", "min ms", "throughput");
+        for(const CaseResult& r : results)
+        {
+            std::printf("%-44s %10.3f %10.3f %10.3f %14.2f %s/s\n",
+                        r.name.c_str(), r.medianMs, r.p95Ms, r.minMs,
+                        Throughput(r), r.itemUnit);
+        }
+    }
+
+    bool WriteJson(const std::string& path) const
+    {
+        FILE* f = std::fopen(path.c_str(), "w");
+        if(!f) return false;
+
+        char date[32] = {};
+        std::time_t now = std::time(nullptr);
+        if(const std::tm* utc = std::gmtime(&now))
+            std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", utc);
+        #ifdef NDEBUG
+            const char* buildType = "release";
+        #else
+            const char* buildType = "debug";
+        #endif
+
+        std::fprintf(f, "{\n");
+        std::fprintf(f, "  \"schema\": 1,\n");
+        std::fprintf(f, "  \"label\": \"%s\",\n", Escape(options.label).c_str());
+        std::fprintf(f, "  \"date\": \"%s\",\n", date);
+        std::fprintf(f, "  \"build\": \"%s\",\n", buildType);
+        std::fprintf(f, "  \"threads\": %u,\n", ThreadPool::Global().ThreadCount());
+        std::fprintf(f, "  \"results\": [\n");
+        for(size_t i = 0; i < results.size(); i++)
+        {
+            const CaseResult& r = results[i];
+            std::fprintf(f, "    {\"name\": \"%s\", \"warmup\": %d, \"iterations\": %d, "
+                         "\"median_ms\": %.4f, \"p95_ms\": %.4f, \"min_ms\": %.4f, "
+                         "\"mean_ms\": %.4f, \"items\": %.6g, \"unit\": \"%s\", "
+                         "\"per_second\": %.4f}%s\n",
+                         Escape(r.name).c_str(), r.warmup, r.iterations,
+                         r.medianMs, r.p95Ms, r.minMs, r.meanMs, r.items,
+                         r.itemUnit, Throughput(r),
+                         (i + 1 < results.size()) ? "," : "");
+        }
+        std::fprintf(f, "  ]\n}\n");
+        return std::fclose(f) == 0;
+    }
+
+    static double Throughput(const CaseResult& r)
+    {
+        return r.items / (r.medianMs * 1e-3);
+    }
+
+    static std::string Escape(const std::string& s)
+    {
+        std::string out;
+        for(char c : s)
+        {
+            if(c == '"' || c == '\\') out += '\\';
+            if(static_cast<unsigned char>(c) < 0x20) continue;
+            out += c;
+        }
+        return out;
+    }
+};
+
+// ===================== //
+//      WORKLOADS        //
+// ===================== //
+static std::vector<fs::path> FilesIn(const fs::path& dir,
+                                     const std::vector<std::string>& extensions)
+{
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for(const fs::directory_entry& e : fs::directory_iterator(dir, ec))
+    {
+        std::string ext = e.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(),
+                       [](unsigned char c) { return char(std::tolower(c)); });
+        if(e.is_regular_file() &&
+           std::find(extensions.begin(), extensions.end(), ext) != extensions.end())
+            files.push_back(e.path());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Heightfield grid with positions, uvs and normals, written the way
+// our exporters write meshes ("f v/vt/vn", one index for all three)
+static bool WriteSyntheticObj(const fs::path& path, uint64_t triangleCount)
+{
+    uint32_t cells = uint32_t(std::ceil(std::sqrt(double(triangleCount) * 0.5)));
+    uint32_t n = std::max(cells, 1u) + 1;
+    FILE* f = std::fopen(path.string().c_str(), "wb");
+    if(!f) return false;
+
+    std::vector<char> buffer(1 << 20);
+    size_t used = 0;
+    auto Flush = [&]()
+    {
+        std::fwrite(buffer.data(), 1, used, f);
+        used = 0;
+    };
+    // Room for one more line
+    auto Line = [&]()
+    {
+        if(buffer.size() - used < 256) Flush();
+        return buffer.data() + used;
+    };
+
+    float inv = 1.0f / float(n - 1);
+    for(uint32_t j = 0; j < n; j++)
+    for(uint32_t i = 0; i < n; i++)
+    {
+        float x = float(i) * inv, z = float(j) * inv;
+        float y = 0.05f * std::sin(20.0f * x) * std::cos(20.0f * z);
+        used += size_t(std::snprintf(Line(), 256, "v %.6f %.6f %.6f\n",
+                                     double(x), double(y), double(z)));
+    }
+    for(uint32_t j = 0; j < n; j++)
+    for(uint32_t i = 0; i < n; i++)
+        used += size_t(std::snprintf(Line(), 256, "vt %.6f %.6f\n",
+                                     double(float(i) * inv), double(float(j) * inv)));
+    for(uint32_t k = 0; k < n * n; k++)
+        used += size_t(std::snprintf(Line(), 256, "vn 0 1 0\n"));
+
+    uint64_t written = 0;
+    for(uint32_t j = 0; j + 1 < n && written < triangleCount; j++)
+    for(uint32_t i = 0; i + 1 < n && written < triangleCount; i++)
+    {
+        uint32_t a = j * n + i + 1, b = a + 1;
+        uint32_t c = a + n, d = c + 1;
+        used += size_t(std::snprintf(Line(), 256, "f %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                                     a, a, a, c, c, c, b, b, b));
+        if(++written == triangleCount) break;
+        used += size_t(std::snprintf(Line(), 256, "f %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                                     b, b, b, c, c, c, d, d, d));
+        written++;
+    }
+    Flush();
+    return std::fclose(f) == 0;
+}
+
+// Face index streams of a latitude/longitude sphere (shared pos/normal,
+// duplicated uv seam), see bench/objDedupBench.cpp
+static std::vector<ObjKeyType> SphereKeys(uint32_t n)
+{
+    std::vector<ObjKeyType> keys;
+    auto Key = [n](uint32_t i, uint32_t j)
+    {
+        uint32_t pos = j * n + (i % n);
+        return ObjKeyType{pos, j * (n + 1) + i, pos};
+    };
+    for(uint32_t j = 0; j + 1 < n; j++)
+    for(uint32_t i = 0; i < n; i++)
+    {
+        ObjKeyType a = Key(i, j), b = Key(i + 1, j);
+        ObjKeyType c = Key(i, j + 1), d = Key(i + 1, j + 1);
+        keys.insert(keys.end(), {a, b, c, b, d, c});
+    }
+    return keys;
+}
+
+static std::vector<ObjKeyType> RandomKeys(uint32_t faceCount)
+{
+    std::vector<ObjKeyType> keys;
+    std::mt19937 rng(0x5EED);
+    std::uniform_int_distribution<uint32_t> dist(0, faceCount / 2);
+    for(uint32_t i = 0; i < faceCount * 3; i++)
+        keys.push_back(ObjKeyType{dist(rng), dist(rng) % 64, dist(rng) % 64});
+    return keys;
+}
+
+static uint64_t Deduplicate(const std::vector<ObjKeyType>& keys)
+{
+    // Sized the way the loader estimates it
+    ObjIndexMap<uint32_t> map(keys.size() / 4);
+    uint32_t counter = 0;
+    for(const ObjKeyType& k : keys)
+    {
+        if(map.Emplace(k, counter).second) counter++;
+    }
+    return map.Size();
+}
+
+int main(int argc, char** argv)
+{
+    Options options = ParseOptions(argc, argv);
+    Suite suite(options);
+
+    // OBJ parsing
+    for(const fs::path& p : FilesIn("meshes", {".obj"}))
+    {
+        std::string path = p.generic_string();
+        double mib = double(fs::file_size(p)) / (1024.0 * 1024.0);
+        suite.Add("obj/" + p.filename().string(), mib, "MiB",
+                  [path]() { return uint64_t(LoadObj(path).VertexCount()); });
+    }
+    if(options.syntheticTriangles != 0)
+    {
+        std::string name = "obj/synthetic_" + std::to_string(options.syntheticTriangles) + "_tris";
+        fs::path path = fs::temp_directory_path() / "planet_bench_synthetic.obj";
+        if(options.filter.empty() || name.find(options.filter) != std::string::npos)
+        {
+            if(!WriteSyntheticObj(path, options.syntheticTriangles))
+            {
+                std::fprintf(stderr, "Unable to write \"%s\"\n", path.string().c_str());
+                return EXIT_FAILURE;
+            }
+            double mib = double(fs::file_size(path)) / (1024.0 * 1024.0);
+            std::string pathStr = path.string();
+            suite.Add(name, mib, "MiB",
+                      [pathStr]() { return uint64_t(LoadObj(pathStr).VertexCount()); },
+                      true);
+            fs::remove(path);
+        }
+    }
+
+    // Image decode and CPU mips, in the renderer's orientation
+    stbi_set_flip_vertically_on_load(1);
+    for(const fs::path& p : FilesIn("textures", {".jpg", ".jpeg", ".png"}))
+    {
+        std::string path = p.generic_string();
+        std::string name = p.filename().string();
+        int w = 0, h = 0, c = 0;
+        if(!stbi_info(path.c_str(), &w, &h, &c))
+        {
+            std::fprintf(stderr, "Unable to read image \"%s\"\n", path.c_str());
+            continue;
+        }
+        double mpix = double(w) * double(h) * 1e-6;
+        suite.Add("decode/" + name, mpix, "MPix", [path]()
+        {
+            int x, y, n;
+            unsigned char* pixels = stbi_load(path.c_str(), &x, &y, &n, 0);
+            uint64_t r = pixels ? uint64_t(pixels[0]) + uint64_t(x) : 0;
+            stbi_image_free(pixels);
+            return r;
+        });
+
+        std::string mipName = "mips/" + name;
+        std::string boxName = "mips-box/" + name;
+        std::string wideName = "mips16/" + name;
+        BlockFormat::Type format = BlockFormat::ForChannelCount(c);
+        std::string bcName = std::string("bc/") + BlockFormat::Name(format) + "/" + name;
+        std::string ptexName = std::string("ptex/") + BlockFormat::Name(format) + "/" + name;
+        auto Selected = [&](const std::string& n)
+        {
+            return options.filter.empty() || n.find(options.filter) != std::string::npos;
+        };
+        if(!Selected(mipName) && !Selected(boxName) && !Selected(wideName) &&
+           !Selected(bcName) && !Selected(ptexName))
+            continue;
+        unsigned char* pixels = stbi_load(path.c_str(), &w, &h, &c, 0);
+        if(!pixels) continue;
+        suite.Add(mipName, mpix, "MPix", [&]()
+        {
+            MipChain mips = GenerateMips(pixels, uint32_t(w), uint32_t(h), uint32_t(c));
+            return uint64_t(mips.levels.size()) + mips.data.back();
+        });
+        suite.Add(boxName, mpix, "MPix", [&]()
+        {
+            MipChain mips = GenerateMips(pixels, uint32_t(w), uint32_t(h), uint32_t(c), 1,
+                                         MipFilter());
+            return uint64_t(mips.levels.size()) + mips.data.back();
+        });
+        if(Selected(wideName))
+        {
+            std::vector<uint16_t> wide(size_t(w) * size_t(h) * size_t(c));
+            for(size_t i = 0; i < wide.size(); i++)
+                wide[i] = uint16_t(pixels[i] * 257);
+            suite.Add(wideName, mpix, "MPix", [&]()
+            {
+                MipChain mips = GenerateMips(wide.data(), uint32_t(w), uint32_t(h), uint32_t(c),
+                                             2, MipFilter::For(uint32_t(c)));
+                return uint64_t(mips.levels.size()) + mips.data.back();
+            });
+        }
+        suite.Add(bcName, mpix, "MPix", [&]()
+        {
+            CompressedImage image = CompressImage(pixels, uint32_t(w), uint32_t(h),
+                                                  uint32_t(c), format);
+            return uint64_t(image.data.size()) + image.data[0];
+        }, true);
+        if(Selected(ptexName))
+        {
+            fs::path ptexPath = fs::temp_directory_path() / ("planet_bench_" + name + ".ptex");
+            TextureImage image = EncodeTexture(pixels, uint32_t(w), uint32_t(h),
+                                               uint32_t(c), TexelEncoding::Block(format));
+            std::string ptexStr = ptexPath.generic_string();
+            if(TextureContainer::Write(ptexStr, image))
+            {
+                suite.Add(ptexName, mpix, "MPix", [&ptexStr]()
+                {
+                    TextureContainer container;
+                    if(!container.Open(ptexStr)) return uint64_t(0);
+                    return uint64_t(container.levels.size()) + container.data[0];
+                });
+                fs::remove(ptexPath);
+            }
+        }
+        stbi_image_free(pixels);
+    }
+
+    // Deduplication map
+    {
+        std::vector<ObjKeyType> keys = SphereKeys(1000);
+        suite.Add("dedup/sphere_grid_1000", double(keys.size()) * 1e-6, "Minserts",
+                  [&keys]() { return Deduplicate(keys); });
+        keys = RandomKeys(1000000);
+        suite.Add("dedup/random_1000000", double(keys.size()) * 1e-6, "Minserts",
+                  [&keys]() { return Deduplicate(keys); });
+    }
+
+    suite.PrintTable();
+    if(!suite.WriteJson(options.jsonPath))
+    {
+        std::fprintf(stderr, "Unable to write \"%s\"\n", options.jsonPath.c_str());
+        return EXIT_FAILURE;
+    }
+    std::printf("Results are written to \"%s\".\n", options.jsonPath.c_str());
+    return 0;
+}
@@ -0,0 +1,267 @@
+#include "assetRegistry.h"
+#include "sphereGenerator.h"
+#include "threadPool.h"
+
+#include <cstdio>
+#include <filesystem>
+
+namespace
+{
+    std::string NormalizePath(const std::string& path)
+    {
+        return std::filesystem::path(path).lexically_normal().generic_string();
+    }
+
+    std::string TextureKey(const std::string& texPath,
+                           TextureGL::SampleMode sampleMode,
+                           TextureGL::EdgeResolve edgeResolveMode,
+                           bool compress)
+    {
+        return ((compress ? "bc|" : "") + std::to_string(sampleMode) + "|" +
+                std::to_string(edgeResolveMode) + "|" +
+                NormalizePath(texPath));
+    }
+
+    std::string TexturePrefetchKey(const std::string& texPath, bool compress)
+    {
+        return (compress ? "bc|" : "") + NormalizePath(texPath);
+    }
+
+    std::string ShaderKey(ShaderGL::Type t, const std::string& path,
+                          const ShaderGL::Constants& constants)
+    {
+        std::string key = std::to_string(t) + "|" + NormalizePath(path);
+        for(const ShaderGL::Constant& c : constants)
+            key += "|" + std::to_string(c.id) + "=" + std::to_string(c.value);
+        return key;
+    }
+
+    std::string MeshKey(const std::vector<std::string>& lodObjPaths,
+                        MeshVertexLayout::Format vFormat)
+    {
+        std::string key = MeshVertexLayout::FormatName(vFormat);
+        for(const std::string& p : lodObjPaths)
+            key += "|" + NormalizePath(p);
+        return key;
+    }
+}
+
+template<class T, class LoadFunc, class SizeFunc>
+std::shared_ptr<const T> AssetRegistry::Acquire(Table<const T>& table,
+                                                const std::string& key,
+                                                LoadFunc&& Load, SizeFunc&& Size)
+{
+    stats.requests++;
+    std::weak_ptr<const T>& entry = table[key];
+    if(std::shared_ptr<const T> asset = entry.lock())
+    {
+        stats.dedupBytes += Size(*asset);
+        return asset;
+    }
+
+    std::shared_ptr<const T> asset = Load();
+    entry = asset;
+    stats.loads++;
+    stats.loadedBytes += Size(*asset);
+    return asset;
+}
+
+AssetRegistry::MeshHandle AssetRegistry::Mesh(const std::string& objPath,
+                                              MeshVertexLayout::Format vFormat)
+{
+    return Mesh(std::vector<std::string>{objPath}, vFormat);
+}
+
+AssetRegistry::MeshHandle AssetRegistry::Mesh(const std::vector<std::string>& lodObjPaths,
+                                              MeshVertexLayout::Format vFormat)
+{
+    std::string key = MeshKey(lodObjPaths, vFormat);
+    return Acquire(meshes, key,
+                   [&]()
+                   {
+                       auto it = pendingMeshes.find(key);
+                       if(it == pendingMeshes.end())
+                           return std::make_shared<const MeshGL>(MeshGL(lodObjPaths, vFormat));
+                       std::future<std::vector<MeshLodSource>> prefetch = std::move(it->second);
+                       pendingMeshes.erase(it);
+                       stats.prefetchedLoads++;
+                       auto mesh = std::make_shared<const MeshGL>(MeshGL(prefetch.get()));
+                       mesh->SetMemoryLabel(lodObjPaths[0]);
+                       return mesh;
+                   },
+                   [](const MeshGL& m) { return m.GPUBytes(); });
+}
+
+AssetRegistry::MeshHandle AssetRegistry::StreamMesh(const std::string& objPath,
+                                                    size_t memoryCap,
+                                                    MeshVertexLayout::Format vFormat)
+{
+    // The cap only moves the window borders, meshes of any cap draw the same
+    std::string key = (std::string("stream|") + MeshVertexLayout::FormatName(vFormat) +
+                       "|" + NormalizePath(objPath));
+
+    return Acquire(meshes, key,
+                   [&]()
+                   {
+                       return std::make_shared<const MeshGL>(MeshGL(objPath, memoryCap,
+                                                                    vFormat));
+                   },
+                   [](const MeshGL& m) { return m.GPUBytes(); });
+}
+
+AssetRegistry::MeshHandle AssetRegistry::Mesh(const std::vector<SphereShape>& lodShapes,
+                                              MeshVertexLayout::Format vFormat)
+{
+    // Procedural, keyed by its parameters
+    std::string key = MeshVertexLayout::FormatName(vFormat);
+    for(const SphereShape& s : lodShapes)
+    {
+        key += "|sphere:";
+        key += SphereShape::TypeName(s.type);
+        key += ":" + std::to_string(s.level);
+    }
+
+    return Acquire(meshes, key,
+                   [&]()
+                   {
+                       return std::make_shared<const MeshGL>(MeshGL(lodShapes, vFormat));
+                   },
+                   [](const MeshGL& m) { return m.GPUBytes(); });
+}
+
+AssetRegistry::TextureHandle AssetRegistry::Texture(const std::string& texPath,
+                                                    TextureGL::SampleMode sampleMode,
+                                                    TextureGL::EdgeResolve edgeResolveMode,
+                                                    bool compress)
+{
+    return Acquire(textures, TextureKey(texPath, sampleMode, edgeResolveMode, compress),
+                   [&]()
+                   {
+                       return std::make_shared<const TextureGL>(TextureGL(texPath, sampleMode,
+                                                                          edgeResolveMode,
+                                                                          compress));
+                   },
+                   [](const TextureGL& t) { return t.gpuBytes; });
+}
+
+AssetRegistry::TextureHandle AssetRegistry::StreamTexture(TextureStreamer& streamer,
+                                                          const std::string& texPath,
+                                                          TextureGL::SampleMode sampleMode,
+                                                          TextureGL::EdgeResolve edgeResolveMode,
+                                                          const glm::vec4& placeholder,
+                                                          bool compress)
+{
+    // Same key as the synchronous load, the resulting texture is identical
+    return Acquire(textures, TextureKey(texPath, sampleMode, edgeResolveMode, compress),
+                   [&]()
+                   {
+                       return streamer.Request(TakeTexturePrefetch(texPath, compress),
+                                               sampleMode, edgeResolveMode, placeholder);
+                   },
+                   [](const TextureGL& t) { return t.gpuBytes; });
+}
+
+AssetRegistry::TextureHandle AssetRegistry::ResidentTexture(TextureResidency& residency,
+                                                            const std::string& texPath,
+                                                            TextureGL::SampleMode sampleMode,
+                                                            TextureGL::EdgeResolve edgeResolveMode,
+                                                            const glm::vec4& placeholder,
+                                                            bool compress)
+{
+    // Sized by the residency, the GPU memory is the one at creation
+    return Acquire(textures, "resident|" + TextureKey(texPath, sampleMode, edgeResolveMode,
+                                                      compress),
+                   [&]()
+                   {
+                       return residency.Request(TakeTexturePrefetch(texPath, compress),
+                                                sampleMode, edgeResolveMode, placeholder);
+                   },
+                   [](const TextureGL& t) { return t.gpuBytes; });
+}
+
+TextureStreamer::Source AssetRegistry::TakeTexturePrefetch(const std::string& texPath,
+                                                           bool compress)
+{
+    auto it = pendingTextures.find(TexturePrefetchKey(texPath, compress));
+    if(it == pendingTextures.end()) return TextureStreamer::Prefetch(texPath, compress);
+    TextureStreamer::Source source = std::move(it->second);
+    pendingTextures.erase(it);
+    stats.prefetchedLoads++;
+    return source;
+}
+
+void AssetRegistry::SubmitShader(ShaderGL::Type t, const std::string& path,
+                                 const ShaderGL::Constants& constants)
+{
+    std::string key = ShaderKey(t, path, constants);
+    if(pendingShaders.count(key) != 0) return;
+    pendingShaders.emplace(key, ShaderGL::Submit(t, path, constants));
+}
+
+void AssetRegistry::PrefetchMesh(const std::string& objPath,
+                                 MeshVertexLayout::Format vFormat)
+{
+    PrefetchMesh(std::vector<std::string>{objPath}, vFormat);
+}
+
+void AssetRegistry::PrefetchMesh(const std::vector<std::string>& lodObjPaths,
+                                 MeshVertexLayout::Format vFormat)
+{
+    std::string key = MeshKey(lodObjPaths, vFormat);
+    if(pendingMeshes.count(key) != 0) return;
+    pendingMeshes.emplace(key, ThreadPool::Global().Submit([lodObjPaths, vFormat]()
+    {
+        return LoadMeshLodSources(lodObjPaths, vFormat);
+    }));
+}
+
+void AssetRegistry::PrefetchTexture(const std::string& texPath, bool compress)
+{
+    std::string key = TexturePrefetchKey(texPath, compress);
+    if(pendingTextures.count(key) != 0) return;
+    pendingTextures.emplace(key, TextureStreamer::Prefetch(texPath, compress));
+}
+
+AssetRegistry::ShaderHandle AssetRegistry::Shader(ShaderGL::Type t,
+                                                  const std::string& path,
+                                                  const ShaderGL::Constants& constants)
+{
+    std::string key = ShaderKey(t, path, constants);
+    // Programs are not counted towards the GPU memory
+    return Acquire(shaders, key,
+                   [&]()
+                   {
+                       auto it = pendingShaders.find(key);
+                       if(it == pendingShaders.end())
+                           return std::make_shared<const ShaderGL>(ShaderGL(t, path,
+                                                                            constants));
+                       ShaderGL::Pending pending = std::move(it->second);
+                       pendingShaders.erase(it);
+                       stats.prefetchedLoads++;
+                       return std::make_shared<const ShaderGL>(ShaderGL(std::move(pending)));
+                   },
+                   [](const ShaderGL&) { return size_t(0); });
+}
+
+AssetRegistry::CubeMapHandle AssetRegistry::CubeMap(const std::string& equirectPath,
+                                                    TextureGL::SampleMode sampleMode,
+                                                    bool compress)
+{
+    return Acquire(cubeMaps, TextureKey(equirectPath, sampleMode, TextureGL::CLAMP, compress),
+                   [&]()
+                   {
+                       return std::make_shared<const CubeMapGL>(equirectPath, sampleMode,
+                                                                compress);
+                   },
+                   [](const CubeMapGL& c) { return c.gpuBytes; });
+}
+
+void AssetRegistry::PrintStats() const
+{
+    static constexpr double MiB = 1024.0 * 1024.0;
+    std::printf("Assets: %u requests, %u loaded (%.2f MiB GPU memory, %u prefetched), "
+                "%u shared (%.2f MiB GPU memory deduplicated).\n",
+                stats.requests, stats.loads, double(stats.loadedBytes) / MiB,
+                stats.prefetchedLoads, stats.requests - stats.loads,
+                double(stats.dedupBytes) / MiB);
+}
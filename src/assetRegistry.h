@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "textureResidency.h"
+#include "textureStreamer.h"
+#include "utility.h"
+
+struct SphereShape;
+
+// Path keyed cache of the GL assets. Every request returns a shared
+// handle; an asset is loaded on the first request and reused by all
+// later requests with the same key while a handle to it is alive.
+// The registry only holds weak references, the asset is freed when
+// the last handle goes away.
+//
+// Keys are the lexically normalized source path(s) plus the parameters
+// that change the GPU object (vertex format, sampling etc.), so
+// "a/../b.obj" and "b.obj" share an asset.
+//
+// GL objects are created on the calling thread, so requests must come
+// from the thread that owns the GL context. Prefetches only start CPU
+// work on the workers (file reads, OBJ parsing, image decode) and make
+// no GL calls; they can be issued before the GL context exists, the
+// first request of the same key then only uploads.
+struct AssetRegistry {
+  using MeshHandle = std::shared_ptr<const MeshGL>;
+  using TextureHandle = std::shared_ptr<const TextureGL>;
+  using ShaderHandle = std::shared_ptr<const ShaderGL>;
+  using CubeMapHandle = std::shared_ptr<const CubeMapGL>;
+
+  struct Stats {
+    // Requests / requests that created an asset / requests that
+    // consumed a prefetch
+    uint32_t requests = 0;
+    uint32_t loads = 0;
+    uint32_t prefetchedLoads = 0;
+    // GPU memory that was allocated by the loads, and the memory that
+    // the deduplicated requests would have allocated on their own
+    size_t loadedBytes = 0;
+    size_t dedupBytes = 0;
+  };
+
+  // Constructors, Movement & Destructor
+  AssetRegistry() = default;
+  AssetRegistry(const AssetRegistry &) = delete;
+  AssetRegistry(AssetRegistry &&) = delete;
+  AssetRegistry &operator=(const AssetRegistry &) = delete;
+  AssetRegistry &operator=(AssetRegistry &&) = delete;
+  ~AssetRegistry() = default;
+
+  // See the MeshGL constructors
+  MeshHandle Mesh(const std::string &objPath,
+                  MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  MeshHandle Mesh(const std::vector<std::string> &lodObjPaths,
+                  MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  MeshHandle Mesh(const std::vector<SphereShape> &lodShapes,
+                  MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  // Bounded memory ingestion, a different asset than "Mesh" of the
+  // same path since it is not optimized
+  MeshHandle StreamMesh(const std::string &objPath, size_t memoryCap,
+                        MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  // Block compressed and uncompressed versions of an image are
+  // different assets
+  TextureHandle Texture(const std::string &texPath, TextureGL::SampleMode,
+                        TextureGL::EdgeResolve, bool compress = false);
+  // Programs specialized with different constants are different assets
+  ShaderHandle Shader(ShaderGL::Type, const std::string &path,
+                      const ShaderGL::Constants & = {});
+  // Cube map of an equirectangular image, see CubeMapGL
+  CubeMapHandle CubeMap(const std::string &equirectPath, TextureGL::SampleMode,
+                        bool compress = false);
+  // Asynchronous version of "Texture" (see TextureStreamer), shares the
+  // texture with synchronous requests of the same key
+  TextureHandle StreamTexture(TextureStreamer &, const std::string &texPath,
+                              TextureGL::SampleMode, TextureGL::EdgeResolve,
+                              const glm::vec4 &placeholder,
+                              bool compress = false);
+
+  // Levels kept resident by "residency" (see TextureResidency), a
+  // different asset than the full resolution texture of the same key
+  TextureHandle ResidentTexture(TextureResidency &, const std::string &texPath,
+                                TextureGL::SampleMode, TextureGL::EdgeResolve,
+                                const glm::vec4 &placeholder,
+                                bool compress = false);
+
+  // CPU side of a later "Mesh" (OBJ paths) / "StreamTexture" /
+  // "ResidentTexture" request
+  void PrefetchMesh(const std::string &objPath,
+                    MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  void PrefetchMesh(const std::vector<std::string> &lodObjPaths,
+                    MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  void PrefetchTexture(const std::string &texPath, bool compress = false);
+  // Compile and link of a later "Shader" request (see ShaderGL::Submit),
+  // needs the GL context unlike the prefetches
+  void SubmitShader(ShaderGL::Type, const std::string &path,
+                    const ShaderGL::Constants & = {});
+
+  const Stats &GetStats() const { return stats; }
+  void PrintStats() const;
+
+private:
+  template <class T>
+  using Table = std::unordered_map<std::string, std::weak_ptr<T>>;
+
+  Table<const MeshGL> meshes;
+  Table<const TextureGL> textures;
+  Table<const ShaderGL> shaders;
+  Table<const CubeMapGL> cubeMaps;
+  // Prefetches by the key of their request (textures by path and
+  // compression only), consumed by the request that loads the asset
+  std::unordered_map<std::string, std::future<std::vector<MeshLodSource>>>
+      pendingMeshes;
+  std::unordered_map<std::string, TextureStreamer::Source> pendingTextures;
+  std::unordered_map<std::string, ShaderGL::Pending> pendingShaders;
+  Stats stats;
+
+  // The prefetch of a texture, or a new one
+  TextureStreamer::Source TakeTexturePrefetch(const std::string &texPath,
+                                              bool compress);
+
+  template <class T, class LoadFunc, class SizeFunc>
+  std::shared_ptr<const T> Acquire(Table<const T> &, const std::string &key,
+                                   LoadFunc &&, SizeFunc &&);
+};
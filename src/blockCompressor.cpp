@@ -0,0 +1,539 @@
+#include "blockCompressor.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #define PLANET_BC_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr uint32_t TEXELS = 16;
+
+    // Texels of a block, channel major so that four texels are
+    // processed at once
+    struct Block
+    {
+        alignas(16) float c[4][TEXELS];
+    };
+
+    // Interpolated endpoint colors of a block, channel major
+    struct Palette
+    {
+        alignas(16) float c[4][16];
+        uint32_t size = 0;
+    };
+
+    void LoadBlock(Block& b, const unsigned char* pixels, uint32_t width,
+                   uint32_t height, uint32_t channelCount,
+                   uint32_t bx, uint32_t by)
+    {
+        for(uint32_t i = 0; i < TEXELS; i++)
+        {
+            uint32_t x = std::min(bx * 4 + (i % 4), width - 1);
+            uint32_t y = std::min(by * 4 + (i / 4), height - 1);
+            const unsigned char* p = pixels + (size_t(y) * width + x) * channelCount;
+            for(uint32_t c = 0; c < 4; c++)
+            {
+                float missing = (c == 3) ? 255.0f : 0.0f;
+                b.c[c][i] = (c < channelCount) ? float(p[c]) : missing;
+            }
+        }
+    }
+
+    // Closest palette entry of every texel, returns the total weighted
+    // squared error
+    float SelectIndices(const Block& b, const Palette& pal,
+                        const glm::vec4& weights, uint8_t* indices)
+    {
+        float total = 0.0f;
+#ifdef PLANET_BC_SSE2
+        for(uint32_t g = 0; g < TEXELS; g += 4)
+        {
+            __m128 px[4];
+            for(uint32_t c = 0; c < 4; c++) px[c] = _mm_load_ps(&b.c[c][g]);
+            __m128 bestErr = _mm_set1_ps(std::numeric_limits<float>::max());
+            __m128 bestIdx = _mm_setzero_ps();
+            for(uint32_t e = 0; e < pal.size; e++)
+            {
+                __m128 err = _mm_setzero_ps();
+                for(uint32_t c = 0; c < 4; c++)
+                {
+                    if(weights[int(c)] == 0.0f) continue;
+                    __m128 d = _mm_sub_ps(px[c], _mm_set1_ps(pal.c[c][e]));
+                    err = _mm_add_ps(err, _mm_mul_ps(_mm_mul_ps(d, d),
+                                                     _mm_set1_ps(weights[int(c)])));
+                }
+                __m128 less = _mm_cmplt_ps(err, bestErr);
+                bestErr = _mm_min_ps(err, bestErr);
+                bestIdx = _mm_or_ps(_mm_and_ps(less, _mm_set1_ps(float(e))),
+                                    _mm_andnot_ps(less, bestIdx));
+            }
+            alignas(16) float errs[4], idx[4];
+            _mm_store_ps(errs, bestErr);
+            _mm_store_ps(idx, bestIdx);
+            for(uint32_t k = 0; k < 4; k++)
+            {
+                indices[g + k] = uint8_t(idx[k]);
+                total += errs[k];
+            }
+        }
+#else
+        for(uint32_t i = 0; i < TEXELS; i++)
+        {
+            float bestErr = std::numeric_limits<float>::max();
+            for(uint32_t e = 0; e < pal.size; e++)
+            {
+                float err = 0.0f;
+                for(uint32_t c = 0; c < 4; c++)
+                {
+                    if(weights[int(c)] == 0.0f) continue;
+                    float d = b.c[c][i] - pal.c[c][e];
+                    err += d * d * weights[int(c)];
+                }
+                if(err < bestErr)
+                {
+                    bestErr = err;
+                    indices[i] = uint8_t(e);
+                }
+            }
+            total += bestErr;
+        }
+#endif
+        return total;
+    }
+
+    // Principal axis of the texels (power iteration on the covariance),
+    // returns the extreme projections as the endpoints
+    void FitEndpoints(const Block& b, uint32_t channelCount,
+                      glm::vec4& e0, glm::vec4& e1)
+    {
+        glm::vec4 mean(0.0f), lo(255.0f), hi(0.0f);
+        for(uint32_t i = 0; i < TEXELS; i++)
+        {
+            glm::vec4 p(b.c[0][i], b.c[1][i], b.c[2][i], b.c[3][i]);
+            mean += p;
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        mean /= float(TEXELS);
+
+        glm::mat4 cov(0.0f);
+        for(uint32_t i = 0; i < TEXELS; i++)
+        {
+            glm::vec4 d = glm::vec4(b.c[0][i], b.c[1][i], b.c[2][i], b.c[3][i]) - mean;
+            for(uint32_t c = channelCount; c < 4; c++) d[int(c)] = 0.0f;
+            cov += glm::outerProduct(d, d);
+        }
+        glm::vec4 axis = hi - lo;
+        for(uint32_t c = channelCount; c < 4; c++) axis[int(c)] = 0.0f;
+        if(glm::dot(axis, axis) == 0.0f)
+        {
+            e0 = e1 = mean;
+            return;
+        }
+        for(int k = 0; k < 8; k++)
+        {
+            glm::vec4 next = cov * axis;
+            float len = glm::length(next);
+            if(len < 1e-6f) break;
+            axis = next / len;
+        }
+        axis = glm::normalize(axis);
+
+        float tMin = std::numeric_limits<float>::max();
+        float tMax = std::numeric_limits<float>::lowest();
+        for(uint32_t i = 0; i < TEXELS; i++)
+        {
+            glm::vec4 d = glm::vec4(b.c[0][i], b.c[1][i], b.c[2][i], b.c[3][i]) - mean;
+            float t = glm::dot(d, axis);
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+        e0 = glm::clamp(mean + axis * tMax, 0.0f, 255.0f);
+        e1 = glm::clamp(mean + axis * tMin, 0.0f, 255.0f);
+    }
+
+    // Least squares endpoints for fixed indices with the
+    // interpolation weights "w" (in [0, 1], 0 selects e0)
+    bool RefitEndpoints(const Block& b, const uint8_t* indices,
+                        const float* w, glm::vec4& e0, glm::vec4& e1)
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        glm::vec4 ax(0.0f), bx(0.0f);
+        for(uint32_t i = 0; i < TEXELS; i++)
+        {
+            float t = w[indices[i]];
+            float a = 1.0f - t;
+            glm::vec4 p(b.c[0][i], b.c[1][i], b.c[2][i], b.c[3][i]);
+            aa += a * a;
+            ab += a * t;
+            bb += t * t;
+            ax += a * p;
+            bx += t * p;
+        }
+        float det = aa * bb - ab * ab;
+        if(std::abs(det) < 1e-6f) return false;
+        e0 = glm::clamp((ax * bb - bx * ab) / det, 0.0f, 255.0f);
+        e1 = glm::clamp((bx * aa - ax * ab) / det, 0.0f, 255.0f);
+        return true;
+    }
+
+    // Little endian bit writer of a 128-bit block
+    struct BitWriter
+    {
+        unsigned char* out;
+        uint32_t bit = 0;
+
+        void Write(uint32_t value, uint32_t count)
+        {
+            for(uint32_t i = 0; i < count; i++, bit++)
+            {
+                if((value >> i) & 1u)
+                    out[bit / 8] = static_cast<unsigned char>(out[bit / 8] | (1u << (bit % 8)));
+            }
+        }
+    };
+
+    // ================ //
+    //       BC1        //
+    // ================ //
+    uint32_t Expand(uint32_t v, uint32_t bits)
+    {
+        return (v << (8 - bits)) | (v >> (2 * bits - 8));
+    }
+
+    uint16_t To565(const glm::vec4& c)
+    {
+        uint32_t r = uint32_t(std::lround(c.r * 31.0f / 255.0f));
+        uint32_t g = uint32_t(std::lround(c.g * 63.0f / 255.0f));
+        uint32_t b = uint32_t(std::lround(c.b * 31.0f / 255.0f));
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    glm::vec4 From565(uint16_t v)
+    {
+        return glm::vec4(float(Expand(v >> 11, 5)),
+                         float(Expand((v >> 5) & 0x3Fu, 6)),
+                         float(Expand(v & 0x1Fu, 5)), 0.0f);
+    }
+
+    // Four color mode (c0 > c1)
+    float EncodeBC1Endpoints(const Block& b, uint16_t c0, uint16_t c1,
+                             uint8_t* indices)
+    {
+        static const glm::vec4 Weights(1.0f, 1.0f, 1.0f, 0.0f);
+        Palette pal;
+        pal.size = 4;
+        glm::vec4 p0 = From565(c0), p1 = From565(c1);
+        glm::vec4 p[4] = {p0, p1, (2.0f * p0 + p1) / 3.0f, (p0 + 2.0f * p1) / 3.0f};
+        for(uint32_t e = 0; e < 4; e++)
+        for(uint32_t c = 0; c < 4; c++)
+            pal.c[c][e] = p[e][int(c)];
+        return SelectIndices(b, pal, Weights, indices);
+    }
+
+    void EncodeBC1(const Block& b, unsigned char* out)
+    {
+        // Palette index order is e0, e1, 1/3, 2/3
+        static constexpr float W[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+        glm::vec4 e0, e1;
+        FitEndpoints(b, 3, e0, e1);
+        uint16_t bestC0 = 0, bestC1 = 0;
+        uint8_t best[TEXELS] = {};
+        float bestErr = std::numeric_limits<float>::max();
+        for(int pass = 0; pass < 3; pass++)
+        {
+            uint16_t c0 = To565(e0), c1 = To565(e1);
+            if(c0 < c1) std::swap(c0, c1);
+            uint8_t indices[TEXELS] = {};
+            // Equal endpoints select c0 everywhere
+            float err = (c0 == c1) ? EncodeBC1Endpoints(b, c0, c0, indices)
+                                   : EncodeBC1Endpoints(b, c0, c1, indices);
+            if(c0 == c1) std::fill(indices, indices + TEXELS, uint8_t(0));
+            if(err < bestErr)
+            {
+                bestErr = err;
+                bestC0 = c0;
+                bestC1 = c1;
+                std::copy(indices, indices + TEXELS, best);
+            }
+            if(c0 == c1 || !RefitEndpoints(b, indices, W, e0, e1)) break;
+        }
+
+        uint32_t bits = 0;
+        for(uint32_t i = 0; i < TEXELS; i++)
+            bits |= uint32_t(best[i]) << (2 * i);
+        std::memcpy(out + 0, &bestC0, 2);
+        std::memcpy(out + 2, &bestC1, 2);
+        std::memcpy(out + 4, &bits, 4);
+    }
+
+    // ================ //
+    //       BC4        //
+    // ================ //
+    void EncodeBC4(const Block& b, uint32_t channel, unsigned char* out)
+    {
+        // Eight value mode (r0 > r1), index order r0, r1, 6/7 r0 + 1/7 r1, ...
+        float lo = 255.0f, hi = 0.0f;
+        for(uint32_t i = 0; i < TEXELS; i++)
+        {
+            lo = std::min(lo, b.c[channel][i]);
+            hi = std::max(hi, b.c[channel][i]);
+        }
+        uint32_t r0 = uint32_t(std::lround(hi));
+        uint32_t r1 = uint32_t(std::lround(lo));
+        uint8_t indices[TEXELS] = {};
+        if(r0 != r1)
+        {
+            Block single;
+            std::memcpy(single.c[0], b.c[channel], sizeof(single.c[0]));
+            Palette pal;
+            pal.size = 8;
+            pal.c[0][0] = float(r0);
+            pal.c[0][1] = float(r1);
+            for(uint32_t k = 1; k < 7; k++)
+                pal.c[0][k + 1] = float(((7 - k) * r0 + k * r1) / 7);
+            SelectIndices(single, pal, glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), indices);
+        }
+
+        out[0] = static_cast<unsigned char>(r0);
+        out[1] = static_cast<unsigned char>(r1);
+        uint64_t bits = 0;
+        for(uint32_t i = 0; i < TEXELS; i++)
+            bits |= uint64_t(indices[i]) << (3 * i);
+        for(uint32_t i = 0; i < 6; i++)
+            out[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+
+    // ================ //
+    //   BC7 (mode 6)   //
+    // ================ //
+    constexpr uint32_t BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30,
+                                          34, 38, 43, 47, 51, 55, 60, 64};
+
+    // 7-bit endpoint with its p-bit, the one closer to "e"
+    glm::uvec4 QuantizeBC7(const glm::vec4& e, uint32_t& pBit)
+    {
+        glm::uvec4 best(0u);
+        float bestErr = std::numeric_limits<float>::max();
+        for(uint32_t p = 0; p < 2; p++)
+        {
+            glm::uvec4 q;
+            float err = 0.0f;
+            for(int c = 0; c < 4; c++)
+            {
+                float v = std::round((e[c] - float(p)) * 0.5f);
+                q[c] = uint32_t(std::clamp(v, 0.0f, 127.0f));
+                float d = float((q[c] << 1) | p) - e[c];
+                err += d * d;
+            }
+            if(err < bestErr)
+            {
+                bestErr = err;
+                best = q;
+                pBit = p;
+            }
+        }
+        return best;
+    }
+
+    float EncodeBC7Endpoints(const Block& b, const glm::uvec4& q0, uint32_t p0,
+                             const glm::uvec4& q1, uint32_t p1, uint8_t* indices)
+    {
+        Palette pal;
+        pal.size = 16;
+        for(int c = 0; c < 4; c++)
+        {
+            uint32_t v0 = (q0[c] << 1) | p0;
+            uint32_t v1 = (q1[c] << 1) | p1;
+            for(uint32_t e = 0; e < 16; e++)
+                pal.c[c][e] = float(((64 - BC7_WEIGHTS[e]) * v0 + BC7_WEIGHTS[e] * v1 + 32) >> 6);
+        }
+        return SelectIndices(b, pal, glm::vec4(1.0f), indices);
+    }
+
+    void EncodeBC7(const Block& b, unsigned char* out)
+    {
+        static const float W[16] =
+        {
+            0.0f / 64.0f,  4.0f / 64.0f,  9.0f / 64.0f,  13.0f / 64.0f,
+            17.0f / 64.0f, 21.0f / 64.0f, 26.0f / 64.0f, 30.0f / 64.0f,
+            34.0f / 64.0f, 38.0f / 64.0f, 43.0f / 64.0f, 47.0f / 64.0f,
+            51.0f / 64.0f, 55.0f / 64.0f, 60.0f / 64.0f, 64.0f / 64.0f
+        };
+
+        glm::vec4 e0, e1;
+        FitEndpoints(b, 4, e0, e1);
+        glm::uvec4 best0(0u), best1(0u);
+        uint32_t bestP0 = 0, bestP1 = 0;
+        uint8_t best[TEXELS] = {};
+        float bestErr = std::numeric_limits<float>::max();
+        for(int pass = 0; pass < 3; pass++)
+        {
+            uint32_t p0 = 0, p1 = 0;
+            glm::uvec4 q0 = QuantizeBC7(e0, p0);
+            glm::uvec4 q1 = QuantizeBC7(e1, p1);
+            uint8_t indices[TEXELS] = {};
+            float err = EncodeBC7Endpoints(b, q0, p0, q1, p1, indices);
+            if(err < bestErr)
+            {
+                bestErr = err;
+                best0 = q0;
+                best1 = q1;
+                bestP0 = p0;
+                bestP1 = p1;
+                std::copy(indices, indices + TEXELS, best);
+            }
+            if(err == 0.0f || !RefitEndpoints(b, indices, W, e0, e1)) break;
+        }
+
+        // The anchor (texel 0) index has an implicit zero top bit
+        if(best[0] >= 8)
+        {
+            std::swap(best0, best1);
+            std::swap(bestP0, bestP1);
+            for(uint8_t& i : best) i = uint8_t(15 - i);
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter w = {out};
+        w.Write(1u << 6, 7);
+        for(int c = 0; c < 4; c++)
+        {
+            w.Write(best0[c], 7);
+            w.Write(best1[c], 7);
+        }
+        w.Write(bestP0, 1);
+        w.Write(bestP1, 1);
+        w.Write(best[0], 3);
+        for(uint32_t i = 1; i < TEXELS; i++)
+            w.Write(best[i], 4);
+        assert(w.bit == 128);
+    }
+
+    void EncodeBlock(BlockFormat::Type format, const Block& b, unsigned char* out)
+    {
+        switch(format)
+        {
+            case BlockFormat::BC1: EncodeBC1(b, out); break;
+            case BlockFormat::BC4: EncodeBC4(b, 0, out); break;
+            case BlockFormat::BC5: EncodeBC4(b, 0, out);
+                                   EncodeBC4(b, 1, out + 8); break;
+            case BlockFormat::BC7: EncodeBC7(b, out); break;
+        }
+    }
+}
+
+size_t BlockFormat::BlockSize(Type t)
+{
+    return (t == BC1 || t == BC4) ? 8 : 16;
+}
+
+const char* BlockFormat::Name(Type t)
+{
+    switch(t)
+    {
+        case BC1: return "BC1";
+        case BC4: return "BC4";
+        case BC5: return "BC5";
+        case BC7: return "BC7";
+        default:  return "UNKNOWN";
+    }
+}
+
+BlockFormat::Type BlockFormat::ForChannelCount(int channelCount)
+{
+    switch(channelCount)
+    {
+        case 1:  return BC4;
+        case 2:  return BC5;
+        case 3:  return BC1;
+        default: return BC7;
+    }
+}
+
+std::vector<MipLevel> BlockFormat::LevelsFor(Type t, uint32_t width, uint32_t height)
+{
+    std::vector<MipLevel> levels(MipCountFor(width, height));
+    size_t offset = 0;
+    for(uint32_t i = 0; i < levels.size(); i++)
+    {
+        MipLevel& l = levels[i];
+        l.width = std::max(width >> i, 1u);
+        l.height = std::max(height >> i, 1u);
+        l.offset = offset;
+        l.size = (size_t((l.width + BLOCK_DIM - 1) / BLOCK_DIM) *
+                  size_t((l.height + BLOCK_DIM - 1) / BLOCK_DIM) * BlockSize(t));
+        offset += l.size;
+    }
+    return levels;
+}
+
+void CompressLevel(BlockFormat::Type format, const unsigned char* pixels,
+                   uint32_t width, uint32_t height, uint32_t channelCount,
+                   unsigned char* out)
+{
+    assert(channelCount >= 1 && channelCount <= 4);
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    size_t blockSize = BlockFormat::BlockSize(format);
+    ThreadPool::Global().ParallelFor(blocksY, [&](uint32_t by)
+    {
+        Block b;
+        unsigned char* row = out + size_t(by) * blocksX * blockSize;
+        for(uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            LoadBlock(b, pixels, width, height, channelCount, bx, by);
+            EncodeBlock(format, b, row + bx * blockSize);
+        }
+    });
+}
+
+CompressedImage CompressImage(const unsigned char* pixels, uint32_t width,
+                              uint32_t height, uint32_t channelCount,
+                              BlockFormat::Type format, const MipFilter& filter)
+{
+    CompressedImage image;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    image.levels = BlockFormat::LevelsFor(format, width, height);
+    image.data.resize(image.levels.back().offset + image.levels.back().size);
+
+    MipChain mips = GenerateMips(pixels, width, height, channelCount, 1, filter);
+    for(size_t i = 0; i < image.levels.size(); i++)
+    {
+        const MipLevel& l = image.levels[i];
+        const unsigned char* src = (i == 0) ? pixels : mips.Pixels(i - 1);
+        CompressLevel(format, src, l.width, l.height, channelCount,
+                      image.data.data() + l.offset);
+    }
+    return image;
+}
+
+CompressedImage CompressImage(const unsigned char* pixels, uint32_t width,
+                              uint32_t height, uint32_t channelCount,
+                              BlockFormat::Type format)
+{
+    return CompressImage(pixels, width, height, channelCount, format,
+                         MipFilter::For(channelCount));
+}
+
+void CompressSolidBlock(BlockFormat::Type format, const glm::vec4& color,
+                        unsigned char* out)
+{
+    unsigned char texel[4];
+    for(int c = 0; c < 4; c++)
+        texel[c] = static_cast<unsigned char>(std::lround(std::clamp(color[c], 0.0f, 1.0f) * 255.0f));
+    Block b;
+    LoadBlock(b, texel, 1, 1, 4, 0, 0);
+    EncodeBlock(format, b, out);
+}
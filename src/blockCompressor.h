@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mipGenerator.h"
+
+// GPU block compression formats, each block holds 4x4 texels
+// BC1 : RGB, 8 bytes per block (4 bits per texel)
+// BC4 : single channel, 8 bytes per block
+// BC5 : two channels (two BC4 blocks), 16 bytes per block
+// BC7 : RGBA, 16 bytes per block (mode 6 only)
+struct BlockFormat {
+  enum Type : uint32_t { BC1 = 0, BC4 = 1, BC5 = 2, BC7 = 3 };
+
+  static constexpr uint32_t BLOCK_DIM = 4;
+
+  static size_t BlockSize(Type);
+  static const char *Name(Type);
+  // 1: BC4, 2: BC5, 3: BC1, 4: BC7
+  static Type ForChannelCount(int channelCount);
+  // Levels of a full mip chain, packed back to back
+  static std::vector<MipLevel> LevelsFor(Type, uint32_t width,
+                                         uint32_t height);
+};
+
+// Block compressed image with its full mip chain
+struct CompressedImage {
+  BlockFormat::Type format = BlockFormat::BC1;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<MipLevel> levels;
+  std::vector<unsigned char> data;
+};
+
+// Encodes a tightly packed 8-bit image into "format" blocks (row
+// major), blocks on the right / bottom edge repeat the last column /
+// row. Channels the format has but the image does not are zero
+// (alpha is opaque). Block rows are encoded on the global thread pool.
+void CompressLevel(BlockFormat::Type format, const unsigned char *pixels,
+                   uint32_t width, uint32_t height, uint32_t channelCount,
+                   unsigned char *out);
+
+// Mips (see GenerateMips) and the compression of every level
+CompressedImage CompressImage(const unsigned char *pixels, uint32_t width,
+                              uint32_t height, uint32_t channelCount,
+                              BlockFormat::Type format, const MipFilter &);
+// With the filter of the renderer (see MipFilter::For)
+CompressedImage CompressImage(const unsigned char *pixels, uint32_t width,
+                              uint32_t height, uint32_t channelCount,
+                              BlockFormat::Type format);
+
+// Single block of a solid color (components in [0, 1])
+void CompressSolidBlock(BlockFormat::Type format, const glm::vec4 &color,
+                        unsigned char *out);
@@ -0,0 +1,142 @@
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+void AABB::Extend(const glm::vec3& p)
+{
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+}
+
+void AABB::Extend(const AABB& other)
+{
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+AABB AABB::FromPoints(const glm::vec3* points, size_t count)
+{
+    AABB box;
+    for(size_t i = 0; i < count; i++)
+        box.Extend(points[i]);
+    return box;
+}
+
+void BoundingSphere::Extend(const BoundingSphere& other)
+{
+    if(other.IsEmpty()) return;
+    if(IsEmpty())
+    {
+        *this = other;
+        return;
+    }
+    glm::vec3 d = other.center - center;
+    float dist = glm::length(d);
+    // One contains the other
+    if(dist + other.radius <= radius) return;
+    if(dist + radius <= other.radius)
+    {
+        *this = other;
+        return;
+    }
+    float newRadius = (dist + radius + other.radius) * 0.5f;
+    center += d * ((newRadius - radius) / dist);
+    radius = newRadius;
+}
+
+BoundingSphere BoundingSphere::FromPoints(const glm::vec3* points, size_t count)
+{
+    BoundingSphere s;
+    if(count == 0) return s;
+
+    // Around the box center
+    glm::vec3 boxCenter = AABB::FromPoints(points, count).Center();
+    float boxRadiusSqr = 0.0f;
+    for(size_t i = 0; i < count; i++)
+    {
+        glm::vec3 d = points[i] - boxCenter;
+        boxRadiusSqr = std::max(boxRadiusSqr, glm::dot(d, d));
+    }
+
+    // Ritter: the diameter from the point farthest from an arbitrary
+    // point and the point farthest from that, then grown to fit
+    auto Farthest = [&](const glm::vec3& from)
+    {
+        size_t best = 0;
+        float bestSqr = -1.0f;
+        for(size_t i = 0; i < count; i++)
+        {
+            glm::vec3 d = points[i] - from;
+            float distSqr = glm::dot(d, d);
+            if(distSqr > bestSqr) { best = i; bestSqr = distSqr; }
+        }
+        return points[best];
+    };
+    glm::vec3 a = Farthest(points[0]);
+    glm::vec3 b = Farthest(a);
+    s.center = (a + b) * 0.5f;
+    s.radius = glm::length(b - a) * 0.5f;
+    for(size_t i = 0; i < count; i++)
+    {
+        glm::vec3 d = points[i] - s.center;
+        float distSqr = glm::dot(d, d);
+        if(distSqr <= s.radius * s.radius) continue;
+        float dist = std::sqrt(distSqr);
+        float newRadius = (s.radius + dist) * 0.5f;
+        s.center += d * ((newRadius - s.radius) / dist);
+        s.radius = newRadius;
+    }
+
+    float boxRadius = std::sqrt(boxRadiusSqr);
+    if(boxRadius < s.radius)
+    {
+        s.center = boxCenter;
+        s.radius = boxRadius;
+    }
+    return s;
+}
+
+Frustum Frustum::FromMatrix(const glm::mat4& clip)
+{
+    // Rows of the (column major) matrix
+    glm::vec4 x(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+    glm::vec4 y(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+    glm::vec4 z(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+    glm::vec4 w(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+
+    Frustum f;
+    f.planes = {w + x, w - x, w + y, w - y, w + z, w - z};
+    // Normalized so that plane distances are in the units of the space
+    // (the far plane of an infinite projection has no normal)
+    for(glm::vec4& p : f.planes)
+    {
+        float length = glm::length(glm::vec3(p));
+        if(length > 0.0f) p /= length;
+    }
+    return f;
+}
+
+bool Frustum::Intersects(const glm::vec3& center, float radius) const
+{
+    for(const glm::vec4& p : planes)
+    {
+        if(glm::dot(glm::vec3(p), center) + p.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::Intersects(const AABB& box) const
+{
+    glm::vec3 c = box.Center();
+    glm::vec3 e = box.Extent();
+    for(const glm::vec4& p : planes)
+    {
+        // Distance of the corner that is farthest along the normal
+        float reach = glm::dot(glm::abs(glm::vec3(p)), e);
+        if(glm::dot(glm::vec3(p), c) + p.w < -reach)
+            return false;
+    }
+    return true;
+}
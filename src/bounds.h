@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+// Axis aligned box, empty until a point is added
+struct AABB {
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+  bool IsEmpty() const { return min.x > max.x; }
+  glm::vec3 Center() const { return (min + max) * 0.5f; }
+  glm::vec3 Extent() const { return (max - min) * 0.5f; }
+
+  void Extend(const glm::vec3 &p);
+  void Extend(const AABB &);
+  static AABB FromPoints(const glm::vec3 *points, size_t count);
+};
+
+struct BoundingSphere {
+  glm::vec3 center = glm::vec3(0.0f);
+  // Negative when empty
+  float radius = -1.0f;
+
+  bool IsEmpty() const { return radius < 0.0f; }
+  // Smallest sphere that contains both
+  void Extend(const BoundingSphere &);
+  // Ritter's sphere or the sphere around the box center, whichever is
+  // smaller (within a few percent of the minimal sphere in practice)
+  static BoundingSphere FromPoints(const glm::vec3 *points, size_t count);
+};
+
+// View frustum as six inward facing planes (xyz: normal, w: offset),
+// extracted from a clip matrix (Gribb & Hartmann). With a
+// "proj * view * model" matrix the planes are in object space, so
+// object space bounds can be tested without transforming them.
+struct Frustum {
+  std::array<glm::vec4, 6> planes;
+
+  static Frustum FromMatrix(const glm::mat4 &clip);
+
+  // False only if the sphere / box is entirely outside of a plane
+  bool Intersects(const glm::vec3 &center, float radius) const;
+  bool Intersects(const AABB &) const;
+};
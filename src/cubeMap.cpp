@@ -0,0 +1,185 @@
+#include "cubeMap.h"
+#include "threadPool.h"
+
+#include <stb_image.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+
+namespace
+{
+    // Taps per axis of a face texel at most
+    constexpr uint32_t MAX_TAPS = 8;
+
+    // Direction of the face coordinates "sc", "tc" in [-1, 1] (the face
+    // selection table of the GL specification, inverted)
+    glm::vec3 FaceDirection(uint32_t face, float sc, float tc)
+    {
+        switch(face)
+        {
+            case 0:  return glm::vec3(1.0f, -tc, -sc);
+            case 1:  return glm::vec3(-1.0f, -tc, sc);
+            case 2:  return glm::vec3(sc, 1.0f, tc);
+            case 3:  return glm::vec3(sc, -1.0f, -tc);
+            case 4:  return glm::vec3(sc, -tc, 1.0f);
+            default: return glm::vec3(-sc, -tc, -1.0f);
+        }
+    }
+
+    // Adds the bilinear sample of the image in direction "dir" (mapped
+    // as background.frag does) to "sum", columns wrap and rows clamp
+    void AddTap(const unsigned char* pixels, uint32_t width, uint32_t height,
+                uint32_t channelCount, const glm::vec3& dir, float* sum)
+    {
+        glm::vec3 d = glm::normalize(dir);
+        float u = 0.5f + std::atan2(d.z, d.x) / glm::two_pi<float>();
+        float v = 0.5f - std::asin(std::clamp(d.y, -1.0f, 1.0f)) / glm::pi<float>();
+        float x = u * float(width) - 0.5f;
+        float y = v * float(height) - 0.5f;
+        float fx = std::floor(x);
+        float fy = std::floor(y);
+        int w = int(width);
+        int h = int(height);
+        int x0 = ((int(fx) % w) + w) % w;
+        int y0 = int(fy);
+        uint32_t xs[2] = {uint32_t(x0), uint32_t((x0 + 1) % w)};
+        uint32_t ys[2] = {uint32_t(std::clamp(y0, 0, h - 1)),
+                          uint32_t(std::clamp(y0 + 1, 0, h - 1))};
+        float wx[2] = {1.0f - (x - fx), x - fx};
+        float wy[2] = {1.0f - (y - fy), y - fy};
+        for(uint32_t j = 0; j < 2; j++)
+        for(uint32_t i = 0; i < 2; i++)
+        {
+            const unsigned char* p = pixels + (size_t(ys[j]) * width + xs[i]) * channelCount;
+            float weight = wx[i] * wy[j];
+            for(uint32_t c = 0; c < channelCount; c++)
+                sum[c] += weight * float(p[c]);
+        }
+    }
+}
+
+uint32_t CubeFaceSizeFor(uint32_t equirectWidth)
+{
+    // A quarter turn per face
+    return std::bit_floor(std::max(equirectWidth / 4, 1u));
+}
+
+std::vector<unsigned char> EquirectToCube(const unsigned char* pixels,
+                                          uint32_t width, uint32_t height,
+                                          uint32_t channelCount,
+                                          uint32_t faceSize)
+{
+    std::vector<unsigned char> faces(size_t(faceSize) * faceSize * 6 * channelCount);
+    float texelSize = 2.0f / float(faceSize);
+    // Angle between two texels of the image, along a row at the equator
+    // and along a column
+    float rowAngle = glm::two_pi<float>() / float(width);
+    float columnAngle = glm::pi<float>() / float(height);
+    ThreadPool::Global().ParallelFor(6 * faceSize, [&](uint32_t row)
+    {
+        uint32_t face = row / faceSize;
+        float tc = (float(row % faceSize) + 0.5f) * texelSize - 1.0f;
+        unsigned char* out = faces.data() + size_t(row) * faceSize * channelCount;
+        for(uint32_t i = 0; i < faceSize; i++)
+        {
+            float sc = (float(i) + 0.5f) * texelSize - 1.0f;
+            glm::vec3 d = FaceDirection(face, sc, tc);
+            float length = glm::length(d);
+            // Angular size of the texel against the spacing of the image
+            // texels at its latitude (rows shrink by its cosine)
+            float cosLatitude = std::sqrt(d.x * d.x + d.z * d.z) / length;
+            float texelAngle = texelSize / length;
+            float sourceAngle = std::min(rowAngle * std::max(cosLatitude, 1.0f / float(MAX_TAPS)),
+                                         columnAngle);
+            uint32_t taps = std::clamp(uint32_t(std::ceil(texelAngle / sourceAngle)),
+                                       1u, MAX_TAPS);
+
+            float sum[4] = {};
+            float step = texelSize / float(taps);
+            for(uint32_t b = 0; b < taps; b++)
+            for(uint32_t a = 0; a < taps; a++)
+            {
+                float s = sc + (float(a) + 0.5f) * step - 0.5f * texelSize;
+                float t = tc + (float(b) + 0.5f) * step - 0.5f * texelSize;
+                AddTap(pixels, width, height, channelCount, FaceDirection(face, s, t), sum);
+            }
+            float scale = 1.0f / float(taps * taps);
+            for(uint32_t c = 0; c < channelCount; c++)
+                out[i * channelCount + c] = static_cast<unsigned char>(
+                    std::min(sum[c] * scale + 0.5f, 255.0f));
+        }
+    });
+    return faces;
+}
+
+std::string CubeMapCachePathFor(const std::string& imagePath,
+                                const TexelEncoding& encoding)
+{
+    std::string name = encoding.Name();
+    for(char& c : name)
+        c = char(std::tolower(c));
+    return imagePath + ".cube." + name + ".texcache";
+}
+
+bool LoadCubeMap(const std::string& imagePath, const TexelEncoding& encoding,
+                 TextureSource& out)
+{
+    // Try the cache first, it is mapped and uploaded as is
+    std::string cachePath = CubeMapCachePathFor(imagePath, encoding);
+    SourceKey key;
+    bool hasKey = ComputeSourceKey(imagePath, key);
+    if(hasKey && out.container.Open(cachePath))
+    {
+        if(out.container.source == key && out.container.encoding == encoding)
+        {
+            out.encoding = out.container.encoding;
+            out.width = out.container.width;
+            out.height = out.container.height;
+            out.levels = out.container.levels;
+            out.data = out.container.data;
+            std::printf("Cube map of \"%s\" is loaded succesfully from its %s cache.\n",
+                        imagePath.c_str(), encoding.Name().c_str());
+            return true;
+        }
+        std::printf("[WARNING]: Cube map cache \"%s\" is out of date, "
+                    "falling back to the image.\n", cachePath.c_str());
+        out.container = TextureContainer();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    stbi_set_flip_vertically_on_load_thread(1);
+    int w, h, channelCount;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels(stbi_load(imagePath.c_str(), &w, &h,
+                                                                    &channelCount, 0),
+                                                          stbi_image_free);
+    if(!pixels) return false;
+
+    uint32_t faceSize = CubeFaceSizeFor(uint32_t(w));
+    std::vector<unsigned char> faces = EquirectToCube(pixels.get(), uint32_t(w), uint32_t(h),
+                                                      uint32_t(channelCount), faceSize);
+    pixels.reset();
+    out.image = EncodeTexture(faces.data(), faceSize, 6 * faceSize,
+                              uint32_t(channelCount), encoding);
+    out.encoding = out.image.encoding;
+    out.width = out.image.width;
+    out.height = out.image.height;
+    out.levels = out.image.levels;
+    out.data = out.image.data.data();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                          start).count();
+    std::printf("Cube map of \"%s\" is resampled to 6 %ux%u %s faces in %.0f ms.\n",
+                imagePath.c_str(), faceSize, faceSize, encoding.Name().c_str(), ms);
+
+    if(hasKey && !TextureContainer::Write(cachePath, out.image, key))
+        std::printf("[WARNING]: Unable to write cube map cache \"%s\"\n",
+                    cachePath.c_str());
+    return true;
+}
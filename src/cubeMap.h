@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "textureContainer.h"
+
+// Cube maps resampled from equirectangular images (longitude along the
+// rows, rows bottom first as loaded), with the direction mapping of the
+// sky shader, so a cube map lookup samples what the image lookup did.
+//
+// Faces are in the GL order (+X, -X, +Y, -Y, +Z, -Z), with rows in the
+// GL face orientation, stacked into a single "faceSize" x 6 * "faceSize"
+// image. While faces are at least 2 texels wide, its box filtered mips
+// are the mips of every face (and block rows never straddle two faces
+// while they are at least a block wide), so it is encoded and cached as
+// a regular texture.
+
+// Face size with the texel density of an equirectangular image of
+// "width" at its equator, a power of two
+uint32_t CubeFaceSizeFor(uint32_t equirectWidth);
+
+// Resamples a tightly packed 8-bit image with 1 to 4 channels. Each
+// face texel averages bilinear taps on a grid sized to its footprint on
+// the image (denser toward the poles, where the image is stretched).
+// Face rows are resampled on the global thread pool.
+std::vector<unsigned char> EquirectToCube(const unsigned char *pixels,
+                                          uint32_t width, uint32_t height,
+                                          uint32_t channelCount,
+                                          uint32_t faceSize);
+
+// "textures/stars.jpg", BC1 -> "textures/stars.jpg.cube.bc1.texcache"
+std::string CubeMapCachePathFor(const std::string &imagePath,
+                                const TexelEncoding &);
+
+// Stacked faces of the cube map of an image in "encoding" (a block
+// format, or raw with the 8-bit channels of the image), through a source
+// keyed cache next to the image that is (re)written whenever it is
+// missing or stale. Thread safe, returns false if the image can not be
+// read.
+bool LoadCubeMap(const std::string &imagePath, const TexelEncoding &,
+                 TextureSource &out);
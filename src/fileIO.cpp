@@ -0,0 +1,320 @@
+#include "fileIO.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Zero sized files can not be mapped, but they are still valid files.
+// Point to this so that parsers can safely iterate [data, data + 0).
+static constexpr char EmptyFileData[1] = {'\0'};
+
+MappedFile::MappedFile(const std::string& path)
+{
+    #ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+    if(file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return;
+    }
+    size = size_t(fileSize.QuadPart);
+    if(size == 0)
+    {
+        CloseHandle(file);
+        data = EmptyFileData;
+        isOpen = true;
+        return;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                        0, 0, nullptr);
+    // Mapping holds its own reference to the file
+    CloseHandle(file);
+    if(!mapping) { size = 0; return; }
+
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!ptr)
+    {
+        CloseHandle(mapping);
+        size = 0;
+        return;
+    }
+    mapHandle = mapping;
+    data = static_cast<const char*>(ptr);
+    isOpen = true;
+    #else
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return;
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+    {
+        close(fd);
+        return;
+    }
+    size = size_t(fileStat.st_size);
+    if(size == 0)
+    {
+        close(fd);
+        data = EmptyFileData;
+        isOpen = true;
+        return;
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // Mapping holds its own reference to the file
+    close(fd);
+    if(ptr == MAP_FAILED) { size = 0; return; }
+
+    // We read front to back, let the kernel read-ahead aggressively
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(ptr);
+    isOpen = true;
+    #endif
+}
+
+void MappedFile::Close()
+{
+    if(data && data != EmptyFileData)
+    {
+        #ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(static_cast<HANDLE>(mapHandle));
+        #else
+        munmap(const_cast<char*>(data), size);
+        #endif
+    }
+    data = nullptr;
+    size = 0;
+    isOpen = false;
+    mapHandle = nullptr;
+}
+
+void MappedFile::DropPages(size_t offset, size_t length) const
+{
+    if(!data || data == EmptyFileData) return;
+    #ifdef _WIN32
+    // Views can not drop clean pages on demand, the working set
+    // manager trims them instead
+    (void)offset;
+    (void)length;
+    #else
+    // Page align inwards
+    static const size_t PageSize = size_t(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + PageSize - 1) / PageSize * PageSize;
+    size_t end = std::min(offset + length, size) / PageSize * PageSize;
+    if(begin >= end) return;
+    madvise(const_cast<char*>(data) + begin, end - begin, MADV_DONTNEED);
+    #endif
+}
+
+ScratchFile::ScratchFile(size_t sizeIn)
+{
+    if(sizeIn == 0) return;
+    #ifdef _WIN32
+    char dir[MAX_PATH + 1], path[MAX_PATH + 1];
+    if(!GetTempPathA(MAX_PATH + 1, dir) ||
+       !GetTempFileNameA(dir, "scr", 0, path))
+        return;
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                              CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                              nullptr);
+    if(file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = LONGLONG(sizeIn);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                        DWORD(fileSize.HighPart),
+                                        fileSize.LowPart, nullptr);
+    // Mapping holds its own reference to the file
+    CloseHandle(file);
+    if(!mapping) return;
+
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    if(!ptr)
+    {
+        CloseHandle(mapping);
+        return;
+    }
+    mapHandle = mapping;
+    #else
+    std::error_code err;
+    std::string dir = std::filesystem::temp_directory_path(err).string();
+    if(err) dir = "/tmp";
+    std::string path = dir + "/scratchXXXXXX";
+    int fd = mkstemp(path.data());
+    if(fd < 0) return;
+    // Unnamed from now on, freed once the mapping is gone
+    unlink(path.c_str());
+    if(ftruncate(fd, off_t(sizeIn)) != 0)
+    {
+        close(fd);
+        return;
+    }
+    void* ptr = mmap(nullptr, sizeIn, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED) return;
+    #endif
+    data = ptr;
+    size = sizeIn;
+}
+
+ScratchFile::~ScratchFile()
+{
+    if(!data) return;
+    #ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(static_cast<HANDLE>(mapHandle));
+    #else
+    munmap(data, size);
+    #endif
+}
+
+bool GetFileStamp(const std::string& path, FileStamp& out)
+{
+    std::error_code err;
+    std::filesystem::path p(path);
+    uint64_t size = std::filesystem::file_size(p, err);
+    if(err) return false;
+    auto time = std::filesystem::last_write_time(p, err);
+    if(err) return false;
+
+    out.size = size;
+    out.modifiedTime = int64_t(time.time_since_epoch().count());
+    return true;
+}
+
+bool ComputeSourceKey(const std::string& path, SourceKey& out)
+{
+    if(!GetFileStamp(path, out.stamp)) return false;
+    MappedFile source(path);
+    if(!source.IsOpen()) return false;
+    out.hash = HashBytes(source.data, source.size);
+    return true;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+    // XXH64, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+    auto Read64 = [](const unsigned char* p)
+    {
+        uint64_t v; std::memcpy(&v, p, sizeof(uint64_t)); return v;
+    };
+    auto Read32 = [](const unsigned char* p)
+    {
+        uint32_t v; std::memcpy(&v, p, sizeof(uint32_t)); return v;
+    };
+    auto Round = [](uint64_t acc, uint64_t input)
+    {
+        acc += input * P2;
+        acc = std::rotl(acc, 31);
+        return acc * P1;
+    };
+    auto Merge = [&](uint64_t acc, uint64_t val)
+    {
+        acc ^= Round(0, val);
+        return acc * P1 + P4;
+    };
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t h;
+    if(size >= 32)
+    {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+        const unsigned char* limit = end - 32;
+        do
+        {
+            v1 = Round(v1, Read64(p));      p += 8;
+            v2 = Round(v2, Read64(p));      p += 8;
+            v3 = Round(v3, Read64(p));      p += 8;
+            v4 = Round(v4, Read64(p));      p += 8;
+        }
+        while(p <= limit);
+
+        h = std::rotl(v1, 1) + std::rotl(v2, 7) +
+            std::rotl(v3, 12) + std::rotl(v4, 18);
+        h = Merge(h, v1);
+        h = Merge(h, v2);
+        h = Merge(h, v3);
+        h = Merge(h, v4);
+    }
+    else h = seed + P5;
+
+    h += uint64_t(size);
+    for(; p + 8 <= end; p += 8)
+    {
+        h ^= Round(0, Read64(p));
+        h = std::rotl(h, 27) * P1 + P4;
+    }
+    if(p + 4 <= end)
+    {
+        h ^= uint64_t(Read32(p)) * P1;
+        h = std::rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for(; p != end; p++)
+    {
+        h ^= uint64_t(*p) * P5;
+        h = std::rotl(h, 11) * P1;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool WriteFileAtomic(const std::string& path,
+                     const std::vector<FileChunk>& chunks)
+{
+    std::string tmpPath = path + ".tmp";
+    std::FILE* f = std::fopen(tmpPath.c_str(), "wb");
+    if(!f) return false;
+
+    bool ok = true;
+    for(const FileChunk& c : chunks)
+    {
+        if(c.size == 0) continue;
+        ok &= (std::fwrite(c.data, 1, c.size, f) == c.size);
+    }
+    ok &= (std::fclose(f) == 0);
+
+    std::error_code err;
+    if(ok) std::filesystem::rename(tmpPath, path, err);
+    if(!ok || err)
+    {
+        std::filesystem::remove(tmpPath, err);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only memory mapping of an entire file.
+// Parsers can tokenize directly over "data" without copying
+// the file into std::string / iostream buffers.
+struct MappedFile {
+  const char *data = nullptr;
+  size_t size = 0;
+
+  // Constructors, Movement & Destructor
+  // Check "IsOpen()" after construction, a missing or unreadable file
+  // is not fatal here since callers may have a fallback.
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile(MappedFile &&);
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile &operator=(MappedFile &&);
+  ~MappedFile();
+
+  bool IsOpen() const { return isOpen; }
+  // Hint that [offset, offset + size) will not be read again soon, its
+  // pages are released and read back from the file if they are touched.
+  // Keeps the resident size of a front to back scan bounded.
+  void DropPages(size_t offset, size_t size) const;
+
+private:
+  bool isOpen = false;
+  // Only used on Windows (file mapping handle)
+  void *mapHandle = nullptr;
+  void Close();
+};
+
+// Read-write mapping of an unnamed temporary file, for intermediate
+// arrays that are too large to keep on the heap. The OS writes its
+// pages back to the disk and evicts them under memory pressure.
+// The file is deleted when the mapping is closed.
+struct ScratchFile {
+  void *data = nullptr;
+  size_t size = 0;
+
+  // Constructors, Movement & Destructor
+  // Check "IsOpen()" after construction
+  ScratchFile() = default;
+  explicit ScratchFile(size_t size);
+  ScratchFile(const ScratchFile &) = delete;
+  ScratchFile(ScratchFile &&) = delete;
+  ScratchFile &operator=(const ScratchFile &) = delete;
+  ScratchFile &operator=(ScratchFile &&) = delete;
+  ~ScratchFile();
+
+  bool IsOpen() const { return data != nullptr; }
+
+private:
+  // Only used on Windows (file mapping handle)
+  void *mapHandle = nullptr;
+};
+
+// Size and modification time of a file, used to key the on-disk
+// caches on their source files.
+struct FileStamp {
+  uint64_t size = 0;
+  int64_t modifiedTime = 0;
+
+  bool operator==(const FileStamp &) const = default;
+};
+
+// Returns false if the file does not exist
+bool GetFileStamp(const std::string &path, FileStamp &out);
+
+// Identity of a cache source file, a cache is valid only for the exact
+// same key.
+struct SourceKey {
+  FileStamp stamp;
+  uint64_t hash = 0;
+
+  bool operator==(const SourceKey &) const = default;
+};
+
+// Stamp and content hash of a file. Returns false if it does not exist
+bool ComputeSourceKey(const std::string &path, SourceKey &out);
+
+// 64-bit non-cryptographic hash (XXH64) of a byte range
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+// Part of a file to be written (see WriteFileAtomic)
+struct FileChunk {
+  const void *data;
+  size_t size;
+};
+
+// Writes the chunks back to back into a temporary file and renames it
+// over "path", so readers never observe a partially written file.
+// Returns false (and leaves "path" untouched) on failure.
+bool WriteFileAtomic(const std::string &path,
+                     const std::vector<FileChunk> &chunks);
+
+// Inline Definitions
+inline MappedFile::MappedFile(MappedFile &&other)
+    : data(other.data), size(other.size), isOpen(other.isOpen),
+      mapHandle(other.mapHandle) {
+  other.data = nullptr;
+  other.size = 0;
+  other.isOpen = false;
+  other.mapHandle = nullptr;
+}
+
+inline MappedFile &MappedFile::operator=(MappedFile &&other) {
+  assert(this != &other);
+  Close();
+  data = other.data;
+  size = other.size;
+  isOpen = other.isOpen;
+  mapHandle = other.mapHandle;
+  other.data = nullptr;
+  other.size = 0;
+  other.isOpen = false;
+  other.mapHandle = nullptr;
+  return *this;
+}
+
+inline MappedFile::~MappedFile() { Close(); }
@@ -0,0 +1,162 @@
+#include "gpuMemory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+namespace
+{
+    constexpr double MiB = 1024.0 * 1024.0;
+}
+
+GPUMemory& GPUMemory::Global()
+{
+    static GPUMemory memory;
+    return memory;
+}
+
+const char* GPUMemory::Name(Category c)
+{
+    switch(c)
+    {
+        case MESH:            return "Meshes";
+        case TEXTURE_2D:      return "Textures";
+        case CUBE_MAP:        return "Cube maps";
+        case RENDER_TARGET:   return "Render targets";
+        case STAGING:         return "Staging";
+        case VIRTUAL_TEXTURE: return "Virtual textures";
+        default:              return "Unknown";
+    }
+}
+
+void GPUMemory::Add(const Record& r, int sign)
+{
+    Usage& u = categories[r.category];
+    if(sign > 0)
+    {
+        u.bytes += r.bytes;
+        u.padding += r.padding;
+        u.objectCount++;
+        peak = std::max(peak, Total().Total());
+    }
+    else
+    {
+        u.bytes -= r.bytes;
+        u.padding -= r.padding;
+        u.objectCount--;
+    }
+}
+
+void GPUMemory::Track(Kind kind, uint32_t id, Category category, size_t bytes,
+                      size_t padding, const std::string& label)
+{
+    if(id == 0) return;
+    auto [it, inserted] = records.try_emplace(Key(kind, id));
+    Record& r = it->second;
+    if(!inserted) Add(r, -1);
+    size_t aligned = (bytes + padding + ALLOCATION_ALIGNMENT - 1) /
+                     ALLOCATION_ALIGNMENT * ALLOCATION_ALIGNMENT;
+    r.category = category;
+    r.bytes = bytes;
+    r.padding = aligned - bytes;
+    if(!label.empty()) r.label = label;
+    Add(r, 1);
+}
+
+void GPUMemory::SetLabel(Kind kind, uint32_t id, const std::string& label)
+{
+    auto it = records.find(Key(kind, id));
+    if(it != records.end()) it->second.label = label;
+}
+
+void GPUMemory::Move(Kind kind, uint32_t from, uint32_t to)
+{
+    auto it = records.find(Key(kind, from));
+    if(it == records.end()) return;
+    Record r = std::move(it->second);
+    records.erase(it);
+    Release(kind, to);
+    records.emplace(Key(kind, to), std::move(r));
+}
+
+void GPUMemory::Release(Kind kind, uint32_t id)
+{
+    auto it = records.find(Key(kind, id));
+    if(it == records.end()) return;
+    Add(it->second, -1);
+    records.erase(it);
+}
+
+GPUMemory::Usage GPUMemory::Total() const
+{
+    Usage total;
+    for(const Usage& u : categories)
+    {
+        total.bytes += u.bytes;
+        total.padding += u.padding;
+        total.objectCount += u.objectCount;
+    }
+    return total;
+}
+
+void GPUMemory::SetBudget(size_t bytes, OverBudget handler)
+{
+    budget = bytes;
+    overBudget = std::move(handler);
+}
+
+void GPUMemory::Enforce()
+{
+    if(budget == 0) return;
+    size_t total = Total().Total();
+    if(total <= budget) return;
+
+    if(overBudget) overBudget(total - budget);
+    total = Total().Total();
+    if(total <= budget) return;
+
+    std::fprintf(stderr, "GPU memory budget of %.2f MiB is exceeded by %.2f MiB!\n",
+                 double(budget) / MiB, double(total - budget) / MiB);
+    PrintReport(true, stderr);
+    std::exit(EXIT_FAILURE);
+}
+
+void GPUMemory::PrintReport(bool perAsset, std::FILE* out) const
+{
+    Usage total = Total();
+    std::fprintf(out, "GPU memory: %.2f MiB (%.2f MiB of it estimated padding) in %u objects, "
+                      "peak %.2f MiB", double(total.Total()) / MiB,
+                 double(total.padding) / MiB, total.objectCount, double(peak) / MiB);
+    if(budget != 0) std::fprintf(out, ", budget %.2f MiB", double(budget) / MiB);
+    std::fprintf(out, "\n");
+    for(uint32_t c = 0; c < CATEGORY_COUNT; c++)
+    {
+        const Usage& u = categories[c];
+        if(u.objectCount == 0) continue;
+        std::fprintf(out, "  %-18s %10.2f MiB %10.2f MiB padding %6u objects\n",
+                     Name(Category(c)), double(u.Total()) / MiB, double(u.padding) / MiB,
+                     u.objectCount);
+    }
+    if(!perAsset) return;
+
+    // Objects with the same label (e.g. the buffers of a mesh) are one asset
+    std::map<std::pair<Category, std::string>, Usage> assets;
+    for(const auto& [key, r] : records)
+    {
+        Usage& u = assets[{r.category, r.label.empty() ? "(unnamed)" : r.label}];
+        u.bytes += r.bytes;
+        u.padding += r.padding;
+        u.objectCount++;
+    }
+    std::vector<std::pair<const std::pair<Category, std::string>*, Usage>> sorted;
+    for(const auto& [key, u] : assets)
+        sorted.push_back({&key, u});
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b)
+    {
+        return a.second.Total() > b.second.Total();
+    });
+    for(const auto& [key, u] : sorted)
+        std::fprintf(out, "    %10.2f MiB  %-18s %s\n", double(u.Total()) / MiB,
+                     Name(key->first), key->second.c_str());
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// Bookkeeping of the GPU memory of every GL buffer and texture.
+//
+// The owner of a GL object records its storage next to the allocation
+// (the tight size of the buffer, or of every stored mip level) and
+// releases it next to the glDelete* call; records are keyed on the GL
+// name and grouped by category and by label (the asset path). Drivers
+// pad allocations, the padding is estimated on top of the recorded
+// sizes: every object is rounded up to ALLOCATION_ALIGNMENT (the VRAM
+// page of current GPUs) and the owner adds the layout padding it knows
+// of (e.g. 3 channel texels stored as 4).
+//
+// With a budget, "Enforce" (once per frame) compares the estimate with
+// it. Over budget, the handler is asked to release the excess (e.g. by
+// lowering the texture residency); if it can not, the report is printed
+// and the program exits.
+//
+// Not thread safe, all calls must come from the thread that owns the GL
+// context.
+class GPUMemory {
+public:
+  static constexpr size_t ALLOCATION_ALIGNMENT = 64 * 1024;
+
+  enum Kind : uint32_t { BUFFER, TEXTURE };
+  enum Category : uint32_t {
+    MESH,
+    TEXTURE_2D,
+    CUBE_MAP,
+    RENDER_TARGET,
+    STAGING,
+    VIRTUAL_TEXTURE,
+    CATEGORY_COUNT
+  };
+
+  struct Usage {
+    size_t bytes = 0;
+    // Estimated, see above
+    size_t padding = 0;
+    uint32_t objectCount = 0;
+
+    size_t Total() const { return bytes + padding; }
+  };
+
+  // Called with the estimated bytes above the budget, returns the bytes
+  // it released
+  using OverBudget = std::function<size_t(size_t excess)>;
+
+  // Constructors, Movement & Destructor
+  GPUMemory() = default;
+  GPUMemory(const GPUMemory &) = delete;
+  GPUMemory(GPUMemory &&) = delete;
+  GPUMemory &operator=(const GPUMemory &) = delete;
+  GPUMemory &operator=(GPUMemory &&) = delete;
+  ~GPUMemory() = default;
+
+  // Process-wide tracker, created on first use
+  static GPUMemory &Global();
+  static const char *Name(Category);
+
+  // Records object "id", or resizes its record (keeping its label when
+  // "label" is empty)
+  void Track(Kind, uint32_t id, Category, size_t bytes, size_t padding = 0,
+             const std::string &label = {});
+  void SetLabel(Kind, uint32_t id, const std::string &label);
+  // The storage of "from" was replaced by "to", which inherits its record
+  void Move(Kind, uint32_t from, uint32_t to);
+  void Release(Kind, uint32_t id);
+
+  Usage Total() const;
+  const Usage &Total(Category c) const { return categories[c]; }
+  // Highest estimate since the start
+  size_t Peak() const { return peak; }
+
+  // Zero disables the budget
+  void SetBudget(size_t bytes, OverBudget = {});
+  size_t Budget() const { return budget; }
+  void Enforce();
+
+  // Totals by category, with "perAsset" the labels by size too
+  void PrintReport(bool perAsset, std::FILE * = stdout) const;
+
+private:
+  struct Record {
+    Category category = MESH;
+    size_t bytes = 0;
+    size_t padding = 0;
+    std::string label;
+  };
+
+  std::unordered_map<uint64_t, Record> records;
+  Usage categories[CATEGORY_COUNT];
+  size_t peak = 0;
+  size_t budget = 0;
+  OverBudget overBudget;
+
+  static uint64_t Key(Kind k, uint32_t id) { return (uint64_t(k) << 32) | id; }
+  void Add(const Record &, int sign);
+};
@@ -1,7 +1,19 @@
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdio>
-
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "assetRegistry.h"
+#include "gpuMemory.h"
+#include "sphereGenerator.h"
+#include "textureContainer.h"
+#include "textureResidency.h"
 #include "utility.h"
+#include "virtualTexture.h"
 
 #include <GLFW/glfw3.h>
 
@@ -192,58 +204,277 @@ void KeyboardCallback(GLFWwindow *wnd, int key, int scancode, int action,
     if (key == GLFW_KEY_4)
       mode = 3;
     state->mode = mode;
+
+    // Vertex format of the planets (packed / float)
+    if (key == GLFW_KEY_V) {
+      state->packedVertices = !state->packedVertices;
+      std::printf("Planet vertex format: %s\n",
+                  state->packedVertices ? "packed" : "float32");
+    }
+    // Performance report
+    if (key == GLFW_KEY_I)
+      state->printStats = !state->printStats;
+    // GPU memory report
+    if (key == GLFW_KEY_M)
+      state->printMemory = true;
+
+    // LOD error threshold
+    if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) {
+      float factor = (key == GLFW_KEY_LEFT_BRACKET) ? 0.5f : 2.0f;
+      state->lodPixelError =
+          glm::clamp(state->lodPixelError * factor, 0.125f, 64.0f);
+      std::printf("LOD error threshold: %g px\n",
+                  double(state->lodPixelError));
+    }
   }
 }
 
 int main(int argc, const char *argv[]) {
+  auto startTime = std::chrono::steady_clock::now();
+
+  // Planets can use a user mesh instead of the sphere:
+  //   --mesh <obj>          loaded through the mesh cache
+  //   --mesh-mem-cap <MiB>  ingested within the given memory (StreamObj)
+  // The cap covers the parse windows only: the meshlets and the GPU side
+  // buffers (grown by doubling) still scale with the mesh.
+  // Textures are block compressed unless:
+  //   --no-texture-compression
+  // Assets are decoded while the window initializes unless:
+  //   --sequential-startup
+  // Texture levels are kept resident within (see TextureResidency):
+  //   --texture-budget <MiB>
+  // Earth albedo and sky can be virtual textures (see texture_converter
+  // --virtual), sampled through a tile cache of the given size:
+  //   --virtual-earth <vtex>  --virtual-sky <vtex>  --virtual-cap <MiB>
+  // Otherwise the sky is resampled into a cube map (see CubeMapGL) unless:
+  //   --no-sky-cube-map
+  // GPU memory (see GPUMemory) is reported at startup and on "M", with
+  // a budget the texture residency is reduced to stay within it (and the
+  // program exits if it can not):
+  //   --gpu-budget <MiB>
+  // Shadows are folded into the planet programs (specialization
+  // constants, see ShaderGL::Constant), they are left out with:
+  //   --no-shadows
+  std::string userMeshPath;
+  size_t userMeshMemoryCap = 0;
+  bool compressTextures = true;
+  bool sequentialStartup = false;
+  size_t textureBudget = TextureResidency::DEFAULT_BUDGET;
+  std::string virtualEarthPath, virtualSkyPath;
+  size_t virtualCap = VirtualTextureSystem::DEFAULT_VRAM_CAP;
+  bool skyCubeMap = true;
+  size_t gpuBudget = 0;
+  bool shadows = true;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--mesh" && i + 1 < argc)
+      userMeshPath = argv[++i];
+    else if (arg == "--mesh-mem-cap" && i + 1 < argc)
+      userMeshMemoryCap = size_t(std::strtoull(argv[++i], nullptr, 10)) << 20;
+    else if (arg == "--no-texture-compression")
+      compressTextures = false;
+    else if (arg == "--sequential-startup")
+      sequentialStartup = true;
+    else if (arg == "--texture-budget" && i + 1 < argc)
+      textureBudget = size_t(std::strtoull(argv[++i], nullptr, 10)) << 20;
+    else if (arg == "--virtual-earth" && i + 1 < argc)
+      virtualEarthPath = argv[++i];
+    else if (arg == "--virtual-sky" && i + 1 < argc)
+      virtualSkyPath = argv[++i];
+    else if (arg == "--virtual-cap" && i + 1 < argc)
+      virtualCap = size_t(std::strtoull(argv[++i], nullptr, 10)) << 20;
+    else if (arg == "--no-sky-cube-map")
+      skyCubeMap = false;
+    else if (arg == "--gpu-budget" && i + 1 < argc)
+      gpuBudget = size_t(std::strtoull(argv[++i], nullptr, 10)) << 20;
+    else if (arg == "--no-shadows")
+      shadows = false;
+  }
+  skyCubeMap = skyCubeMap && virtualSkyPath.empty();
+  const char *skyImage = "working_dir/textures/8k_stars_milky_way.jpg";
+
+  // Every asset is requested through the registry, repeated requests
+  // share the GPU objects of the first one
+  AssetRegistry assets;
+  // Converted containers (see texture_converter) are used instead of
+  // their images when they exist
+  auto TexturePath = [](const char *image) {
+    std::string path = TextureContainer::PathFor(image);
+    return std::filesystem::exists(path) ? path : std::string(image);
+  };
+  const char *textureImages[] = {
+      "working_dir/textures/2k_earth_daymap.jpg",
+      "working_dir/textures/2k_earth_surface.texpack",
+      "working_dir/textures/2k_moon.jpg",
+      "working_dir/textures/sunmap.jpg"};
+  // Texture decodes and user mesh loads run on the workers while the
+  // window and the GL context are created, the requests below only
+  // upload their results
+  if (!sequentialStartup) {
+    for (const char *image : textureImages)
+      assets.PrefetchTexture(TexturePath(image), compressTextures);
+    if (!skyCubeMap)
+      assets.PrefetchTexture(TexturePath(skyImage), compressTextures);
+    if (!userMeshPath.empty() && userMeshMemoryCap == 0) {
+      assets.PrefetchMesh(userMeshPath);
+      assets.PrefetchMesh(userMeshPath, MeshVertexLayout::PACKED);
+    }
+  }
+
   GLState state = GLState("Planet Renderer", 1280, 720, CallbackPointersGLFW());
+  // Lighting parameters of the planet programs, constant per run
+  const ShaderGL::Constants planetConstants = {
+      ShaderGL::Constant::Bool(0, "USE_SHADOWS", shadows),
+      ShaderGL::Constant::Float(1, "SPECULAR_POWER", 32.0f)};
+  const ShaderGL::Constants earthConstants = {
+      ShaderGL::Constant::Bool(0, "USE_SHADOWS", shadows),
+      ShaderGL::Constant::Float(1, "SPECULAR_POWER_LOW", 8.0f),
+      ShaderGL::Constant::Float(2, "SPECULAR_POWER_HIGH", 64.0f)};
+  // Every program is handed to the driver before any of them is waited
+  // on, so drivers with background compilers build them in parallel
+  struct ShaderFile {
+    ShaderGL::Type type;
+    const char *path;
+    ShaderGL::Constants constants;
+  };
+  const ShaderFile shaderFiles[] = {
+      {ShaderGL::VERTEX, "working_dir/shaders/planet.vert", {}},
+      {ShaderGL::FRAGMENT, "working_dir/shaders/planet.frag", planetConstants},
+      {ShaderGL::FRAGMENT, "working_dir/shaders/earth.frag", earthConstants},
+      {ShaderGL::FRAGMENT, "working_dir/shaders/cloud.frag", {}},
+      {ShaderGL::VERTEX, "working_dir/shaders/shadow.vert", {}},
+      {ShaderGL::FRAGMENT, "working_dir/shaders/shadow.frag", {}},
+      {ShaderGL::VERTEX, "working_dir/shaders/background.vert", {}},
+      {ShaderGL::FRAGMENT, "working_dir/shaders/background.frag", {}},
+      {ShaderGL::VERTEX, "working_dir/shaders/sun.vert", {}},
+      {ShaderGL::FRAGMENT, "working_dir/shaders/sun.frag", {}}};
+  for (const ShaderFile &f : shaderFiles)
+    assets.SubmitShader(f.type, f.path, f.constants);
   // Load planet shaders
-  ShaderGL planetVShader =
-      ShaderGL(ShaderGL::VERTEX, "working_dir/shaders/planet.vert");
-  ShaderGL planetFShader =
-      ShaderGL(ShaderGL::FRAGMENT, "working_dir/shaders/planet.frag");
-  ShaderGL earthFShader =
-      ShaderGL(ShaderGL::FRAGMENT, "working_dir/shaders/earth.frag");
-  ShaderGL cloudFShader =
-      ShaderGL(ShaderGL::FRAGMENT, "working_dir/shaders/cloud.frag");
+  auto planetVShader =
+      assets.Shader(ShaderGL::VERTEX, "working_dir/shaders/planet.vert");
+  auto planetFShader = assets.Shader(
+      ShaderGL::FRAGMENT, "working_dir/shaders/planet.frag", planetConstants);
+  auto earthFShader = assets.Shader(
+      ShaderGL::FRAGMENT, "working_dir/shaders/earth.frag", earthConstants);
+  auto cloudFShader =
+      assets.Shader(ShaderGL::FRAGMENT, "working_dir/shaders/cloud.frag");
   // Shadow shaders
-  ShaderGL shadowVShader =
-      ShaderGL(ShaderGL::VERTEX, "working_dir/shaders/shadow.vert");
-  ShaderGL shadowFShader =
-      ShaderGL(ShaderGL::FRAGMENT, "working_dir/shaders/shadow.frag");
+  auto shadowVShader =
+      assets.Shader(ShaderGL::VERTEX, "working_dir/shaders/shadow.vert");
+  auto shadowFShader =
+      assets.Shader(ShaderGL::FRAGMENT, "working_dir/shaders/shadow.frag");
   // Background shaders
-  ShaderGL bgVShader =
-      ShaderGL(ShaderGL::VERTEX, "working_dir/shaders/background.vert");
-  ShaderGL bgFShader =
-      ShaderGL(ShaderGL::FRAGMENT, "working_dir/shaders/background.frag");
+  auto bgVShader =
+      assets.Shader(ShaderGL::VERTEX, "working_dir/shaders/background.vert");
+  auto bgFShader =
+      assets.Shader(ShaderGL::FRAGMENT, "working_dir/shaders/background.frag");
   // Sun shaders
-  ShaderGL sunVShader =
-      ShaderGL(ShaderGL::VERTEX, "working_dir/shaders/sun.vert");
-  ShaderGL sunFShader =
-      ShaderGL(ShaderGL::FRAGMENT, "working_dir/shaders/sun.frag");
-
-  // Load sphere meshes
-  MeshGL sphereMesh = MeshGL("working_dir/meshes/sphere_80k.obj");
-  MeshGL bgSphere = MeshGL("working_dir/meshes/sphere_80k.obj");
-
-  // Load textures
-  TextureGL earthTex = TextureGL("working_dir/textures/2k_earth_daymap.jpg",
-                                 TextureGL::LINEAR, TextureGL::REPEAT);
-  TextureGL earthSpecTex =
-      TextureGL("working_dir/textures/2k_earth_specular_map.png",
-                TextureGL::LINEAR, TextureGL::REPEAT);
-  TextureGL earthNightTex =
-      TextureGL("working_dir/textures/2k_earth_nightmap_alpha.png",
-                TextureGL::LINEAR, TextureGL::REPEAT);
-  TextureGL earthCloudTex =
-      TextureGL("working_dir/textures/2k_earth_clouds_alpha.png",
-                TextureGL::LINEAR, TextureGL::REPEAT);
-  TextureGL moonTex = TextureGL("working_dir/textures/2k_moon.jpg",
-                                TextureGL::LINEAR, TextureGL::REPEAT);
-  TextureGL starsTex = TextureGL("working_dir/textures/8k_stars_milky_way.jpg",
-                                 TextureGL::LINEAR, TextureGL::REPEAT);
-  TextureGL sunTex = TextureGL("working_dir/textures/sunmap.jpg",
-                               TextureGL::LINEAR, TextureGL::REPEAT);
+  auto sunVShader =
+      assets.Shader(ShaderGL::VERTEX, "working_dir/shaders/sun.vert");
+  auto sunFShader =
+      assets.Shader(ShaderGL::FRAGMENT, "working_dir/shaders/sun.frag");
+
+  // Generate sphere meshes, LOD chains with 4x fewer triangles per level
+  std::vector<SphereShape> sphereLods;
+  for (uint32_t budget = 80000; budget >= 1250; budget /= 4)
+    sphereLods.push_back(
+        SphereShape::ForTriangleBudget(SphereShape::UV, budget));
+  // Sky and sun
+  auto bgSphere = assets.Mesh(sphereLods);
+
+  // Planets have both vertex formats resident so they can be compared
+  // at runtime (V key)
+  AssetRegistry::MeshHandle sphereMesh, spherePackedMesh;
+  if (!userMeshPath.empty() && userMeshMemoryCap != 0) {
+    sphereMesh = assets.StreamMesh(userMeshPath, userMeshMemoryCap);
+    spherePackedMesh = assets.StreamMesh(userMeshPath, userMeshMemoryCap,
+                                         MeshVertexLayout::PACKED);
+  } else if (!userMeshPath.empty()) {
+    sphereMesh = assets.Mesh(userMeshPath);
+    spherePackedMesh = assets.Mesh(userMeshPath, MeshVertexLayout::PACKED);
+  } else {
+    // Shares "bgSphere"
+    sphereMesh = assets.Mesh(sphereLods);
+    spherePackedMesh = assets.Mesh(sphereLods, MeshVertexLayout::PACKED);
+  }
+
+  // Page files of the virtual textures, their tiles stream in on demand
+  VirtualTextureSystem virtualTextures(virtualCap);
+  constexpr uint32_t NO_VIRTUAL_TEXTURE = UINT32_MAX;
+  uint32_t virtualEarth = NO_VIRTUAL_TEXTURE, virtualSky = NO_VIRTUAL_TEXTURE;
+  if (!virtualEarthPath.empty())
+    virtualEarth = virtualTextures.Add(virtualEarthPath);
+  if (!virtualSkyPath.empty())
+    virtualSky = virtualTextures.Add(virtualSkyPath);
+  // Binds virtual texture "id" for the active fragment shader program,
+  // or disables virtual sampling there
+  auto BindVirtual = [&](uint32_t id) {
+    static constexpr GLuint U_VIRTUAL = 9;
+    if (id != NO_VIRTUAL_TEXTURE)
+      virtualTextures.Bind(id);
+    glUniform1i(U_VIRTUAL, (id != NO_VIRTUAL_TEXTURE) ? 1 : 0);
+  };
+
+  // Textures only keep the levels they are drawn with, each one is drawn
+  // with its placeholder color until its first level is resident
+  TextureResidency residency(textureBudget);
+  GPUMemory::Global().SetBudget(
+      gpuBudget, [&](size_t excess) { return residency.Reduce(excess); });
+  auto ResidentTexture = [&](const char *image, const glm::vec4 &placeholder) {
+    return assets.ResidentTexture(residency, TexturePath(image),
+                                  TextureGL::LINEAR, TextureGL::REPEAT,
+                                  placeholder, compressTextures);
+  };
+  auto earthTex = ResidentTexture("working_dir/textures/2k_earth_daymap.jpg",
+                                  glm::vec4(0.1f, 0.2f, 0.4f, 1.0f));
+  // Specular mask, night lights and cloud alpha packed into one texture
+  // (see TexturePack), sampled by the Earth and the cloud shaders
+  auto earthSurfaceTex =
+      ResidentTexture("working_dir/textures/2k_earth_surface.texpack",
+                      glm::vec4(0.0f));
+  auto moonTex = ResidentTexture("working_dir/textures/2k_moon.jpg",
+                                 glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+  // The sky is a cube map, or the equirectangular image mapped by the
+  // sky shader
+  AssetRegistry::TextureHandle starsTex;
+  AssetRegistry::CubeMapHandle starsCube;
+  if (skyCubeMap)
+    starsCube = assets.CubeMap(skyImage, TextureGL::LINEAR, compressTextures);
+  else
+    starsTex = ResidentTexture(skyImage, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+  auto sunTex = ResidentTexture("working_dir/textures/sunmap.jpg",
+                                glm::vec4(1.0f, 0.8f, 0.4f, 1.0f));
+
+  // Full chains in 8-bit uncompressed storage, against the budget of the
+  // levels actually resident (reported with the stats)
+  uint32_t compressedTextureCount = 0, textureCount = 0;
+  {
+    static constexpr double MiB = 1024.0 * 1024.0;
+    size_t rawBytes = 0;
+    for (const auto &t :
+         {earthTex, earthSurfaceTex, moonTex, starsTex, sunTex}) {
+      if (!t)
+        continue;
+      compressedTextureCount += t->compressed ? 1u : 0u;
+      textureCount++;
+      for (uint32_t i = 0; i < t->mipCount; i++)
+        rawBytes += (size_t(std::max(t->width >> i, 1)) *
+                     size_t(std::max(t->height >> i, 1)) *
+                     size_t(t->channelCount));
+    }
+    std::printf("Textures: %u of %u block compressed, %.2f MiB uncompressed, "
+                "%.2f MiB GPU memory budget\n",
+                compressedTextureCount, textureCount, double(rawBytes) / MiB,
+                double(residency.Budget()) / MiB);
+    if (starsCube)
+      std::printf("Sky: 6 %dx%d cube map faces, %.2f MiB instead of %.2f MiB "
+                  "equirectangular\n",
+                  starsCube->faceSize, starsCube->faceSize,
+                  double(starsCube->gpuBytes) / MiB,
+                  double(starsCube->equirectBytes) / MiB);
+  }
+  assets.PrintStats();
 
   // Create shadow map framebuffer
   const int SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
@@ -264,6 +495,10 @@ int main(int argc, const char *argv[]) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
                          shadowDepthTex, 0);
+  GPUMemory::Global().Track(GPUMemory::TEXTURE, shadowDepthTex,
+                            GPUMemory::RENDER_TARGET,
+                            size_t(SHADOW_WIDTH) * SHADOW_HEIGHT * 4, 0,
+                            "shadow depth");
 
   // Create color texture (for storing z values)
   glGenTextures(1, &shadowColorTex);
@@ -276,24 +511,79 @@ int main(int argc, const char *argv[]) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
                          shadowColorTex, 0);
+  GPUMemory::Global().Track(GPUMemory::TEXTURE, shadowColorTex,
+                            GPUMemory::RENDER_TARGET,
+                            size_t(SHADOW_WIDTH) * SHADOW_HEIGHT * 4, 0,
+                            "shadow map");
 
   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     std::printf("Shadow framebuffer not complete!\n");
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  GPUMemory::Global().PrintReport(true);
+  GPUMemory::Global().Enforce();
+
   // Set unchanged state(s)
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
   glEnable(GL_DEPTH_TEST);
 
+  // GPU timings of the passes that draw the planet mesh
+  GPUTimerGL shadowTimer;
+  GPUTimerGL planetTimer;
+  GPUTimerGL skyTimer;
+  bool timedPacked = state.packedVertices;
+  uint32_t statFrames = 0;
+  // Triangles submitted per frame, for each camera mode
+  std::array<double, 4> modeTriangles = {};
+  std::array<uint32_t, 4> modeFrames = {};
+  // Bodies outside of the light / camera frustum, since the last report
+  uint64_t statSkippedShadowDraws = 0;
+  uint64_t statSkippedDraws = 0;
+  auto InFrustum = [](const MeshGL &mesh, const glm::mat4x4 &model,
+                      const glm::mat4x4 &viewProj) {
+    // Object space planes, the mesh bounds are tested as they are
+    Frustum frustum = Frustum::FromMatrix(viewProj * model);
+    return frustum.Intersects(mesh.boundingSphere.center,
+                              mesh.boundingSphere.radius) &&
+           frustum.Intersects(mesh.bounds);
+  };
+  // Meshlet culling of the camera passes, since the last report
+  MeshletDrawList drawList;
+  uint64_t statClusters = 0;
+  uint64_t statCulledClusters = 0;
+  uint64_t statCulledTriangles = 0;
+  auto DrawCulled = [&](const MeshGL &mesh, uint32_t lod,
+                        const glm::mat4x4 &model, const glm::mat4x4 &viewProj,
+                        bool cullBackfacing) {
+    mesh.CullMeshlets(lod, model, viewProj, state.pos, cullBackfacing,
+                      drawList);
+    mesh.Draw(drawList);
+    statClusters += drawList.clusterCount;
+    statCulledClusters += drawList.culledClusters;
+    statCulledTriangles += drawList.culledTriangles;
+    return drawList.triangleCount - drawList.culledTriangles;
+  };
+  double lastStatTime = glfwGetTime();
+
   // =============== //
   //   RENDER LOOP   //
   // =============== //
   float lastTime = static_cast<float>(glfwGetTime());
+  bool firstFramePresented = false;
 
   while (!glfwWindowShouldClose(state.window)) {
     // Poll inputs from the OS via GLFW
     glfwPollEvents();
+    // Texture levels needed by the last frame
+    residency.Update();
+    GPUMemory::Global().Enforce();
+    if (state.printMemory) {
+      GPUMemory::Global().PrintReport(true);
+      state.printMemory = false;
+    }
+    // Tiles requested by the frames the GPU has finished
+    virtualTextures.BeginFrame();
 
     // Calculate delta time
     float currentFrameTime = static_cast<float>(glfwGetTime());
@@ -308,6 +598,16 @@ int main(int argc, const char *argv[]) {
 
     // Update camera based on mode
     UpdateCamera(state, state.window, deltaTime);
+    uint32_t frameTriangles = 0;
+
+    const MeshGL &planetMesh =
+        state.packedVertices ? *spherePackedMesh : *sphereMesh;
+    // Do not mix the timings of the two formats
+    if (timedPacked != state.packedVertices) {
+      timedPacked = state.packedVertices;
+      shadowTimer.ResetStats();
+      planetTimer.ResetStats();
+    }
 
     // Uniform locations
     static constexpr GLuint U_TRANSFORM_MODEL = 0;
@@ -318,7 +618,6 @@ int main(int argc, const char *argv[]) {
     static constexpr GLuint U_LIGHT_COLOR = 5;
     static constexpr GLuint U_EYE_POS = 6;
     static constexpr GLuint U_LIGHT_VP = 7;
-    static constexpr GLuint U_USE_SHADOWS = 8;
 
     // Rotating sun direction
     float sunAngle = state.currentTime * 0.1f;
@@ -336,6 +635,8 @@ int main(int argc, const char *argv[]) {
     );
     glm::mat4x4 lightProj = glm::ortho(-8.0f, 8.0f, -8.0f, 8.0f, 0.1f, 50.0f);
     glm::mat4x4 lightVP = lightProj * lightView;
+    // Orthographic, the same for every planet
+    float shadowPixelsPerUnit = float(SHADOW_WIDTH) / 16.0f;
 
     // Render to shadow FBO
     glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
@@ -344,26 +645,37 @@ int main(int argc, const char *argv[]) {
     glClearColor(999999.0f, 999999.0f, 999999.0f, 1.0f); // Large value
 
     glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT,
-                       shadowVShader.shaderId);
+                       shadowVShader->shaderId);
     glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT,
-                       shadowFShader.shaderId);
-    glBindVertexArray(sphereMesh.vaoId);
+                       shadowFShader->shaderId);
+    glBindVertexArray(planetMesh.vaoId);
+    shadowTimer.Begin();
 
-    // Render all planets to shadow map
-    for (int i = 0; i < 3; i++) {
+    // Render all planets to shadow map (unless the planet programs
+    // ignore it)
+    for (int i = 0; shadows && i < 3; i++) {
       glm::mat4x4 model = glm::identity<glm::mat4x4>();
       model = glm::translate(model, g_planets[i].position);
       model = glm::rotate(model, state.currentTime * g_planets[i].rotationSpeed,
                           glm::vec3(0, 1, 0));
       model = glm::scale(model, glm::vec3(g_planets[i].scale));
+      if (!InFrustum(planetMesh, model, lightVP)) {
+        statSkippedShadowDraws++;
+        continue;
+      }
+
+      uint32_t lod = planetMesh.SelectLod(
+          g_planets[i].scale, shadowPixelsPerUnit, state.lodPixelError);
 
-      glActiveShaderProgram(state.renderPipeline, shadowVShader.shaderId);
+      glActiveShaderProgram(state.renderPipeline, shadowVShader->shaderId);
       glUniformMatrix4fv(U_TRANSFORM_MODEL, 1, false, glm::value_ptr(model));
       glUniformMatrix4fv(U_LIGHT_VP, 1, false, glm::value_ptr(lightVP));
+      planetMesh.SetDecodeUniforms(lod);
 
-      glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT,
-                     nullptr);
+      planetMesh.Draw(lod);
+      frameTriangles += planetMesh.lods[lod].indexCount / 3;
     }
+    shadowTimer.End();
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -375,6 +687,19 @@ int main(int argc, const char *argv[]) {
         glm::radians(50.0f), float(state.width) / float(state.height), 0.01f,
         100.0f);
     glm::mat4x4 view = glm::lookAt(state.pos, state.gaze, state.up);
+    glm::mat4x4 viewProj = proj * view;
+    // Screen pixels per world unit at unit distance, for LOD selection
+    float focalPixels =
+        float(state.height) * 0.5f / glm::tan(glm::radians(50.0f) * 0.5f);
+    auto PixelsPerUnit = [&](const glm::vec3 &p) {
+      float dist = glm::distance(state.pos, p);
+      return focalPixels / glm::max(dist, 1e-3f);
+    };
+    // Textures wrap the spheres, their width spans the circumference
+    auto UseOnSphere = [&](const TextureGL &texture, float radius,
+                           float pixelsPerUnit) {
+      residency.Use(texture, glm::two_pi<float>() * radius * pixelsPerUnit);
+    };
 
     glViewport(0, 0, state.width, state.height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -390,34 +715,52 @@ int main(int argc, const char *argv[]) {
                               // z=1.0)
 
     glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT,
-                       bgVShader.shaderId);
+                       bgVShader->shaderId);
     glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT,
-                       bgFShader.shaderId);
-    glBindVertexArray(bgSphere.vaoId);
+                       bgFShader->shaderId);
+    glBindVertexArray(bgSphere->vaoId);
 
     // Large sphere centered on camera with orthographic projection
     // Simple model matrix - just a unit sphere (shader handles the rest)
     glm::mat4x4 bgModel = glm::identity<glm::mat4x4>();
 
-    glActiveShaderProgram(state.renderPipeline, bgVShader.shaderId);
+    glActiveShaderProgram(state.renderPipeline, bgVShader->shaderId);
     glUniformMatrix4fv(U_TRANSFORM_MODEL, 1, false, glm::value_ptr(bgModel));
     glUniformMatrix4fv(U_TRANSFORM_VIEW, 1, false, glm::value_ptr(view));
     glUniformMatrix4fv(U_TRANSFORM_PROJ, 1, false,
                        glm::value_ptr(proj)); // Use same projection as planets
 
-    glActiveShaderProgram(state.renderPipeline, bgFShader.shaderId);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, starsTex.textureId);
-
-    glDrawElements(GL_TRIANGLES, bgSphere.indexCount, GL_UNSIGNED_INT, nullptr);
+    glActiveShaderProgram(state.renderPipeline, bgFShader->shaderId);
+    static constexpr GLuint U_CUBE_MAP = 10;
+    if (starsCube) {
+      glActiveTexture(GL_TEXTURE3);
+      glBindTexture(GL_TEXTURE_CUBE_MAP, starsCube->textureId);
+      glActiveTexture(GL_TEXTURE0);
+    } else {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, starsTex->textureId);
+    }
+    glUniform1i(U_CUBE_MAP, starsCube ? 1 : 0);
+    BindVirtual(virtualSky);
+    // Sampled by view direction, the full turn at the focal length
+    if (starsTex && virtualSky == NO_VIRTUAL_TEXTURE)
+      UseOnSphere(*starsTex, 1.0f, focalPixels);
+
+    // The sky is sampled by view direction from its center, so the
+    // tessellation does not show; the coarsest LOD is exact
+    uint32_t bgLod = uint32_t(bgSphere->lods.size() - 1);
+    skyTimer.Begin();
+    bgSphere->Draw(bgLod);
+    skyTimer.End();
+    frameTriangles += bgSphere->lods[bgLod].indexCount / 3;
 
     // ========================================
     // SUN RENDERING (infinitely far)
     // ========================================
     glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT,
-                       sunVShader.shaderId);
+                       sunVShader->shaderId);
     glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT,
-                       sunFShader.shaderId);
+                       sunFShader->shaderId);
 
     // Position sun in the light direction (opposite of light direction vector)
     // Scale determines apparent size of sun
@@ -434,19 +777,23 @@ int main(int argc, const char *argv[]) {
     glm::mat4 viewNoTranslate =
         glm::mat4(glm::mat3(view)); // Remove translation
 
-    glActiveShaderProgram(state.renderPipeline, sunVShader.shaderId);
+    glActiveShaderProgram(state.renderPipeline, sunVShader->shaderId);
     glUniformMatrix4fv(U_TRANSFORM_MODEL, 1, false, glm::value_ptr(sunModel));
     glUniformMatrix4fv(U_TRANSFORM_VIEW, 1, false,
                        glm::value_ptr(viewNoTranslate));
     glUniformMatrix4fv(U_TRANSFORM_PROJ, 1, false, glm::value_ptr(proj));
 
-    glActiveShaderProgram(state.renderPipeline, sunFShader.shaderId);
+    glActiveShaderProgram(state.renderPipeline, sunFShader->shaderId);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sunTex.textureId);
+    glBindTexture(GL_TEXTURE_2D, sunTex->textureId);
+    UseOnSphere(*sunTex, sunScale, focalPixels);
 
-    // Use a small sphere for the sun
-    glBindVertexArray(bgSphere.vaoId);
-    glDrawElements(GL_TRIANGLES, bgSphere.indexCount, GL_UNSIGNED_INT, nullptr);
+    // Use a small sphere for the sun, it is at unit distance in view space
+    uint32_t sunLod =
+        bgSphere->SelectLod(sunScale, focalPixels, state.lodPixelError);
+    glBindVertexArray(bgSphere->vaoId);
+    bgSphere->Draw(sunLod);
+    frameTriangles += bgSphere->lods[sunLod].indexCount / 3;
 
     glDepthMask(GL_TRUE);    // Re-enable depth writing
     glEnable(GL_CULL_FACE);  // Restore for planets
@@ -456,9 +803,10 @@ int main(int argc, const char *argv[]) {
     // PLANET RENDERING
     // ========================================
     glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT,
-                       planetVShader.shaderId);
-    glBindVertexArray(sphereMesh.vaoId);
+                       planetVShader->shaderId);
+    glBindVertexArray(planetMesh.vaoId);
     glDisable(GL_CULL_FACE); // Disable culling to see full spheres
+    planetTimer.Begin();
 
     // Bind shadow map
     glActiveTexture(GL_TEXTURE4);
@@ -472,62 +820,70 @@ int main(int argc, const char *argv[]) {
       model = glm::rotate(model, state.currentTime * g_planets[i].rotationSpeed,
                           glm::vec3(0, 1, 0));
       model = glm::scale(model, glm::vec3(g_planets[i].scale));
+      if (!InFrustum(planetMesh, model, viewProj)) {
+        statSkippedDraws++;
+        continue;
+      }
 
       // Normal matrix
       glm::mat3x3 normalMatrix = glm::inverseTranspose(glm::mat3(model));
 
+      uint32_t lod = planetMesh.SelectLod(
+          g_planets[i].scale, PixelsPerUnit(g_planets[i].position),
+          state.lodPixelError);
+
       // Set vertex shader uniforms
-      glActiveShaderProgram(state.renderPipeline, planetVShader.shaderId);
+      glActiveShaderProgram(state.renderPipeline, planetVShader->shaderId);
       glUniformMatrix4fv(U_TRANSFORM_MODEL, 1, false, glm::value_ptr(model));
       glUniformMatrix4fv(U_TRANSFORM_VIEW, 1, false, glm::value_ptr(view));
       glUniformMatrix4fv(U_TRANSFORM_PROJ, 1, false, glm::value_ptr(proj));
       glUniformMatrix3fv(U_TRANSFORM_NORMAL, 1, false,
                          glm::value_ptr(normalMatrix));
+      planetMesh.SetDecodeUniforms(lod);
 
       // Use Earth shader for Earth, regular planet shader for moons
       if (i == 0) {
         // Use Earth shader with special textures
         glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT,
-                           earthFShader.shaderId);
-        glActiveShaderProgram(state.renderPipeline, earthFShader.shaderId);
+                           earthFShader->shaderId);
+        glActiveShaderProgram(state.renderPipeline, earthFShader->shaderId);
         glUniform3fv(U_LIGHT_DIR, 1, glm::value_ptr(sunDir));
         glUniform3fv(U_LIGHT_COLOR, 1, glm::value_ptr(sunColor));
         glUniform3fv(U_EYE_POS, 1, glm::value_ptr(state.pos));
         glUniformMatrix4fv(U_LIGHT_VP, 1, false, glm::value_ptr(lightVP));
-        glUniform1i(U_USE_SHADOWS, 1);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, earthTex.textureId);
+        glBindTexture(GL_TEXTURE_2D, earthTex->textureId);
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, earthSpecTex.textureId);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, earthNightTex.textureId);
+        glBindTexture(GL_TEXTURE_2D, earthSurfaceTex->textureId);
+        BindVirtual(virtualEarth);
+        for (const auto &t : {earthTex, earthSurfaceTex})
+          if (t != earthTex || virtualEarth == NO_VIRTUAL_TEXTURE)
+            UseOnSphere(*t, g_planets[i].scale,
+                        PixelsPerUnit(g_planets[i].position));
       } else {
         // Use regular planet shader
         glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT,
-                           planetFShader.shaderId);
-        glActiveShaderProgram(state.renderPipeline, planetFShader.shaderId);
+                           planetFShader->shaderId);
+        glActiveShaderProgram(state.renderPipeline, planetFShader->shaderId);
         glUniform3fv(U_LIGHT_DIR, 1, glm::value_ptr(sunDir));
         glUniform3fv(U_LIGHT_COLOR, 1, glm::value_ptr(sunColor));
         glUniform3fv(U_EYE_POS, 1, glm::value_ptr(state.pos));
         glUniformMatrix4fv(U_LIGHT_VP, 1, false, glm::value_ptr(lightVP));
-        glUniform1i(U_USE_SHADOWS, 1);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, moonTex.textureId);
+        glBindTexture(GL_TEXTURE_2D, moonTex->textureId);
+        UseOnSphere(*moonTex, g_planets[i].scale,
+                    PixelsPerUnit(g_planets[i].position));
       }
 
-      // Draw the planet
-      glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT,
-                     nullptr);
+      // Draw the visible clusters of the planet, the far side is hidden
+      // by the near side
+      frameTriangles += DrawCulled(planetMesh, lod, model, viewProj, true);
     }
 
     // Render Earth clouds separately
     {
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-      glDepthMask(GL_FALSE);
-
       // Cloud model matrix (slightly larger sphere, different rotation speed)
       float cloudScale = 1.01f;
       float cloudRotationSpeed = 0.15f; // Different from Earth's rotation
@@ -538,37 +894,138 @@ int main(int argc, const char *argv[]) {
                       glm::vec3(0, 1, 0));
       cloudModel =
           glm::scale(cloudModel, glm::vec3(g_planets[0].scale * cloudScale));
+      if (!InFrustum(planetMesh, cloudModel, viewProj)) {
+        statSkippedDraws++;
+      } else {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+
+        glm::mat3x3 cloudNormalMatrix =
+            glm::inverseTranspose(glm::mat3(cloudModel));
+
+        uint32_t cloudLod = planetMesh.SelectLod(
+            g_planets[0].scale * cloudScale,
+            PixelsPerUnit(g_planets[0].position), state.lodPixelError);
+
+        // Set vertex shader uniforms
+        glActiveShaderProgram(state.renderPipeline, planetVShader->shaderId);
+        glUniformMatrix4fv(U_TRANSFORM_MODEL, 1, false,
+                           glm::value_ptr(cloudModel));
+        glUniformMatrix4fv(U_TRANSFORM_VIEW, 1, false, glm::value_ptr(view));
+        glUniformMatrix4fv(U_TRANSFORM_PROJ, 1, false, glm::value_ptr(proj));
+        glUniformMatrix3fv(U_TRANSFORM_NORMAL, 1, false,
+                           glm::value_ptr(cloudNormalMatrix));
+        planetMesh.SetDecodeUniforms(cloudLod);
+
+        // Use cloud shader
+        glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT,
+                           cloudFShader->shaderId);
+        glActiveShaderProgram(state.renderPipeline, cloudFShader->shaderId);
+        glUniform3fv(U_LIGHT_DIR, 1, glm::value_ptr(sunDir));
+        glUniform3fv(U_LIGHT_COLOR, 1, glm::value_ptr(sunColor));
 
-      glm::mat3x3 cloudNormalMatrix =
-          glm::inverseTranspose(glm::mat3(cloudModel));
-
-      // Set vertex shader uniforms
-      glActiveShaderProgram(state.renderPipeline, planetVShader.shaderId);
-      glUniformMatrix4fv(U_TRANSFORM_MODEL, 1, false,
-                         glm::value_ptr(cloudModel));
-      glUniformMatrix4fv(U_TRANSFORM_VIEW, 1, false, glm::value_ptr(view));
-      glUniformMatrix4fv(U_TRANSFORM_PROJ, 1, false, glm::value_ptr(proj));
-      glUniformMatrix3fv(U_TRANSFORM_NORMAL, 1, false,
-                         glm::value_ptr(cloudNormalMatrix));
-
-      // Use cloud shader
-      glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT,
-                         cloudFShader.shaderId);
-      glActiveShaderProgram(state.renderPipeline, cloudFShader.shaderId);
-      glUniform3fv(U_LIGHT_DIR, 1, glm::value_ptr(sunDir));
-      glUniform3fv(U_LIGHT_COLOR, 1, glm::value_ptr(sunColor));
-
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, earthCloudTex.textureId);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, earthSurfaceTex->textureId);
+        UseOnSphere(*earthSurfaceTex, g_planets[0].scale * cloudScale,
+                    PixelsPerUnit(g_planets[0].position));
 
-      // Draw clouds
-      glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT,
-                     nullptr);
+        // Draw clouds, the far side shows through so only the clusters
+        // outside of the frustum are culled
+        frameTriangles +=
+            DrawCulled(planetMesh, cloudLod, cloudModel, viewProj, false);
 
-      glDepthMask(GL_TRUE);
-      glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+      }
+    }
+    planetTimer.End();
+
+    // Performance report, once per second
+    modeTriangles[state.cameraMode] += double(frameTriangles);
+    modeFrames[state.cameraMode]++;
+    statFrames++;
+    double statTime = glfwGetTime();
+    if (statTime - lastStatTime >= 1.0) {
+      if (state.printStats) {
+        MeshVertexLayout layout =
+            MeshVertexLayout::For(planetMesh.format, planetMesh.vertexCount);
+        std::printf("[Stats] %.1f fps | planet mesh %s (%zu bytes/vertex) | "
+                    "GPU shadow pass %.3f ms, planet pass %.3f ms, sky "
+                    "pass %.3f ms (%s) (%u of %u textures block "
+                    "compressed)\n",
+                    double(statFrames) / (statTime - lastStatTime),
+                    MeshVertexLayout::FormatName(planetMesh.format),
+                    layout.BytesPerVertex(), shadowTimer.AverageMs(),
+                    planetTimer.AverageMs(), skyTimer.AverageMs(),
+                    starsCube ? "cube map" : "equirectangular",
+                    compressedTextureCount, textureCount);
+        std::printf("        triangles/frame since start "
+                    "(LOD error now %g px):",
+                    double(state.lodPixelError));
+        for (uint32_t m = 0; m < 4; m++) {
+          if (modeFrames[m] == 0)
+            continue;
+          std::printf(" camera %u: %.0f", m,
+                      modeTriangles[m] / double(modeFrames[m]));
+        }
+        std::printf("\n");
+        std::printf("        meshlets culled/frame: %.0f of %.0f clusters, "
+                    "%.0f triangles\n",
+                    double(statCulledClusters) / double(statFrames),
+                    double(statClusters) / double(statFrames),
+                    double(statCulledTriangles) / double(statFrames));
+        std::printf("        draws skipped/frame (outside of the frustum): "
+                    "shadow %.2f, camera %.2f\n",
+                    double(statSkippedShadowDraws) / double(statFrames),
+                    double(statSkippedDraws) / double(statFrames));
+        constexpr double MiB = 1024.0 * 1024.0;
+        const TextureResidency::Stats &texStats = residency.GetStats();
+        std::printf("        textures: %.2f of %.2f MiB resident (budget %.2f "
+                    "MiB), %.2f MiB uploaded, %u evictions, %u trims\n",
+                    double(residency.ResidentBytes()) / MiB,
+                    double(residency.FullChainBytes()) / MiB,
+                    double(residency.Budget()) / MiB,
+                    double(texStats.uploadedBytes) / MiB, texStats.evictions,
+                    texStats.trims);
+        if (virtualTextures.SlotCount() != 0) {
+          const VirtualTextureSystem::Stats &vtStats =
+              virtualTextures.GetStats();
+          std::printf("        virtual textures: %u of %u tiles resident "
+                      "(%.2f MiB), %u requested, %u uploaded, %u evictions, "
+                      "%u dropped\n",
+                      virtualTextures.ResidentTiles(),
+                      virtualTextures.SlotCount(),
+                      double(virtualTextures.CacheBytes()) / MiB,
+                      vtStats.requestedTiles, vtStats.uploadedTiles,
+                      vtStats.evictions, vtStats.droppedTiles);
+        }
+      }
+      residency.ResetStats();
+      virtualTextures.ResetStats();
+      shadowTimer.ResetStats();
+      planetTimer.ResetStats();
+      skyTimer.ResetStats();
+      statSkippedShadowDraws = 0;
+      statSkippedDraws = 0;
+      statClusters = 0;
+      statCulledClusters = 0;
+      statCulledTriangles = 0;
+      statFrames = 0;
+      lastStatTime = statTime;
     }
 
+    virtualTextures.EndFrame();
     glfwSwapBuffers(state.window);
+    if (!firstFramePresented) {
+      firstFramePresented = true;
+      double ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - startTime)
+                      .count();
+      std::printf("First frame after %.1f ms (%s startup, %u textures "
+                  "still loading)\n",
+                  ms, sequentialStartup ? "sequential" : "parallel",
+                  residency.PendingCount());
+    }
   }
 }
@@ -0,0 +1,162 @@
+#include "meshCache.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    constexpr char MESH_CACHE_MAGIC[8] = {'P', 'L', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+    // All offsets are from the start of the file
+    struct MeshCacheHeader
+    {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    headerSize;
+        // Source key
+        uint64_t    sourceSize;
+        int64_t     sourceTime;
+        uint64_t    sourceHash;
+        // Vertex format and its decode parameters
+        uint32_t    format;
+        uint32_t    octNormals;
+        float       posDecode[4];
+        float       uvDecode[4];
+        // Payload
+        uint32_t    vertexCount;
+        uint32_t    indexCount;
+        uint32_t    indexStride;
+        float       surfaceError;
+        uint64_t    vertexOffset;
+        uint64_t    vertexSize;
+        uint64_t    indexOffset;
+        uint64_t    indexSize;
+        uint64_t    payloadHash;
+    };
+    static_assert(sizeof(MeshCacheHeader) == 136);
+
+    constexpr size_t AlignUp(size_t v, size_t a)
+    {
+        return (v + a - 1) / a * a;
+    }
+}
+
+std::string MeshCache::PathFor(const std::string& objPath,
+                               MeshVertexLayout::Format format)
+{
+    if(format == MeshVertexLayout::PACKED)
+        return objPath + ".packed.meshcache";
+    return objPath + ".meshcache";
+}
+
+bool MeshCache::ComputeKey(const std::string& objPath, MeshSourceKey& out)
+{
+    return ComputeSourceKey(objPath, out);
+}
+
+bool MeshCache::Write(const std::string& objPath, const MeshSourceKey& key,
+                      const MeshVertexLayout& vLayout, const MeshDecode& vDecode,
+                      float surfaceError,
+                      const std::vector<unsigned char>& vertexBlock,
+                      const std::vector<unsigned char>& indexBlock,
+                      uint32_t indexStride)
+{
+    assert(vertexBlock.size() == vLayout.totalSize);
+    assert(indexBlock.size() % (3 * indexStride) == 0);
+    size_t indexSize = indexBlock.size();
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version      = VERSION;
+    header.headerSize   = sizeof(MeshCacheHeader);
+    header.sourceSize   = key.stamp.size;
+    header.sourceTime   = key.stamp.modifiedTime;
+    header.sourceHash   = key.hash;
+    header.format       = vLayout.format;
+    header.octNormals   = vDecode.octNormals ? 1 : 0;
+    std::memcpy(header.posDecode, &vDecode.position[0], sizeof(header.posDecode));
+    std::memcpy(header.uvDecode, &vDecode.uv[0], sizeof(header.uvDecode));
+    header.vertexCount  = vLayout.vertexCount;
+    header.indexCount   = uint32_t(indexSize / indexStride);
+    header.indexStride  = indexStride;
+    header.surfaceError = surfaceError;
+    header.vertexOffset = AlignUp(sizeof(MeshCacheHeader), MeshVertexLayout::ALIGNMENT);
+    header.vertexSize   = vertexBlock.size();
+    header.indexOffset  = header.vertexOffset + vertexBlock.size();
+    header.indexSize    = indexSize;
+    header.payloadHash  = HashBytes(indexBlock.data(), indexSize,
+                                    HashBytes(vertexBlock.data(), vertexBlock.size()));
+
+    static constexpr unsigned char Padding[MeshVertexLayout::ALIGNMENT] = {};
+    return WriteFileAtomic(PathFor(objPath, vLayout.format),
+    {
+        {&header, sizeof(MeshCacheHeader)},
+        {Padding, header.vertexOffset - sizeof(MeshCacheHeader)},
+        {vertexBlock.data(), vertexBlock.size()},
+        {indexBlock.data(), indexSize}
+    });
+}
+
+bool MeshCache::Open(const std::string& objPath, const MeshSourceKey& key,
+                     MeshVertexLayout::Format format)
+{
+    std::string cachePath = PathFor(objPath, format);
+    file = MappedFile(cachePath);
+    if(!file.IsOpen()) return false;
+
+    auto Reject = [&](const char* reason)
+    {
+        std::printf("[WARNING]: Mesh cache \"%s\" is %s, "
+                    "falling back to the obj file.\n",
+                    cachePath.c_str(), reason);
+        file = MappedFile();
+        return false;
+    };
+
+    MeshCacheHeader header;
+    if(file.size < sizeof(MeshCacheHeader)) return Reject("corrupt");
+    std::memcpy(&header, file.data, sizeof(MeshCacheHeader));
+    if(std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+       header.headerSize != sizeof(MeshCacheHeader))
+        return Reject("corrupt");
+    if(header.version != VERSION)
+        return Reject("from an older version");
+    if(header.format != format)
+        return Reject("corrupt");
+
+    MeshSourceKey cachedKey;
+    cachedKey.stamp.size = header.sourceSize;
+    cachedKey.stamp.modifiedTime = header.sourceTime;
+    cachedKey.hash = header.sourceHash;
+    if(!(cachedKey == key)) return Reject("out of date");
+
+    // Payload bounds must be consistent with the counts and the file
+    MeshVertexLayout vLayout = MeshVertexLayout::For(format, header.vertexCount);
+    bool sizesOk = (header.vertexSize == vLayout.totalSize &&
+                    header.indexStride == IndexStrideFor(header.vertexCount) &&
+                    header.indexSize == uint64_t(header.indexCount) * header.indexStride &&
+                    header.indexCount % 3 == 0 &&
+                    header.vertexOffset % MeshVertexLayout::ALIGNMENT == 0 &&
+                    header.vertexOffset >= sizeof(MeshCacheHeader) &&
+                    header.indexOffset == header.vertexOffset + header.vertexSize &&
+                    header.indexOffset + header.indexSize == file.size);
+    if(!sizesOk) return Reject("corrupt");
+
+    const char* vData = file.data + header.vertexOffset;
+    const char* iData = file.data + header.indexOffset;
+    uint64_t payloadHash = HashBytes(iData, header.indexSize,
+                                     HashBytes(vData, header.vertexSize));
+    if(payloadHash != header.payloadHash) return Reject("corrupt");
+
+    layout = vLayout;
+    decode.octNormals = (header.octNormals != 0);
+    std::memcpy(&decode.position[0], header.posDecode, sizeof(header.posDecode));
+    std::memcpy(&decode.uv[0], header.uvDecode, sizeof(header.uvDecode));
+    indexCount = header.indexCount;
+    indexStride = header.indexStride;
+    surfaceError = header.surfaceError;
+    vertexData = vData;
+    indexData = iData;
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fileIO.h"
+#include "vertexFormat.h"
+
+using MeshSourceKey = SourceKey;
+
+// On-disk cache of a parsed OBJ, stored next to it as "<obj>.meshcache"
+// ("<obj>.packed.meshcache" for the PACKED vertex format).
+// It holds the deduplicated and optimized (see OptimizeMesh) vertex
+// streams, byte for byte in the MeshVertexLayout of the GPU buffer,
+// followed by the 16 or 32-bit index buffer.
+// Loading it is a memory mapping; the mapped bytes are handed directly
+// to the GL.
+//
+// A cache is invalidated when the source size, modification time or
+// content hash changes; a payload checksum catches corrupt files.
+struct MeshCache {
+  static constexpr uint32_t VERSION = 4;
+
+  MappedFile file;
+  MeshVertexLayout layout;
+  MeshDecode decode;
+  // LOD error of the mesh (see MeshSurfaceError)
+  float surfaceError = 0.0f;
+  uint32_t indexCount = 0;
+  uint32_t indexStride = 0;
+  // Pointers into the mapping
+  const void *vertexData = nullptr;
+  const void *indexData = nullptr;
+
+  static std::string PathFor(const std::string &objPath,
+                             MeshVertexLayout::Format);
+  // Returns false if the source does not exist
+  static bool ComputeKey(const std::string &objPath, MeshSourceKey &out);
+  // "vertexBlock" must be in "layout" (see BuildVertexBlock),
+  // "indexBlock" holds "indexStride" byte indices (see BuildIndexBlock).
+  // Returns false on I/O failure (the cache is simply not written)
+  static bool Write(const std::string &objPath, const MeshSourceKey &,
+                    const MeshVertexLayout &layout, const MeshDecode &decode,
+                    float surfaceError,
+                    const std::vector<unsigned char> &vertexBlock,
+                    const std::vector<unsigned char> &indexBlock,
+                    uint32_t indexStride);
+
+  // Maps and validates the cache of "objPath" in "format". Returns false
+  // if it is missing, stale or corrupt; the caller should parse the OBJ.
+  bool Open(const std::string &objPath, const MeshSourceKey &,
+            MeshVertexLayout::Format format);
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// CPU side single-indexed mesh. Vertex attributes are planar
+// (one array per attribute) which is the layout MeshGL uploads.
+struct MeshData {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<uint32_t> indices;
+
+  uint32_t VertexCount() const { return uint32_t(positions.size()); }
+};
@@ -0,0 +1,395 @@
+#include "meshOptimizer.h"
+#include "meshData.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+
+namespace
+{
+    constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+
+    // FIFO cache simulation; "stamps" holds the time each vertex
+    // entered the cache, a vertex is cached if it entered less than
+    // "size" misses ago.
+    struct FifoCache
+    {
+        std::vector<uint32_t> stamps;
+        uint32_t time;
+        uint32_t size;
+
+        FifoCache(uint32_t vertexCount, uint32_t cacheSize)
+            : stamps(vertexCount, 0)
+            , time(cacheSize + 1)
+            , size(cacheSize)
+        {}
+
+        // Empties the cache in O(1)
+        void Reset() { time += size + 1; }
+
+        bool Access(uint32_t v)
+        {
+            if(time - stamps[v] <= size) return false;
+            stamps[v] = time++;
+            return true;
+        }
+    };
+
+    // Forsyth's scoring, see
+    // https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+    constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRI_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+    float VertexScore(int32_t cachePosition, uint32_t activeTriCount)
+    {
+        // No triangle needs this vertex anymore
+        if(activeTriCount == 0) return -1.0f;
+
+        float score = 0.0f;
+        if(cachePosition < 0)
+        {
+            // Not in the cache, no score
+        }
+        else if(cachePosition < 3)
+        {
+            // Used by the last triangle, a fixed score so that the
+            // heuristic does not favor emitting the same strip backwards
+            score = LAST_TRI_SCORE;
+        }
+        else
+        {
+            float scaler = 1.0f / float(FORSYTH_CACHE_SIZE - 3);
+            score = 1.0f - float(cachePosition - 3) * scaler;
+            score = std::pow(score, CACHE_DECAY_POWER);
+        }
+        // Boost vertices with few remaining triangles so that
+        // lone triangles are finished early
+        float valenceBoost = std::pow(float(activeTriCount), -VALENCE_BOOST_POWER);
+        return score + VALENCE_BOOST_SCALE * valenceBoost;
+    }
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices,
+                                    uint32_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    if(indices.empty() || vertexCount == 0) return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    for(uint32_t v : indices)
+        stats.transformedCount += cache.Access(v) ? 1u : 0u;
+
+    stats.acmr = float(stats.transformedCount) / float(indices.size() / 3);
+    stats.atvr = float(stats.transformedCount) / float(vertexCount);
+    return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    assert(indices.size() % 3 == 0);
+    uint32_t triCount = uint32_t(indices.size() / 3);
+    if(triCount == 0) return;
+
+    // Vertex -> triangle adjacency (CSR)
+    std::vector<uint32_t> adjOffsets(vertexCount + 1, 0);
+    for(uint32_t v : indices) adjOffsets[v + 1]++;
+    for(uint32_t v = 0; v < vertexCount; v++)
+        adjOffsets[v + 1] += adjOffsets[v];
+    std::vector<uint32_t> adjTris(indices.size());
+    {
+        std::vector<uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+        for(uint32_t i = 0; i < indices.size(); i++)
+            adjTris[fill[indices[i]]++] = i / 3;
+    }
+
+    // Active triangles of a vertex are kept at the front of its
+    // adjacency range, "activeCounts" is the length of that prefix.
+    std::vector<uint32_t> activeCounts(vertexCount);
+    std::vector<float> vertexScores(vertexCount);
+    for(uint32_t v = 0; v < vertexCount; v++)
+    {
+        activeCounts[v] = adjOffsets[v + 1] - adjOffsets[v];
+        vertexScores[v] = VertexScore(-1, activeCounts[v]);
+    }
+
+    std::vector<float> triScores(triCount);
+    std::vector<bool> emitted(triCount, false);
+    for(uint32_t t = 0; t < triCount; t++)
+    {
+        triScores[t] = (vertexScores[indices[t * 3 + 0]] +
+                        vertexScores[indices[t * 3 + 1]] +
+                        vertexScores[indices[t * 3 + 2]]);
+    }
+
+    // LRU cache, three extra slots hold the vertices pushed out
+    // by the last triangle so their scores are updated too
+    std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> cache;
+    uint32_t cacheCount = 0;
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    uint32_t bestTri = 0;
+    uint32_t scanCursor = 0;
+    for(uint32_t emittedCount = 0; emittedCount < triCount; emittedCount++)
+    {
+        // Nothing in the cache touches a remaining triangle, pick the
+        // next one in input order (keeps the search linear overall)
+        if(bestTri == INVALID)
+        {
+            while(emitted[scanCursor]) scanCursor++;
+            bestTri = scanCursor;
+        }
+
+        const uint32_t* tri = indices.data() + bestTri * 3;
+        result.insert(result.end(), tri, tri + 3);
+        emitted[bestTri] = true;
+
+        // Remove the triangle from the active lists of its vertices
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t v = tri[k];
+            uint32_t* adj = adjTris.data() + adjOffsets[v];
+            uint32_t count = activeCounts[v];
+            uint32_t* it = std::find(adj, adj + count, bestTri);
+            assert(it != adj + count);
+            std::swap(*it, adj[count - 1]);
+            activeCounts[v]--;
+        }
+
+        // Push the vertices to the front of the LRU cache
+        std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> newCache;
+        uint32_t newCount = 0;
+        for(uint32_t k = 0; k < 3; k++) newCache[newCount++] = tri[k];
+        for(uint32_t i = 0; i < cacheCount; i++)
+        {
+            uint32_t v = cache[i];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+
+        // Re-score the cached vertices and their remaining triangles
+        for(uint32_t i = 0; i < newCount; i++)
+        {
+            uint32_t v = newCache[i];
+            int32_t position = (i < FORSYTH_CACHE_SIZE) ? int32_t(i) : -1;
+            float newScore = VertexScore(position, activeCounts[v]);
+            float delta = newScore - vertexScores[v];
+            vertexScores[v] = newScore;
+
+            const uint32_t* adj = adjTris.data() + adjOffsets[v];
+            for(uint32_t j = 0; j < activeCounts[v]; j++)
+                triScores[adj[j]] += delta;
+        }
+        // Best of those is the next candidate
+        float bestScore = -1.0f;
+        bestTri = INVALID;
+        for(uint32_t i = 0; i < newCount; i++)
+        {
+            uint32_t v = newCache[i];
+            const uint32_t* adj = adjTris.data() + adjOffsets[v];
+            for(uint32_t j = 0; j < activeCounts[v]; j++)
+            {
+                if(triScores[adj[j]] > bestScore)
+                {
+                    bestScore = triScores[adj[j]];
+                    bestTri = adj[j];
+                }
+            }
+        }
+        cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+        std::copy_n(newCache.begin(), cacheCount, cache.begin());
+    }
+    indices = std::move(result);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices,
+                      const std::vector<glm::vec3>& positions,
+                      float threshold)
+{
+    assert(indices.size() % 3 == 0);
+    uint32_t triCount = uint32_t(indices.size() / 3);
+    uint32_t vertexCount = uint32_t(positions.size());
+    if(triCount == 0) return;
+
+    // Hard boundaries: triangles whose vertices all miss the cache,
+    // the optimizer restarted there so splitting costs nothing
+    std::vector<uint32_t> hardStarts = {0};
+    {
+        FifoCache cache(vertexCount, VertexCacheStats::FIFO_SIZE);
+        for(uint32_t t = 0; t < triCount; t++)
+        {
+            uint32_t misses = 0;
+            for(uint32_t k = 0; k < 3; k++)
+                misses += cache.Access(indices[t * 3 + k]) ? 1u : 0u;
+            if(t != 0 && misses == 3) hardStarts.push_back(t);
+        }
+    }
+    hardStarts.push_back(triCount);
+
+    // Soft boundaries: split a hard cluster wherever its running ACMR
+    // (from a cold cache) is within the threshold of the full cluster
+    std::vector<uint32_t> clusterStarts;
+    FifoCache cache(vertexCount, VertexCacheStats::FIFO_SIZE);
+    auto TriangleMisses = [&](uint32_t t)
+    {
+        uint32_t misses = 0;
+        for(uint32_t k = 0; k < 3; k++)
+            misses += cache.Access(indices[t * 3 + k]) ? 1u : 0u;
+        return misses;
+    };
+    for(size_t c = 0; c + 1 < hardStarts.size(); c++)
+    {
+        uint32_t start = hardStarts[c];
+        uint32_t end = hardStarts[c + 1];
+
+        cache.Reset();
+        uint32_t clusterMisses = 0;
+        for(uint32_t t = start; t < end; t++) clusterMisses += TriangleMisses(t);
+        float clusterAcmr = float(clusterMisses) / float(end - start);
+
+        cache.Reset();
+        clusterStarts.push_back(start);
+        uint32_t runStart = start;
+        uint32_t runMisses = 0;
+        for(uint32_t t = start; t < end; t++)
+        {
+            runMisses += TriangleMisses(t);
+            float runAcmr = float(runMisses) / float(t + 1 - runStart);
+            if(t + 1 < end && runAcmr <= clusterAcmr * threshold)
+            {
+                clusterStarts.push_back(t + 1);
+                runStart = t + 1;
+                runMisses = 0;
+                cache.Reset();
+            }
+        }
+    }
+    clusterStarts.push_back(triCount);
+    uint32_t clusterCount = uint32_t(clusterStarts.size() - 1);
+
+    // Sort key: how much a cluster faces away from the mesh center,
+    // those are likely in front and occlude the others
+    glm::vec3 meshCenter(0.0f);
+    for(const glm::vec3& p : positions) meshCenter += p;
+    if(vertexCount != 0) meshCenter /= float(vertexCount);
+
+    std::vector<float> sortKeys(clusterCount);
+    for(uint32_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for(uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const glm::vec3& p0 = positions[indices[t * 3 + 0]];
+            const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+            // Length of the cross product is twice the area
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        float normalLength = glm::length(normal);
+        if(area == 0.0f || normalLength == 0.0f)
+        {
+            sortKeys[c] = 0.0f;
+            continue;
+        }
+        centroid /= area;
+        normal /= normalLength;
+        sortKeys[c] = glm::dot(centroid - meshCenter, normal);
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for(uint32_t c : order)
+    {
+        result.insert(result.end(),
+                      indices.begin() + clusterStarts[c] * 3,
+                      indices.begin() + clusterStarts[c + 1] * 3);
+    }
+    indices = std::move(result);
+}
+
+void OptimizeVertexFetch(MeshData& mesh)
+{
+    std::vector<uint32_t> remap(mesh.VertexCount(), INVALID);
+    uint32_t newCount = 0;
+    for(uint32_t& v : mesh.indices)
+    {
+        if(remap[v] == INVALID) remap[v] = newCount++;
+        v = remap[v];
+    }
+
+    auto Reorder = [&](auto& stream)
+    {
+        std::remove_reference_t<decltype(stream)> result(newCount);
+        for(uint32_t v = 0; v < remap.size(); v++)
+            if(remap[v] != INVALID) result[remap[v]] = stream[v];
+        stream = std::move(result);
+    };
+    Reorder(mesh.positions);
+    Reorder(mesh.normals);
+    Reorder(mesh.uvs);
+}
+
+float MeshSurfaceError(const MeshData& mesh)
+{
+    if(mesh.VertexCount() == 0) return 0.0f;
+
+    glm::vec3 center(0.0f);
+    for(const glm::vec3& p : mesh.positions) center += p;
+    center /= float(mesh.VertexCount());
+
+    float radius = 0.0f;
+    for(const glm::vec3& p : mesh.positions) radius += glm::distance(p, center);
+    radius /= float(mesh.VertexCount());
+
+    float error = 0.0f;
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        glm::vec3 centroid = (mesh.positions[mesh.indices[i + 0]] +
+                              mesh.positions[mesh.indices[i + 1]] +
+                              mesh.positions[mesh.indices[i + 2]]) / 3.0f;
+        error = std::max(error, std::abs(glm::distance(centroid, center) - radius));
+    }
+    return error;
+}
+
+void OptimizeMesh(MeshData& mesh, const char* name)
+{
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    VertexCacheStats before = AnalyzeVertexCache(mesh.indices, mesh.VertexCount());
+
+    OptimizeVertexCache(mesh.indices, mesh.VertexCount());
+    OptimizeOverdraw(mesh.indices, mesh.positions);
+    OptimizeVertexFetch(mesh);
+
+    VertexCacheStats after = AnalyzeVertexCache(mesh.indices, mesh.VertexCount());
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::printf("Mesh \"%s\" is optimized in %.2f ms. "
+                "ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (FIFO %u)\n",
+                name, ms, double(before.acmr), double(after.acmr),
+                double(before.atvr), double(after.atvr),
+                VertexCacheStats::FIFO_SIZE);
+}
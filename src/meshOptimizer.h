@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct MeshData;
+
+// Post-transform vertex cache efficiency of an index buffer, measured
+// with a FIFO cache simulation.
+// ACMR: transformed vertices per triangle (0.5 is the ideal for
+//       large regular meshes, 3 is no reuse at all)
+// ATVR: transformed vertices per unique vertex (1 is ideal)
+struct VertexCacheStats {
+  static constexpr uint32_t FIFO_SIZE = 16;
+
+  uint32_t transformedCount = 0;
+  float acmr = 0.0f;
+  float atvr = 0.0f;
+};
+
+VertexCacheStats
+AnalyzeVertexCache(const std::vector<uint32_t> &indices, uint32_t vertexCount,
+                   uint32_t cacheSize = VertexCacheStats::FIFO_SIZE);
+
+// Reorders triangles for post-transform vertex cache reuse
+// (Forsyth, "Linear-Speed Vertex Cache Optimisation").
+void OptimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount);
+
+// Reorders the clusters of a cache optimized index buffer so that
+// outward facing clusters are drawn first, which lowers overdraw
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw"). Clusters are split where the cache simulation
+// restarts and further where the cluster ACMR stays within
+// "threshold" times its final value, so vertex cache efficiency
+// degrades at most by that factor.
+void OptimizeOverdraw(std::vector<uint32_t> &indices,
+                      const std::vector<glm::vec3> &positions,
+                      float threshold = 1.05f);
+
+// Renumbers vertices in the order the index buffer first uses them
+// and reorders the attribute streams accordingly, so vertex fetch
+// walks the buffers linearly. Unreferenced vertices are dropped.
+void OptimizeVertexFetch(MeshData &mesh);
+
+// Estimated object space distance between the triangles and the smooth
+// surface their vertices sample, used as the LOD error of the mesh:
+// the largest deviation of a triangle centroid from the mean vertex
+// radius around the vertex centroid. This is exact (the sagitta) for
+// tessellated spheres and a coarse estimate for other closed shapes.
+float MeshSurfaceError(const MeshData &mesh);
+
+// Runs the three optimizations above and prints ACMR/ATVR before and after.
+// "name" is only used for diagnostics.
+void OptimizeMesh(MeshData &mesh, const char *name);
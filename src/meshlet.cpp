@@ -0,0 +1,127 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+    void ComputeBounds(Meshlet& m, const uint32_t* indices,
+                       const glm::vec3* positions)
+    {
+        const uint32_t* tri = indices + m.firstIndex;
+        uint32_t cornerCount = m.triangleCount * 3;
+
+        // Sphere around the box center, tight enough for culling
+        glm::vec3 pMin = positions[tri[0]];
+        glm::vec3 pMax = pMin;
+        for(uint32_t i = 1; i < cornerCount; i++)
+        {
+            pMin = glm::min(pMin, positions[tri[i]]);
+            pMax = glm::max(pMax, positions[tri[i]]);
+        }
+        m.center = (pMin + pMax) * 0.5f;
+        float radiusSqr = 0.0f;
+        for(uint32_t i = 0; i < cornerCount; i++)
+        {
+            glm::vec3 d = positions[tri[i]] - m.center;
+            radiusSqr = std::max(radiusSqr, glm::dot(d, d));
+        }
+        m.radius = std::sqrt(radiusSqr);
+
+        // Cone around the mean of the unit face normals
+        std::vector<glm::vec3> normals;
+        normals.reserve(m.triangleCount);
+        glm::vec3 axis(0.0f);
+        for(uint32_t t = 0; t < cornerCount; t += 3)
+        {
+            const glm::vec3& a = positions[tri[t + 0]];
+            const glm::vec3& b = positions[tri[t + 1]];
+            const glm::vec3& c = positions[tri[t + 2]];
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float len = glm::length(n);
+            // Degenerate triangles are never rasterized
+            if(len == 0.0f) continue;
+            normals.push_back(n / len);
+            axis += normals.back();
+        }
+        float axisLen = glm::length(axis);
+        if(axisLen == 0.0f)
+        {
+            m.coneCos = 0.0f;
+            m.coneSin = 1.0f;
+            return;
+        }
+        m.coneAxis = axis / axisLen;
+        float minCos = 1.0f;
+        for(const glm::vec3& n : normals)
+            minCos = std::min(minCos, glm::dot(n, m.coneAxis));
+        m.coneCos = std::max(minCos, 0.0f);
+        m.coneSin = std::sqrt(1.0f - m.coneCos * m.coneCos);
+    }
+}
+
+bool Meshlet::IsBackfacing(const glm::vec3& eye) const
+{
+    if(coneCos <= 0.0f) return false;
+    // A triangle at p with normal n faces away if dot(p - eye, n) >= 0.
+    // Over the sphere and the cone, the smallest value is
+    // |v| * cos(phi + theta) - radius, where v = center - eye,
+    // phi = angle(v, axis) and theta is the cone half angle.
+    glm::vec3 v = center - eye;
+    float vDotAxis = glm::dot(v, coneAxis);
+    if(vDotAxis <= 0.0f) return false;
+    float vPerp = std::sqrt(std::max(glm::dot(v, v) - vDotAxis * vDotAxis, 0.0f));
+    return vDotAxis * coneCos - vPerp * coneSin >= radius;
+}
+
+std::vector<Meshlet> BuildMeshlets(const uint32_t* indices, size_t indexCount,
+                                   const glm::vec3* positions,
+                                   uint32_t maxVertices, uint32_t maxTriangles)
+{
+    assert(indexCount % 3 == 0);
+    assert(maxVertices >= 3 && maxTriangles >= 1);
+    uint32_t vertexEnd = 0;
+    for(size_t i = 0; i < indexCount; i++)
+        vertexEnd = std::max(vertexEnd, indices[i] + 1);
+
+    // Meshlet that used a vertex last, plus one (zero: none)
+    std::vector<uint32_t> lastUser(vertexEnd, 0);
+    std::vector<Meshlet> meshlets;
+    Meshlet current;
+    uint32_t vertexCount = 0;
+    auto Finish = [&]()
+    {
+        if(current.triangleCount == 0) return;
+        ComputeBounds(current, indices, positions);
+        meshlets.push_back(current);
+        current = Meshlet();
+        vertexCount = 0;
+    };
+
+    for(size_t t = 0; t < indexCount; t += 3)
+    {
+        const uint32_t* tri = indices + t;
+        uint32_t stamp = uint32_t(meshlets.size()) + 1;
+        uint32_t newCount = 0;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            bool repeated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+            newCount += (lastUser[tri[k]] != stamp && !repeated) ? 1u : 0u;
+        }
+        if(vertexCount + newCount > maxVertices ||
+           current.triangleCount + 1 > maxTriangles)
+        {
+            Finish();
+            stamp = uint32_t(meshlets.size()) + 1;
+            newCount = 3;
+        }
+        if(current.triangleCount == 0) current.firstIndex = uint32_t(t);
+        for(uint32_t k = 0; k < 3; k++)
+            lastUser[tri[k]] = stamp;
+        vertexCount += newCount;
+        current.triangleCount++;
+    }
+    Finish();
+    return meshlets;
+}
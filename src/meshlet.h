@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Cluster of neighbouring triangles of an index buffer. Meshlets are
+// consecutive ranges of the index buffer, so a meshlet is drawn as a
+// plain sub-range and neighbouring visible meshlets merge into one draw.
+struct Meshlet {
+  static constexpr uint32_t MAX_VERTICES = 64;
+  static constexpr uint32_t MAX_TRIANGLES = 124;
+
+  // Index range, relative to the buffer given to "BuildMeshlets"
+  uint32_t firstIndex = 0;
+  uint32_t triangleCount = 0;
+  // Bounding sphere
+  glm::vec3 center = glm::vec3(0.0f);
+  float radius = 0.0f;
+  // Normal cone, every triangle normal is within the half angle around
+  // "coneAxis". Cones of 90 degrees or wider store a zero cosine and are
+  // never backfacing.
+  glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+  float coneCos = 0.0f;
+  float coneSin = 1.0f;
+
+  // True if every triangle faces away from "eye" (counter clockwise
+  // triangles are front facing), in the space of the meshlet
+  bool IsBackfacing(const glm::vec3 &eye) const;
+};
+
+// Splits the triangles of "indices" (in their order) into meshlets of at
+// most "maxVertices" unique vertices and "maxTriangles" triangles.
+// Index buffers that are ordered for vertex cache reuse give compact
+// meshlets.
+std::vector<Meshlet>
+BuildMeshlets(const uint32_t *indices, size_t indexCount,
+              const glm::vec3 *positions,
+              uint32_t maxVertices = Meshlet::MAX_VERTICES,
+              uint32_t maxTriangles = Meshlet::MAX_TRIANGLES);
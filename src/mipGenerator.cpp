@@ -0,0 +1,352 @@
+#include "mipGenerator.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+namespace
+{
+    // Linear values encoded back to 8-bit sRGB through a table, fine
+    // enough that every step is below one code
+    constexpr uint32_t ENCODE_STEPS = 4096;
+
+    float SrgbToLinear(float v)
+    {
+        return (v <= 0.04045f) ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float LinearToSrgb(float v)
+    {
+        return (v <= 0.0031308f) ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+    }
+
+    const std::vector<float>& SrgbDecodeTable(uint32_t bytesPerChannel)
+    {
+        static const std::vector<float> tables[2] =
+        {
+            [](){ std::vector<float> t(256);
+                  for(size_t i = 0; i < t.size(); i++)
+                      t[i] = SrgbToLinear(float(i) / 255.0f);
+                  return t; }(),
+            [](){ std::vector<float> t(65536);
+                  for(size_t i = 0; i < t.size(); i++)
+                      t[i] = SrgbToLinear(float(i) / 65535.0f);
+                  return t; }()
+        };
+        return tables[bytesPerChannel - 1];
+    }
+
+    const std::array<uint8_t, ENCODE_STEPS>& SrgbEncodeTable()
+    {
+        static const std::array<uint8_t, ENCODE_STEPS> table = []()
+        {
+            std::array<uint8_t, ENCODE_STEPS> t;
+            for(uint32_t i = 0; i < ENCODE_STEPS; i++)
+            {
+                float v = LinearToSrgb(float(i) / float(ENCODE_STEPS - 1));
+                t[i] = static_cast<uint8_t>(v * 255.0f + 0.5f);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    // Texel layout and filter of a chain
+    struct Format
+    {
+        uint32_t channelCount;
+        uint32_t bytesPerChannel;
+        // Channels [0, colorCount) are weighted by alpha / sRGB
+        uint32_t colorCount;
+        bool srgb;
+        bool alpha;
+        float maxValue;
+        const float* decodeTable;
+
+        uint32_t Channel(const unsigned char* texels, size_t i) const
+        {
+            if(bytesPerChannel == 1) return texels[i];
+            uint16_t v;
+            std::memcpy(&v, texels + i * 2, sizeof(uint16_t));
+            return v;
+        }
+
+        void SetChannel(unsigned char* texels, size_t i, uint32_t v) const
+        {
+            if(bytesPerChannel == 1)
+                texels[i] = static_cast<unsigned char>(v);
+            else
+            {
+                uint16_t v16 = static_cast<uint16_t>(v);
+                std::memcpy(texels + i * 2, &v16, sizeof(uint16_t));
+            }
+        }
+    };
+
+    // Linear floats of "count" texels of a row (texel "x" is texel
+    // "min(x, width - 1)"), colors premultiplied by alpha
+    void DecodeRow(const unsigned char* row, uint32_t width, uint32_t count,
+                   const Format& f, float* out)
+    {
+        float scale = 1.0f / f.maxValue;
+        uint32_t c = f.channelCount;
+        for(uint32_t x = 0; x < count; x++)
+        {
+            size_t src = size_t(std::min(x, width - 1)) * c;
+            float* texel = out + size_t(x) * c;
+            for(uint32_t i = 0; i < c; i++)
+            {
+                uint32_t v = f.Channel(row, src + i);
+                texel[i] = (f.srgb && i < f.colorCount) ? f.decodeTable[v] : float(v) * scale;
+            }
+            if(f.alpha)
+                for(uint32_t i = 0; i < f.colorCount; i++)
+                    texel[i] *= texel[c - 1];
+        }
+    }
+
+    // out[i] = a[i] + b[i]
+    void AddRows(const float* a, const float* b, size_t count, float* out)
+    {
+        size_t i = 0;
+#ifdef MIP_GENERATOR_SSE2
+        for(; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif
+        for(; i < count; i++)
+            out[i] = a[i] + b[i];
+    }
+
+    // Texel "x" of "out" is the average of texels "2x" and "2x + 1" of
+    // "in" (already the sum of two rows)
+    void AddPairs(const float* in, uint32_t count, uint32_t channelCount, float* out)
+    {
+        uint32_t x = 0;
+#ifdef MIP_GENERATOR_SSE2
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        if(channelCount == 4)
+        {
+            for(; x < count; x++)
+            {
+                __m128 a = _mm_loadu_ps(in + size_t(x) * 8);
+                __m128 b = _mm_loadu_ps(in + size_t(x) * 8 + 4);
+                _mm_storeu_ps(out + size_t(x) * 4, _mm_mul_ps(_mm_add_ps(a, b), quarter));
+            }
+        }
+        else if(channelCount == 2)
+        {
+            for(; x + 2 <= count; x += 2)
+            {
+                __m128 a = _mm_loadu_ps(in + size_t(x) * 4);
+                __m128 b = _mm_loadu_ps(in + size_t(x) * 4 + 4);
+                __m128 first = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 1, 0));
+                __m128 second = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 2, 3, 2));
+                _mm_storeu_ps(out + size_t(x) * 2, _mm_mul_ps(_mm_add_ps(first, second), quarter));
+            }
+        }
+        else if(channelCount == 1)
+        {
+            for(; x + 4 <= count; x += 4)
+            {
+                __m128 a = _mm_loadu_ps(in + size_t(x) * 2);
+                __m128 b = _mm_loadu_ps(in + size_t(x) * 2 + 4);
+                __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+                _mm_storeu_ps(out + x, _mm_mul_ps(_mm_add_ps(even, odd), quarter));
+            }
+        }
+#endif
+        for(; x < count; x++)
+            for(uint32_t c = 0; c < channelCount; c++)
+                out[size_t(x) * channelCount + c] =
+                    0.25f * (in[size_t(x) * 2 * channelCount + c] +
+                             in[(size_t(x) * 2 + 1) * channelCount + c]);
+    }
+
+    // Writes "count" filtered texels back in the layout of the chain
+    void EncodeRow(float* texels, uint32_t count, const Format& f, unsigned char* row)
+    {
+        const std::array<uint8_t, ENCODE_STEPS>& encode = SrgbEncodeTable();
+        uint32_t c = f.channelCount;
+        for(uint32_t x = 0; x < count; x++)
+        {
+            float* texel = texels + size_t(x) * c;
+            if(f.alpha && texel[c - 1] > 0.0f)
+                for(uint32_t i = 0; i < f.colorCount; i++)
+                    texel[i] /= texel[c - 1];
+            for(uint32_t i = 0; i < c; i++)
+            {
+                float v = std::clamp(texel[i], 0.0f, 1.0f);
+                uint32_t encoded;
+                if(!f.srgb || i >= f.colorCount)
+                    encoded = uint32_t(v * f.maxValue + 0.5f);
+                else if(f.bytesPerChannel == 1)
+                    encoded = encode[uint32_t(v * float(ENCODE_STEPS - 1) + 0.5f)];
+                else
+                    encoded = uint32_t(LinearToSrgb(v) * f.maxValue + 0.5f);
+                f.SetChannel(row, size_t(x) * c + i, encoded);
+            }
+        }
+    }
+
+    void Downsample(const unsigned char* src, uint32_t w, uint32_t h,
+                    const Format& f, unsigned char* dst)
+    {
+        uint32_t dw = std::max(w / 2, 1u);
+        uint32_t dh = std::max(h / 2, 1u);
+        size_t texelSize = size_t(f.channelCount) * f.bytesPerChannel;
+        size_t srcPitch = size_t(w) * texelSize;
+        size_t dstPitch = size_t(dw) * texelSize;
+        // Texels of a source row, pairs for every destination texel
+        uint32_t pairTexels = dw * 2;
+        size_t rowFloats = size_t(pairTexels) * f.channelCount;
+        // Rows in bands, so the jobs are not too small
+        static constexpr uint32_t BAND = 16;
+        ThreadPool::Global().ParallelFor((dh + BAND - 1) / BAND, [&](uint32_t band)
+        {
+            std::vector<float> row0(rowFloats), row1(rowFloats);
+            std::vector<float> out(size_t(dw) * f.channelCount);
+            uint32_t yEnd = std::min(dh, (band + 1) * BAND);
+            for(uint32_t y = band * BAND; y < yEnd; y++)
+            {
+                DecodeRow(src + size_t(std::min(y * 2, h - 1)) * srcPitch, w, pairTexels,
+                          f, row0.data());
+                DecodeRow(src + size_t(std::min(y * 2 + 1, h - 1)) * srcPitch, w, pairTexels,
+                          f, row1.data());
+                AddRows(row0.data(), row1.data(), rowFloats, row0.data());
+                AddPairs(row0.data(), dw, f.channelCount, out.data());
+                EncodeRow(out.data(), dw, f, dst + size_t(y) * dstPitch);
+            }
+        });
+    }
+
+    // Alpha values of a level, alpha is the last channel
+    std::vector<uint32_t> AlphaHistogram(const unsigned char* texels, size_t texelCount,
+                                         const Format& f)
+    {
+        std::vector<uint32_t> histogram(size_t(f.maxValue) + 1, 0);
+        for(size_t i = 0; i < texelCount; i++)
+            histogram[f.Channel(texels, i * f.channelCount + f.channelCount - 1)]++;
+        return histogram;
+    }
+
+    // Fraction of texels whose alpha times "scale" is above "cutoff"
+    // (in channel units)
+    float Coverage(const std::vector<uint32_t>& histogram, size_t texelCount,
+                   float cutoff, float scale)
+    {
+        size_t first = size_t(std::floor(cutoff / scale)) + 1;
+        size_t covered = 0;
+        for(size_t v = first; v < histogram.size(); v++)
+            covered += histogram[v];
+        return float(covered) / float(texelCount);
+    }
+
+    // Scales the alpha of a level so that "coverage" of it is above
+    // "cutoff", as in level 0
+    void KeepCoverage(unsigned char* texels, size_t texelCount, const Format& f,
+                      float cutoff, float coverage)
+    {
+        std::vector<uint32_t> histogram = AlphaHistogram(texels, texelCount, f);
+        float low = 0.0f, high = 16.0f;
+        for(uint32_t i = 0; i < 24; i++)
+        {
+            float mid = 0.5f * (low + high);
+            if(Coverage(histogram, texelCount, cutoff, mid) < coverage) low = mid;
+            else high = mid;
+        }
+        float scale = high;
+        size_t alpha = f.channelCount - 1;
+        for(size_t i = 0; i < texelCount; i++)
+        {
+            float v = float(f.Channel(texels, i * f.channelCount + alpha)) * scale;
+            f.SetChannel(texels, i * f.channelCount + alpha,
+                         uint32_t(std::min(v + 0.5f, f.maxValue)));
+        }
+    }
+}
+
+MipFilter MipFilter::For(uint32_t channelCount)
+{
+    MipFilter f;
+    f.srgb = (channelCount >= 3);
+    f.alpha = (channelCount == 4);
+    f.alphaCutoff = (channelCount == 4) ? 0.5f : 0.0f;
+    return f;
+}
+
+uint32_t MipCountFor(uint32_t width, uint32_t height)
+{
+    return uint32_t(std::bit_width(std::max({width, height, 1u})));
+}
+
+MipChain GenerateMips(const void* pixels, uint32_t width, uint32_t height,
+                      uint32_t channelCount, uint32_t bytesPerChannel,
+                      const MipFilter& filter)
+{
+    MipChain chain;
+    chain.channelCount = channelCount;
+    chain.bytesPerChannel = bytesPerChannel;
+    size_t texelSize = size_t(channelCount) * bytesPerChannel;
+    size_t total = 0;
+    for(uint32_t i = 1; i < MipCountFor(width, height); i++)
+    {
+        MipLevel l;
+        l.width = std::max(width >> i, 1u);
+        l.height = std::max(height >> i, 1u);
+        l.offset = total;
+        l.size = size_t(l.width) * l.height * texelSize;
+        total += l.size;
+        chain.levels.push_back(l);
+    }
+    chain.data.resize(total);
+
+    Format f;
+    f.channelCount = channelCount;
+    f.bytesPerChannel = bytesPerChannel;
+    f.alpha = filter.alpha && (channelCount == 2 || channelCount == 4);
+    f.colorCount = f.alpha ? channelCount - 1 : channelCount;
+    f.srgb = filter.srgb;
+    f.maxValue = (bytesPerChannel == 1) ? 255.0f : 65535.0f;
+    f.decodeTable = filter.srgb ? SrgbDecodeTable(bytesPerChannel).data() : nullptr;
+
+    const unsigned char* src = static_cast<const unsigned char*>(pixels);
+    bool keepCoverage = (channelCount == 2 || channelCount == 4) && filter.alphaCutoff > 0.0f;
+    float cutoff = filter.alphaCutoff * f.maxValue;
+    float coverage = 0.0f;
+    if(keepCoverage)
+    {
+        size_t texelCount = size_t(width) * height;
+        coverage = Coverage(AlphaHistogram(src, texelCount, f), texelCount, cutoff, 1.0f);
+        // Nothing or everything passes at any scale
+        keepCoverage = (coverage > 0.0f && coverage < 1.0f);
+    }
+
+    uint32_t w = width, h = height;
+    for(const MipLevel& l : chain.levels)
+    {
+        unsigned char* dst = chain.data.data() + l.offset;
+        Downsample(src, w, h, f, dst);
+        if(keepCoverage)
+            KeepCoverage(dst, size_t(l.width) * l.height, f, cutoff, coverage);
+        src = dst;
+        w = l.width;
+        h = l.height;
+    }
+    return chain;
+}
+
+MipChain GenerateMips(const unsigned char* pixels, uint32_t width,
+                      uint32_t height, uint32_t channelCount)
+{
+    return GenerateMips(pixels, width, height, channelCount, 1,
+                        MipFilter::For(channelCount));
+}
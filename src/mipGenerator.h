@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Level of an image stored in a byte array with other levels
+struct MipLevel {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  size_t offset = 0;
+  size_t size = 0;
+};
+
+// Mips of an image below its level 0, down to 1x1. Level sizes follow
+// the GL ("max(1, size >> level)"), "data" holds the levels back to
+// back (level 1 first) in the texel layout of level 0.
+struct MipChain {
+  uint32_t channelCount = 0;
+  uint32_t bytesPerChannel = 1;
+  std::vector<MipLevel> levels;
+  std::vector<unsigned char> data;
+
+  const unsigned char *Pixels(size_t i) const {
+    return data.data() + levels[i].offset;
+  }
+};
+
+// How the texels of a level are averaged
+struct MipFilter {
+  // Channels other than alpha hold sRGB encoded values, they are
+  // averaged in linear space and encoded back
+  bool srgb = false;
+  // The last channel (of 2 and 4 channel images) is alpha, the other
+  // channels are averaged weighted by it so transparent texels do not
+  // bleed their color
+  bool alpha = false;
+  // The last channel of 2 and 4 channel images (weighted or not) is
+  // rescaled in every level to keep the fraction of texels above
+  // "alphaCutoff" (0 to 1) in level 0, so alpha tested / thresholded
+  // maps do not thin out with distance. 0 disables.
+  float alphaCutoff = 0.0f;
+
+  // Filter of the renderer: 3 and 4 channel images are sRGB colors, the
+  // alpha of 4 channel images keeps its coverage at 0.5; 1 and 2 channel
+  // images are data
+  static MipFilter For(uint32_t channelCount);
+};
+
+// Number of levels of a full chain of a "width" x "height" image
+uint32_t MipCountFor(uint32_t width, uint32_t height);
+
+// 2x2 box filtered mips of a tightly packed image with 1 to 4 channels of
+// 8 or 16 bits ("bytesPerChannel" 1 or 2). Sizes halve rounding down like
+// GL levels, so odd sizes drop their last row / column and a size of 1
+// repeats its only row / column. Texels are filtered as floats (SSE2
+// where available) in bands of rows on the global thread pool.
+MipChain GenerateMips(const void *pixels, uint32_t width, uint32_t height,
+                      uint32_t channelCount, uint32_t bytesPerChannel,
+                      const MipFilter &);
+// 8-bit image with the filter of the renderer (see MipFilter::For)
+MipChain GenerateMips(const unsigned char *pixels, uint32_t width,
+                      uint32_t height, uint32_t channelCount);
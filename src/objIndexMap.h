@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// For mesh multiple index hashing
+struct ObjKeyType {
+  uint32_t posIndex;
+  uint32_t uvIndex;
+  uint32_t normalIndex;
+
+  auto operator<=>(const ObjKeyType &) const = default;
+};
+
+// OBJ indices are highly structured (runs of consecutive integers, often
+// the same value in all three slots), so a linear combination of the
+// indices collides a lot. Fold the key to 64-bit and run it through the
+// MurmurHash3 finalizer so that every input bit affects the low bits.
+struct ObjKeyHash {
+  uint64_t operator()(const ObjKeyType &k) const {
+    uint64_t h = (uint64_t(k.posIndex) | (uint64_t(k.uvIndex) << 32));
+    h ^= uint64_t(k.normalIndex) * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+  }
+};
+
+// Open-addressing (linear probing) map from ObjKeyType to "Value".
+// Slots are stored inline in a single array, so a lookup is usually a
+// single cache line. Keys with "posIndex == EMPTY" can not be inserted
+// (an OBJ face vertex always has a position).
+//
+// Capacity is a power of two and is doubled once the load factor
+// exceeds 3/4. Size it up front with "Reserve" when the element count
+// can be estimated.
+template <class Value, class Allocator = std::allocator<Value>>
+class ObjIndexMap {
+public:
+  static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+  struct Slot {
+    ObjKeyType key;
+    Value value;
+  };
+  using SlotAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+
+  ObjIndexMap() = default;
+  explicit ObjIndexMap(size_t expectedCount) { Reserve(expectedCount); }
+  explicit ObjIndexMap(const Allocator &alloc) : slots(SlotAllocator(alloc)) {}
+
+  // Makes room for "count" elements without rehashing
+  void Reserve(size_t count);
+
+  // Inserts (key, value) if key is not present. Returns the value
+  // stored for the key and whether the insertion happened.
+  std::pair<Value, bool> Emplace(const ObjKeyType &key, const Value &value);
+
+  // Removes every element, the capacity is kept
+  void Clear();
+
+  size_t Size() const { return count; }
+  size_t Capacity() const { return slots.size(); }
+  size_t MemoryUsage() const { return slots.capacity() * sizeof(Slot); }
+
+private:
+  std::vector<Slot, SlotAllocator> slots;
+  size_t count = 0;
+  uint64_t mask = 0;
+
+  void Rehash(size_t newCapacity);
+};
+
+// Template Definitions
+template <class Value, class Allocator>
+void ObjIndexMap<Value, Allocator>::Reserve(size_t newCount) {
+  // Keep the load factor at or below 3/4
+  size_t needed = std::bit_ceil(std::max<size_t>(16, newCount + newCount / 3 + 1));
+  if (needed > slots.size())
+    Rehash(needed);
+}
+
+template <class Value, class Allocator>
+void ObjIndexMap<Value, Allocator>::Rehash(size_t newCapacity) {
+  assert(std::has_single_bit(newCapacity));
+  std::vector<Slot, SlotAllocator> oldSlots = std::move(slots);
+  slots.assign(newCapacity, Slot{{EMPTY, EMPTY, EMPTY}, Value{}});
+  mask = newCapacity - 1;
+
+  ObjKeyHash hasher;
+  for (const Slot &s : oldSlots) {
+    if (s.key.posIndex == EMPTY)
+      continue;
+    uint64_t i = hasher(s.key) & mask;
+    while (slots[i].key.posIndex != EMPTY)
+      i = (i + 1) & mask;
+    slots[i] = s;
+  }
+}
+
+template <class Value, class Allocator>
+void ObjIndexMap<Value, Allocator>::Clear() {
+  std::fill(slots.begin(), slots.end(), Slot{{EMPTY, EMPTY, EMPTY}, Value{}});
+  count = 0;
+}
+
+template <class Value, class Allocator>
+std::pair<Value, bool>
+ObjIndexMap<Value, Allocator>::Emplace(const ObjKeyType &key,
+                                       const Value &value) {
+  assert(key.posIndex != EMPTY);
+  if ((count + 1) * 4 > slots.size() * 3)
+    Rehash(std::max<size_t>(16, slots.size() * 2));
+
+  uint64_t i = ObjKeyHash()(key) & mask;
+  for (;; i = (i + 1) & mask) {
+    Slot &s = slots[i];
+    if (s.key.posIndex == EMPTY) {
+      s.key = key;
+      s.value = value;
+      count++;
+      return {value, true};
+    }
+    if (s.key == key)
+      return {s.value, false};
+  }
+}
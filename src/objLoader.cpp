@@ -0,0 +1,832 @@
+#include "objLoader.h"
+#include "fileIO.h"
+#include "objIndexMap.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    inline bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* SkipBlanks(const char* p, const char* end)
+    {
+        while(p != end && IsBlank(*p)) p++;
+        return p;
+    }
+
+    // Numbers end at a blank or at the end of the line
+    inline bool IsTokenEnd(const char* p, const char* end)
+    {
+        return p == end || IsBlank(*p);
+    }
+
+    // Records the first malformed token in "error" and skips it
+    inline const char* RejectToken(const char* token, const char* end,
+                                   const char*& error)
+    {
+        if(!error) error = token;
+        while(token != end && !IsBlank(*token)) token++;
+        return token;
+    }
+
+    // Reports "error" (see RejectToken) with its line and exits
+    [[noreturn]] void ExitMalformed(const std::string& name, const char* begin,
+                                    const char* error)
+    {
+        size_t line = size_t(std::count(begin, error, '\n')) + 1;
+        std::fprintf(stderr, "Obj file \"%s\" is malformed at line %zu!\n",
+                     name.c_str(), line);
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Fast path for the plain decimal notation that exporters write
+    // ("-0.123456"). Anything more involved (exponents, very long
+    // mantissas, inf/nan) is delegated to std::from_chars.
+    inline const char* ParseFloat(const char* p, const char* end, float& out,
+                                  const char*& error)
+    {
+        // Exact powers of ten representable in double
+        static constexpr double POW10[] =
+        {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+            1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+            1e16, 1e17, 1e18
+        };
+        static constexpr int MAX_DIGITS = 18;
+
+        const char* start = p;
+        bool negative = (p != end && *p == '-');
+        if(negative) p++;
+
+        uint64_t mantissa = 0;
+        int digitCount = 0;
+        int fractionCount = 0;
+        const char* digitStart = p;
+        while(p != end && uint32_t(*p - '0') < 10u)
+        {
+            mantissa = mantissa * 10u + uint64_t(*p - '0');
+            digitCount++; p++;
+        }
+        bool hasInteger = (p != digitStart);
+        if(p != end && *p == '.')
+        {
+            p++;
+            const char* fractionStart = p;
+            while(p != end && uint32_t(*p - '0') < 10u)
+            {
+                mantissa = mantissa * 10u + uint64_t(*p - '0');
+                digitCount++; p++;
+            }
+            fractionCount = int(p - fractionStart);
+            hasInteger |= (fractionCount != 0);
+        }
+        bool simple = (hasInteger && digitCount <= MAX_DIGITS &&
+                       (p == end || (*p != 'e' && *p != 'E')));
+        if(!simple)
+        {
+            std::from_chars_result result = std::from_chars(start, end, out);
+            if(result.ec != std::errc() || !IsTokenEnd(result.ptr, end))
+            {
+                out = 0.0f;
+                return RejectToken(start, end, error);
+            }
+            return result.ptr;
+        }
+        if(!IsTokenEnd(p, end))
+            return RejectToken(start, end, error);
+        double v = double(mantissa) / POW10[fractionCount];
+        out = float(negative ? -v : v);
+        return p;
+    }
+
+    // Parses up to "N" whitespace separated floats in [p, end), missing
+    // ones are zero
+    template<int N>
+    inline glm::vec<N, float> ParseVec(const char* p, const char* end,
+                                       const char*& error)
+    {
+        glm::vec<N, float> v(0.0f);
+        for(int i = 0; i < N; i++)
+        {
+            p = SkipBlanks(p, end);
+            if(p == end) break;
+            p = ParseFloat(p, end, v[i], error);
+        }
+        return v;
+    }
+
+    // Parses a single face vertex ("p", "p/t", "p//n" or "p/t/n")
+    // and advances "p" past it.
+    inline ObjKeyType ParseTriplet(const char*& p, const char* end,
+                                   const char*& error)
+    {
+        p = SkipBlanks(p, end);
+        const char* token = p;
+        // OBJ is 1-indexed, zero means "not present" here so that
+        // the conversion below wraps it to uint32_t max
+        uint32_t pId = 0, uvId = 0, nId = 0;
+        std::from_chars_result result = std::from_chars(p, end, pId);
+        bool valid = (result.ec == std::errc());
+        p = result.ptr;
+        if(valid && p != end && *p == '/')
+        {
+            p++;
+            // UV (optional)
+            if(p != end && *p != '/')
+            {
+                result = std::from_chars(p, end, uvId);
+                valid = (result.ec == std::errc());
+                p = result.ptr;
+            }
+            // Normal (optional)
+            if(valid && p != end && *p == '/')
+            {
+                p++;
+                result = std::from_chars(p, end, nId);
+                valid = (result.ec == std::errc());
+                p = result.ptr;
+            }
+        }
+        if(!valid || !IsTokenEnd(p, end))
+        {
+            p = RejectToken(token, end, error);
+            return ObjKeyType{0, 0, 0};
+        }
+        return ObjKeyType
+        {
+            // Data of OBJ file is 1-indexed, so convert.
+            .posIndex    = pId - 1,
+            .uvIndex     = uvId - 1,
+            .normalIndex = nId - 1
+        };
+    }
+}
+
+namespace
+{
+    // Files are split into chunks of at least this size,
+    // anything smaller is parsed serially.
+    constexpr size_t MIN_CHUNK_SIZE = 1024 * 1024;
+
+    // Owner of a key is the (chunk, local vertex) that saw it first
+    struct ObjKeyOwner
+    {
+        uint32_t chunk;
+        uint32_t localIndex;
+    };
+
+    // Per-chunk parse results and merge state
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+        // Raw attributes of this chunk, in file order
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec2> uvs;
+        // Local deduplication, index of a key in "uniqueKeys" is
+        // its local vertex index
+        std::vector<ObjKeyType> uniqueKeys;
+        std::vector<uint32_t> localIndices;
+        // Merge state
+        std::vector<std::vector<uint32_t>> shardKeys;
+        std::vector<uint8_t> isNew;
+        std::vector<ObjKeyOwner> owner;
+        std::vector<uint32_t> newRank;
+        std::vector<uint32_t> globalIds;
+        uint32_t newCount = 0;
+        uint32_t vertexBase = 0;
+        size_t indexBase = 0;
+        size_t positionBase = 0;
+        size_t normalBase = 0;
+        size_t uvBase = 0;
+        // Diagnostics
+        bool warnNormalsZero = false;
+        bool warnUVsZero = false;
+        bool badPosition = false;
+        // First malformed number (see RejectToken)
+        const char* parseError = nullptr;
+    };
+
+    void ParseChunk(ObjChunk& chunk, uint32_t shardCount)
+    {
+        chunk.positions.reserve(512);
+        chunk.normals.reserve(512);
+        chunk.uvs.reserve(512);
+        chunk.localIndices.reserve(512);
+        chunk.uniqueKeys.reserve(512);
+        // Sized when the first face is seen (see below)
+        ObjIndexMap<uint32_t> indexHashes;
+
+        auto EmitVertex = [&](const ObjKeyType& key)
+        {
+            // Face without a position, keep the triangle count
+            // intact and report it after the parse
+            if(key.posIndex == ObjIndexMap<uint32_t>::EMPTY)
+            {
+                chunk.badPosition = true;
+                chunk.localIndices.push_back(0);
+                return;
+            }
+            uint32_t nextIndex = uint32_t(chunk.uniqueKeys.size());
+            auto [index, inserted] = indexHashes.Emplace(key, nextIndex);
+            if(inserted) chunk.uniqueKeys.push_back(key);
+            chunk.localIndices.push_back(index);
+        };
+
+        // Tokenize line by line directly over the input bytes
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+        while(p != end)
+        {
+            const char* lineEnd = static_cast<const char*>
+            (
+                std::memchr(p, '\n', size_t(end - p))
+            );
+            if(!lineEnd) lineEnd = end;
+
+            const char* line = SkipBlanks(p, lineEnd);
+            p = (lineEnd == end) ? end : lineEnd + 1;
+            if(lineEnd - line < 2) continue;
+
+            if(line[0] == 'v' && IsBlank(line[1]))
+            {
+                chunk.positions.push_back(ParseVec<3>(line + 2, lineEnd, chunk.parseError));
+            }
+            else if(line[0] == 'f' && IsBlank(line[1]))
+            {
+                // Exporters write faces after the attributes, so the
+                // rest of the chunk is mostly face lines of similar
+                // length. A closed triangle mesh has roughly one unique
+                // vertex per two triangles; uv/normal seams add a few more.
+                if(indexHashes.Capacity() == 0)
+                {
+                    size_t estFaceCount = size_t(end - line) / size_t(lineEnd - line + 1);
+                    indexHashes.Reserve(estFaceCount * 3 / 4);
+                    chunk.localIndices.reserve(estFaceCount * 3);
+                }
+                const char* f = line + 2;
+                EmitVertex(ParseTriplet(f, lineEnd, chunk.parseError));
+                EmitVertex(ParseTriplet(f, lineEnd, chunk.parseError));
+                EmitVertex(ParseTriplet(f, lineEnd, chunk.parseError));
+            }
+            else if(line[0] == 'v' && line[1] == 't' &&
+                    lineEnd - line > 2 && IsBlank(line[2]))
+            {
+                chunk.uvs.push_back(ParseVec<2>(line + 3, lineEnd, chunk.parseError));
+            }
+            else if(line[0] == 'v' && line[1] == 'n' &&
+                    lineEnd - line > 2 && IsBlank(line[2]))
+            {
+                chunk.normals.push_back(ParseVec<3>(line + 3, lineEnd, chunk.parseError));
+            }
+        }
+
+        // Bucket the unique keys by shard for the merge
+        if(shardCount > 1)
+        {
+            // Tables use the low bits of the hash, use the high bits here
+            // so that keys of a shard do not cluster in its table
+            ObjKeyHash hasher;
+            chunk.shardKeys.resize(shardCount);
+            for(uint32_t i = 0; i < uint32_t(chunk.uniqueKeys.size()); i++)
+            {
+                uint32_t shard = uint32_t((hasher(chunk.uniqueKeys[i]) >> 32) % shardCount);
+                chunk.shardKeys[shard].push_back(i);
+            }
+        }
+    }
+
+    // Writes the attributes of the vertices first seen in this chunk
+    void LinearizeChunk(ObjChunk& chunk, MeshData& mesh,
+                        const std::vector<glm::vec3>& positions,
+                        const std::vector<glm::vec3>& normals,
+                        const std::vector<glm::vec2>& uvs)
+    {
+        for(uint32_t l = 0; l < uint32_t(chunk.uniqueKeys.size()); l++)
+        {
+            if(!chunk.isNew.empty() && !chunk.isNew[l]) continue;
+
+            const ObjKeyType& key = chunk.uniqueKeys[l];
+            uint32_t i = chunk.globalIds[l];
+            if(key.posIndex < positions.size())
+                mesh.positions[i] = positions[key.posIndex];
+            else
+            {
+                chunk.badPosition = true;
+                mesh.positions[i] = glm::vec3(0);
+            }
+            // If these are not available just write zero
+            if(key.uvIndex < uvs.size())
+                mesh.uvs[i] = uvs[key.uvIndex];
+            else
+            {
+                chunk.warnUVsZero = true;
+                mesh.uvs[i] = glm::vec2(0);
+            }
+            //
+            if(key.normalIndex < normals.size())
+                mesh.normals[i] = normals[key.normalIndex];
+            else
+            {
+                chunk.warnNormalsZero = true;
+                mesh.normals[i] = glm::vec3(0);
+            }
+        }
+    }
+}
+
+MeshData ParseObj(const char* begin, const char* end, const std::string& name,
+                  uint32_t maxThreads)
+{
+    ThreadPool& pool = ThreadPool::Global();
+    if(maxThreads == 0) maxThreads = pool.ThreadCount() + 1;
+
+    // ===================== //
+    //  SPLIT INTO CHUNKS    //
+    // ===================== //
+    // Chunks end at a newline so that no line spans two chunks
+    size_t totalSize = size_t(end - begin);
+    uint32_t chunkCount = uint32_t(std::clamp<size_t>(totalSize / MIN_CHUNK_SIZE,
+                                                      1, maxThreads));
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* chunkStart = begin;
+    for(uint32_t c = 0; c < chunkCount; c++)
+    {
+        const char* chunkEnd = end;
+        if(c + 1 != chunkCount)
+        {
+            chunkEnd = std::max(chunkStart, begin + totalSize / chunkCount * (c + 1));
+            const char* nl = static_cast<const char*>
+            (
+                std::memchr(chunkEnd, '\n', size_t(end - chunkEnd))
+            );
+            chunkEnd = nl ? nl + 1 : end;
+        }
+        chunks[c].begin = chunkStart;
+        chunks[c].end = chunkEnd;
+        chunkStart = chunkEnd;
+    }
+    // Shard count of the global deduplication
+    uint32_t shardCount = (chunkCount == 1) ? 1 : chunkCount;
+
+    // ===================== //
+    //   PARSE (PARALLEL)    //
+    // ===================== //
+    pool.ParallelFor(chunkCount, [&](uint32_t c)
+    {
+        ParseChunk(chunks[c], shardCount);
+    });
+
+    auto ExitBadPosition = [&]()
+    {
+        std::fprintf(stderr, "Obj file \"%s\" has a face referring to "
+                     "a non-existent position!\n",
+                     name.c_str());
+        std::exit(EXIT_FAILURE);
+    };
+    // Faces without a position have no vertex (their local index is a
+    // placeholder), stop before the merge remaps them. Chunks are in
+    // file order, so the first parse error is the first one reported.
+    for(const ObjChunk& chunk : chunks)
+        if(chunk.parseError) ExitMalformed(name, begin, chunk.parseError);
+    for(const ObjChunk& chunk : chunks)
+        if(chunk.badPosition) ExitBadPosition();
+
+    // Prefix sums of the attribute and index counts
+    size_t positionCount = 0, normalCount = 0, uvCount = 0, indexCount = 0;
+    for(ObjChunk& chunk : chunks)
+    {
+        chunk.positionBase = positionCount;
+        chunk.normalBase = normalCount;
+        chunk.uvBase = uvCount;
+        chunk.indexBase = indexCount;
+        positionCount += chunk.positions.size();
+        normalCount += chunk.normals.size();
+        uvCount += chunk.uvs.size();
+        indexCount += chunk.localIndices.size();
+    }
+
+    // ===================== //
+    //  DEDUPLICATION MERGE  //
+    // ===================== //
+    // Vertex indices must match the serial order. A key gets the next
+    // index when it is seen first in face order; that is the first
+    // chunk having it, at its local first-seen position. So:
+    //  - Each shard finds the owner chunk of its keys (chunks in order).
+    //  - Each chunk ranks its owned ("new") keys.
+    //  - Global index = vertex base of the owner chunk + rank.
+    if(chunkCount > 1)
+    {
+        for(ObjChunk& chunk : chunks)
+        {
+            chunk.isNew.resize(chunk.uniqueKeys.size(), 0);
+            chunk.owner.resize(chunk.uniqueKeys.size());
+        }
+        pool.ParallelFor(shardCount, [&](uint32_t s)
+        {
+            size_t keyCount = 0;
+            for(const ObjChunk& chunk : chunks) keyCount += chunk.shardKeys[s].size();
+
+            ObjIndexMap<ObjKeyOwner> shardMap(keyCount);
+            for(uint32_t c = 0; c < chunkCount; c++)
+            for(uint32_t l : chunks[c].shardKeys[s])
+            {
+                ObjKeyOwner o = {c, l};
+                auto [owner, inserted] = shardMap.Emplace(chunks[c].uniqueKeys[l], o);
+                chunks[c].isNew[l] = inserted ? 1 : 0;
+                chunks[c].owner[l] = owner;
+            }
+        });
+        pool.ParallelFor(chunkCount, [&](uint32_t c)
+        {
+            ObjChunk& chunk = chunks[c];
+            chunk.shardKeys = std::vector<std::vector<uint32_t>>();
+            chunk.newRank.resize(chunk.uniqueKeys.size());
+            uint32_t rank = 0;
+            for(size_t l = 0; l < chunk.uniqueKeys.size(); l++)
+            {
+                chunk.newRank[l] = rank;
+                rank += chunk.isNew[l];
+            }
+            chunk.newCount = rank;
+        });
+    }
+    else chunks[0].newCount = uint32_t(chunks[0].uniqueKeys.size());
+
+    uint32_t vertexCount = 0;
+    for(ObjChunk& chunk : chunks)
+    {
+        chunk.vertexBase = vertexCount;
+        vertexCount += chunk.newCount;
+    }
+
+    // ===================== //
+    //  LINEARIZE (PARALLEL) //
+    // ===================== //
+    // Concatenated attributes that faces refer to. With a single chunk,
+    // use its arrays directly.
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    if(chunkCount > 1)
+    {
+        positions.resize(positionCount);
+        normals.resize(normalCount);
+        uvs.resize(uvCount);
+        pool.ParallelFor(chunkCount, [&](uint32_t c)
+        {
+            ObjChunk& chunk = chunks[c];
+            std::copy(chunk.positions.cbegin(), chunk.positions.cend(),
+                      positions.begin() + std::ptrdiff_t(chunk.positionBase));
+            std::copy(chunk.normals.cbegin(), chunk.normals.cend(),
+                      normals.begin() + std::ptrdiff_t(chunk.normalBase));
+            std::copy(chunk.uvs.cbegin(), chunk.uvs.cend(),
+                      uvs.begin() + std::ptrdiff_t(chunk.uvBase));
+            chunk.positions = std::vector<glm::vec3>();
+            chunk.normals = std::vector<glm::vec3>();
+            chunk.uvs = std::vector<glm::vec2>();
+        });
+    }
+    else
+    {
+        positions = std::move(chunks[0].positions);
+        normals = std::move(chunks[0].normals);
+        uvs = std::move(chunks[0].uvs);
+    }
+
+    MeshData mesh;
+    mesh.positions.resize(vertexCount);
+    mesh.normals.resize(vertexCount);
+    mesh.uvs.resize(vertexCount);
+    mesh.indices.resize(indexCount);
+    pool.ParallelFor(chunkCount, [&](uint32_t c)
+    {
+        ObjChunk& chunk = chunks[c];
+        size_t localCount = chunk.uniqueKeys.size();
+        chunk.globalIds.resize(localCount);
+        for(size_t l = 0; l < localCount; l++)
+        {
+            if(chunkCount == 1)
+            {
+                chunk.globalIds[l] = uint32_t(l);
+                continue;
+            }
+            const ObjKeyOwner& o = chunk.owner[l];
+            const ObjChunk& ownerChunk = chunks[o.chunk];
+            chunk.globalIds[l] = ownerChunk.vertexBase + ownerChunk.newRank[o.localIndex];
+        }
+        for(size_t i = 0; i < chunk.localIndices.size(); i++)
+            mesh.indices[chunk.indexBase + i] = chunk.globalIds[chunk.localIndices[i]];
+
+        LinearizeChunk(chunk, mesh, positions, normals, uvs);
+    });
+
+    bool warnNormalsZero = false;
+    bool warnUVsZero = false;
+    for(const ObjChunk& chunk : chunks)
+    {
+        // Position indices past the concatenated positions
+        if(chunk.badPosition) ExitBadPosition();
+        warnNormalsZero |= chunk.warnNormalsZero;
+        warnUVsZero |= chunk.warnUVsZero;
+    }
+
+    if(warnNormalsZero)
+        std::printf("[WARNING]: Obj file \"%s\" has some of its "
+                    "normals are not present. These are written as zero!\n",
+                    name.c_str());
+    if(warnUVsZero)
+        std::printf("[WARNING]: Obj file \"%s\" has some of its "
+                    "uvs are not present. These are written as zero!\n",
+                    name.c_str());
+
+    assert(mesh.indices.size() % 3 == 0);
+    return mesh;
+}
+
+MeshData LoadObj(const std::string& objPath, uint32_t maxThreads)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+
+    MappedFile file(objPath);
+    if(!file.IsOpen())
+    {
+        std::fprintf(stderr, "Unable to open obj file \"%s\"\n",
+                     objPath.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    MeshData mesh = ParseObj(file.data, file.data + file.size, objPath,
+                             maxThreads);
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    double mbPerSec = (ms > 0.0) ? (double(file.size) * 1e-6) / (ms * 1e-3) : 0.0;
+    std::printf("Obj file \"%s\" is loaded succesfully. "
+                "(%.2f MB in %.2f ms, %.1f MB/s)\n",
+                objPath.c_str(), double(file.size) * 1e-6, ms, mbPerSec);
+    return mesh;
+}
+
+namespace
+{
+    // Scanned pages of the OBJ are released in steps of this size
+    constexpr size_t DROP_PAGE_INTERVAL = 8 * 1024 * 1024;
+
+    // Calls "f(line, lineEnd)" for every line with its leading blanks
+    // skipped, releasing the pages behind the scan
+    template<class Func>
+    void ForEachLine(const MappedFile& file, Func&& f)
+    {
+        const char* p = file.data;
+        const char* end = file.data + file.size;
+        size_t dropped = 0;
+        while(p != end)
+        {
+            const char* lineEnd = static_cast<const char*>
+            (
+                std::memchr(p, '\n', size_t(end - p))
+            );
+            if(!lineEnd) lineEnd = end;
+
+            const char* line = SkipBlanks(p, lineEnd);
+            p = (lineEnd == end) ? end : lineEnd + 1;
+            if(lineEnd - line >= 2) f(line, lineEnd);
+
+            size_t scanned = size_t(p - file.data);
+            if(scanned - dropped >= DROP_PAGE_INTERVAL)
+            {
+                file.DropPages(dropped, scanned - dropped);
+                dropped = scanned;
+            }
+        }
+        file.DropPages(dropped, file.size - dropped);
+    }
+
+    enum class ObjLineType { POSITION, UV, NORMAL, FACE, OTHER };
+
+    inline ObjLineType ClassifyLine(const char* line, const char* lineEnd)
+    {
+        if(line[0] == 'v' && IsBlank(line[1])) return ObjLineType::POSITION;
+        if(line[0] == 'f' && IsBlank(line[1])) return ObjLineType::FACE;
+        if(line[0] == 'v' && lineEnd - line > 2 && IsBlank(line[2]))
+        {
+            if(line[1] == 't') return ObjLineType::UV;
+            if(line[1] == 'n') return ObjLineType::NORMAL;
+        }
+        return ObjLineType::OTHER;
+    }
+
+    // Heap memory of a window of "triangleCount" triangles when every
+    // corner is a new vertex
+    size_t WindowBytes(size_t triangleCount)
+    {
+        size_t cornerCount = triangleCount * 3;
+        size_t slotCount = std::bit_ceil(std::max<size_t>(16, cornerCount + cornerCount / 3 + 1));
+        return (cornerCount * (sizeof(uint32_t) + 2 * sizeof(glm::vec3) + sizeof(glm::vec2)) +
+                slotCount * sizeof(ObjIndexMap<uint32_t>::Slot));
+    }
+}
+
+ObjStreamStats StreamObj(const std::string& objPath, size_t memoryCap,
+                         const ObjStreamCallbacks& callbacks)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+
+    MappedFile file(objPath);
+    if(!file.IsOpen())
+    {
+        std::fprintf(stderr, "Unable to open obj file \"%s\"\n",
+                     objPath.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+
+    // ===================== //
+    //    COUNTING PASS      //
+    // ===================== //
+    ObjStreamInfo info;
+    ForEachLine(file, [&](const char* line, const char* lineEnd)
+    {
+        switch(ClassifyLine(line, lineEnd))
+        {
+            case ObjLineType::POSITION: info.positionCount++; break;
+            case ObjLineType::UV:       info.uvCount++; break;
+            case ObjLineType::NORMAL:   info.normalCount++; break;
+            case ObjLineType::FACE:     info.indexCount += 3; break;
+            case ObjLineType::OTHER:    break;
+        }
+    });
+
+    // ===================== //
+    //    ATTRIBUTE PASS     //
+    // ===================== //
+    // Attribute pools go to a scratch file, faces refer to them randomly
+    ObjStreamStats stats;
+    stats.scratchBytes = size_t(info.positionCount * sizeof(glm::vec3) +
+                                info.normalCount * sizeof(glm::vec3) +
+                                info.uvCount * sizeof(glm::vec2));
+    ScratchFile scratch(stats.scratchBytes);
+    if(stats.scratchBytes != 0 && !scratch.IsOpen())
+    {
+        std::fprintf(stderr, "Unable to create the scratch file of \"%s\"\n",
+                     objPath.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    glm::vec3* positions = static_cast<glm::vec3*>(scratch.data);
+    glm::vec3* normals = positions + info.positionCount;
+    glm::vec2* uvs = reinterpret_cast<glm::vec2*>(normals + info.normalCount);
+    {
+        uint64_t p = 0, n = 0, t = 0;
+        const char* error = nullptr;
+        ForEachLine(file, [&](const char* line, const char* lineEnd)
+        {
+            switch(ClassifyLine(line, lineEnd))
+            {
+                case ObjLineType::POSITION: positions[p++] = ParseVec<3>(line + 2, lineEnd, error); break;
+                case ObjLineType::UV:       uvs[t++] = ParseVec<2>(line + 3, lineEnd, error); break;
+                case ObjLineType::NORMAL:   normals[n++] = ParseVec<3>(line + 3, lineEnd, error); break;
+                default: break;
+            }
+        });
+        if(error) ExitMalformed(objPath, file.data, error);
+    }
+    if(info.positionCount != 0)
+    {
+        info.posMin = info.posMax = positions[0];
+        for(uint64_t i = 1; i < info.positionCount; i++)
+        {
+            info.posMin = glm::min(info.posMin, positions[i]);
+            info.posMax = glm::max(info.posMax, positions[i]);
+        }
+    }
+    if(info.uvCount != 0)
+    {
+        info.uvMin = info.uvMax = uvs[0];
+        for(uint64_t i = 1; i < info.uvCount; i++)
+        {
+            info.uvMin = glm::min(info.uvMin, uvs[i]);
+            info.uvMax = glm::max(info.uvMax, uvs[i]);
+        }
+    }
+    if(callbacks.begin) callbacks.begin(info);
+
+    // ===================== //
+    //  FACE PASS (WINDOWS)  //
+    // ===================== //
+    // Largest window whose worst case fits in the cap
+    size_t lo = 1, hi = std::max<size_t>(1, memoryCap / 16);
+    while(lo < hi)
+    {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if(WindowBytes(mid) <= memoryCap) lo = mid;
+        else hi = mid - 1;
+    }
+    size_t windowTriangles = std::min<size_t>(lo, std::max<uint64_t>(info.indexCount / 3, 1));
+    if(WindowBytes(windowTriangles) > memoryCap)
+        std::printf("[WARNING]: Memory cap of %zu bytes is too small for \"%s\", "
+                    "using %zu bytes\n",
+                    memoryCap, objPath.c_str(), WindowBytes(windowTriangles));
+
+    size_t windowCorners = windowTriangles * 3;
+    MeshData window;
+    window.positions.reserve(windowCorners);
+    window.normals.reserve(windowCorners);
+    window.uvs.reserve(windowCorners);
+    window.indices.reserve(windowCorners);
+    ObjIndexMap<uint32_t> indexHashes(windowCorners);
+    stats.peakBytes = (window.positions.capacity() * sizeof(glm::vec3) +
+                       window.normals.capacity() * sizeof(glm::vec3) +
+                       window.uvs.capacity() * sizeof(glm::vec2) +
+                       window.indices.capacity() * sizeof(uint32_t) +
+                       indexHashes.MemoryUsage());
+
+    bool warnNormalsZero = false;
+    bool warnUVsZero = false;
+    auto Flush = [&]()
+    {
+        if(window.indices.empty()) return;
+        if(callbacks.window) callbacks.window(stats.vertexCount, window);
+        stats.vertexCount += window.VertexCount();
+        stats.indexCount += window.indices.size();
+        stats.windowCount++;
+        window.positions.clear();
+        window.normals.clear();
+        window.uvs.clear();
+        window.indices.clear();
+        indexHashes.Clear();
+    };
+    auto EmitVertex = [&](const ObjKeyType& key)
+    {
+        if(key.posIndex >= info.positionCount)
+        {
+            std::fprintf(stderr, "Obj file \"%s\" has a face referring to "
+                         "a non-existent position!\n",
+                         objPath.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        uint32_t nextIndex = window.VertexCount();
+        auto [index, inserted] = indexHashes.Emplace(key, nextIndex);
+        if(inserted)
+        {
+            window.positions.push_back(positions[key.posIndex]);
+            // If these are not available just write zero
+            if(key.uvIndex < info.uvCount)
+                window.uvs.push_back(uvs[key.uvIndex]);
+            else
+            {
+                warnUVsZero = true;
+                window.uvs.push_back(glm::vec2(0));
+            }
+            if(key.normalIndex < info.normalCount)
+                window.normals.push_back(normals[key.normalIndex]);
+            else
+            {
+                warnNormalsZero = true;
+                window.normals.push_back(glm::vec3(0));
+            }
+        }
+        window.indices.push_back(stats.vertexCount + index);
+    };
+    ForEachLine(file, [&](const char* line, const char* lineEnd)
+    {
+        if(ClassifyLine(line, lineEnd) != ObjLineType::FACE) return;
+        if(window.indices.size() == windowCorners) Flush();
+
+        const char* f = line + 2;
+        const char* error = nullptr;
+        ObjKeyType keys[3];
+        for(ObjKeyType& key : keys) key = ParseTriplet(f, lineEnd, error);
+        if(error) ExitMalformed(objPath, file.data, error);
+        for(const ObjKeyType& key : keys) EmitVertex(key);
+    });
+    Flush();
+
+    if(warnNormalsZero)
+        std::printf("[WARNING]: Obj file \"%s\" has some of its "
+                    "normals are not present. These are written as zero!\n",
+                    objPath.c_str());
+    if(warnUVsZero)
+        std::printf("[WARNING]: Obj file \"%s\" has some of its "
+                    "uvs are not present. These are written as zero!\n",
+                    objPath.c_str());
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::printf("Obj file \"%s\" is streamed succesfully. "
+                "(%.2f MB in %.2f ms, %u windows, %.2f MiB peak window memory, "
+                "%.2f MiB scratch)\n",
+                objPath.c_str(), double(file.size) * 1e-6, ms, stats.windowCount,
+                double(stats.peakBytes) / (1024.0 * 1024.0),
+                double(stats.scratchBytes) / (1024.0 * 1024.0));
+    return stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "meshData.h"
+
+// Parses a triangulated Wavefront OBJ ("v", "vt", "vn" and "f" lines)
+// into a single-indexed mesh. Unique position/uv/normal triplets
+// are given vertex indices in the order they first appear in faces.
+//
+// The file is memory mapped and tokenized in place.
+// Missing files are fatal.
+//
+// Large files are split into newline-aligned chunks that are parsed on
+// the global thread pool; the per-chunk deduplication results are merged
+// so that the output is identical to a serial parse.
+// "maxThreads" limits the chunk count (zero: pool size, one: serial).
+MeshData LoadObj(const std::string &objPath, uint32_t maxThreads = 0);
+
+// Same as above, but over an in-memory OBJ text. "name" is only
+// used for diagnostics.
+MeshData ParseObj(const char *begin, const char *end, const std::string &name,
+                  uint32_t maxThreads = 0);
+
+// Attribute statistics of an OBJ, gathered before its faces are streamed
+struct ObjStreamInfo {
+  uint64_t positionCount = 0;
+  uint64_t normalCount = 0;
+  uint64_t uvCount = 0;
+  uint64_t indexCount = 0;
+  // Bounds of all "v" / "vt" entries
+  glm::vec3 posMin = glm::vec3(0.0f);
+  glm::vec3 posMax = glm::vec3(0.0f);
+  glm::vec2 uvMin = glm::vec2(0.0f);
+  glm::vec2 uvMax = glm::vec2(1.0f);
+};
+
+struct ObjStreamStats {
+  uint32_t vertexCount = 0;
+  uint64_t indexCount = 0;
+  uint32_t windowCount = 0;
+  // Heap memory of the window buffers at their largest
+  size_t peakBytes = 0;
+  // File backed attribute pools (see ScratchFile)
+  size_t scratchBytes = 0;
+};
+
+// Receivers of "StreamObj". "begin" is called once before any window;
+// "window" receives the vertices that are new in a window (numbered
+// from "firstVertex") and the window's indices, which refer to global
+// vertex numbers.
+struct ObjStreamCallbacks {
+  std::function<void(const ObjStreamInfo &)> begin;
+  std::function<void(uint32_t firstVertex, const MeshData &window)> window;
+};
+
+// Bounded memory version of "LoadObj" for meshes that do not fit in
+// memory a few times over. The file is scanned three times: counting,
+// attributes (into a ScratchFile instead of the heap) and faces. Faces
+// are processed in windows whose buffers and deduplication map stay
+// within "memoryCap" bytes; vertices are deduplicated within a window
+// only, so vertices on window borders are duplicated. Pages of the OBJ
+// that were scanned are released as the scan goes. What the receivers
+// keep of the windows is not counted against "memoryCap".
+//
+// Missing files are fatal.
+ObjStreamStats StreamObj(const std::string &objPath, size_t memoryCap,
+                         const ObjStreamCallbacks &callbacks);
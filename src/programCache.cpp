@@ -0,0 +1,92 @@
+#include "programCache.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    constexpr char PROGRAM_CACHE_MAGIC[8] = {'P', 'L', 'P', 'R', 'O', 'G', '\0', '\0'};
+
+    struct ProgramCacheHeader
+    {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    headerSize;
+        // Source key
+        uint64_t    sourceHash;
+        uint64_t    driverHash;
+        // Payload, right after the header
+        uint32_t    binaryFormat;
+        uint32_t    reserved;
+        uint64_t    binarySize;
+        uint64_t    payloadHash;
+    };
+    static_assert(sizeof(ProgramCacheHeader) == 56);
+}
+
+std::string ProgramCache::PathFor(const std::string& shaderPath)
+{
+    return shaderPath + EXTENSION;
+}
+
+bool ProgramCache::Write(const std::string& shaderPath, uint64_t sourceHash,
+                         uint64_t driverHash, uint32_t format,
+                         const void* data, size_t size)
+{
+    ProgramCacheHeader header = {};
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    header.version      = VERSION;
+    header.headerSize   = sizeof(ProgramCacheHeader);
+    header.sourceHash   = sourceHash;
+    header.driverHash   = driverHash;
+    header.binaryFormat = format;
+    header.binarySize   = size;
+    header.payloadHash  = HashBytes(data, size);
+    return WriteFileAtomic(PathFor(shaderPath),
+    {
+        {&header, sizeof(ProgramCacheHeader)},
+        {data, size}
+    });
+}
+
+bool ProgramCache::Open(const std::string& shaderPath, uint64_t sourceHash,
+                        uint64_t driverHash)
+{
+    std::string cachePath = PathFor(shaderPath);
+    file = MappedFile(cachePath);
+    if(!file.IsOpen()) return false;
+
+    auto Reject = [&](const char* reason)
+    {
+        std::printf("[WARNING]: Program cache \"%s\" is %s, "
+                    "falling back to the shader source.\n",
+                    cachePath.c_str(), reason);
+        file = MappedFile();
+        return false;
+    };
+
+    ProgramCacheHeader header;
+    if(file.size < sizeof(ProgramCacheHeader)) return Reject("corrupt");
+    std::memcpy(&header, file.data, sizeof(ProgramCacheHeader));
+    if(std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0 ||
+       header.headerSize != sizeof(ProgramCacheHeader))
+        return Reject("corrupt");
+    if(header.version != VERSION)
+        return Reject("from an older version");
+    if(header.sourceHash != sourceHash)
+        return Reject("out of date");
+    if(header.driverHash != driverHash)
+        return Reject("from another driver");
+    if(header.binarySize == 0 ||
+       sizeof(ProgramCacheHeader) + header.binarySize != file.size)
+        return Reject("corrupt");
+
+    const char* data = file.data + sizeof(ProgramCacheHeader);
+    if(HashBytes(data, header.binarySize) != header.payloadHash)
+        return Reject("corrupt");
+
+    binaryFormat = header.binaryFormat;
+    binary = data;
+    binarySize = header.binarySize;
+    return true;
+}
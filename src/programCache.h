@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "fileIO.h"
+
+// On-disk cache of a linked program (glGetProgramBinary), stored next to
+// its shader as "<shader>.progbin" ("<shader>.<constants hash>.progbin"
+// for specialized programs, see ShaderGL::Constant).
+// Binaries are only valid for the driver that produced them, so a cache
+// is keyed on the content hash of the shader source and on the hash of
+// the GL vendor, renderer and version strings (a driver update changes
+// the version). Even a cache with the right key may be rejected by
+// glProgramBinary, callers must fall back to compiling the source.
+// Loading is a memory mapping, a payload checksum catches corrupt files.
+struct ProgramCache {
+  static constexpr uint32_t VERSION = 1;
+  static constexpr const char *EXTENSION = ".progbin";
+
+  MappedFile file;
+  // GLenum returned by glGetProgramBinary
+  uint32_t binaryFormat = 0;
+  const void *binary = nullptr;
+  size_t binarySize = 0;
+
+  // "shaders/sun.frag" -> "shaders/sun.frag.progbin", the shader path
+  // may carry the constants hash
+  static std::string PathFor(const std::string &shaderPath);
+  // Returns false on I/O failure (the cache is simply not written)
+  static bool Write(const std::string &shaderPath, uint64_t sourceHash,
+                    uint64_t driverHash, uint32_t binaryFormat,
+                    const void *binary, size_t binarySize);
+
+  // Maps and validates the cache of "shaderPath". Returns false if it is
+  // missing, stale or corrupt; the caller should compile the source.
+  bool Open(const std::string &shaderPath, uint64_t sourceHash,
+            uint64_t driverHash);
+};
@@ -0,0 +1,319 @@
+#include "sphereGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include <glm/gtc/constants.hpp>
+
+namespace
+{
+    constexpr uint32_t MIN_UV_SEGMENTS = 4;
+    // Grids are emitted in column blocks this wide, two rows of a block
+    // fit in the post-transform cache (see VertexCacheStats::FIFO_SIZE)
+    constexpr uint32_t COLUMN_BLOCK = 6;
+
+    uint32_t UVSegments(uint32_t level) { return std::max(MIN_UV_SEGMENTS, level); }
+    uint32_t UVRings(uint32_t level) { return std::max(2u, UVSegments(level) / 2); }
+
+    // Equirectangular mapping of the sphere assets
+    glm::vec3 FromLatLon(float lat, float lon)
+    {
+        return glm::vec3(std::cos(lat) * std::sin(lon),
+                         std::sin(lat),
+                         std::cos(lat) * std::cos(lon));
+    }
+
+    float ToU(const glm::vec3& p)
+    {
+        float lon = std::atan2(p.x, p.z) - glm::half_pi<float>();
+        float u = lon / glm::two_pi<float>();
+        return u - std::floor(u);
+    }
+
+    float ToV(const glm::vec3& p)
+    {
+        return std::asin(std::clamp(p.y, -1.0f, 1.0f)) / glm::pi<float>() + 0.5f;
+    }
+
+    // Writes triangles and keeps track of the LOD error
+    struct TriangleSink
+    {
+        const IndexStreamWriter&    writer;
+        uint32_t                    indexCount = 0;
+        float                       minCentroidRadius = 1.0f;
+
+        void Write(uint32_t a, uint32_t b, uint32_t c,
+                   const glm::vec3& pa, const glm::vec3& pb, const glm::vec3& pc)
+        {
+            writer.Write(indexCount + 0, a);
+            writer.Write(indexCount + 1, b);
+            writer.Write(indexCount + 2, c);
+            indexCount += 3;
+            minCentroidRadius = std::min(minCentroidRadius,
+                                         glm::length((pa + pb + pc) / 3.0f));
+        }
+    };
+
+    void GenerateUV(uint32_t level, const VertexStreamWriter& vertices,
+                    TriangleSink& triangles)
+    {
+        uint32_t segments = UVSegments(level);
+        uint32_t rings = UVRings(level);
+        // Trigonometry is separable, tabulate it per ring and segment
+        std::vector<glm::vec2> latSinCos(rings + 1);
+        std::vector<glm::vec2> lonSinCos(segments + 1);
+        for(uint32_t j = 0; j <= rings; j++)
+        {
+            float lat = glm::pi<float>() * (float(j) / float(rings) - 0.5f);
+            latSinCos[j] = glm::vec2(std::sin(lat), std::cos(lat));
+        }
+        for(uint32_t i = 0; i <= segments; i++)
+        {
+            float lon = glm::half_pi<float>() +
+                        glm::two_pi<float>() * float(i) / float(segments);
+            lonSinCos[i] = glm::vec2(std::sin(lon), std::cos(lon));
+        }
+        auto Index = [&](uint32_t i, uint32_t j) { return j * (segments + 1) + i; };
+        auto Position = [&](uint32_t i, uint32_t j)
+        {
+            // Same as FromLatLon
+            return glm::vec3(latSinCos[j].y * lonSinCos[i].x,
+                             latSinCos[j].x,
+                             latSinCos[j].y * lonSinCos[i].y);
+        };
+
+        for(uint32_t j = 0; j <= rings; j++)
+        for(uint32_t i = 0; i <= segments; i++)
+        {
+            glm::vec3 p = Position(i, j);
+            // Pole vertices take the u of the triangle they belong to
+            float u = float(i) / float(segments);
+            if(j == 0 || j == rings) u += 0.5f / float(segments);
+            vertices.Write(Index(i, j), p, p, glm::vec2(u, float(j) / float(rings)));
+        }
+
+        // Bands from south to north, the pole bands are single triangles
+        for(uint32_t i0 = 0; i0 < segments; i0 += COLUMN_BLOCK)
+        for(uint32_t j = 0; j < rings; j++)
+        for(uint32_t i = i0; i < std::min(i0 + COLUMN_BLOCK, segments); i++)
+        {
+            uint32_t a = Index(i, j), b = Index(i + 1, j);
+            uint32_t c = Index(i + 1, j + 1), d = Index(i, j + 1);
+            glm::vec3 pa = Position(i, j), pb = Position(i + 1, j);
+            glm::vec3 pc = Position(i + 1, j + 1), pd = Position(i, j + 1);
+            if(j != 0) triangles.Write(a, b, c, pa, pb, pc);
+            if(j != rings - 1) triangles.Write(a, c, d, pa, pc, pd);
+        }
+    }
+
+    // Writes a grid face projected on the sphere, "toSphere" maps grid
+    // coordinates in [0, 1]^2 (or in the triangle s + t <= 1) to it.
+    template<class ToSphere>
+    void GenerateFace(uint32_t n, bool triangular, glm::vec3 centroid,
+                      ToSphere&& toSphere, uint32_t& vertexOffset,
+                      std::vector<glm::vec3>& positions,
+                      const VertexStreamWriter& vertices, TriangleSink& triangles)
+    {
+        float uCenter = ToU(glm::normalize(centroid));
+        // Triangular faces lose a vertex per row
+        auto RowStart = [&](uint32_t j)
+        {
+            return triangular ? (j * (n + 1) - j * (j - 1) / 2) : j * (n + 1);
+        };
+        auto Index = [&](uint32_t i, uint32_t j) { return vertexOffset + RowStart(j) + i; };
+        // Face local positions, the triangles reuse them
+        auto Position = [&](uint32_t i, uint32_t j) { return positions[RowStart(j) + i]; };
+        positions.resize((n + 1) * (n + 1));
+
+        for(uint32_t j = 0; j <= n; j++)
+        for(uint32_t i = 0; i <= (triangular ? n - j : n); i++)
+        {
+            glm::vec3 p = toSphere(float(i) / float(n), float(j) / float(n));
+            positions[RowStart(j) + i] = p;
+            // Unwrap u around the face center, poles have no longitude
+            float u = uCenter;
+            if(std::abs(p.y) < 1.0f - 1e-6f)
+            {
+                u = ToU(p);
+                u += std::round(uCenter - u);
+            }
+            vertices.Write(Index(i, j), p, p, glm::vec2(u, ToV(p)));
+        }
+
+        for(uint32_t i0 = 0; i0 < n; i0 += COLUMN_BLOCK)
+        for(uint32_t j = 0; j < n; j++)
+        for(uint32_t i = i0; i < std::min(i0 + COLUMN_BLOCK, triangular ? n - j : n); i++)
+        {
+            uint32_t a = Index(i, j), b = Index(i + 1, j);
+            uint32_t c = Index(i + 1, j + 1), d = Index(i, j + 1);
+            glm::vec3 pa = Position(i, j), pb = Position(i + 1, j);
+            glm::vec3 pc = Position(i + 1, j + 1), pd = Position(i, j + 1);
+            if(triangular)
+            {
+                triangles.Write(a, b, d, pa, pb, pd);
+                // Upside down triangle of the cell
+                if(i + j + 1 < n) triangles.Write(b, c, d, pb, pc, pd);
+                continue;
+            }
+            triangles.Write(a, b, c, pa, pb, pc);
+            triangles.Write(a, c, d, pa, pc, pd);
+        }
+        vertexOffset += triangular ? (n + 1) * (n + 2) / 2 : (n + 1) * (n + 1);
+    }
+
+    void GenerateIco(uint32_t n, const VertexStreamWriter& vertices,
+                     TriangleSink& triangles)
+    {
+        // Poles at the north/south vertices, two rings of five between
+        float ringLat = std::atan(0.5f);
+        float step = glm::two_pi<float>() / 5.0f;
+        glm::vec3 north(0.0f, 1.0f, 0.0f), south(0.0f, -1.0f, 0.0f);
+        std::array<glm::vec3, 5> upper, lower;
+        for(uint32_t k = 0; k < 5; k++)
+        {
+            upper[k] = FromLatLon(ringLat, float(k) * step);
+            lower[k] = FromLatLon(-ringLat, (float(k) + 0.5f) * step);
+        }
+
+        uint32_t vertexOffset = 0;
+        std::vector<glm::vec3> positions;
+        auto Face = [&](glm::vec3 a, glm::vec3 b, glm::vec3 c)
+        {
+            auto ToSphere = [&](float s, float t)
+            {
+                return glm::normalize(a + (b - a) * s + (c - a) * t);
+            };
+            GenerateFace(n, true, a + b + c, ToSphere, vertexOffset,
+                         positions, vertices, triangles);
+        };
+        for(uint32_t k = 0; k < 5; k++)
+        {
+            uint32_t k1 = (k + 1) % 5;
+            Face(upper[k], upper[k1], north);
+            Face(upper[k], lower[k], upper[k1]);
+            Face(lower[k], lower[k1], upper[k1]);
+            Face(lower[k1], lower[k], south);
+        }
+    }
+
+    void GenerateCube(uint32_t n, const VertexStreamWriter& vertices,
+                      TriangleSink& triangles)
+    {
+        // The cube is stood on a corner so that both poles are cube
+        // corners; then no face wraps around a pole and its u range
+        // can be unwrapped.
+        glm::vec3 from = glm::normalize(glm::vec3(1.0f));
+        glm::vec3 to(0.0f, 1.0f, 0.0f);
+        glm::vec3 axis = glm::normalize(glm::cross(from, to));
+        float cosA = glm::dot(from, to);
+        float sinA = std::sqrt(1.0f - cosA * cosA);
+        auto Rotate = [&](const glm::vec3& v)
+        {
+            return (v * cosA + glm::cross(axis, v) * sinA +
+                    axis * glm::dot(axis, v) * (1.0f - cosA));
+        };
+        // Area preserving-ish cube to sphere mapping
+        auto Spherify = [](const glm::vec3& c)
+        {
+            glm::vec3 c2 = c * c;
+            return glm::vec3(c.x * std::sqrt(1.0f - c2.y / 2.0f - c2.z / 2.0f + c2.y * c2.z / 3.0f),
+                             c.y * std::sqrt(1.0f - c2.z / 2.0f - c2.x / 2.0f + c2.z * c2.x / 3.0f),
+                             c.z * std::sqrt(1.0f - c2.x / 2.0f - c2.y / 2.0f + c2.x * c2.y / 3.0f));
+        };
+
+        // Normal and tangents with t1 x t2 = normal
+        static const std::array<std::array<glm::vec3, 3>, 6> Faces =
+        {{
+            {glm::vec3( 1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1)},
+            {glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)},
+            {glm::vec3( 0, 1, 0), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0)},
+            {glm::vec3( 0,-1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1)},
+            {glm::vec3( 0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0)},
+            {glm::vec3( 0, 0,-1), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0)}
+        }};
+
+        uint32_t vertexOffset = 0;
+        std::vector<glm::vec3> positions;
+        for(const auto& f : Faces)
+        {
+            auto ToSphere = [&](float s, float t)
+            {
+                glm::vec3 c = f[0] + f[1] * (2.0f * s - 1.0f) + f[2] * (2.0f * t - 1.0f);
+                return glm::normalize(Rotate(Spherify(c)));
+            };
+            GenerateFace(n, false, Rotate(f[0]), ToSphere, vertexOffset,
+                         positions, vertices, triangles);
+        }
+    }
+}
+
+uint32_t SphereShape::VertexCount() const
+{
+    uint32_t n = std::max(1u, level);
+    switch(type)
+    {
+        case UV:    return (UVSegments(level) + 1) * (UVRings(level) + 1);
+        case ICO:   return 20 * (n + 1) * (n + 2) / 2;
+        case CUBE:  return 6 * (n + 1) * (n + 1);
+    }
+    return 0;
+}
+
+uint32_t SphereShape::TriangleCount() const
+{
+    uint32_t n = std::max(1u, level);
+    switch(type)
+    {
+        case UV:    return 2 * UVSegments(level) * (UVRings(level) - 1);
+        case ICO:   return 20 * n * n;
+        case CUBE:  return 12 * n * n;
+    }
+    return 0;
+}
+
+SphereShape SphereShape::ForTriangleBudget(Type type, uint32_t triangleBudget)
+{
+    SphereShape shape = {type, (type == UV) ? MIN_UV_SEGMENTS : 1u};
+    SphereShape next = shape;
+    for(next.level++; next.TriangleCount() <= triangleBudget; next.level++)
+        shape = next;
+    return shape;
+}
+
+const char* SphereShape::TypeName(Type type)
+{
+    switch(type)
+    {
+        case UV:    return "UV";
+        case ICO:   return "ICO";
+        case CUBE:  return "CUBE";
+    }
+    return "UNKNOWN";
+}
+
+MeshDecode SphereDecode()
+{
+    MeshDecode decode;
+    decode.position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    // Unwrapped u is within [-0.5, 1.5]
+    decode.uv = glm::vec4(-0.5f, 0.0f, 2.0f, 1.0f);
+    decode.octNormals = true;
+    return decode;
+}
+
+float GenerateSphere(const SphereShape& shape, const VertexStreamWriter& vertices,
+                     const IndexStreamWriter& indices)
+{
+    TriangleSink triangles = {indices};
+    uint32_t n = std::max(1u, shape.level);
+    switch(shape.type)
+    {
+        case SphereShape::UV:   GenerateUV(shape.level, vertices, triangles); break;
+        case SphereShape::ICO:  GenerateIco(n, vertices, triangles); break;
+        case SphereShape::CUBE: GenerateCube(n, vertices, triangles); break;
+    }
+    // Vertices are on the unit sphere, so this is MeshSurfaceError
+    return 1.0f - triangles.minCentroidRadius;
+}
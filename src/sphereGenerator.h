@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "vertexFormat.h"
+
+// Tessellation of the unit sphere. "level" is:
+// UV   : longitude segments (latitude rings are half of it)
+// ICO  : edge subdivision frequency of the icosahedron faces
+// CUBE : grid cells along an edge of the cube faces
+//
+// UVs follow the equirectangular mapping of the sphere assets
+// (u = 0 at +X, v = 0 at the south pole); triangles are counter
+// clockwise from outside. ICO and CUBE faces have their own vertices
+// so that u can be unwrapped per face, which puts u in [-0.5, 1.5]
+// (textures must repeat horizontally).
+struct SphereShape {
+  enum Type : uint32_t { UV = 0, ICO = 1, CUBE = 2 };
+
+  Type type = UV;
+  uint32_t level = 32;
+
+  uint32_t VertexCount() const;
+  uint32_t TriangleCount() const;
+
+  // Finest shape whose triangle count is within "triangleBudget"
+  // (the coarsest one if none is)
+  static SphereShape ForTriangleBudget(Type, uint32_t triangleBudget);
+  static const char *TypeName(Type);
+};
+
+// PACKED decode of generated spheres (see VertexStreamWriter)
+MeshDecode SphereDecode();
+
+// Writes the vertices and indices of "shape" (VertexCount() and
+// 3 * TriangleCount() entries). Returns its LOD error, see
+// MeshSurfaceError.
+float GenerateSphere(const SphereShape &shape, const VertexStreamWriter &,
+                     const IndexStreamWriter &);
@@ -0,0 +1,382 @@
+#include "textureContainer.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+namespace
+{
+    constexpr char TEXTURE_CONTAINER_MAGIC[8] = {'P', 'L', 'T', 'E', 'X', '\0', '\0', '\0'};
+    constexpr size_t LEVEL_ALIGNMENT = 16;
+
+    // All offsets are from the start of the file
+    struct TextureContainerHeader
+    {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    headerSize;
+        // Texel encoding
+        uint32_t    compressed;
+        uint32_t    blockFormat;
+        uint32_t    channelCount;
+        uint32_t    bytesPerChannel;
+        // Level 0 size, "levelCount" index entries follow the header
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    levelCount;
+        uint32_t    reserved;
+        // Source key, zero for converted assets
+        uint64_t    sourceSize;
+        int64_t     sourceTime;
+        uint64_t    sourceHash;
+        // Levels in file order (padding excluded)
+        uint64_t    payloadHash;
+    };
+    static_assert(sizeof(TextureContainerHeader) == 80);
+
+    struct LevelIndexEntry
+    {
+        uint64_t    offset;
+        uint64_t    size;
+    };
+    static_assert(sizeof(LevelIndexEntry) == 16);
+
+    constexpr size_t AlignUp(size_t v, size_t a)
+    {
+        return (v + a - 1) / a * a;
+    }
+
+    // Levels with their file offsets, the smallest level comes first
+    std::vector<MipLevel> FileLayout(const TexelEncoding& encoding,
+                                     uint32_t width, uint32_t height)
+    {
+        std::vector<MipLevel> levels = encoding.LevelsFor(width, height);
+        size_t offset = AlignUp(sizeof(TextureContainerHeader) +
+                                levels.size() * sizeof(LevelIndexEntry), LEVEL_ALIGNMENT);
+        for(size_t i = levels.size(); i-- > 0;)
+        {
+            levels[i].offset = offset;
+            offset = AlignUp(offset + levels[i].size, LEVEL_ALIGNMENT);
+        }
+        return levels;
+    }
+
+    uint64_t PayloadHash(const unsigned char* data, const std::vector<MipLevel>& levels)
+    {
+        uint64_t hash = 0;
+        for(size_t i = levels.size(); i-- > 0;)
+            hash = HashBytes(data + levels[i].offset, levels[i].size, hash);
+        return hash;
+    }
+
+    bool EncodingFrom(const TextureContainerHeader& header, TexelEncoding& out)
+    {
+        if(header.compressed)
+        {
+            if(header.blockFormat > BlockFormat::BC7) return false;
+            out = TexelEncoding::Block(BlockFormat::Type(header.blockFormat));
+            return true;
+        }
+        if(header.channelCount < 1 || header.channelCount > 4 ||
+           (header.bytesPerChannel != 1 && header.bytesPerChannel != 2))
+            return false;
+        out = TexelEncoding::Raw(header.channelCount, header.bytesPerChannel);
+        return true;
+    }
+}
+
+TexelEncoding TexelEncoding::Block(BlockFormat::Type format)
+{
+    TexelEncoding e;
+    e.compressed = true;
+    e.blockFormat = format;
+    return e;
+}
+
+TexelEncoding TexelEncoding::Raw(uint32_t channels, uint32_t bytes)
+{
+    TexelEncoding e;
+    e.channelCount = channels;
+    e.bytesPerChannel = bytes;
+    return e;
+}
+
+std::string TexelEncoding::Name() const
+{
+    if(compressed) return BlockFormat::Name(blockFormat);
+
+    static constexpr const char* Channels[4] = {"R", "RG", "RGB", "RGBA"};
+    if(channelCount < 1 || channelCount > 4) return "UNKNOWN";
+    return Channels[channelCount - 1] + std::to_string(bytesPerChannel * 8);
+}
+
+uint32_t TexelEncoding::ChannelCount() const
+{
+    if(!compressed) return channelCount;
+    switch(blockFormat)
+    {
+        case BlockFormat::BC1: return 3;
+        case BlockFormat::BC4: return 1;
+        case BlockFormat::BC5: return 2;
+        default:               return 4;
+    }
+}
+
+std::vector<MipLevel> TexelEncoding::LevelsFor(uint32_t width, uint32_t height) const
+{
+    if(compressed) return BlockFormat::LevelsFor(blockFormat, width, height);
+
+    std::vector<MipLevel> levels(MipCountFor(width, height));
+    size_t offset = 0;
+    for(uint32_t i = 0; i < levels.size(); i++)
+    {
+        MipLevel& l = levels[i];
+        l.width = std::max(width >> i, 1u);
+        l.height = std::max(height >> i, 1u);
+        l.offset = offset;
+        l.size = size_t(l.width) * l.height * channelCount * bytesPerChannel;
+        offset += l.size;
+    }
+    return levels;
+}
+
+TextureImage EncodeTexture(const unsigned char* pixels, uint32_t width,
+                           uint32_t height, uint32_t channelCount,
+                           const TexelEncoding& encoding, const MipFilter& filter)
+{
+    TextureImage image;
+    image.encoding = encoding;
+    image.width = width;
+    image.height = height;
+    if(encoding.compressed)
+    {
+        CompressedImage c = CompressImage(pixels, width, height, channelCount,
+                                          encoding.blockFormat, filter);
+        image.levels = std::move(c.levels);
+        image.data = std::move(c.data);
+        return image;
+    }
+
+    assert(encoding.channelCount == channelCount && encoding.bytesPerChannel == 1);
+    image.levels = encoding.LevelsFor(width, height);
+    image.data.resize(image.levels.back().offset + image.levels.back().size);
+    std::memcpy(image.data.data(), pixels, image.levels[0].size);
+    MipChain mips = GenerateMips(pixels, width, height, channelCount, 1, filter);
+    for(size_t i = 1; i < image.levels.size(); i++)
+        std::memcpy(image.data.data() + image.levels[i].offset, mips.Pixels(i - 1),
+                    image.levels[i].size);
+    return image;
+}
+
+TextureImage EncodeTexture(const unsigned char* pixels, uint32_t width,
+                           uint32_t height, uint32_t channelCount,
+                           const TexelEncoding& encoding)
+{
+    return EncodeTexture(pixels, width, height, channelCount, encoding,
+                         MipFilter::For(channelCount));
+}
+
+std::string TextureContainer::PathFor(const std::string& imagePath)
+{
+    return std::filesystem::path(imagePath).replace_extension(EXTENSION).generic_string();
+}
+
+bool TextureContainer::IsContainerPath(const std::string& path)
+{
+    return std::filesystem::path(path).extension() == EXTENSION;
+}
+
+bool TextureContainer::Write(const std::string& path, const TextureImage& image,
+                             const SourceKey& key)
+{
+    std::vector<MipLevel> layout = FileLayout(image.encoding, image.width, image.height);
+    assert(layout.size() == image.levels.size());
+
+    TextureContainerHeader header = {};
+    std::memcpy(header.magic, TEXTURE_CONTAINER_MAGIC, sizeof(TEXTURE_CONTAINER_MAGIC));
+    header.version         = VERSION;
+    header.headerSize      = sizeof(TextureContainerHeader);
+    header.compressed      = image.encoding.compressed ? 1 : 0;
+    header.blockFormat     = image.encoding.blockFormat;
+    header.channelCount    = image.encoding.channelCount;
+    header.bytesPerChannel = image.encoding.bytesPerChannel;
+    header.width           = image.width;
+    header.height          = image.height;
+    header.levelCount      = uint32_t(layout.size());
+    header.sourceSize      = key.stamp.size;
+    header.sourceTime      = key.stamp.modifiedTime;
+    header.sourceHash      = key.hash;
+    header.payloadHash     = PayloadHash(image.data.data(), image.levels);
+
+    std::vector<LevelIndexEntry> index(layout.size());
+    for(size_t i = 0; i < layout.size(); i++)
+        index[i] = LevelIndexEntry{layout[i].offset, layout[i].size};
+
+    static constexpr unsigned char Padding[LEVEL_ALIGNMENT] = {};
+    std::vector<FileChunk> chunks =
+    {
+        {&header, sizeof(TextureContainerHeader)},
+        {index.data(), index.size() * sizeof(LevelIndexEntry)}
+    };
+    size_t offset = sizeof(TextureContainerHeader) + index.size() * sizeof(LevelIndexEntry);
+    for(size_t i = layout.size(); i-- > 0;)
+    {
+        chunks.push_back({Padding, layout[i].offset - offset});
+        chunks.push_back({image.data.data() + image.levels[i].offset, image.levels[i].size});
+        offset = layout[i].offset + layout[i].size;
+    }
+    return WriteFileAtomic(path, chunks);
+}
+
+bool TextureContainer::ReadHeader(const std::string& path, TexelEncoding& outEncoding,
+                                  uint32_t& outWidth, uint32_t& outHeight)
+{
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if(!f) return false;
+    TextureContainerHeader header;
+    bool read = (std::fread(&header, sizeof(TextureContainerHeader), 1, f) == 1);
+    std::fclose(f);
+
+    if(!read ||
+       std::memcmp(header.magic, TEXTURE_CONTAINER_MAGIC, sizeof(TEXTURE_CONTAINER_MAGIC)) != 0 ||
+       header.headerSize != sizeof(TextureContainerHeader) ||
+       header.version != VERSION ||
+       header.width == 0 || header.height == 0 ||
+       !EncodingFrom(header, outEncoding))
+        return false;
+    outWidth = header.width;
+    outHeight = header.height;
+    return true;
+}
+
+bool TextureContainer::Open(const std::string& path)
+{
+    file = MappedFile(path);
+    if(!file.IsOpen()) return false;
+
+    auto Reject = [&](const char* reason)
+    {
+        std::printf("[WARNING]: Texture container \"%s\" is %s.\n",
+                    path.c_str(), reason);
+        file = MappedFile();
+        return false;
+    };
+
+    TextureContainerHeader header;
+    if(file.size < sizeof(TextureContainerHeader)) return Reject("corrupt");
+    std::memcpy(&header, file.data, sizeof(TextureContainerHeader));
+    if(std::memcmp(header.magic, TEXTURE_CONTAINER_MAGIC, sizeof(TEXTURE_CONTAINER_MAGIC)) != 0 ||
+       header.headerSize != sizeof(TextureContainerHeader))
+        return Reject("corrupt");
+    if(header.version != VERSION)
+        return Reject("from an older version");
+
+    TexelEncoding enc;
+    if(!EncodingFrom(header, enc) || header.width == 0 || header.height == 0)
+        return Reject("corrupt");
+
+    // The index must be exactly the layout the writer produces
+    std::vector<MipLevel> layout = FileLayout(enc, header.width, header.height);
+    size_t indexEnd = sizeof(TextureContainerHeader) + layout.size() * sizeof(LevelIndexEntry);
+    if(header.levelCount != layout.size() || file.size < indexEnd ||
+       file.size != layout[0].offset + layout[0].size)
+        return Reject("corrupt");
+    for(size_t i = 0; i < layout.size(); i++)
+    {
+        LevelIndexEntry e;
+        std::memcpy(&e, file.data + sizeof(TextureContainerHeader) + i * sizeof(LevelIndexEntry),
+                    sizeof(LevelIndexEntry));
+        if(e.offset != layout[i].offset || e.size != layout[i].size)
+            return Reject("corrupt");
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(file.data);
+    if(PayloadHash(bytes, layout) != header.payloadHash)
+        return Reject("corrupt");
+
+    encoding = enc;
+    width = header.width;
+    height = header.height;
+    levels = std::move(layout);
+    data = bytes;
+    source.stamp.size = header.sourceSize;
+    source.stamp.modifiedTime = header.sourceTime;
+    source.hash = header.sourceHash;
+    return true;
+}
+
+std::string TextureSource::CachePathFor(const std::string& imagePath, BlockFormat::Type t)
+{
+    std::string name = BlockFormat::Name(t);
+    for(char& c : name)
+        c = char(std::tolower(c));
+    return imagePath + "." + name + ".texcache";
+}
+
+bool TextureSource::LoadContainer(const std::string& path)
+{
+    if(!container.Open(path)) return false;
+    encoding = container.encoding;
+    width = container.width;
+    height = container.height;
+    levels = container.levels;
+    data = container.data;
+    return true;
+}
+
+bool TextureSource::LoadCompressed(const std::string& imagePath, BlockFormat::Type format)
+{
+    // Try the cache first, it is mapped and uploaded as is
+    std::string cachePath = CachePathFor(imagePath, format);
+    SourceKey key;
+    bool hasKey = ComputeSourceKey(imagePath, key);
+    if(hasKey && container.Open(cachePath))
+    {
+        if(container.source == key && container.encoding == TexelEncoding::Block(format))
+        {
+            encoding = container.encoding;
+            width = container.width;
+            height = container.height;
+            levels = container.levels;
+            data = container.data;
+            std::printf("Texture \"%s\" is loaded succesfully from its %s cache.\n",
+                        imagePath.c_str(), BlockFormat::Name(format));
+            return true;
+        }
+        std::printf("[WARNING]: Texture cache \"%s\" is out of date, "
+                    "falling back to the image.\n", cachePath.c_str());
+        container = TextureContainer();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    stbi_set_flip_vertically_on_load_thread(1);
+    int w, h, channelCount;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels(stbi_load(imagePath.c_str(), &w, &h,
+                                                                    &channelCount, 0),
+                                                          stbi_image_free);
+    if(!pixels) return false;
+
+    image = EncodeTexture(pixels.get(), uint32_t(w), uint32_t(h),
+                          uint32_t(channelCount), TexelEncoding::Block(format));
+    encoding = image.encoding;
+    width = image.width;
+    height = image.height;
+    levels = image.levels;
+    data = image.data.data();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                          start).count();
+    std::printf("Texture \"%s\" is compressed to %s in %.0f ms.\n",
+                imagePath.c_str(), BlockFormat::Name(format), ms);
+
+    if(hasKey && !TextureContainer::Write(cachePath, image, key))
+        std::printf("[WARNING]: Unable to write texture cache \"%s\"\n",
+                    cachePath.c_str());
+    return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "blockCompressor.h"
+#include "fileIO.h"
+
+// Texel layout of the levels of a texture: GPU blocks, or tightly packed
+// rows of 8 / 16-bit texels with 1 to 4 channels
+struct TexelEncoding {
+  bool compressed = false;
+  BlockFormat::Type blockFormat = BlockFormat::BC1;
+  uint32_t channelCount = 0;
+  uint32_t bytesPerChannel = 1;
+
+  static TexelEncoding Block(BlockFormat::Type);
+  static TexelEncoding Raw(uint32_t channelCount, uint32_t bytesPerChannel);
+
+  // "BC1", "RGBA8", "R16" etc.
+  std::string Name() const;
+  // Channels the encoding stores (BC1: 3, BC4: 1, BC5: 2, BC7: 4)
+  uint32_t ChannelCount() const;
+  // Levels of a full mip chain, packed back to back
+  std::vector<MipLevel> LevelsFor(uint32_t width, uint32_t height) const;
+
+  bool operator==(const TexelEncoding &) const = default;
+};
+
+// Image with its full mip chain
+struct TextureImage {
+  TexelEncoding encoding;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<MipLevel> levels;
+  std::vector<unsigned char> data;
+};
+
+// Encodes a tightly packed 8-bit image (rows bottom first) and its box
+// filtered mips (see GenerateMips, CompressImage). Raw encodings must
+// have the channel count of the image and 8-bit channels.
+TextureImage EncodeTexture(const unsigned char *pixels, uint32_t width,
+                           uint32_t height, uint32_t channelCount,
+                           const TexelEncoding &, const MipFilter &);
+// With the filter of the renderer (see MipFilter::For)
+TextureImage EncodeTexture(const unsigned char *pixels, uint32_t width,
+                           uint32_t height, uint32_t channelCount,
+                           const TexelEncoding &);
+
+// GPU ready texture file ("*.ptex"), laid out like a KTX2 file: a header,
+// an index of every mip level and the levels in the layout the GL
+// uploads as is (blocks, or rows bottom first with no padding). Levels
+// are stored from the smallest one to level 0, each 16-byte aligned, so
+// the coarse mips are read first.
+//
+// Converted assets (see tools/textureConverter.cpp) have no source key;
+// caches of an image carry the key of the image they were encoded from.
+// Loading is a memory mapping, a payload checksum catches corrupt files.
+struct TextureContainer {
+  static constexpr uint32_t VERSION = 1;
+  static constexpr const char *EXTENSION = ".ptex";
+
+  MappedFile file;
+  TexelEncoding encoding;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // Level offsets are from "data", the start of the mapping
+  std::vector<MipLevel> levels;
+  const unsigned char *data = nullptr;
+  SourceKey source;
+
+  // "textures/moon.jpg" -> "textures/moon.ptex"
+  static std::string PathFor(const std::string &imagePath);
+  static bool IsContainerPath(const std::string &path);
+  // Returns false on I/O failure
+  static bool Write(const std::string &path, const TextureImage &,
+                    const SourceKey &source = {});
+  // Header only, for allocating the storage before the levels are read.
+  // Returns false if the file is not a container of this version.
+  static bool ReadHeader(const std::string &path, TexelEncoding &,
+                         uint32_t &width, uint32_t &height);
+
+  // Maps and validates a container, returns false (with a warning when
+  // the file exists) if it is missing or corrupt.
+  bool Open(const std::string &path);
+};
+
+// Levels of a texture in their GPU layout: a container mapped as is, or
+// an image block compressed through a source keyed container next to it
+// ("<image>.<format>.texcache", e.g. "moon.jpg.bc1.texcache") that is
+// (re)written whenever it is missing or stale.
+struct TextureSource {
+  TexelEncoding encoding;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<MipLevel> levels;
+  const unsigned char *data = nullptr;
+  // Owners of "data", the container or the encoded image
+  TextureContainer container;
+  TextureImage image;
+
+  static std::string CachePathFor(const std::string &imagePath,
+                                  BlockFormat::Type);
+
+  // Thread safe, both return false if the file can not be read
+  bool LoadContainer(const std::string &path);
+  bool LoadCompressed(const std::string &imagePath, BlockFormat::Type);
+};
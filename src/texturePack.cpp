@@ -0,0 +1,250 @@
+#include "texturePack.h"
+#include "threadPool.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    constexpr const char* CHANNEL_NAMES = "rgba";
+
+    bool SourceFrom(const std::string& name, TexturePack::Channel::Source& out)
+    {
+        if(name == "r")         out = TexturePack::Channel::R;
+        else if(name == "g")    out = TexturePack::Channel::G;
+        else if(name == "b")    out = TexturePack::Channel::B;
+        else if(name == "a")    out = TexturePack::Channel::A;
+        else if(name == "luma") out = TexturePack::Channel::LUMA;
+        else return false;
+        return true;
+    }
+}
+
+bool TexturePack::IsPackPath(const std::string& p)
+{
+    return std::filesystem::path(p).extension() == EXTENSION;
+}
+
+std::string TexturePack::CachePathFor(const std::string& packPath,
+                                      const TexelEncoding& encoding)
+{
+    std::string name = encoding.Name();
+    for(char& c : name)
+        c = char(std::tolower(c));
+    return packPath + "." + name + ".texcache";
+}
+
+bool TexturePack::Read(const std::string& packPath)
+{
+    std::ifstream file(packPath);
+    if(!file)
+    {
+        std::fprintf(stderr, "Unable to read texture pack \"%s\"\n", packPath.c_str());
+        return false;
+    }
+    path = packPath;
+    images.clear();
+    channels.clear();
+    coverage = 0.0f;
+
+    std::filesystem::path directory = std::filesystem::path(packPath).parent_path();
+    std::string line;
+    int lineNumber = 0;
+    auto Fail = [&](const std::string& reason)
+    {
+        std::fprintf(stderr, "Texture pack \"%s\", line %d: %s\n",
+                     packPath.c_str(), lineNumber, reason.c_str());
+        return false;
+    };
+    while(std::getline(file, line))
+    {
+        lineNumber++;
+        std::istringstream tokens(line);
+        std::string key;
+        if(!(tokens >> key) || key[0] == '#') continue;
+
+        if(key == "coverage")
+        {
+            if(!(tokens >> coverage) || coverage < 0.0f || coverage > 1.0f)
+                return Fail("coverage must be in [0, 1]");
+            continue;
+        }
+        if(channels.size() == 4) return Fail("a pack has at most 4 channels");
+        if(key.size() != 1 || key[0] != CHANNEL_NAMES[channels.size()])
+            return Fail(std::string("expected channel \"") + CHANNEL_NAMES[channels.size()] + "\"");
+
+        std::string source;
+        if(!(tokens >> source)) return Fail("missing the source of the channel");
+        Channel channel;
+        if(source.find_first_not_of("0123456789") == std::string::npos)
+        {
+            unsigned long value = std::strtoul(source.c_str(), nullptr, 10);
+            if(source.size() > 3 || value > 255) return Fail("constants are 0 to 255");
+            channel.constant = static_cast<unsigned char>(value);
+        }
+        else
+        {
+            std::string selector;
+            if(!(tokens >> selector) || !SourceFrom(selector, channel.source))
+                return Fail("expected the channel of \"" + source + "\" (r, g, b, a or luma)");
+            std::string image = (directory / source).lexically_normal().generic_string();
+            auto it = std::find(images.begin(), images.end(), image);
+            channel.image = uint32_t(it - images.begin());
+            if(it == images.end()) images.push_back(image);
+        }
+        std::string rest;
+        if(tokens >> rest && rest[0] != '#') return Fail("unexpected \"" + rest + "\"");
+        channels.push_back(channel);
+    }
+    if(channels.empty()) return Fail("no channels");
+    return true;
+}
+
+bool TexturePack::Info(uint32_t& width, uint32_t& height) const
+{
+    // Packs of constants only are a single texel
+    width = height = 1;
+    for(size_t i = 0; i < images.size(); i++)
+    {
+        int w, h, c;
+        if(!stbi_info(images[i].c_str(), &w, &h, &c))
+        {
+            std::fprintf(stderr, "Unable to read image \"%s\"\n", images[i].c_str());
+            return false;
+        }
+        if(i != 0 && (uint32_t(w) != width || uint32_t(h) != height))
+        {
+            std::fprintf(stderr, "Image \"%s\" of texture pack \"%s\" is %dx%d, "
+                         "the others are %ux%u\n", images[i].c_str(), path.c_str(),
+                         w, h, width, height);
+            return false;
+        }
+        width = uint32_t(w);
+        height = uint32_t(h);
+    }
+    return true;
+}
+
+MipFilter TexturePack::Filter() const
+{
+    MipFilter filter;
+    filter.alphaCutoff = coverage;
+    return filter;
+}
+
+bool TexturePack::ComputeKey(SourceKey& out) const
+{
+    if(!ComputeSourceKey(path, out)) return false;
+    for(const std::string& image : images)
+    {
+        SourceKey key;
+        if(!ComputeSourceKey(image, key)) return false;
+        out.stamp.size += key.stamp.size;
+        out.stamp.modifiedTime = std::max(out.stamp.modifiedTime, key.stamp.modifiedTime);
+        out.hash = HashBytes(&key.hash, sizeof(key.hash), out.hash);
+    }
+    return true;
+}
+
+std::vector<unsigned char> TexturePack::Pack(uint32_t& width, uint32_t& height) const
+{
+    // Every image as RGBA, so any selector reads a defined value
+    std::vector<unsigned char*> decoded(images.size(), nullptr);
+    std::vector<int> widths(images.size()), heights(images.size());
+    ThreadPool::Global().ParallelFor(uint32_t(images.size()), [&](uint32_t i)
+    {
+        stbi_set_flip_vertically_on_load_thread(1);
+        int c;
+        decoded[i] = stbi_load(images[i].c_str(), &widths[i], &heights[i], &c, 4);
+    });
+    std::vector<unsigned char> texels;
+    bool valid = true;
+    for(size_t i = 0; i < images.size(); i++)
+        valid = valid && decoded[i] && widths[i] == widths[0] && heights[i] == heights[0];
+    if(valid)
+    {
+        width = images.empty() ? 1 : uint32_t(widths[0]);
+        height = images.empty() ? 1 : uint32_t(heights[0]);
+        size_t channelCount = channels.size();
+        texels.resize(size_t(width) * height * channelCount);
+        ThreadPool::Global().ParallelFor(height, [&](uint32_t y)
+        {
+            size_t first = size_t(y) * width;
+            for(size_t i = first; i < first + width; i++)
+            for(size_t c = 0; c < channelCount; c++)
+            {
+                const Channel& channel = channels[c];
+                unsigned char& out = texels[i * channelCount + c];
+                if(channel.source == Channel::CONSTANT)
+                {
+                    out = channel.constant;
+                    continue;
+                }
+                const unsigned char* texel = decoded[channel.image] + i * 4;
+                if(channel.source == Channel::LUMA)
+                    out = static_cast<unsigned char>((54u * texel[0] + 183u * texel[1] +
+                                                      19u * texel[2] + 128u) >> 8);
+                else out = texel[channel.source];
+            }
+        });
+    }
+    for(unsigned char* pixels : decoded)
+        stbi_image_free(pixels);
+    return texels;
+}
+
+bool LoadTexturePack(const TexturePack& pack, const TexelEncoding& encoding,
+                     TextureSource& out)
+{
+    // Try the cache first, it is mapped and uploaded as is
+    std::string cachePath = TexturePack::CachePathFor(pack.path, encoding);
+    SourceKey key;
+    bool hasKey = pack.ComputeKey(key);
+    if(hasKey && out.container.Open(cachePath))
+    {
+        if(out.container.source == key && out.container.encoding == encoding)
+        {
+            out.encoding = out.container.encoding;
+            out.width = out.container.width;
+            out.height = out.container.height;
+            out.levels = out.container.levels;
+            out.data = out.container.data;
+            std::printf("Texture pack \"%s\" is loaded succesfully from its %s cache.\n",
+                        pack.path.c_str(), encoding.Name().c_str());
+            return true;
+        }
+        std::printf("[WARNING]: Texture pack cache \"%s\" is out of date, "
+                    "falling back to the images.\n", cachePath.c_str());
+        out.container = TextureContainer();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t w, h;
+    std::vector<unsigned char> texels = pack.Pack(w, h);
+    if(texels.empty()) return false;
+
+    out.image = EncodeTexture(texels.data(), w, h, uint32_t(pack.channels.size()),
+                              encoding, pack.Filter());
+    out.encoding = out.image.encoding;
+    out.width = out.image.width;
+    out.height = out.image.height;
+    out.levels = out.image.levels;
+    out.data = out.image.data.data();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                          start).count();
+    std::printf("Texture pack \"%s\" is packed from %zu images to %s in %.0f ms.\n",
+                pack.path.c_str(), pack.images.size(), encoding.Name().c_str(), ms);
+
+    if(hasKey && !TextureContainer::Write(cachePath, out.image, key))
+        std::printf("[WARNING]: Unable to write texture pack cache \"%s\"\n",
+                    cachePath.c_str());
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fileIO.h"
+#include "mipGenerator.h"
+#include "textureContainer.h"
+
+// Texture whose channels are selected from other images, so data that
+// is sampled together is stored (and bound) as one texture. It is
+// described by a text file ("*.texpack") with one line per channel of
+// the texture, in order ("r", then "g", "b" and "a"):
+//
+//   # Specular mask, night light intensity and cloud alpha
+//   r 2k_earth_specular_map.png r
+//   g 2k_earth_nightmap_alpha.png luma
+//   b 0
+//   a 2k_earth_clouds_alpha.png a
+//   coverage 0.5
+//
+// A channel is a channel of an image ("r", "g", "b", "a", or "luma",
+// the Rec. 709 luminance of its color), or a constant from 0 to 255.
+// Image paths are relative to the descriptor and every image must have
+// the same size; gray images read as their value in "r", "g" and "b",
+// images with no alpha as opaque. Channels hold data, mips average them
+// as they are (no sRGB decode, no alpha weighting). "coverage" keeps
+// the alpha coverage of the last channel of 2 and 4 channel textures at
+// that cutoff (see MipFilter).
+struct TexturePack {
+  static constexpr const char *EXTENSION = ".texpack";
+
+  struct Channel {
+    enum Source : uint32_t { R, G, B, A, LUMA, CONSTANT };
+
+    Source source = CONSTANT;
+    // Index in "images", unused by constants
+    uint32_t image = 0;
+    unsigned char constant = 0;
+  };
+
+  std::string path;
+  // Distinct image paths, relative to the working directory
+  std::vector<std::string> images;
+  std::vector<Channel> channels;
+  float coverage = 0.0f;
+
+  static bool IsPackPath(const std::string &path);
+  // "textures/earth.texpack", BC7 -> "textures/earth.texpack.bc7.texcache"
+  static std::string CachePathFor(const std::string &packPath,
+                                  const TexelEncoding &);
+
+  // Parses a descriptor, returns false (with an error) if it can not be
+  // read or is malformed
+  bool Read(const std::string &packPath);
+  // Size the images share, false if one of them can not be read or the
+  // sizes differ
+  bool Info(uint32_t &width, uint32_t &height) const;
+  MipFilter Filter() const;
+  // Key of the descriptor and of every image, any change to one of them
+  // changes it. Returns false if a file does not exist.
+  bool ComputeKey(SourceKey &out) const;
+  // Decodes the images (on the global thread pool) and packs their
+  // channels into tightly packed 8-bit texels, rows bottom first. Empty
+  // if an image can not be read.
+  std::vector<unsigned char> Pack(uint32_t &width, uint32_t &height) const;
+};
+
+// Levels of a pack in "encoding" (a block format, or raw with the 8-bit
+// channels of the pack), through a source keyed cache next to the
+// descriptor that is (re)written whenever it is missing or stale. Thread
+// safe, returns false if an image can not be read.
+bool LoadTexturePack(const TexturePack &, const TexelEncoding &,
+                     TextureSource &out);
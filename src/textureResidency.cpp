@@ -0,0 +1,374 @@
+#include "textureResidency.h"
+#include "gpuMemory.h"
+#include "mipGenerator.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+TextureResidency::TextureResidency(size_t budgetIn, size_t frameBudgetIn)
+    : budget(budgetIn)
+    , frameBudget(frameBudgetIn)
+{}
+
+std::shared_ptr<const TextureGL>
+TextureResidency::Request(const std::string& texPath,
+                          TextureGL::SampleMode sampleMode,
+                          TextureGL::EdgeResolve edgeResolveMode,
+                          const glm::vec4& placeholder, bool compress)
+{
+    return Request(TextureStreamer::Prefetch(texPath, compress), sampleMode,
+                   edgeResolveMode, placeholder);
+}
+
+std::shared_ptr<const TextureGL>
+TextureResidency::Request(TextureStreamer::Source&& source,
+                          TextureGL::SampleMode sampleMode,
+                          TextureGL::EdgeResolve edgeResolveMode,
+                          const glm::vec4& placeholder)
+{
+    // Prefetched before the GL could be asked for S3TC
+    if(source.kind != TextureStreamer::Source::CONTAINER && source.encoding.compressed &&
+       !TextureGL::SupportsBlockFormat(source.encoding.blockFormat))
+        source = TextureStreamer::Prefetch(source.path, true, false);
+
+    Entry e;
+    e.path = source.path;
+    e.sampleMode = sampleMode;
+    e.edgeResolveMode = edgeResolveMode;
+    e.startTime = source.startTime;
+    // Only the top mip is resident until the levels are read
+    uint32_t topLevel = MipCountFor(source.width, source.height) - 1;
+    const TexelEncoding& encoding = source.encoding;
+    if(encoding.compressed)
+    {
+        if(!TextureGL::SupportsBlockFormat(encoding.blockFormat))
+        {
+            std::fprintf(stderr, "%s textures are not supported by the GL!\n",
+                         BlockFormat::Name(encoding.blockFormat));
+            std::exit(EXIT_FAILURE);
+        }
+        e.texture = std::make_shared<TextureGL>(TextureGL(int(source.width),
+                                                          int(source.height),
+                                                          source.channelCount,
+                                                          encoding.blockFormat,
+                                                          sampleMode, edgeResolveMode,
+                                                          placeholder, topLevel));
+    }
+    else
+    {
+        if(!TexelFormatGL::For(int(encoding.channelCount), encoding.bytesPerChannel == 2,
+                               e.texelFormat))
+        {
+            std::fprintf(stderr, "Unkown image type!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        e.texture = std::make_shared<TextureGL>(TextureGL(int(source.width),
+                                                          int(source.height),
+                                                          e.texelFormat, sampleMode,
+                                                          edgeResolveMode, placeholder,
+                                                          topLevel));
+    }
+    e.validLevel = e.texture->mipCount;
+    e.decode = std::move(source.decode);
+    GPUMemory::Global().SetLabel(GPUMemory::TEXTURE, e.texture->textureId, source.path);
+    entries.push_back(std::move(e));
+    return entries.back().texture;
+}
+
+void TextureResidency::Use(const TextureGL& texture, float pixelsAcross)
+{
+    for(Entry& e : entries)
+    {
+        if(e.texture.get() != &texture) continue;
+        // Trilinear filtering blends the level of the footprint with the
+        // next coarser one
+        float texelsPerPixel = float(texture.width) / std::max(pixelsAcross, 1.0f);
+        uint32_t level = 0;
+        if(texelsPerPixel > 1.0f)
+            level = std::min(uint32_t(std::log2(texelsPerPixel)), texture.mipCount - 1);
+        e.frameLevel = std::min(e.frameLevel, level);
+        e.lastUseFrame = frame;
+        return;
+    }
+}
+
+size_t TextureResidency::LevelBytes(const Entry& e, uint32_t level)
+{
+    const TextureGL& t = *e.texture;
+    size_t bytes = 0;
+    if(e.levels.levels.size() == t.mipCount)
+    {
+        for(uint32_t l = level; l < t.mipCount; l++)
+            bytes += e.levels.levels[l].size;
+        return bytes;
+    }
+    // Not read yet
+    for(uint32_t l = level; l < t.mipCount; l++)
+        bytes += (size_t(std::max(t.width >> l, 1)) * size_t(std::max(t.height >> l, 1)) *
+                  e.texelFormat.texelSize);
+    return bytes;
+}
+
+void TextureResidency::Finish(Entry& e)
+{
+    TextureStreamer::Decoded d = e.decode.get();
+    if(d.levels.empty())
+    {
+        std::fprintf(stderr, "Unable to read image \"%s\"\n", e.path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    // Decoded images come with their mips (see TextureStreamer::Prefetch)
+    const TextureGL& t = *e.texture;
+    e.levels = std::move(d);
+    e.loaded = true;
+    e.tailLevel = 0;
+    while(e.tailLevel + 1 < t.mipCount &&
+          uint32_t(std::max(t.width, t.height) >> e.tailLevel) > TAIL_SIZE)
+        e.tailLevel++;
+    e.wantedLevel = e.tailLevel;
+    e.wantedUseTime = Clock::now();
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - e.startTime).count();
+    std::printf("Texture \"%s\" is readable after %.0f ms.\n", e.path.c_str(), ms);
+}
+
+void TextureResidency::SetResidentLevel(Entry& e, uint32_t level)
+{
+    TextureGL& t = *e.texture;
+    if(level == t.residentLevel) return;
+    t.Reallocate(level, e.sampleMode, e.edgeResolveMode);
+    t.gpuBytes = LevelBytes(e, level);
+    t.TrackMemory();
+    // Uploaded levels that are not part of the storage anymore
+    if(level >= e.validLevel)
+    {
+        e.validLevel = level;
+        e.nextRow = 0;
+        e.pageIn = {};
+    }
+    // Levels copied from the old storage may not be uploaded yet, the
+    // placeholder top mip is sampled until the first one is
+    uint32_t baseLevel = std::min(e.validLevel, t.mipCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(baseLevel - level));
+}
+
+bool TextureResidency::EvictFor(const Entry& e, size_t bytes)
+{
+    size_t resident = ResidentBytes();
+    while(resident + bytes > budget)
+    {
+        // Least recently used texture that has levels below its tail and
+        // was not drawn in the last frame
+        Entry* victim = nullptr;
+        for(Entry& o : entries)
+        {
+            if(&o == &e || !o.loaded || o.lastUseFrame == frame ||
+               o.texture->residentLevel >= o.tailLevel)
+                continue;
+            if(!victim || o.lastUseFrame < victim->lastUseFrame)
+                victim = &o;
+        }
+        if(!victim) return false;
+
+        size_t before = victim->texture->gpuBytes;
+        victim->wantedLevel = victim->tailLevel;
+        victim->wantedUseTime = Clock::now();
+        SetResidentLevel(*victim, victim->tailLevel);
+        resident -= before - victim->texture->gpuBytes;
+        stats.evictions++;
+    }
+    return true;
+}
+
+size_t TextureResidency::Reduce(size_t bytes)
+{
+    size_t resident = ResidentBytes();
+    budget = (resident > bytes) ? std::min(budget, resident - bytes) : 0;
+    size_t freed = 0;
+    while(freed < bytes)
+    {
+        // Unlike "EvictFor", textures drawn this frame are candidates too
+        Entry* victim = nullptr;
+        for(Entry& o : entries)
+        {
+            if(!o.loaded || o.texture->residentLevel >= o.tailLevel) continue;
+            if(!victim || o.lastUseFrame < victim->lastUseFrame)
+                victim = &o;
+        }
+        if(!victim) break;
+
+        size_t before = victim->texture->gpuBytes;
+        victim->wantedLevel = victim->tailLevel;
+        victim->wantedUseTime = Clock::now();
+        SetResidentLevel(*victim, victim->tailLevel);
+        freed += before - victim->texture->gpuBytes;
+        stats.evictions++;
+    }
+    std::printf("Texture residency budget is reduced to %.2f MiB, %.2f MiB is released.\n",
+                double(budget) / (1024.0 * 1024.0), double(freed) / (1024.0 * 1024.0));
+    return freed;
+}
+
+size_t TextureResidency::Upload(Entry& e, size_t maxBytes)
+{
+    TextureGL& t = *e.texture;
+    uint32_t level = e.validLevel - 1;
+    const MipLevel& l = e.levels.levels[level];
+    const unsigned char* pixels = e.levels.data + l.offset;
+
+    // Touch every page of the level on a worker first, so reading a
+    // mapped file does not block the GL thread
+    using namespace std::chrono_literals;
+    if(!e.pageIn.valid())
+    {
+        size_t size = l.size;
+        e.pageIn = ThreadPool::Global().Submit([owner = e.levels.owner, pixels, size]()
+        {
+            const volatile unsigned char* p = pixels;
+            unsigned char sum = 0;
+            for(size_t i = 0; i < size; i += 4096)
+                sum = static_cast<unsigned char>(sum + p[i]);
+            (void)sum;
+        });
+        return 0;
+    }
+    if(e.pageIn.wait_for(0s) != std::future_status::ready) return 0;
+
+    // As many rows as the budget allows, at least one
+    uint32_t rowCount = l.height;
+    if(t.compressed)
+        rowCount = (l.height + BlockFormat::BLOCK_DIM - 1) / BlockFormat::BLOCK_DIM;
+    size_t rowSize = l.size / rowCount;
+    uint32_t rows = uint32_t(std::max<size_t>(maxBytes / rowSize, 1));
+    rows = std::min(rows, rowCount - e.nextRow);
+
+    GLint storageLevel = GLint(level - t.residentLevel);
+    const unsigned char* src = pixels + size_t(e.nextRow) * rowSize;
+    glBindTexture(GL_TEXTURE_2D, t.textureId);
+    if(t.compressed)
+    {
+        // Regions are whole blocks, except at the level border
+        uint32_t y = e.nextRow * BlockFormat::BLOCK_DIM;
+        uint32_t h = std::min(rows * BlockFormat::BLOCK_DIM, l.height - y);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, storageLevel, 0, GLint(y),
+                                  GLsizei(l.width), GLsizei(h), t.sizedFormat,
+                                  GLsizei(size_t(rows) * rowSize), src);
+    }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, storageLevel, 0, GLint(e.nextRow),
+                        GLsizei(l.width), GLsizei(rows), e.texelFormat.format,
+                        e.texelFormat.type, src);
+    }
+    e.nextRow += rows;
+    size_t bytes = size_t(rows) * rowSize;
+    stats.uploadedBytes += bytes;
+    if(e.nextRow != rowCount) return bytes;
+
+    // Level complete, sample it
+    e.nextRow = 0;
+    e.pageIn = {};
+    e.validLevel = level;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(level - t.residentLevel));
+    return bytes;
+}
+
+void TextureResidency::Update()
+{
+    // Released by every user
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [](const Entry& e) { return e.texture.use_count() == 1; }),
+                  entries.end());
+
+    using namespace std::chrono_literals;
+    for(Entry& e : entries)
+    {
+        if(!e.loaded && e.decode.wait_for(0s) == std::future_status::ready)
+            Finish(e);
+    }
+
+    // Levels needed by the uses of the last frame, finer ones are kept
+    // for a while in case they are needed again
+    Clock::time_point now = Clock::now();
+    for(Entry& e : entries)
+    {
+        uint32_t needed = (e.lastUseFrame == frame) ? std::min(e.frameLevel, e.tailLevel)
+                                                    : e.tailLevel;
+        e.frameLevel = UINT32_MAX;
+        if(!e.loaded) continue;
+
+        if(needed <= e.wantedLevel || now - e.wantedUseTime >= TRIM_DELAY)
+        {
+            e.wantedLevel = needed;
+            e.wantedUseTime = now;
+        }
+        if(e.wantedLevel > e.texture->residentLevel)
+        {
+            SetResidentLevel(e, e.wantedLevel);
+            stats.trims++;
+        }
+    }
+
+    // Finer levels, most recently used textures first; the others make
+    // room when the budget is reached
+    std::vector<Entry*> order;
+    for(Entry& e : entries)
+        if(e.loaded) order.push_back(&e);
+    std::stable_sort(order.begin(), order.end(), [](const Entry* a, const Entry* b)
+    {
+        return a->lastUseFrame > b->lastUseFrame;
+    });
+    for(Entry* e : order)
+    {
+        uint32_t residentLevel = e->texture->residentLevel;
+        if(e->wantedLevel >= residentLevel) continue;
+
+        uint32_t level = e->wantedLevel;
+        for(; level < residentLevel; level++)
+        {
+            if(EvictFor(*e, LevelBytes(*e, level) - e->texture->gpuBytes))
+                break;
+        }
+        if(level < residentLevel) SetResidentLevel(*e, level);
+    }
+
+    // Uploads, at least one row per frame so wide levels progress
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t remaining = frameBudget;
+    for(Entry* e : order)
+    {
+        if(remaining == 0) break;
+        if(e->validLevel > e->texture->residentLevel)
+            remaining -= std::min(remaining, Upload(*e, remaining));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    frame++;
+}
+
+size_t TextureResidency::ResidentBytes() const
+{
+    size_t bytes = 0;
+    for(const Entry& e : entries)
+        bytes += e.texture->gpuBytes;
+    return bytes;
+}
+
+size_t TextureResidency::FullChainBytes() const
+{
+    size_t bytes = 0;
+    for(const Entry& e : entries)
+        bytes += (e.loaded) ? LevelBytes(e, 0) : e.texture->gpuBytes;
+    return bytes;
+}
+
+uint32_t TextureResidency::PendingCount() const
+{
+    uint32_t count = 0;
+    for(const Entry& e : entries)
+        count += (e.loaded) ? 0 : 1;
+    return count;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "textureStreamer.h"
+#include "utility.h"
+
+// Keeps only the mip levels textures are drawn with on the GPU.
+//
+// Textures are requested like streamed ones (see TextureStreamer), with
+// a storage of their 1x1 top mip showing a placeholder color. Their
+// levels are read on the global thread pool and kept on the CPU side
+// (containers stay mapped; images get box filtered mips). Each frame
+// the renderer reports the screen size textures are drawn at ("Use"),
+// which gives the finest level the sampler needs.
+//
+// "Update" reallocates the storage of a texture to the needed levels
+// (TextureGL::Reallocate, resident levels are copied on the GPU) and
+// uploads the finer ones from coarse to fine, at most "frameBudget"
+// bytes per frame; GL_TEXTURE_BASE_LEVEL follows the uploaded levels,
+// so a texture sharpens progressively. The pages of a level are touched
+// on a worker before its upload so mapped files do not stall the GL
+// thread. Levels with sizes up to TAIL_SIZE are always resident. Finer
+// levels that were not needed for TRIM_DELAY are released; when the
+// resident levels of every texture would exceed "budget", the least
+// recently used textures fall back to their tail first, then the
+// request itself is clamped to what fits.
+//
+// Requests, "Use" and "Update" must be called on the thread that owns
+// the GL context.
+class TextureResidency {
+public:
+  static constexpr size_t DEFAULT_BUDGET = 128 * 1024 * 1024;
+  static constexpr size_t DEFAULT_FRAME_BUDGET = 8 * 1024 * 1024;
+  static constexpr uint32_t TAIL_SIZE = 128;
+  static constexpr std::chrono::milliseconds TRIM_DELAY{2000};
+
+  struct Stats {
+    // Since the last "ResetStats"
+    size_t uploadedBytes = 0;
+    uint32_t evictions = 0;
+    uint32_t trims = 0;
+  };
+
+  // Constructors, Movement & Destructor
+  explicit TextureResidency(size_t budget = DEFAULT_BUDGET,
+                            size_t frameBudget = DEFAULT_FRAME_BUDGET);
+  TextureResidency(const TextureResidency &) = delete;
+  TextureResidency(TextureResidency &&) = delete;
+  TextureResidency &operator=(const TextureResidency &) = delete;
+  TextureResidency &operator=(TextureResidency &&) = delete;
+  ~TextureResidency() = default;
+
+  std::shared_ptr<const TextureGL> Request(const std::string &texPath,
+                                           TextureGL::SampleMode,
+                                           TextureGL::EdgeResolve,
+                                           const glm::vec4 &placeholder,
+                                           bool compress = false);
+  std::shared_ptr<const TextureGL> Request(TextureStreamer::Source &&,
+                                           TextureGL::SampleMode,
+                                           TextureGL::EdgeResolve,
+                                           const glm::vec4 &placeholder);
+
+  // "texture" is drawn this frame with its width spanning
+  // "pixelsAcross" screen pixels (e.g. the circumference of a sphere it
+  // wraps). Textures of other owners are ignored.
+  void Use(const TextureGL &texture, float pixelsAcross);
+  // Adjusts the residency to the uses since the last call and uploads
+  // the next levels, once per frame
+  void Update();
+  // Lowers the budget by "bytes" and drops textures (least recently used
+  // first, drawn or not) to their tails until that much is released.
+  // Returns the bytes released, e.g. for a GPUMemory budget.
+  size_t Reduce(size_t bytes);
+
+  size_t ResidentBytes() const;
+  // Bytes of the full chains of the managed textures
+  size_t FullChainBytes() const;
+  size_t Budget() const { return budget; }
+  // Textures whose levels are still being read
+  uint32_t PendingCount() const;
+  const Stats &GetStats() const { return stats; }
+  void ResetStats() { stats = Stats(); }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    std::shared_ptr<TextureGL> texture;
+    std::string path;
+    TextureGL::SampleMode sampleMode = TextureGL::LINEAR;
+    TextureGL::EdgeResolve edgeResolveMode = TextureGL::REPEAT;
+    TexelFormatGL texelFormat;
+    // Every level once read
+    std::future<TextureStreamer::Decoded> decode;
+    TextureStreamer::Decoded levels;
+    bool loaded = false;
+    uint32_t tailLevel = 0;
+    // Finest level the texture is kept at, and of the uses this frame
+    uint32_t wantedLevel = 0;
+    uint32_t frameLevel = UINT32_MAX;
+    uint64_t lastUseFrame = 0;
+    // Last time "wantedLevel" was needed
+    Clock::time_point wantedUseTime;
+    Clock::time_point startTime;
+    // Finest uploaded level ("mipCount" before the first one), the next
+    // one is uploaded row by row (block rows when compressed) once its
+    // pages are touched
+    uint32_t validLevel = 0;
+    uint32_t nextRow = 0;
+    std::future<void> pageIn;
+  };
+
+  size_t budget;
+  size_t frameBudget;
+  uint64_t frame = 1;
+  std::vector<Entry> entries;
+  Stats stats;
+
+  // Bytes of the levels "level" and coarser
+  static size_t LevelBytes(const Entry &, uint32_t level);
+  void Finish(Entry &);
+  void SetResidentLevel(Entry &, uint32_t level);
+  bool EvictFor(const Entry &, size_t bytes);
+  // Returns the bytes uploaded, at most "budget" (at least one row)
+  size_t Upload(Entry &, size_t budget);
+};
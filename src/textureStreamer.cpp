@@ -0,0 +1,384 @@
+#include "textureStreamer.h"
+#include "gpuMemory.h"
+#include "mipGenerator.h"
+#include "textureContainer.h"
+#include "texturePack.h"
+#include "threadPool.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+TextureStreamer::TextureStreamer(size_t stagingSizeIn, size_t frameBudgetIn)
+    : stagingSize(stagingSizeIn)
+    , frameBudget(frameBudgetIn)
+{
+    static constexpr GLbitfield Flags = (GL_MAP_WRITE_BIT |
+                                         GL_MAP_PERSISTENT_BIT |
+                                         GL_MAP_COHERENT_BIT);
+    glGenBuffers(1, &stagingBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(stagingSize), nullptr, Flags);
+    staging = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                                           GLsizeiptr(stagingSize),
+                                                           Flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if(!staging)
+    {
+        std::printf("Unable to map the texture staging buffer!\n");
+        std::exit(EXIT_FAILURE);
+    }
+    GPUMemory::Global().Track(GPUMemory::BUFFER, stagingBuffer, GPUMemory::STAGING, stagingSize,
+                              0, "texture streaming ring");
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for(const InFlight& f : inFlight)
+        glDeleteSync(f.fence);
+    GPUMemory::Global().Release(GPUMemory::BUFFER, stagingBuffer);
+    if(stagingBuffer)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &stagingBuffer);
+    }
+}
+
+TextureStreamer::Source TextureStreamer::Prefetch(const std::string& texPath,
+                                                  bool compress, bool allowBC1)
+{
+    // Header only, the levels are read by the workers: GPU ready levels
+    // (a container, or a compressed image or a pack through its cache) or
+    // level 0 of an image and its filtered mips
+    Source source;
+    source.path = texPath;
+    source.startTime = std::chrono::steady_clock::now();
+    bool is16Bit = false;
+    TexturePack pack;
+    if(TextureContainer::IsContainerPath(texPath))
+    {
+        if(!TextureContainer::ReadHeader(texPath, source.encoding,
+                                         source.width, source.height))
+        {
+            std::fprintf(stderr, "Unable to read texture container \"%s\"\n",
+                         texPath.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        source.kind = Source::CONTAINER;
+        source.channelCount = int(source.encoding.ChannelCount());
+    }
+    else if(TexturePack::IsPackPath(texPath))
+    {
+        if(!pack.Read(texPath) || !pack.Info(source.width, source.height))
+            std::exit(EXIT_FAILURE);
+        source.kind = Source::PACK;
+        source.channelCount = int(pack.channels.size());
+        if(compress)
+        {
+            BlockFormat::Type format = BlockFormat::ForChannelCount(source.channelCount);
+            if(format == BlockFormat::BC1 && !allowBC1)
+                format = BlockFormat::BC7;
+            source.encoding = TexelEncoding::Block(format);
+        }
+        else source.encoding = TexelEncoding::Raw(uint32_t(source.channelCount), 1);
+    }
+    else
+    {
+        int w = 0, h = 0;
+        if(!stbi_info(texPath.c_str(), &w, &h, &source.channelCount))
+        {
+            std::fprintf(stderr, "Unable to read image \"%s\"\n", texPath.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        source.width = uint32_t(w);
+        source.height = uint32_t(h);
+        is16Bit = stbi_is_16_bit(texPath.c_str());
+        if(compress && !is16Bit)
+        {
+            BlockFormat::Type format = BlockFormat::ForChannelCount(source.channelCount);
+            if(format == BlockFormat::BC1 && !allowBC1)
+                format = BlockFormat::BC7;
+            source.kind = Source::COMPRESSED_IMAGE;
+            source.encoding = TexelEncoding::Block(format);
+        }
+        else source.encoding = TexelEncoding::Raw(uint32_t(source.channelCount),
+                                                  is16Bit ? 2 : 1);
+    }
+
+    if(source.kind != Source::IMAGE)
+    {
+        Source::Kind kind = source.kind;
+        TexelEncoding encoding = source.encoding;
+        source.decode = ThreadPool::Global().Submit([texPath, kind, encoding, pack]()
+        {
+            auto levels = std::make_shared<TextureSource>();
+            Decoded d;
+            bool loaded = false;
+            switch(kind)
+            {
+                case Source::CONTAINER: loaded = levels->LoadContainer(texPath); break;
+                case Source::PACK:      loaded = LoadTexturePack(pack, encoding, *levels); break;
+                default: loaded = levels->LoadCompressed(texPath, encoding.blockFormat); break;
+            }
+            if(!loaded) return d;
+            d.data = levels->data;
+            d.levels = levels->levels;
+            d.owner = std::move(levels);
+            return d;
+        });
+    }
+    else
+    {
+        int channelCount = source.channelCount;
+        size_t texelSize = size_t(channelCount) * (is16Bit ? 2u : 1u);
+        source.decode = ThreadPool::Global().Submit([texPath, channelCount, is16Bit, texelSize]()
+        {
+            // Same orientation as the synchronous loader (bottom row first)
+            stbi_set_flip_vertically_on_load_thread(1);
+            int w, h, c;
+            void* pixels = nullptr;
+            if(is16Bit) pixels = stbi_load_16(texPath.c_str(), &w, &h, &c, channelCount);
+            else        pixels = stbi_load(texPath.c_str(), &w, &h, &c, channelCount);
+            Decoded d;
+            if(!pixels) return d;
+            // Mips are filtered here as well, every level is uploaded
+            MipChain chain = GenerateMips(pixels, uint32_t(w), uint32_t(h),
+                                          uint32_t(channelCount), is16Bit ? 2u : 1u,
+                                          MipFilter::For(uint32_t(channelCount)));
+            size_t baseSize = size_t(w) * size_t(h) * texelSize;
+            auto buffer = std::make_shared<std::vector<unsigned char>>();
+            buffer->reserve(baseSize + chain.data.size());
+            const unsigned char* base = static_cast<const unsigned char*>(pixels);
+            buffer->insert(buffer->end(), base, base + baseSize);
+            buffer->insert(buffer->end(), chain.data.begin(), chain.data.end());
+            stbi_image_free(pixels);
+
+            d.levels.push_back(MipLevel{uint32_t(w), uint32_t(h), 0, baseSize});
+            for(const MipLevel& l : chain.levels)
+                d.levels.push_back(MipLevel{l.width, l.height, baseSize + l.offset, l.size});
+            d.data = buffer->data();
+            d.owner = std::move(buffer);
+            return d;
+        });
+    }
+    return source;
+}
+
+std::shared_ptr<const TextureGL>
+TextureStreamer::Request(const std::string& texPath,
+                         TextureGL::SampleMode sampleMode,
+                         TextureGL::EdgeResolve edgeResolveMode,
+                         const glm::vec4& placeholder, bool compress)
+{
+    return Request(Prefetch(texPath, compress), sampleMode, edgeResolveMode, placeholder);
+}
+
+std::shared_ptr<const TextureGL>
+TextureStreamer::Request(Source&& source,
+                         TextureGL::SampleMode sampleMode,
+                         TextureGL::EdgeResolve edgeResolveMode,
+                         const glm::vec4& placeholder)
+{
+    // Prefetched before the GL could be asked for S3TC
+    if(source.kind != Source::CONTAINER && source.encoding.compressed &&
+       !TextureGL::SupportsBlockFormat(source.encoding.blockFormat))
+        source = Prefetch(source.path, true, false);
+
+    Job job;
+    job.path = source.path;
+    job.startTime = source.startTime;
+    const TexelEncoding& encoding = source.encoding;
+    std::shared_ptr<const TextureGL> texture;
+    if(encoding.compressed)
+    {
+        // A block row must fit in the ring
+        size_t blocksX = (source.width + BlockFormat::BLOCK_DIM - 1) / BlockFormat::BLOCK_DIM;
+        if(blocksX * BlockFormat::BlockSize(encoding.blockFormat) > stagingSize)
+            return std::make_shared<const TextureGL>(TextureGL(source.path, sampleMode,
+                                                               edgeResolveMode, true));
+        if(!TextureGL::SupportsBlockFormat(encoding.blockFormat))
+        {
+            std::fprintf(stderr, "%s textures are not supported by the GL!\n",
+                         BlockFormat::Name(encoding.blockFormat));
+            std::exit(EXIT_FAILURE);
+        }
+        texture = std::make_shared<const TextureGL>(TextureGL(int(source.width),
+                                                              int(source.height),
+                                                              source.channelCount,
+                                                              encoding.blockFormat,
+                                                              sampleMode, edgeResolveMode,
+                                                              placeholder));
+    }
+    else
+    {
+        if(!TexelFormatGL::For(int(encoding.channelCount), encoding.bytesPerChannel == 2,
+                               job.texelFormat))
+        {
+            std::fprintf(stderr, "Unkown image type!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        // A row must fit in the ring
+        if(size_t(source.width) * job.texelFormat.texelSize > stagingSize)
+            return std::make_shared<const TextureGL>(TextureGL(source.path, sampleMode,
+                                                               edgeResolveMode));
+        texture = std::make_shared<const TextureGL>(TextureGL(int(source.width),
+                                                              int(source.height),
+                                                              job.texelFormat,
+                                                              sampleMode,
+                                                              edgeResolveMode,
+                                                              placeholder));
+    }
+    job.texture = texture;
+    job.decode = std::move(source.decode);
+    GPUMemory::Global().SetLabel(GPUMemory::TEXTURE, texture->textureId, source.path);
+    jobs.push_back(std::move(job));
+    return texture;
+}
+
+void TextureStreamer::Retire()
+{
+    while(!inFlight.empty())
+    {
+        const InFlight& f = inFlight.front();
+        GLenum status = glClientWaitSync(f.fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(f.fence);
+        tail = f.end;
+        used -= f.bytes;
+        inFlight.pop_front();
+    }
+}
+
+int TextureStreamer::ReserveRows(size_t rowSize, int maxRows, size_t& offset,
+                                 size_t& frameBytes)
+{
+    if(used == 0) head = tail = 0;
+    // Completely full
+    if(used != 0 && head == tail) return 0;
+
+    size_t contiguous = 0;
+    if(head >= tail)
+    {
+        contiguous = stagingSize - head;
+        // Wrap around, the end of the ring is wasted until retired
+        if(contiguous < rowSize && tail >= rowSize)
+        {
+            used += contiguous;
+            frameBytes += contiguous;
+            head = 0;
+            contiguous = tail;
+        }
+    }
+    else contiguous = tail - head;
+
+    int rows = int(std::min(size_t(maxRows), contiguous / rowSize));
+    if(rows == 0) return 0;
+
+    size_t size = size_t(rows) * rowSize;
+    offset = head;
+    head += size;
+    used += size;
+    frameBytes += size;
+    return rows;
+}
+
+void TextureStreamer::Update()
+{
+    Retire();
+    if(jobs.empty()) return;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t budget = frameBudget;
+    size_t frameBytes = 0;
+    for(auto it = jobs.begin(); it != jobs.end() && budget != 0;)
+    {
+        Job& job = *it;
+        std::shared_ptr<const TextureGL> texture = job.texture.lock();
+        // Released before it became resident
+        if(!texture)
+        {
+            it = jobs.erase(it);
+            continue;
+        }
+        if(job.decoded.levels.empty())
+        {
+            using namespace std::chrono_literals;
+            if(job.decode.wait_for(0s) != std::future_status::ready)
+            {
+                it++;
+                continue;
+            }
+            job.decoded = job.decode.get();
+            if(job.decoded.levels.empty())
+            {
+                std::fprintf(stderr, "Unable to read image \"%s\"\n",
+                             job.path.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+        }
+
+        // Copy as many rows as the budget and the ring allow,
+        // at least one row per frame so wide images progress
+        const MipLevel& l = job.decoded.levels[job.level];
+        uint32_t rowCount = l.height;
+        if(texture->compressed)
+            rowCount = (l.height + BlockFormat::BLOCK_DIM - 1) / BlockFormat::BLOCK_DIM;
+        size_t rowSize = l.size / rowCount;
+        int maxRows = int(std::max<size_t>(budget / rowSize, 1));
+        maxRows = std::min(maxRows, int(rowCount - job.nextRow));
+        size_t offset = 0;
+        int rows = ReserveRows(rowSize, maxRows, offset, frameBytes);
+        if(rows == 0) break;
+
+        std::memcpy(staging + offset, job.decoded.data + l.offset + job.nextRow * rowSize,
+                    size_t(rows) * rowSize);
+        glBindTexture(GL_TEXTURE_2D, texture->textureId);
+        if(texture->compressed)
+        {
+            // Regions are whole blocks, except at the level border
+            uint32_t y = job.nextRow * BlockFormat::BLOCK_DIM;
+            uint32_t h = std::min(uint32_t(rows) * BlockFormat::BLOCK_DIM, l.height - y);
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, GLint(job.level), 0, GLint(y),
+                                      GLsizei(l.width), GLsizei(h), texture->sizedFormat,
+                                      GLsizei(size_t(rows) * rowSize),
+                                      reinterpret_cast<const void*>(offset));
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, GLint(job.level), 0, GLint(job.nextRow),
+                            GLsizei(l.width), rows,
+                            job.texelFormat.format, job.texelFormat.type,
+                            reinterpret_cast<const void*>(offset));
+        }
+        job.nextRow += uint32_t(rows);
+        budget -= std::min(budget, size_t(rows) * rowSize);
+        if(job.nextRow != rowCount) break;
+
+        // Next level of the same job, if the budget allows
+        job.level++;
+        job.nextRow = 0;
+        if(job.level != job.decoded.levels.size()) continue;
+
+        texture->FinishUpload();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                              job.startTime).count();
+        std::printf("Texture \"%s\" is resident after %.0f ms.\n",
+                    job.path.c_str(), ms);
+        it = jobs.erase(it);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if(frameBytes != 0)
+    {
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        inFlight.push_back(InFlight{fence, head, frameBytes});
+    }
+}
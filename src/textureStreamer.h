@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "textureContainer.h"
+#include "utility.h"
+
+// Loads textures in the background while the render loop keeps going.
+//
+// "Request" only reads the image header and creates the immutable
+// storage, so the texture can be bound right away; it samples a 1x1
+// placeholder color until it is resident (see TextureGL). The header
+// read can also be done by "Prefetch", before the GL context exists.
+// Images are decoded on the global thread pool (containers and the
+// caches of block compressed images and of texture packs are mapped
+// there instead, see TextureSource, TexturePack). "Update", called once
+// per frame, copies decoded rows (block rows when compressed) into a
+// persistently mapped staging ring (GL_PIXEL_UNPACK_BUFFER) and uploads
+// them with glTexSubImage2D / glCompressedTexSubImage2D. At most
+// "frameBudget" bytes are copied per frame; each frame's ring region is
+// fenced (glFenceSync) and reused only after the GL consumed it.
+// Every level is uploaded (images get their mips filtered on the
+// workers, see GenerateMips), then the texture switches to full
+// sampling.
+//
+// All functions except "Prefetch" must be called on the thread that
+// owns the GL context.
+class TextureStreamer {
+public:
+  static constexpr size_t DEFAULT_STAGING_SIZE = 32 * 1024 * 1024;
+  static constexpr size_t DEFAULT_FRAME_BUDGET = 8 * 1024 * 1024;
+
+  // Constructors, Movement & Destructor
+  explicit TextureStreamer(size_t stagingSize = DEFAULT_STAGING_SIZE,
+                           size_t frameBudget = DEFAULT_FRAME_BUDGET);
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer(TextureStreamer &&) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(TextureStreamer &&) = delete;
+  ~TextureStreamer();
+
+  // Levels to upload, rows are bottom first. Empty on failure.
+  struct Decoded {
+    // Owner of "data" (pixels or a TextureSource)
+    std::shared_ptr<const void> owner;
+    const unsigned char *data = nullptr;
+    std::vector<MipLevel> levels;
+  };
+  // CPU side of a request: the header of a texture and the read of its
+  // levels, running on the workers
+  struct Source {
+    enum Kind { CONTAINER, COMPRESSED_IMAGE, PACK, IMAGE };
+
+    std::string path;
+    Kind kind = IMAGE;
+    TexelEncoding encoding;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int channelCount = 0;
+    std::future<Decoded> decode;
+    std::chrono::steady_clock::time_point startTime;
+  };
+
+  // Reads the header (the descriptor and image headers of a pack) and
+  // starts reading the levels on the workers. Makes no GL calls, so it
+  // can run before the GL context exists (the block format assumes S3TC
+  // unless "allowBC1" is false, "Request" restarts BC1 reads without
+  // it).
+  static Source Prefetch(const std::string &texPath, bool compress = false,
+                         bool allowBC1 = true);
+
+  std::shared_ptr<const TextureGL> Request(const std::string &texPath,
+                                           TextureGL::SampleMode,
+                                           TextureGL::EdgeResolve,
+                                           const glm::vec4 &placeholder,
+                                           bool compress = false);
+  std::shared_ptr<const TextureGL> Request(Source &&, TextureGL::SampleMode,
+                                           TextureGL::EdgeResolve,
+                                           const glm::vec4 &placeholder);
+  // Uploads the next chunk of pending textures, once per frame
+  void Update();
+  // Number of requested textures that are not resident yet
+  uint32_t PendingCount() const { return uint32_t(jobs.size()); }
+
+private:
+  struct Job {
+    std::weak_ptr<const TextureGL> texture;
+    std::string path;
+    // Unused when compressed
+    TexelFormatGL texelFormat;
+    std::future<Decoded> decode;
+    Decoded decoded;
+    // Upload position, rows are block rows when compressed
+    size_t level = 0;
+    uint32_t nextRow = 0;
+    std::chrono::steady_clock::time_point startTime;
+  };
+  struct InFlight {
+    GLsync fence;
+    size_t end;
+    size_t bytes;
+  };
+
+  GLuint stagingBuffer = 0;
+  unsigned char *staging = nullptr;
+  size_t stagingSize;
+  size_t frameBudget;
+  // Ring state, [tail, head) is in use by the GL
+  size_t head = 0;
+  size_t tail = 0;
+  size_t used = 0;
+  std::deque<InFlight> inFlight;
+  std::deque<Job> jobs;
+
+  // Frees the ring regions the GL is done with
+  void Retire();
+  // Reserves up to "maxRows" contiguous rows of the ring, returns the
+  // reserved row count (zero if the ring is full)
+  int ReserveRows(size_t rowSize, int maxRows, size_t &offset,
+                  size_t &frameBytes);
+};
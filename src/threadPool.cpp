@@ -0,0 +1,97 @@
+#include "threadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    if(threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    workers.reserve(threadCount);
+    for(uint32_t i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    for(std::thread& t : workers) t.join();
+}
+
+ThreadPool& ThreadPool::Global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    for(;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stop || !jobs.empty(); });
+            // Drain the queue before quitting
+            if(jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t count,
+                             const std::function<void(uint32_t)>& f)
+{
+    if(count == 0) return;
+    if(count == 1) { f(0); return; }
+
+    // Helpers may start after the caller has already finished all the
+    // items, so the state they touch must outlive this call.
+    struct SharedState
+    {
+        std::atomic_uint32_t next = 0;
+        std::atomic_uint32_t done = 0;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    auto state = std::make_shared<SharedState>();
+    // Each helper runs items until none left, "f" is only referenced
+    // while there are items left, which the caller waits for.
+    const std::function<void(uint32_t)>* func = &f;
+    auto Work = [state, func, count]()
+    {
+        uint32_t i;
+        while((i = state->next.fetch_add(1)) < count)
+        {
+            (*func)(i);
+            if(state->done.fetch_add(1) + 1 == count)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cv.notify_all();
+            }
+        }
+    };
+
+    uint32_t helperCount = std::min(count - 1, ThreadCount());
+    for(uint32_t i = 0; i < helperCount; i++) Enqueue(Work);
+
+    Work();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&]() { return state->done.load() == count; });
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Simple fixed-size worker pool.
+//
+// "Submit" queues a single job and returns a future of its result.
+// "ParallelFor" splits [0, count) over the workers and the calling
+// thread; the caller always participates so it is safe to call it from
+// inside another job (it never waits on a job that can not run).
+class ThreadPool {
+public:
+  // Zero means one thread per hardware thread
+  explicit ThreadPool(uint32_t threadCount = 0);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ThreadPool &operator=(ThreadPool &&) = delete;
+  ~ThreadPool();
+
+  uint32_t ThreadCount() const { return uint32_t(workers.size()); }
+
+  template <class Func> auto Submit(Func &&f) -> std::future<decltype(f())>;
+
+  void ParallelFor(uint32_t count, const std::function<void(uint32_t)> &f);
+
+  // Process-wide pool, created on first use
+  static ThreadPool &Global();
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop = false;
+
+  void Enqueue(std::function<void()> job);
+  void WorkerLoop();
+};
+
+// Template Definitions
+template <class Func>
+auto ThreadPool::Submit(Func &&f) -> std::future<decltype(f())> {
+  using R = decltype(f());
+  // std::function requires copyable callables, so wrap the
+  // packaged task in a shared pointer
+  auto task =
+      std::make_shared<std::packaged_task<R()>>(std::forward<Func>(f));
+  std::future<R> result = task->get_future();
+  Enqueue([task]() { (*task)(); });
+  return result;
+}
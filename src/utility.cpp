@@ -1,18 +1,28 @@
 #include "utility.h"
+#include "cubeMap.h"
+#include "meshOptimizer.h"
+#include "mipGenerator.h"
+#include "objLoader.h"
+#include "sphereGenerator.h"
+#include "textureContainer.h"
+#include "texturePack.h"
+#include "threadPool.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <stb_image.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <bit>
-#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <string_view>
 #include <vector>
-#include <charconv>
-#include <array>
 
 void SetupGLFWErrorCallback();
 void SetupOpenGLErrorCallback();
@@ -128,38 +138,334 @@ GLState::~GLState()
     glfwTerminate();
 }
 
-ShaderGL::ShaderGL(Type t, const std::string& path)
+namespace
 {
-    std::ifstream file(path, std::ios::binary);
-    if(!file)
+    // Program binaries are only valid for the driver that created them
+    uint64_t DriverHash()
     {
-        std::printf("Unable to open shader file at \"%s\".\n",
-                    path.c_str());
-        std::exit(EXIT_FAILURE);
+        static const uint64_t hash = []()
+        {
+            uint64_t h = 0;
+            const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+            for(GLenum name : names)
+            {
+                const char* str = reinterpret_cast<const char*>(glGetString(name));
+                if(str) h = HashBytes(str, std::strlen(str), h);
+            }
+            return h;
+        }();
+        return hash;
+    }
+
+    // Drivers may support no binary formats at all
+    bool SupportsProgramBinaries()
+    {
+        static const bool supported = []()
+        {
+            GLint formatCount = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+            return formatCount > 0;
+        }();
+        return supported;
+    }
+
+    // Whole file, false if it can not be read
+    bool ReadShaderFile(const std::string& path, std::vector<GLchar>& out)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if(!file) return false;
+        out.resize(size_t(file.seekg(0, std::ios::end).tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(out.data(), std::streamsize(out.size()));
+        return bool(file);
+    }
+
+    // '#include "file"' line of a shader, the file is relative to the
+    // shader. Included files can not include others.
+    struct ShaderInclude
+    {
+        size_t      begin;
+        size_t      end;
+        uint32_t    line;
+        std::string path;
+    };
+
+    std::vector<ShaderInclude> FindIncludes(const std::string& shaderPath,
+                                            const std::vector<GLchar>& source)
+    {
+        static constexpr std::string_view DIRECTIVE = "#include \"";
+        std::filesystem::path dir = std::filesystem::path(shaderPath).parent_path();
+        std::vector<ShaderInclude> includes;
+        size_t lineStart = 0;
+        for(uint32_t line = 1; lineStart < source.size(); line++)
+        {
+            auto newLine = std::find(source.begin() + std::ptrdiff_t(lineStart),
+                                     source.end(), '\n');
+            size_t lineEnd = size_t(newLine - source.begin());
+            std::string_view text(source.data() + lineStart, lineEnd - lineStart);
+            size_t close = text.find('"', DIRECTIVE.size());
+            if(text.starts_with(DIRECTIVE) && close != std::string_view::npos)
+            {
+                std::string_view name = text.substr(DIRECTIVE.size(),
+                                                    close - DIRECTIVE.size());
+                includes.push_back(ShaderInclude
+                {
+                    lineStart, std::min(lineEnd + 1, source.size()), line,
+                    (dir / name).generic_string()
+                });
+            }
+            lineStart = lineEnd + 1;
+        }
+        return includes;
+    }
+
+    // The module is stale when the source, or a file it includes, was
+    // edited after the build
+    bool IsModuleFresh(const std::string& path, const std::string& modulePath)
+    {
+        FileStamp moduleStamp, stamp;
+        std::vector<GLchar> source;
+        if(!GetFileStamp(modulePath, moduleStamp) || !GetFileStamp(path, stamp) ||
+           stamp.modifiedTime > moduleStamp.modifiedTime || !ReadShaderFile(path, source))
+            return false;
+        for(const ShaderInclude& include : FindIncludes(path, source))
+        {
+            if(!GetFileStamp(include.path, stamp) ||
+               stamp.modifiedTime > moduleStamp.modifiedTime)
+                return false;
+        }
+        return true;
+    }
+
+    // GLSL source of "p" with its includes pasted in, and its constants
+    // defined right after "#version" ("#line" keeps the line numbers of
+    // the compile errors, included lines are in source string 1)
+    void ReadGLSLSource(ShaderGL::Pending& p)
+    {
+        p.spirv = false;
+        if(!ReadShaderFile(p.path, p.source))
+        {
+            std::printf("Unable to open shader file at \"%s\".\n",
+                        p.path.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        // Back to front, so that the offsets of the others stay valid
+        std::vector<ShaderInclude> includes = FindIncludes(p.path, p.source);
+        for(auto include = includes.rbegin(); include != includes.rend(); include++)
+        {
+            std::vector<GLchar> text;
+            if(!ReadShaderFile(include->path, text))
+            {
+                std::printf("Unable to open shader file at \"%s\" (included by \"%s\").\n",
+                            include->path.c_str(), p.path.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            std::string before = "#line 1 1\n";
+            std::string after = "\n#line " + std::to_string(include->line + 1) + " 0\n";
+            text.insert(text.begin(), before.begin(), before.end());
+            text.insert(text.end(), after.begin(), after.end());
+            auto at = p.source.erase(p.source.begin() + std::ptrdiff_t(include->begin),
+                                     p.source.begin() + std::ptrdiff_t(include->end));
+            p.source.insert(at, text.begin(), text.end());
+        }
+
+        std::string defines;
+        for(const ShaderGL::Constant& c : p.constants)
+            defines += "#define " + c.name + " " + c.literal + "\n";
+        if(!defines.empty())
+        {
+            auto lineEnd = std::find(p.source.begin(), p.source.end(), '\n');
+            if(lineEnd != p.source.end()) lineEnd++;
+            defines += "#line 2\n";
+            p.source.insert(lineEnd, defines.begin(), defines.end());
+        }
+    }
+
+    // Program cache key of the source (and constants) of "p"
+    void HashSource(ShaderGL::Pending& p)
+    {
+        p.sourceHash = HashBytes(p.source.data(), p.source.size(), p.spirv ? 1 : 0);
+        for(const ShaderGL::Constant& c : p.constants)
+        {
+            p.sourceHash = HashBytes(&c.id, sizeof(c.id), p.sourceHash);
+            p.sourceHash = HashBytes(&c.value, sizeof(c.value), p.sourceHash);
+        }
+    }
+
+    // Specialized programs of a shader are cached separately
+    std::string ProgramCacheName(const ShaderGL::Pending& p)
+    {
+        if(p.constants.empty()) return p.path;
+        uint64_t hash = 0;
+        for(const ShaderGL::Constant& c : p.constants)
+        {
+            hash = HashBytes(&c.id, sizeof(c.id), hash);
+            hash = HashBytes(c.name.data(), c.name.size(), hash);
+            hash = HashBytes(&c.value, sizeof(c.value), hash);
+        }
+        char suffix[24];
+        std::snprintf(suffix, sizeof(suffix), ".%016llx",
+                      static_cast<unsigned long long>(hash));
+        return p.path + suffix;
+    }
+
+    // Compiles (or specializes) and links the source of "p" into a new
+    // program, without querying any status
+    void SubmitCompile(ShaderGL::Pending& p)
+    {
+        p.shader = glCreateShader(p.type);
+        if(p.spirv)
+        {
+            std::vector<GLuint> ids, values;
+            for(const ShaderGL::Constant& c : p.constants)
+            {
+                ids.push_back(c.id);
+                values.push_back(c.value);
+            }
+            glShaderBinary(1, &p.shader, GL_SHADER_BINARY_FORMAT_SPIR_V, p.source.data(),
+                           GLsizei(p.source.size()));
+            glSpecializeShader(p.shader, "main", GLuint(ids.size()), ids.data(), values.data());
+        }
+        else
+        {
+            const GLchar* srcPtr = p.source.data();
+            GLint sourceSize = GLint(p.source.size());
+            glShaderSource(p.shader, 1, &srcPtr, &sourceSize);
+            glCompileShader(p.shader);
+        }
+
+        // Attach this to openGL "program"
+        // (which represents entirity of the programmable rasterizer pipeline)
+        p.program = glCreateProgram();
+        glProgramParameteri(p.program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        glProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(p.program, p.shader);
+        glLinkProgram(p.program);
+        p.fromCache = false;
+    }
+}
+
+ShaderGL::Constant ShaderGL::Constant::Bool(uint32_t id, const std::string& name, bool v)
+{
+    return Constant{id, name, v ? 1u : 0u, v ? "true" : "false"};
+}
+
+ShaderGL::Constant ShaderGL::Constant::Int(uint32_t id, const std::string& name, int32_t v)
+{
+    return Constant{id, name, std::bit_cast<uint32_t>(v), std::to_string(v)};
+}
+
+ShaderGL::Constant ShaderGL::Constant::Float(uint32_t id, const std::string& name, float v)
+{
+    // Round trips, and is a float literal even when integral
+    char literal[32];
+    std::snprintf(literal, sizeof(literal), "%.9g", double(v));
+    std::string str = literal;
+    if(str.find_first_of(".en") == std::string::npos) str += ".0";
+    return Constant{id, name, std::bit_cast<uint32_t>(v), str};
+}
+
+ShaderGL::Pending ShaderGL::Submit(Type t, const std::string& path,
+                                   const Constants& constants)
+{
+    Pending p;
+    p.type = t;
+    p.path = path;
+    p.constants = constants;
+
+    std::string modulePath = path + ".spv";
+    if(GLAD_GL_VERSION_4_6 && IsModuleFresh(path, modulePath))
+        p.spirv = ReadShaderFile(modulePath, p.source);
+    if(!p.spirv) ReadGLSLSource(p);
+    HashSource(p);
+
+    ProgramCache cache;
+    if(SupportsProgramBinaries() &&
+       cache.Open(ProgramCacheName(p), p.sourceHash, DriverHash()))
+    {
+        // Separability must be set before the binary is loaded
+        p.program = glCreateProgram();
+        glProgramParameteri(p.program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        glProgramBinary(p.program, GLenum(cache.binaryFormat), cache.binary,
+                        GLsizei(cache.binarySize));
+        p.fromCache = true;
+        return p;
+    }
+    SubmitCompile(p);
+    return p;
+}
+
+ShaderGL::ShaderGL(Pending&& p)
+{
+    const char* shaderTypeStr = nullptr;
+    switch(p.type)
+    {
+        case ShaderGL::VERTEX:      shaderTypeStr = "Vertex"; break;
+        case ShaderGL::FRAGMENT:    shaderTypeStr = "Fragment"; break;
+        default:
+        {
+            std::fprintf(stderr, "Unkown Shader Type while compiling \"%s\"!",
+                         p.path.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    GLint isLinked = GL_FALSE;
+    if(p.fromCache)
+    {
+        glGetProgramiv(p.program, GL_LINK_STATUS, &isLinked);
+        if(isLinked == GL_TRUE)
+        {
+            shaderId = p.program;
+            p.program = 0;
+            std::printf("%s Shader \"%s\" is loaded succesfully from its program cache.\n",
+                        shaderTypeStr, p.path.c_str());
+            return;
+        }
+        // Same key, but the driver rejected it anyway
+        std::printf("[WARNING]: Program cache \"%s\" is rejected by the driver, "
+                    "falling back to the shader source.\n",
+                    ProgramCache::PathFor(ProgramCacheName(p)).c_str());
+        glDeleteProgram(p.program);
+        p.program = 0;
+        SubmitCompile(p);
+    }
+
+    // The module may use something the driver does not support,
+    // the GLSL source is still there
+    if(p.spirv)
+    {
+        GLint isSpecialized = GL_FALSE;
+        glGetShaderiv(p.shader, GL_COMPILE_STATUS, &isSpecialized);
+        if(isSpecialized == GL_TRUE)
+            glGetProgramiv(p.program, GL_LINK_STATUS, &isLinked);
+        if(isSpecialized == GL_FALSE || isLinked == GL_FALSE)
+        {
+            std::printf("[WARNING]: SPIR-V module \"%s.spv\" is rejected by the driver, "
+                        "falling back to the shader source.\n", p.path.c_str());
+            glDeleteProgram(p.program);
+            glDeleteShader(p.shader);
+            p.program = 0;
+            p.shader = 0;
+            ReadGLSLSource(p);
+            HashSource(p);
+            SubmitCompile(p);
+        }
     }
-    GLint sourceSize = GLint(file.seekg(0, std::ios::end).tellg());
-    std::vector<GLchar> source(size_t(sourceSize + 1), '\0');
-    file.seekg(0, std::ios::beg);
-    file.read(source.data(), sourceSize);
 
-    // Create temporary shader
-    GLuint shaderGL = glCreateShader(t);
-    GLchar* srcPtr = source.data();
-    glShaderSource(shaderGL, 1, &srcPtr, &sourceSize);
-    glCompileShader(shaderGL);
     GLint isCompiled = GL_FALSE;
-    glGetShaderiv(shaderGL, GL_COMPILE_STATUS, &isCompiled);
+    glGetShaderiv(p.shader, GL_COMPILE_STATUS, &isCompiled);
     if(isCompiled == GL_FALSE)
     {
         // We do not need to print the compilation error
         // OpenGL debug callback will automatically handle it
         std::fprintf(stderr, "Unable to compile shader \"%s\"\n",
-                     path.c_str());
+                     p.path.c_str());
 
         GLint errLen = 0;
-        glGetShaderiv(shaderGL, GL_INFO_LOG_LENGTH, &errLen);
+        glGetShaderiv(p.shader, GL_INFO_LOG_LENGTH, &errLen);
         std::vector<char> errLog(size_t(errLen + 1), '\0');
-        glGetShaderInfoLog(shaderGL, errLen, &errLen, errLog.data());
+        glGetShaderInfoLog(p.shader, errLen, &errLen, errLog.data());
 
         // Use our own print here
         PrintOpenGLError(GL_DEBUG_SOURCE_SHADER_COMPILER,
@@ -170,25 +476,18 @@ ShaderGL::ShaderGL(Type t, const std::string& path)
         std::exit(EXIT_FAILURE);
     }
 
-    // Attach this to openGL "program"
-    // (which represents entirity of the programmable rasterizer pipeline)
-    shaderId = glCreateProgram();
-    glProgramParameteri(shaderId, GL_PROGRAM_SEPARABLE, GL_TRUE);
-    glAttachShader(shaderId, shaderGL);
-    glLinkProgram(shaderId);
-    GLint isLinked = GL_FALSE;
-    glGetProgramiv(shaderId, GL_LINK_STATUS, &isLinked);
+    glGetProgramiv(p.program, GL_LINK_STATUS, &isLinked);
     if(isLinked == GL_FALSE)
     {
         // We do not need to print the compilation error
         // OpenGL debug callback will automatically handle it
         std::fprintf(stderr, "Unable to link shader \"%s\"\n",
-                     path.c_str());
+                     p.path.c_str());
 
         GLint errLen = 0;
-        glGetProgramiv(shaderId, GL_INFO_LOG_LENGTH, &errLen);
+        glGetProgramiv(p.program, GL_INFO_LOG_LENGTH, &errLen);
         std::vector<char> errLog(size_t(errLen + 1), '\0');
-        glGetProgramInfoLog(shaderId, errLen, &errLen, errLog.data());
+        glGetProgramInfoLog(p.program, errLen, &errLen, errLog.data());
         // Use our own print here
         PrintOpenGLError(GL_DEBUG_SOURCE_SHADER_COMPILER,
                          GL_DEBUG_TYPE_ERROR, 0,
@@ -198,273 +497,544 @@ ShaderGL::ShaderGL(Type t, const std::string& path)
     }
     // After linking, we can detach the shader.
     // Actual compiled assembly will be stayed inside the pipeline (program).
-    glDetachShader(shaderId, shaderGL);
-    glDeleteShader(shaderGL);
+    glDetachShader(p.program, p.shader);
+    glDeleteShader(p.shader);
+    p.shader = 0;
+    shaderId = p.program;
+    p.program = 0;
+    std::printf("%s Shader \"%s\" is %s succesfully.\n", shaderTypeStr, p.path.c_str(),
+                p.spirv ? "specialized from its SPIR-V module" : "compiled");
 
-    static const char* const VertexStr      = "Vertex";
-    static const char* const FragmentStr    = "Fragment";
-    const char* shaderTypeStr = nullptr;
-    switch(t)
+    if(!SupportsProgramBinaries()) return;
+    GLint binarySize = 0;
+    glGetProgramiv(shaderId, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if(binarySize <= 0) return;
+    std::vector<unsigned char> binary(static_cast<size_t>(binarySize));
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(shaderId, binarySize, &binarySize, &binaryFormat, binary.data());
+    std::string cacheName = ProgramCacheName(p);
+    if(!ProgramCache::Write(cacheName, p.sourceHash, DriverHash(), uint32_t(binaryFormat),
+                            binary.data(), size_t(binarySize)))
+        std::printf("[WARNING]: Unable to write program cache \"%s\"\n",
+                    ProgramCache::PathFor(cacheName).c_str());
+}
+
+namespace
+{
+    void BuildLodSource(MeshLodSource& out, const MeshData& mesh,
+                        MeshVertexLayout::Format vFormat)
     {
-        case ShaderGL::VERTEX:      shaderTypeStr = VertexStr; break;
-        case ShaderGL::FRAGMENT:    shaderTypeStr = FragmentStr; break;
-        default:
+        out.layout = MeshVertexLayout::For(vFormat, mesh.VertexCount());
+        out.vertexBlock = BuildVertexBlock(mesh, out.layout, out.decode);
+        out.indexStride = IndexStrideFor(mesh.VertexCount());
+        out.indexBlock = BuildIndexBlock(mesh.indices, out.indexStride);
+        out.indexCount = uint32_t(mesh.indices.size());
+        out.error = MeshSurfaceError(mesh);
+        out.vertexData = out.vertexBlock.data();
+        out.indexData = out.indexBlock.data();
+    }
+
+    void LoadLodSource(MeshLodSource& out, const std::string& objPath,
+                       MeshVertexLayout::Format vFormat)
+    {
+        // Try the binary cache first, it is mapped and uploaded as is.
+        MeshSourceKey key;
+        bool hasKey = MeshCache::ComputeKey(objPath, key);
+        if(hasKey && out.cache.Open(objPath, key, vFormat))
         {
-            std::fprintf(stderr, "Unkown Shader Type while compiling \"%s\"!",
-                         path.c_str());
-            std::exit(EXIT_FAILURE);
+            const MeshCache& c = out.cache;
+            out.layout = c.layout;
+            out.decode = c.decode;
+            out.error = c.surfaceError;
+            out.indexCount = c.indexCount;
+            out.indexStride = c.indexStride;
+            out.vertexData = c.vertexData;
+            out.indexData = c.indexData;
+            std::printf("Obj file \"%s\" is loaded succesfully from its cache.\n",
+                        objPath.c_str());
+            return;
         }
+
+        MeshData mesh = LoadObj(objPath);
+        OptimizeMesh(mesh, objPath.c_str());
+        BuildLodSource(out, mesh, vFormat);
+        if(hasKey && !MeshCache::Write(objPath, key, out.layout, out.decode,
+                                       out.error, out.vertexBlock,
+                                       out.indexBlock, out.indexStride))
+            std::printf("[WARNING]: Unable to write mesh cache \"%s\"\n",
+                        MeshCache::PathFor(objPath, vFormat).c_str());
     }
-    std::printf("%s Shader \"%s\" is compiled succesfully.\n",
-                shaderTypeStr, path.c_str());
 }
 
-// For mesh multiple index hashing
-struct ObjKeyType
+std::vector<MeshLodSource> LoadMeshLodSources(const std::vector<std::string>& lodObjPaths,
+                                              MeshVertexLayout::Format vFormat)
 {
-    uint32_t posIndex;
-    uint32_t uvIndex;
-    uint32_t normalIndex;
+    // LODs are independent, each one is loaded by a worker
+    std::vector<MeshLodSource> sources(lodObjPaths.size());
+    ThreadPool::Global().ParallelFor(uint32_t(lodObjPaths.size()), [&](uint32_t i)
+    {
+        LoadLodSource(sources[i], lodObjPaths[i], vFormat);
+    });
+    return sources;
+}
 
-    //auto operator==(const ObjKeyType& other) const
-    //{
-    //    return (posIndex == other.posIndex &&
-    //            uvIndex == other.uvIndex &&
-    //            normalIndex == other.normalIndex);
-    //}
+MeshGL::MeshGL(const std::string& objPath, MeshVertexLayout::Format vFormat)
+    : MeshGL(std::vector<std::string>{objPath}, vFormat)
+{}
 
-    auto operator<=>(const ObjKeyType&) const = default;
-};
+MeshGL::MeshGL(const std::vector<std::string>& lodObjPaths,
+               MeshVertexLayout::Format vFormat)
+    : MeshGL(LoadMeshLodSources(lodObjPaths, vFormat))
+{
+    SetMemoryLabel(lodObjPaths[0]);
+}
 
-template<>
-struct std::hash<ObjKeyType>
+MeshGL::MeshGL(const std::vector<MeshLodSource>& lodSources)
 {
-    std::uint64_t operator()(const ObjKeyType& k) const
-    {
-        return (k.posIndex * 7741ull +
-                k.normalIndex * 5113ull +
-                k.uvIndex * 9157ull);
-    }
-};
+    CreateBuffers(lodSources);
+}
 
-MeshGL::MeshGL(const std::string& objPath)
+namespace
 {
-    // ===================== //
-    //  PARSE WAVEFRONT OBJ  //
-    // ===================== //
-    std::from_chars_result result;
-    std::ifstream file(objPath);
-    if(!file)
+    // GPU buffer that is appended to without knowing its final size,
+    // it grows by doubling with GPU side copies
+    struct GrowingBufferGL
     {
-        std::fprintf(stderr, "Unable to open obj file \"%s\"\n",
-                     objPath.c_str());
-        std::exit(EXIT_FAILURE);
-    }
-    //
-    std::vector<glm::vec3> positions; positions.reserve(512);
-    std::vector<glm::vec3> normals;   normals.reserve(512);
-    std::vector<glm::vec2> uvs;       uvs.reserve(512);
-    std::vector<uint32_t> indices;    indices.reserve(512);
-    //
-    std::unordered_map<ObjKeyType, uint32_t> indexHashes;
-    indexHashes.reserve(1024 * 1024);
+        static constexpr size_t MIN_CAPACITY = 64 * 1024;
 
-    // Only find the index stuff
-    uint32_t indexCounter = 0;
-    std::string line;
-    while(std::getline(file, line))
-    {
-        if(line.starts_with("v "))
-        {
-            const char* ptr = line.data();
-            size_t s0 = line.find_first_of(' ') + 1;
-            size_t s1 = line.find_first_of(' ', s0) + 1;
-            size_t s2 = line.find_first_of(' ', s1) + 1;
-            size_t s3 = line.size();
+        GLuint  id = 0;
+        size_t  size = 0;
+        size_t  capacity = 0;
 
-            glm::vec3 pos;
-            result = std::from_chars(ptr + s0, ptr + s1, pos[0]); assert(result.ec == std::errc());
-            result = std::from_chars(ptr + s1, ptr + s2, pos[1]); assert(result.ec == std::errc());
-            result = std::from_chars(ptr + s2, ptr + s3, pos[2]); assert(result.ec == std::errc());
-            positions.push_back(pos);
+        GrowingBufferGL() = default;
+        GrowingBufferGL(const GrowingBufferGL&) = delete;
+        GrowingBufferGL& operator=(const GrowingBufferGL&) = delete;
+        ~GrowingBufferGL()
+        {
+            GPUMemory::Global().Release(GPUMemory::BUFFER, id);
+            if(id) glDeleteBuffers(1, &id);
         }
-        else if(line.starts_with("f "))
+
+        void Append(const void* data, size_t byteCount)
         {
-            std::string_view lView = line;
-            auto ParseTriplet = [&](size_t start, size_t end)
+            if(size + byteCount > capacity)
             {
-                std::string_view localView = lView.substr(start, end - start);
-                const char* ptr = localView.data();
-                size_t s0  = 0;
-                size_t s1 = localView.find_first_of('/', s0) + 1;
-                size_t s2 = localView.find_first_of('/', s1) + 1;
-                size_t s3 = end - start;
-                uint32_t pId = std::numeric_limits<uint32_t>::max();
-                uint32_t uvId = std::numeric_limits<uint32_t>::max();
-                uint32_t nId = std::numeric_limits<uint32_t>::max();
-                // Pos
+                size_t newCapacity = std::max({capacity * 2, size + byteCount,
+                                               MIN_CAPACITY});
+                GLuint newId = 0;
+                glGenBuffers(1, &newId);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, newId);
+                glBufferStorage(GL_COPY_WRITE_BUFFER, GLsizeiptr(newCapacity),
+                                nullptr, GL_DYNAMIC_STORAGE_BIT);
+                if(size != 0)
                 {
-                    result = std::from_chars(ptr + s0, ptr + s1, pId);
-                    assert(result.ec == std::errc());
+                    glBindBuffer(GL_COPY_READ_BUFFER, id);
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                        0, 0, GLsizeiptr(size));
                 }
-                // These two are optional
-                // UV
-                if(s1 != s2)
-                {
-                    result = std::from_chars(ptr + s1, ptr + s2, uvId);
-                    assert(result.ec == std::errc());
-                }
-                // Normal
-                if(s1 != s3)
-                {
-                    result = std::from_chars(ptr + s2, ptr + s3, nId);
-                    assert(result.ec == std::errc());
-                }
-                return ObjKeyType
-                {
-                    // Data of OBJ file is 1-indexed, so convert.
-                    .posIndex    = pId - 1,
-                    .uvIndex     = uvId - 1,
-                    .normalIndex = nId - 1
-                };
-            };
-
-            size_t s0 = line.find_first_of(' ') + 1;
-            size_t s1 = line.find_first_of(' ', s0) + 1;
-            size_t s2 = line.find_first_of(' ', s1) + 1;
-            size_t s3 = line.size();
-            auto pack0 = ParseTriplet(s0, s1);
-            auto pack1 = ParseTriplet(s1, s2);
-            auto pack2 = ParseTriplet(s2, s3);
-
-            auto insertR = indexHashes.emplace(pack0, indexCounter);
-            if(insertR.second) indexCounter++;
-            indices.push_back(insertR.first->second);
-
-            insertR = indexHashes.emplace(pack1, indexCounter);
-            if(insertR.second) indexCounter++;
-            indices.push_back(insertR.first->second);
-
-            insertR = indexHashes.emplace(pack2, indexCounter);
-            if(insertR.second) indexCounter++;
-            indices.push_back(insertR.first->second);
-        }
-        else if(line.starts_with("vt "))
-        {
-            const char* ptr = line.data();
-            size_t s0 = line.find_first_of(' ') + 1;
-            size_t s1 = line.find_first_of(' ', s0) + 1;
-            size_t s2 = line.size();
-
-            glm::vec2 uv;
-            result = std::from_chars(ptr + s0, ptr + s1, uv[0]); assert(result.ec == std::errc());
-            result = std::from_chars(ptr + s1, ptr + s2, uv[1]); assert(result.ec == std::errc());
-            uvs.push_back(uv);
-        }
-        else if(line.starts_with("vn "))
-        {
-            const char* ptr = line.data();
-            size_t s0 = line.find_first_of(' ') + 1;
-            size_t s1 = line.find_first_of(' ', s0) + 1;
-            size_t s2 = line.find_first_of(' ', s1) + 1;
-            size_t s3 = line.size();
-
-            glm::vec3 normal;
-            result = std::from_chars(ptr + s0, ptr + s1, normal[0]); assert(result.ec == std::errc());
-            result = std::from_chars(ptr + s1, ptr + s2, normal[1]); assert(result.ec == std::errc());
-            result = std::from_chars(ptr + s2, ptr + s3, normal[2]); assert(result.ec == std::errc());
-            normals.push_back(normal);
-        }
-    }
-    // Convert the data to single indexed mode
-    bool warnNormalsZero = false;
-    bool warnUVsZero = false;
-    std::vector<glm::vec3> linPositions; linPositions.resize(indexHashes.size());
-    std::vector<glm::vec3> linNormals;   linNormals.resize(indexHashes.size());
-    std::vector<glm::vec2> linUVs;       linUVs.resize(indexHashes.size());
-    for(const auto& entry : indexHashes)
-    {
-        uint32_t i = entry.second;
-        linPositions[i] = positions[entry.first.posIndex];
-        // If these are not available just write zero
-        if(entry.first.uvIndex != std::numeric_limits<uint32_t>::max())
-            linUVs[i] = uvs[entry.first.uvIndex];
-        else
+                GPUMemory::Global().Release(GPUMemory::BUFFER, id);
+                if(id) glDeleteBuffers(1, &id);
+                id = newId;
+                capacity = newCapacity;
+                GPUMemory::Global().Track(GPUMemory::BUFFER, id, GPUMemory::MESH, capacity, 0,
+                                          "(mesh ingestion)");
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(size),
+                            GLsizeiptr(byteCount), data);
+            size += byteCount;
+        }
+    };
+}
+
+MeshGL::MeshGL(const std::string& objPath, size_t memoryCap,
+               MeshVertexLayout::Format vFormat)
+{
+    using L = MeshVertexLayout;
+    // PACKED vertices are converted in chunks of this many vertices
+    static constexpr uint32_t CONVERT_CHUNK = 4096;
+
+    format = vFormat;
+    MeshDecode decode;
+    // One growing buffer per attribute stream, they are compacted into
+    // the planar layout once the vertex count is known
+    GrowingBufferGL streams[3];
+    L chunkLayout = L::For(format, CONVERT_CHUNK);
+    std::vector<unsigned char> chunk;
+    size_t indexOffset = 0;
+
+    ObjStreamCallbacks callbacks;
+    callbacks.begin = [&](const ObjStreamInfo& info)
+    {
+        if(format == L::PACKED)
         {
-            warnUVsZero = true;
-            linUVs[i] = glm::vec2(0);
+            decode = PackedDecodeFor(info.posMin, info.posMax,
+                                     info.uvMin, info.uvMax);
+            chunk.resize(chunkLayout.totalSize);
         }
-        //
-        if(entry.first.uvIndex != std::numeric_limits<uint32_t>::max())
-            linNormals[i] = normals[entry.first.normalIndex];
-        else
+        indexCount = GLuint(info.indexCount);
+        lods.resize(1);
+        // An OBJ without faces has nothing to store, but the buffers
+        // are still created (zero sized storage is an error)
+        glGenBuffers(1, &iBufferId);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, iBufferId);
+        if(info.indexCount != 0)
+            glBufferStorage(GL_COPY_WRITE_BUFFER,
+                            GLsizeiptr(info.indexCount * sizeof(uint32_t)),
+                            nullptr, GL_DYNAMIC_STORAGE_BIT);
+    };
+    std::vector<uint32_t> localIndices;
+    callbacks.window = [&](uint32_t firstVertex, const MeshData& window)
+    {
+        // Meshlets of the window, on its own vertices
+        localIndices.resize(window.indices.size());
+        for(size_t i = 0; i < window.indices.size(); i++)
+            localIndices[i] = window.indices[i] - firstVertex;
+        AppendMeshlets(0, uint32_t(indexOffset / sizeof(uint32_t)),
+                       localIndices, window.positions);
+        ExtendBounds(window.positions);
+
+        size_t indexBytes = window.indices.size() * sizeof(uint32_t);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, iBufferId);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(indexOffset),
+                        GLsizeiptr(indexBytes), window.indices.data());
+        indexOffset += indexBytes;
+
+        if(format == L::FLOAT32)
+        {
+            streams[L::POSITION].Append(window.positions.data(),
+                                        window.positions.size() * sizeof(glm::vec3));
+            streams[L::NORMAL].Append(window.normals.data(),
+                                      window.normals.size() * sizeof(glm::vec3));
+            streams[L::UV].Append(window.uvs.data(),
+                                  window.uvs.size() * sizeof(glm::vec2));
+            return;
+        }
+        VertexStreamWriter writer = VertexStreamWriter::For(chunkLayout, chunk.data(),
+                                                            0, decode);
+        for(uint32_t first = 0; first < window.VertexCount(); first += CONVERT_CHUNK)
         {
-            warnNormalsZero = true;
-            linNormals[i] = glm::vec3(0);
+            uint32_t count = std::min(CONVERT_CHUNK, window.VertexCount() - first);
+            for(uint32_t i = 0; i < count; i++)
+                writer.Write(i, window.positions[first + i], window.normals[first + i],
+                             window.uvs[first + i]);
+            for(uint32_t a = 0; a < 3; a++)
+                streams[a].Append(chunk.data() + chunkLayout.offsets[a],
+                                  count * chunkLayout.strides[a]);
         }
+    };
+    ObjStreamStats stats = StreamObj(objPath, memoryCap, callbacks);
+    vertexCount = stats.vertexCount;
+
+    // Compact the streams into the final buffer
+    L layout = L::For(format, vertexCount);
+    glGenBuffers(1, &vBufferId);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vBufferId);
+    if(layout.totalSize != 0)
+        glBufferStorage(GL_COPY_WRITE_BUFFER, GLsizeiptr(layout.totalSize),
+                        nullptr, GL_DYNAMIC_STORAGE_BIT);
+    for(uint32_t a = 0; a < 3; a++)
+    {
+        assert(streams[a].size == layout.sizes[a]);
+        if(layout.sizes[a] == 0) continue;
+        glBindBuffer(GL_COPY_READ_BUFFER, streams[a].id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                            GLintptr(layout.offsets[a]), GLsizeiptr(layout.sizes[a]));
     }
-    // Delete tmp buffers
-    positions = std::vector<glm::vec3>();
-    normals = std::vector<glm::vec3>();
-    uvs = std::vector<glm::vec2>();
 
-    if(warnNormalsZero)
-        std::printf("[WARNING]: Obj file \"%s\" has some of its "
-                    "normals are not present. These are written as zero!\n",
-                    objPath.c_str());
-    if(warnUVsZero)
-        std::printf("[WARNING]: Obj file \"%s\" has some of its "
-                    "uvs are not present. These are written as zero!\n",
-                    objPath.c_str());
+    MeshLodGL& lod = lods[0];
+    lod.indexCount = indexCount;
+    lod.vertexCount = vertexCount;
+    lod.decode = decode;
+    CreateVertexArray(layout, sizeof(uint32_t));
+    SetMemoryLabel(objPath);
+}
 
-    // ===================== //
-    //   GEN BUFFER AND VAO  //
-    // ===================== //
-    // Gen buffer
-    std::array<size_t, 3> sizes = {};
-    sizes[0] = linPositions.size() * sizeof(glm::vec3);
-    sizes[1] = linNormals.size() * sizeof(glm::vec3);
-    sizes[2] = linUVs.size() * sizeof(glm::vec2);
-    //
-    std::array<size_t, 4> offsets = {};
-    offsets[0] = 0;
-    for(uint32_t i = 1; i < 4; i++)
+MeshGL::MeshGL(const std::vector<SphereShape>& lodShapes,
+               MeshVertexLayout::Format vFormat)
+{
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    // Every sphere is in the same (unit) bounds
+    MeshDecode sphereDecode = (vFormat == MeshVertexLayout::PACKED)
+                                ? SphereDecode()
+                                : MeshDecode();
+    format = vFormat;
+    uint32_t indexStride = sizeof(uint16_t);
+    lods.resize(lodShapes.size());
+    for(size_t i = 0; i < lodShapes.size(); i++)
     {
-        // This may not be necessary, but align the data to 256-byte boundaries
-        size_t alignedSize = (sizes[i - 1] + 255) / 256 * 256;
-        offsets[i] = offsets[i - 1] + alignedSize;
+        MeshLodGL& lod = lods[i];
+        lod.firstIndex = indexCount;
+        lod.indexCount = lodShapes[i].TriangleCount() * 3;
+        lod.baseVertex = int32_t(vertexCount);
+        lod.vertexCount = lodShapes[i].VertexCount();
+        lod.decode = sphereDecode;
+        indexCount += lod.indexCount;
+        vertexCount += lod.vertexCount;
+        indexStride = std::max(indexStride, IndexStrideFor(lod.vertexCount));
     }
+    MeshVertexLayout layout = MeshVertexLayout::For(format, vertexCount);
+    GLsizeiptr indexSize = GLsizeiptr(size_t(indexCount) * indexStride);
 
-    // Vertices
+    // Spheres are generated directly into the mapped buffers
+    static constexpr GLbitfield MapFlags = (GL_MAP_WRITE_BIT |
+                                            GL_MAP_INVALIDATE_BUFFER_BIT);
     glGenBuffers(1, &vBufferId);
     glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
-    glBufferStorage(GL_ARRAY_BUFFER, GLintptr(offsets.back()), nullptr, GL_DYNAMIC_STORAGE_BIT);
-    // Load the data
-    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offsets[0]), GLsizei(sizes[0]), linPositions.data());
-    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offsets[1]), GLsizei(sizes[1]), linNormals.data());
-    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offsets[2]), GLsizei(sizes[2]), linUVs.data());
-    // Indices
+    glBufferStorage(GL_ARRAY_BUFFER, GLsizeiptr(layout.totalSize),
+                    nullptr, GL_MAP_WRITE_BIT);
+    void* vertexData = glMapBufferRange(GL_ARRAY_BUFFER, 0,
+                                        GLsizeiptr(layout.totalSize), MapFlags);
+    // Not the element array target, it belongs to the bound VAO
     glGenBuffers(1, &iBufferId);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBufferId);
-    glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, GLsizei(indices.size() * sizeof(uint32_t)),
-                    indices.data(), GL_DYNAMIC_STORAGE_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, iBufferId);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, indexSize, nullptr, GL_MAP_WRITE_BIT);
+    void* indexData = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, indexSize, MapFlags);
+    if(!vertexData || !indexData)
+    {
+        std::printf("Unable to map the sphere mesh buffers!\n");
+        std::exit(EXIT_FAILURE);
+    }
 
+    // The buffers are write only, the writers keep a copy of the
+    // positions and indices for the meshlets (PACKED positions differ
+    // by the quantization only)
+    std::vector<glm::vec3> lodPositions;
+    std::vector<uint32_t> lodIndices;
+    for(size_t i = 0; i < lodShapes.size(); i++)
+    {
+        MeshLodGL& lod = lods[i];
+        lodPositions.resize(lod.vertexCount);
+        lodIndices.resize(lod.indexCount);
+        VertexStreamWriter vertices = VertexStreamWriter::For(layout, vertexData,
+                                                              uint32_t(lod.baseVertex),
+                                                              lod.decode);
+        vertices.positions = lodPositions.data();
+        IndexStreamWriter indices =
+        {
+            static_cast<unsigned char*>(indexData) + size_t(lod.firstIndex) * indexStride,
+            indexStride,
+            lodIndices.data()
+        };
+        lod.error = GenerateSphere(lodShapes[i], vertices, indices);
+        AppendMeshlets(uint32_t(i), 0, lodIndices, lodPositions);
+        ExtendBounds(lodPositions);
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::printf("%s sphere mesh (%zu LODs) is generated in %.3f ms.\n",
+                SphereShape::TypeName(lodShapes[0].type), lods.size(), ms);
+    CreateVertexArray(layout, indexStride);
+    SetMemoryLabel(std::string("sphere:") + SphereShape::TypeName(lodShapes[0].type));
+}
+
+MeshGL::MeshGL(const MeshData& mesh, MeshVertexLayout::Format vFormat)
+{
+    std::vector<MeshLodSource> sources(1);
+    BuildLodSource(sources[0], mesh, vFormat);
+    CreateBuffers(sources);
+}
+
+uint32_t MeshGL::SelectLod(float scale, float pixelsPerUnit,
+                           float maxPixelError) const
+{
+    float toPixels = scale * pixelsPerUnit;
+    for(uint32_t i = uint32_t(lods.size()); i-- > 1;)
+    {
+        if(lods[i].error * toPixels <= maxPixelError)
+            return i;
+    }
+    return 0;
+}
+
+void MeshGL::CreateBuffers(const std::vector<MeshLodSource>& sources)
+{
+    using L = MeshVertexLayout;
+    assert(!sources.empty());
+    format = sources[0].layout.format;
+    uint32_t indexStride = 0;
+    lods.resize(sources.size());
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        const MeshLodSource& src = sources[i];
+        assert(src.layout.format == format);
+        MeshLodGL& lod = lods[i];
+        lod.firstIndex = indexCount;
+        lod.indexCount = src.indexCount;
+        lod.baseVertex = int32_t(vertexCount);
+        lod.vertexCount = src.layout.vertexCount;
+        lod.error = src.error;
+        lod.decode = src.decode;
+        indexCount += src.indexCount;
+        vertexCount += src.layout.vertexCount;
+        indexStride = std::max(indexStride, src.indexStride);
+    }
+    assert(indexCount % 3 == 0);
+    L layout = L::For(format, vertexCount);
+
+    // ===================== //
+    //   GEN BUFFER AND VAO  //
+    // ===================== //
+    // LODs are copied next to each other, each attribute stream
+    // holds the LODs back to back
+    glGenBuffers(1, &vBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
+    glBufferStorage(GL_ARRAY_BUFFER, GLsizeiptr(layout.totalSize),
+                    nullptr, GL_DYNAMIC_STORAGE_BIT);
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        const MeshLodSource& src = sources[i];
+        const unsigned char* data = static_cast<const unsigned char*>(src.vertexData);
+        for(uint32_t a = 0; a < 3; a++)
+        {
+            size_t offset = layout.offsets[a] + size_t(lods[i].baseVertex) * layout.strides[a];
+            glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offset),
+                            GLsizeiptr(src.layout.sizes[a]),
+                            data + src.layout.offsets[a]);
+        }
+    }
+    // Indices, 16-bit LODs are widened when another LOD needs 32-bit.
+    // Uploads go through the copy target, binding the element array
+    // target here would change the index buffer of the bound VAO.
+    glGenBuffers(1, &iBufferId);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, iBufferId);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, GLsizeiptr(size_t(indexCount) * indexStride),
+                    nullptr, GL_DYNAMIC_STORAGE_BIT);
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        const MeshLodSource& src = sources[i];
+        GLintptr offset = GLintptr(size_t(lods[i].firstIndex) * indexStride);
+        GLsizeiptr size = GLsizeiptr(size_t(src.indexCount) * indexStride);
+        if(src.indexStride == indexStride)
+        {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, src.indexData);
+            continue;
+        }
+        const uint16_t* narrow = static_cast<const uint16_t*>(src.indexData);
+        std::vector<uint32_t> wide(narrow, narrow + src.indexCount);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, wide.data());
+    }
+
+    // Meshlets and bounds on the positions as they are drawn
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        const MeshLodSource& src = sources[i];
+        std::vector<glm::vec3> positions = ReadPositions(src.layout, src.vertexData,
+                                                         src.decode);
+        AppendMeshlets(uint32_t(i), 0,
+                       ReadIndices(src.indexData, src.indexCount, src.indexStride),
+                       positions);
+        ExtendBounds(positions);
+    }
+
+    CreateVertexArray(layout, indexStride);
+}
+
+void MeshGL::AppendMeshlets(uint32_t lod, uint32_t indexOffset,
+                            const std::vector<uint32_t>& indices,
+                            const std::vector<glm::vec3>& positions)
+{
+    // LODs are appended in order
+    MeshLodGL& l = lods[lod];
+    assert(l.meshletCount == 0 || l.firstMeshlet + l.meshletCount == meshlets.size());
+    if(l.meshletCount == 0) l.firstMeshlet = uint32_t(meshlets.size());
+
+    std::vector<Meshlet> lodMeshlets = BuildMeshlets(indices.data(), indices.size(),
+                                                     positions.data());
+    for(Meshlet& m : lodMeshlets)
+        m.firstIndex += indexOffset;
+    meshlets.insert(meshlets.end(), lodMeshlets.begin(), lodMeshlets.end());
+    l.meshletCount += uint32_t(lodMeshlets.size());
+}
+
+void MeshGL::ExtendBounds(const std::vector<glm::vec3>& positions)
+{
+    bounds.Extend(AABB::FromPoints(positions.data(), positions.size()));
+    boundingSphere.Extend(BoundingSphere::FromPoints(positions.data(),
+                                                     positions.size()));
+}
+
+void MeshGL::CullMeshlets(uint32_t lod, const glm::mat4& model,
+                          const glm::mat4& viewProj, const glm::vec3& eye,
+                          bool cullBackfacing, MeshletDrawList& list) const
+{
+    const MeshLodGL& l = lods[lod];
+    list.counts.clear();
+    list.offsets.clear();
+    list.baseVertices.clear();
+    list.clusterCount = l.meshletCount;
+    list.culledClusters = 0;
+    list.triangleCount = l.indexCount / 3;
+    list.culledTriangles = 0;
+
+    // Both tests run in object space, the sign of the backface test
+    // does not change under (invertible) affine transforms
+    Frustum frustum = Frustum::FromMatrix(viewProj * model);
+    glm::vec3 eyeObject = glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
+    size_t indexStride = (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t)
+                                                          : sizeof(uint32_t);
+    uint32_t rangeEnd = 0;
+    for(uint32_t i = 0; i < l.meshletCount; i++)
+    {
+        const Meshlet& m = meshlets[l.firstMeshlet + i];
+        if(!frustum.Intersects(m.center, m.radius) ||
+           (cullBackfacing && m.IsBackfacing(eyeObject)))
+        {
+            list.culledClusters++;
+            list.culledTriangles += m.triangleCount;
+            continue;
+        }
+        uint32_t first = l.firstIndex + m.firstIndex;
+        GLsizei count = GLsizei(m.triangleCount * 3);
+        if(!list.counts.empty() && first == rangeEnd)
+            list.counts.back() += count;
+        else
+        {
+            list.counts.push_back(count);
+            list.offsets.push_back(reinterpret_cast<const void*>(first * indexStride));
+            list.baseVertices.push_back(l.baseVertex);
+        }
+        rangeEnd = first + uint32_t(count);
+    }
+}
+
+void MeshGL::CreateVertexArray(const MeshVertexLayout& layout,
+                               uint32_t indexStride)
+{
+    using L = MeshVertexLayout;
     // VAO
     glGenVertexArrays(1, &vaoId);
     glBindVertexArray(vaoId);
-    // Pos (tightly packed vec3)
-    glBindVertexBuffer(0, vBufferId, GLintptr(offsets[0]), GLsizei(sizeof(glm::vec3)));
+    glBindVertexBuffer(0, vBufferId, GLintptr(layout.offsets[L::POSITION]),
+                       GLsizei(layout.strides[L::POSITION]));
+    glBindVertexBuffer(1, vBufferId, GLintptr(layout.offsets[L::NORMAL]),
+                       GLsizei(layout.strides[L::NORMAL]));
+    glBindVertexBuffer(2, vBufferId, GLintptr(layout.offsets[L::UV]),
+                       GLsizei(layout.strides[L::UV]));
     glEnableVertexAttribArray(0);
-    glVertexAttribFormat(0, 3, GL_FLOAT, false, 0);
-    // Normal (tightly packed vec3)
-    glBindVertexBuffer(1, vBufferId, GLintptr(offsets[1]), GLsizei(sizeof(glm::vec3)));
     glEnableVertexAttribArray(1);
-    glVertexAttribFormat(1, 3, GL_FLOAT, false, 0);
-
-    // UV (tightly packed vec2)
-    glBindVertexBuffer(2, vBufferId, GLintptr(offsets[2]), GLsizei(sizeof(glm::vec2)));
     glEnableVertexAttribArray(2);
-    glVertexAttribFormat(2, 2, GL_FLOAT, false, 0);
+    if(layout.format == L::PACKED)
+    {
+        // Pos (snorm16, 4th component is padding)
+        glVertexAttribFormat(0, 3, GL_SHORT, true, 0);
+        // Normal (octahedral, snorm10 x/y)
+        glVertexAttribFormat(1, 4, GL_INT_2_10_10_10_REV, true, 0);
+        // UV (unorm16)
+        glVertexAttribFormat(2, 2, GL_UNSIGNED_SHORT, true, 0);
+    }
+    else
+    {
+        // Pos (tightly packed vec3)
+        glVertexAttribFormat(0, 3, GL_FLOAT, false, 0);
+        // Normal (tightly packed vec3)
+        glVertexAttribFormat(1, 3, GL_FLOAT, false, 0);
+        // UV (tightly packed vec2)
+        glVertexAttribFormat(2, 2, GL_FLOAT, false, 0);
+    }
 
     glVertexAttribBinding(0, IN_POS);
     glVertexAttribBinding(1, IN_NORMAL);
@@ -474,17 +1044,199 @@ MeshGL::MeshGL(const std::string& objPath)
     // to make the vao to store indices so that we can call draw elements call
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBufferId);
 
-    std::printf("Obj file \"%s\" is loaded succesfully.\n",
-                objPath.c_str());
+    indexType = (indexStride == sizeof(uint16_t)) ? GL_UNSIGNED_SHORT
+                                                  : GL_UNSIGNED_INT;
+    GPUMemory::Global().Track(GPUMemory::BUFFER, vBufferId, GPUMemory::MESH,
+                              layout.totalSize);
+    GPUMemory::Global().Track(GPUMemory::BUFFER, iBufferId, GPUMemory::MESH,
+                              size_t(indexCount) * indexStride);
 
-    indexCount = uint32_t(indices.size());
-    assert(indexCount % 3 == 0);
+    std::printf("Mesh uses %s vertex format (%zu bytes/vertex, "
+                "%u vertices, %.2f MiB vertex buffer), %u-bit indices "
+                "and %zu meshlets.\n",
+                MeshVertexLayout::FormatName(format), layout.BytesPerVertex(),
+                vertexCount, double(layout.totalSize) / (1024.0 * 1024.0),
+                indexStride * 8, meshlets.size());
+    if(lods.size() > 1)
+    {
+        for(size_t i = 0; i < lods.size(); i++)
+        {
+            std::printf("    LOD %zu: %u triangles, %u vertices, %u meshlets, "
+                        "error %.5f\n",
+                        i, lods[i].indexCount / 3, lods[i].vertexCount,
+                        lods[i].meshletCount, double(lods[i].error));
+        }
+    }
+}
+
+void GPUTimerGL::Begin()
+{
+    // Harvest the oldest query before it is reused. If the GPU is still
+    // behind, drop the sample instead of waiting for it.
+    GLuint q = queries[issued % QUERY_COUNT];
+    if(issued >= QUERY_COUNT)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+            totalMs += double(ns) * 1.0e-6;
+            sampleCount++;
+        }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, q);
+}
+
+void GPUTimerGL::End()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    issued++;
+}
+
+bool TexelFormatGL::For(int channelCount, bool is16Bit, TexelFormatGL& out)
+{
+    out.channelCount = channelCount;
+    out.type = (is16Bit) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    out.texelSize = size_t(channelCount) * ((is16Bit) ? 2u : 1u);
+    switch(channelCount)
+    {
+        case 1: out.sizedFormat = (is16Bit) ? GL_R16    : GL_R8;
+                out.format      = GL_RED;
+                return true;
+        case 2: out.sizedFormat = (is16Bit) ? GL_RG16   : GL_RG8;
+                out.format      = GL_RG;
+                return true;
+        case 3: out.sizedFormat = (is16Bit) ? GL_RGB16  : GL_RGB8;
+                out.format      = GL_RGB;
+                return true;
+        case 4: out.sizedFormat = (is16Bit) ? GL_RGBA16 : GL_RGBA8;
+                out.format      = GL_RGBA;
+                return true;
+        default: return false;
+    }
+}
+
+// Not part of the core profile, exposed by (nearly) every desktop driver
+// through GL_EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+namespace
+{
+    bool HasExtensionGL(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for(GLint i = 0; i < count; i++)
+        {
+            const GLubyte* ext = glGetStringi(GL_EXTENSIONS, GLuint(i));
+            if(ext && std::strcmp(reinterpret_cast<const char*>(ext), name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    size_t RawChainBytes(int width, int height, size_t texelSize, uint32_t firstLevel = 0)
+    {
+        size_t bytes = 0;
+        for(uint32_t i = firstLevel; i < MipCountFor(uint32_t(width), uint32_t(height)); i++)
+        {
+            size_t w = size_t(std::max(width >> i, 1));
+            size_t h = size_t(std::max(height >> i, 1));
+            bytes += w * h * texelSize;
+        }
+        return bytes;
+    }
+
+    size_t CompressedChainBytes(BlockFormat::Type format, int width, int height,
+                                uint32_t firstLevel = 0)
+    {
+        std::vector<MipLevel> levels = BlockFormat::LevelsFor(format, uint32_t(width),
+                                                              uint32_t(height));
+        return levels.back().offset + levels.back().size - levels[firstLevel].offset;
+    }
+}
+
+bool TextureGL::SupportsBlockFormat(BlockFormat::Type format)
+{
+    static const bool HasS3TC = (HasExtensionGL("GL_EXT_texture_compression_s3tc") ||
+                                 HasExtensionGL("GL_EXT_texture_compression_dxt1"));
+    return (format != BlockFormat::BC1 || HasS3TC);
+}
+
+BlockFormat::Type TextureGL::BlockFormatFor(int channelCount)
+{
+    BlockFormat::Type format = BlockFormat::ForChannelCount(channelCount);
+    if(!SupportsBlockFormat(format))
+        format = BlockFormat::BC7;
+    return format;
+}
+
+GLenum TextureGL::CompressedFormatGL(BlockFormat::Type format)
+{
+    switch(format)
+    {
+        case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:               return 0;
+    }
 }
 
 TextureGL::TextureGL(const std::string& texPath,
-                     SampleMode sampleMode, EdgeResolve edgeResolveMode)
+                     SampleMode sampleMode, EdgeResolve edgeResolveMode,
+                     bool compress)
 {
-    stbi_set_flip_vertically_on_load(1);
+    // GPU ready levels, uploaded as they are
+    if(TextureContainer::IsContainerPath(texPath))
+    {
+        TextureSource source;
+        if(!source.LoadContainer(texPath))
+        {
+            std::fprintf(stderr, "Unable to read texture container \"%s\"\n",
+                         texPath.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        channelCount = int(source.encoding.ChannelCount());
+        CreateFrom(source, sampleMode, edgeResolveMode, texPath);
+        return;
+    }
+    // Channels of other images, through the cache of the pack
+    if(TexturePack::IsPackPath(texPath))
+    {
+        TexturePack pack;
+        TextureSource source;
+        if(!pack.Read(texPath)) std::exit(EXIT_FAILURE);
+        channelCount = int(pack.channels.size());
+        TexelEncoding encoding = (compress) ? TexelEncoding::Block(BlockFormatFor(channelCount))
+                                            : TexelEncoding::Raw(uint32_t(channelCount), 1);
+        if(!LoadTexturePack(pack, encoding, source))
+        {
+            std::fprintf(stderr, "Unable to read texture pack \"%s\"\n", texPath.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        CreateFrom(source, sampleMode, edgeResolveMode, texPath);
+        return;
+    }
+    if(compress && !stbi_is_16_bit(texPath.c_str()) &&
+       stbi_info(texPath.c_str(), &width, &height, &channelCount))
+    {
+        TextureSource source;
+        if(!source.LoadCompressed(texPath, BlockFormatFor(channelCount)))
+        {
+            std::fprintf(stderr, "Unable to read image \"%s\"\n", texPath.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        CreateFrom(source, sampleMode, edgeResolveMode, texPath);
+        return;
+    }
+
+    // Thread local, workers may be decoding at the same time
+    stbi_set_flip_vertically_on_load_thread(1);
     std::FILE* f = fopen(texPath.c_str(), "rb");
     if(!f)
     {
@@ -496,6 +1248,7 @@ TextureGL::TextureGL(const std::string& texPath,
     void* rawPixels = nullptr;
     if(is16Bit) rawPixels = stbi_load_from_file_16(f, &width, &height, &channelCount, 0);
     else        rawPixels = stbi_load_from_file(f, &width, &height, &channelCount, 0);
+    std::fclose(f);
     //
     if(!rawPixels)
     {
@@ -503,41 +1256,171 @@ TextureGL::TextureGL(const std::string& texPath,
         std::exit(EXIT_FAILURE);
     }
 
-    // Mipmap count calculation
-    uint32_t mipCount = uint32_t(std::max(width, height));
-    mipCount = (sizeof(GLsizei) * CHAR_BIT) - uint32_t(std::countl_zero(mipCount));
-    //
-    GLenum internalFormatSized = 0;
-    GLenum internalFormat = 0;
-    GLenum pixType = (is16Bit) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
-    switch(channelCount)
+    TexelFormatGL texelFormat;
+    if(!TexelFormatGL::For(channelCount, is16Bit, texelFormat))
     {
-        case 1: internalFormatSized = (is16Bit) ? GL_R16    : GL_R8;
-                internalFormat      = GL_RED;
-                break;
-        case 2: internalFormatSized = (is16Bit) ? GL_RG16   : GL_RG8;
-                internalFormat      = GL_RG;
-                break;
-        case 3: internalFormatSized = (is16Bit) ? GL_RGB16  : GL_RGB8;
-                internalFormat      = GL_RGB;
-                break;
-        case 4: internalFormatSized = (is16Bit) ? GL_RGBA16 : GL_RGBA8;
-                internalFormat      = GL_RGBA;
-                break;
-        default:
+        stbi_image_free(rawPixels);
+        std::fprintf(stderr, "Unkown image type!\n");
+        std::exit(EXIT_FAILURE);
+    }
+    CreateStorage(texelFormat.sizedFormat, sampleMode, edgeResolveMode);
+    gpuBytes = RawChainBytes(width, height, texelFormat.texelSize);
+    TrackMemory(texPath);
+    // Mips are filtered on the CPU (in linear space for colors), not by
+    // the driver
+    MipChain mips = GenerateMips(rawPixels, uint32_t(width), uint32_t(height),
+                                 uint32_t(channelCount), is16Bit ? 2 : 1,
+                                 MipFilter::For(uint32_t(channelCount)));
+    // Rows are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, texelFormat.format,
+                    texelFormat.type, rawPixels);
+    for(size_t i = 0; i < mips.levels.size(); i++)
+        glTexSubImage2D(GL_TEXTURE_2D, GLint(i + 1), 0, 0, GLsizei(mips.levels[i].width),
+                        GLsizei(mips.levels[i].height), texelFormat.format,
+                        texelFormat.type, mips.Pixels(i));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    stbi_image_free(rawPixels);
+}
+
+TextureGL::TextureGL(int w, int h, const TexelFormatGL& texelFormat,
+                     SampleMode sampleMode, EdgeResolve edgeResolveMode,
+                     const glm::vec4& placeholder, uint32_t level)
+    : width(w)
+    , height(h)
+    , channelCount(texelFormat.channelCount)
+    , residentLevel(level)
+{
+    CreateStorage(texelFormat.sizedFormat, sampleMode, edgeResolveMode);
+    gpuBytes = RawChainBytes(width, height, texelFormat.texelSize, residentLevel);
+    TrackMemory();
+
+    // Only the 1x1 top mip is sampled until the upload is done
+    GLint topMip = GLint(mipCount - 1 - residentLevel);
+    glClearTexImage(textureId, topMip, GL_RGBA, GL_FLOAT, &placeholder[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, topMip);
+}
+
+TextureGL::TextureGL(int w, int h, int c, BlockFormat::Type format,
+                     SampleMode sampleMode, EdgeResolve edgeResolveMode,
+                     const glm::vec4& placeholder, uint32_t level)
+    : width(w)
+    , height(h)
+    , channelCount(c)
+    , residentLevel(level)
+    , compressed(true)
+{
+    CreateStorage(CompressedFormatGL(format), sampleMode, edgeResolveMode);
+    gpuBytes = CompressedChainBytes(format, width, height, residentLevel);
+    TrackMemory();
+
+    // Compressed levels can not be cleared, the top mip is a single
+    // block of the placeholder color instead
+    unsigned char block[16];
+    CompressSolidBlock(format, placeholder, block);
+    GLint topMip = GLint(mipCount - 1 - residentLevel);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, topMip, 0, 0, 1, 1, sizedFormat,
+                              GLsizei(BlockFormat::BlockSize(format)), block);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, topMip);
+}
+
+void TextureGL::FinishUpload() const
+{
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+}
+
+void TextureGL::Reallocate(uint32_t level, SampleMode sampleMode,
+                           EdgeResolve edgeResolveMode)
+{
+    GLuint oldId = textureId;
+    uint32_t oldLevel = residentLevel;
+    residentLevel = level;
+    CreateStorage(sizedFormat, sampleMode, edgeResolveMode);
+
+    // Whole levels, so compressed levels smaller than a block copy too
+    uint32_t firstShared = std::max(level, oldLevel);
+    for(uint32_t l = firstShared; l < mipCount; l++)
+    {
+        GLsizei w = std::max(width >> l, 1);
+        GLsizei h = std::max(height >> l, 1);
+        glCopyImageSubData(oldId, GL_TEXTURE_2D, GLint(l - oldLevel), 0, 0, 0,
+                           textureId, GL_TEXTURE_2D, GLint(l - level), 0, 0, 0,
+                           w, h, 1);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(firstShared - level));
+    GPUMemory::Global().Move(GPUMemory::TEXTURE, oldId, textureId);
+    glDeleteTextures(1, &oldId);
+}
+
+void TextureGL::TrackMemory(const std::string& label) const
+{
+    // GPUs have no 3 channel texels, RGB levels are stored as RGBA
+    bool rgb = (sizedFormat == GL_RGB8 || sizedFormat == GL_RGB16);
+    GPUMemory::Global().Track(GPUMemory::TEXTURE, textureId, GPUMemory::TEXTURE_2D,
+                              gpuBytes, rgb ? gpuBytes / 3 : 0, label);
+}
+
+void TextureGL::CreateFrom(const TextureSource& source, SampleMode sampleMode,
+                           EdgeResolve edgeResolveMode, const std::string& label)
+{
+    width = int(source.width);
+    height = int(source.height);
+    compressed = source.encoding.compressed;
+    TexelFormatGL texelFormat;
+    if(compressed)
+    {
+        if(!SupportsBlockFormat(source.encoding.blockFormat))
+        {
+            std::fprintf(stderr, "%s textures are not supported by the GL!\n",
+                         BlockFormat::Name(source.encoding.blockFormat));
+            std::exit(EXIT_FAILURE);
+        }
+        CreateStorage(CompressedFormatGL(source.encoding.blockFormat),
+                      sampleMode, edgeResolveMode);
+    }
+    else
+    {
+        if(!TexelFormatGL::For(int(source.encoding.channelCount),
+                               source.encoding.bytesPerChannel == 2, texelFormat))
         {
-            stbi_image_free(rawPixels);
             std::fprintf(stderr, "Unkown image type!\n");
             std::exit(EXIT_FAILURE);
         }
+        CreateStorage(texelFormat.sizedFormat, sampleMode, edgeResolveMode);
+        // Rows are tightly packed
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     }
 
+    for(size_t i = 0; i < source.levels.size(); i++)
+    {
+        const MipLevel& l = source.levels[i];
+        if(compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, GLint(i), 0, 0,
+                                      GLsizei(l.width), GLsizei(l.height), sizedFormat,
+                                      GLsizei(l.size), source.data + l.offset);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, GLint(i), 0, 0,
+                            GLsizei(l.width), GLsizei(l.height), texelFormat.format,
+                            texelFormat.type, source.data + l.offset);
+        gpuBytes += l.size;
+    }
+    if(!compressed) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    TrackMemory(label);
+}
+
+void TextureGL::CreateStorage(GLenum format, SampleMode sampleMode,
+                              EdgeResolve edgeResolveMode)
+{
+    sizedFormat = format;
+    mipCount = MipCountFor(uint32_t(width), uint32_t(height));
+
     glGenTextures(1, &textureId);
     glBindTexture(GL_TEXTURE_2D, textureId);
-    glTexStorage2D(GL_TEXTURE_2D, GLsizei(mipCount), internalFormatSized, width, height);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, internalFormat,
-                    pixType, rawPixels);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexStorage2D(GL_TEXTURE_2D, GLsizei(mipCount - residentLevel), sizedFormat,
+                   std::max(width >> residentLevel, 1),
+                   std::max(height >> residentLevel, 1));
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, edgeResolveMode);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, edgeResolveMode);
@@ -546,8 +1429,96 @@ TextureGL::TextureGL(const std::string& texPath,
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     else
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
 
-    stbi_image_free(rawPixels);
+CubeMapGL::CubeMapGL(const std::string& equirectPath, TextureGL::SampleMode sampleMode,
+                     bool compress)
+{
+    int width, height;
+    if(!stbi_info(equirectPath.c_str(), &width, &height, &channelCount))
+    {
+        std::fprintf(stderr, "Unable to read image \"%s\"\n", equirectPath.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    TexelEncoding encoding = TexelEncoding::Raw(uint32_t(channelCount), 1);
+    if(compress && !stbi_is_16_bit(equirectPath.c_str()))
+        encoding = TexelEncoding::Block(TextureGL::BlockFormatFor(channelCount));
+    TextureSource source;
+    if(!LoadCubeMap(equirectPath, encoding, source))
+    {
+        std::fprintf(stderr, "Unable to read image \"%s\"\n", equirectPath.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    std::vector<MipLevel> equirectLevels = encoding.LevelsFor(uint32_t(width),
+                                                              uint32_t(height));
+    equirectBytes = equirectLevels.back().offset + equirectLevels.back().size;
+
+    faceSize = int(source.width);
+    compressed = encoding.compressed;
+    TexelFormatGL texelFormat;
+    if(compressed)
+    {
+        if(!TextureGL::SupportsBlockFormat(encoding.blockFormat))
+        {
+            std::fprintf(stderr, "%s textures are not supported by the GL!\n",
+                         BlockFormat::Name(encoding.blockFormat));
+            std::exit(EXIT_FAILURE);
+        }
+        sizedFormat = TextureGL::CompressedFormatGL(encoding.blockFormat);
+    }
+    else
+    {
+        if(!TexelFormatGL::For(channelCount, false, texelFormat))
+        {
+            std::fprintf(stderr, "Unkown image type!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        sizedFormat = texelFormat.sizedFormat;
+    }
+    // Levels of the stacked faces that are still whole faces (and whole
+    // blocks). The stack is 6 faces tall, so it has more levels than a
+    // face; stop at the 1x1 face.
+    uint32_t smallestFace = compressed ? BlockFormat::BLOCK_DIM : 1;
+    while(mipCount < source.levels.size() &&
+          (uint32_t(faceSize) >> mipCount) >= smallestFace)
+        mipCount++;
+
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, GLsizei(mipCount), sizedFormat, faceSize, faceSize);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, GLint(mipCount - 1));
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, sampleMode);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER,
+                    (sampleMode == TextureGL::NEAREST) ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Filters across the face edges instead of clamping at them
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    if(!compressed) glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(uint32_t i = 0; i < mipCount; i++)
+    {
+        const MipLevel& l = source.levels[i];
+        GLsizei size = GLsizei(l.width);
+        size_t faceBytes = l.size / 6;
+        for(uint32_t face = 0; face < 6; face++)
+        {
+            const unsigned char* data = source.data + l.offset + face * faceBytes;
+            GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+            if(compressed)
+                glCompressedTexSubImage2D(target, GLint(i), 0, 0, size, size, sizedFormat,
+                                          GLsizei(faceBytes), data);
+            else
+                glTexSubImage2D(target, GLint(i), 0, 0, size, size, texelFormat.format,
+                                texelFormat.type, data);
+        }
+        gpuBytes += l.size;
+    }
+    if(!compressed) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    bool rgb = (sizedFormat == GL_RGB8);
+    GPUMemory::Global().Track(GPUMemory::TEXTURE, textureId, GPUMemory::CUBE_MAP, gpuBytes,
+                              rgb ? gpuBytes / 3 : 0, equirectPath);
 }
 
 void SetupGLFWErrorCallback()
@@ -2,11 +2,22 @@
 
 #include <cassert>
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "blockCompressor.h"
+#include "bounds.h"
+#include "gpuMemory.h"
+#include "meshCache.h"
+#include "meshlet.h"
+#include "programCache.h"
+#include "vertexFormat.h"
+
 struct GLFWwindow;
+struct MeshData;
+struct TextureSource;
 using GLFWcursorposfun = void (*)(GLFWwindow *, double, double);
 using GLFWmousebuttonfun = void (*)(GLFWwindow *, int, int, int);
 using GLFWscrollfun = void (*)(GLFWwindow *, double, double);
@@ -54,6 +65,14 @@ struct GLState {
   float currentTime = 0.0f;
   // Render mode
   uint32_t mode = 2;
+  // Draw planets with the packed vertex format
+  bool packedVertices = true;
+  // Periodic performance report on stdout
+  bool printStats = false;
+  // One-off GPU memory report on stdout
+  bool printMemory = false;
+  // Allowed screen space error of mesh LODs, in pixels
+  float lodPixelError = 1.0f;
 
   // Constructors, Movement & Destructor
   GLState(const char *const windowName, int width, int height,
@@ -65,12 +84,70 @@ struct GLState {
   ~GLState();
 };
 
+// Separable program of a single shader. On GL 4.6 the SPIR-V module
+// precompiled at build time ("<shader>.spv", see CMakeLists.txt) is
+// loaded instead of the GLSL source while it is not older than the
+// source (or a file it includes); a module that fails to specialize or
+// link falls back to the source. Sources may '#include "file"' a file
+// next to them, one level deep; glslang pastes it into the modules.
+// Linked programs are cached on disk (see ProgramCache) and loaded with
+// glProgramBinary on later runs; a binary the driver rejects is
+// compiled again.
 struct ShaderGL {
   enum Type { VERTEX = GL_VERTEX_SHADER, FRAGMENT = GL_FRAGMENT_SHADER };
 
+  // Value of a specialization constant, "layout(constant_id = id)" in
+  // SPIR-V modules and a macro "name" defined before GLSL sources
+  struct Constant {
+    uint32_t id = 0;
+    std::string name;
+    // As glSpecializeShader takes it (bools are 0 / 1, floats their bits)
+    uint32_t value = 0;
+    std::string literal;
+
+    static Constant Bool(uint32_t id, const std::string &name, bool);
+    static Constant Int(uint32_t id, const std::string &name, int32_t);
+    static Constant Float(uint32_t id, const std::string &name, float);
+  };
+  using Constants = std::vector<Constant>;
+
+  // Program handed to the driver whose compile / link status is not
+  // queried yet. Drivers may compile in the background until the first
+  // query, so submitting every program before creating any ShaderGL
+  // lets them compile in parallel.
+  struct Pending {
+    Type type = VERTEX;
+    std::string path;
+    Constants constants;
+    // SPIR-V module or GLSL source (with the constants defined)
+    std::vector<GLchar> source;
+    bool spirv = false;
+    // Of "source" and the constants
+    uint64_t sourceHash = 0;
+    GLuint shader = 0;
+    GLuint program = 0;
+    // Loaded with glProgramBinary instead of compiled
+    bool fromCache = false;
+
+    // Constructors, Movement & Destructor
+    Pending() = default;
+    Pending(const Pending &) = delete;
+    Pending(Pending &&);
+    Pending &operator=(const Pending &) = delete;
+    Pending &operator=(Pending &&);
+    ~Pending();
+  };
+
   GLuint shaderId = 0;
+  // Reads "path" (or its module) and starts its compile and link (or
+  // binary load)
+  static Pending Submit(Type t, const std::string &path,
+                        const Constants & = {});
+
   // Constructors, Movement & Destructor
-  ShaderGL(Type t, const std::string &path);
+  // Waits for a submitted program, exits if it does not compile or link
+  explicit ShaderGL(Pending &&);
+  ShaderGL(Type t, const std::string &path, const Constants & = {});
   ShaderGL(const ShaderGL &) = delete;
   ShaderGL(ShaderGL &&);
   ShaderGL &operator=(const ShaderGL &) = delete;
@@ -78,6 +155,59 @@ struct ShaderGL {
   ~ShaderGL();
 };
 
+// Level of detail of a MeshGL, all levels share the buffers of the mesh
+struct MeshLodGL {
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+  int32_t baseVertex = 0;
+  uint32_t vertexCount = 0;
+  // Object space deviation from the smooth surface (see MeshSurfaceError)
+  float error = 0.0f;
+  MeshDecode decode;
+  // Clusters of the LOD in MeshGL::meshlets, their first indices are
+  // relative to "firstIndex"
+  uint32_t firstMeshlet = 0;
+  uint32_t meshletCount = 0;
+};
+
+// Visible meshlets of a LOD (see MeshGL::CullMeshlets), adjacent
+// meshlets are merged into a single range
+struct MeshletDrawList {
+  std::vector<GLsizei> counts;
+  std::vector<const void *> offsets;
+  std::vector<GLint> baseVertices;
+  // Statistics of the last cull
+  uint32_t clusterCount = 0;
+  uint32_t culledClusters = 0;
+  uint32_t triangleCount = 0;
+  uint32_t culledTriangles = 0;
+};
+
+struct SphereShape;
+
+// CPU side data of a LOD before the upload, it either points into
+// a mapped mesh cache or into the blocks built from a MeshData
+struct MeshLodSource {
+  MeshVertexLayout layout;
+  MeshDecode decode;
+  float error = 0.0f;
+  uint32_t indexCount = 0;
+  uint32_t indexStride = 0;
+  const void *vertexData = nullptr;
+  const void *indexData = nullptr;
+  // Owners of the data above
+  MeshCache cache;
+  std::vector<unsigned char> vertexBlock;
+  std::vector<unsigned char> indexBlock;
+};
+
+// CPU side of an OBJ LOD chain (see the MeshGL constructor), from the
+// mesh caches or parsed. Makes no GL calls so it can run on any thread,
+// before the GL context exists.
+std::vector<MeshLodSource>
+LoadMeshLodSources(const std::vector<std::string> &lodObjPaths,
+                   MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+
 struct MeshGL {
   // These intake Ids must match to the vertex shader
   // That is used currently.
@@ -85,18 +215,104 @@ struct MeshGL {
   static constexpr GLuint IN_NORMAL = 1;
   static constexpr GLuint IN_UV = 2;
   static constexpr GLuint IN_COLOR = 3;
+  // Vertex decode uniforms (see MeshDecode), these locations must
+  // match to the vertex shaders that support packed vertices
+  static constexpr GLuint U_POS_DECODE = 9;
+  static constexpr GLuint U_UV_DECODE = 10;
+  static constexpr GLuint U_OCT_NORMALS = 11;
 
   GLuint vBufferId = 0;
   GLuint iBufferId = 0;
   GLuint vaoId = 0;
+  // Totals of all LODs
   GLuint indexCount = 0;
+  uint32_t vertexCount = 0;
+  // GL_UNSIGNED_SHORT when the vertex count of every LOD allows it
+  GLenum indexType = GL_UNSIGNED_INT;
+  MeshVertexLayout::Format format = MeshVertexLayout::FLOAT32;
+  // Finest first, the vertex and index buffers hold the LODs back to back
+  std::vector<MeshLodGL> lods;
+  // Clusters of every LOD (see Meshlet)
+  std::vector<Meshlet> meshlets;
+  // Object space bounds of every LOD
+  AABB bounds;
+  BoundingSphere boundingSphere;
   // Constructors, Movement & Destructor
-  MeshGL(const std::string &objPath);
+  // Loads from the binary mesh cache next to the OBJ when it is valid,
+  // otherwise parses and optimizes (OptimizeMesh) the OBJ and
+  // (re)writes the cache. MeshData is uploaded in its given order.
+  MeshGL(const std::string &objPath,
+         MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  // LOD chain, one OBJ per level (finest first)
+  MeshGL(const std::vector<std::string> &lodObjPaths,
+         MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  // Uploads a chain of LoadMeshLodSources
+  explicit MeshGL(const std::vector<MeshLodSource> &lodSources);
+  // Bounded memory ingestion of a large OBJ (see StreamObj), the windows
+  // are appended to GPU side buffers as they are parsed so the CPU side
+  // never holds the whole mesh. The mesh is uploaded as parsed (no
+  // cache, no OptimizeMesh) with 32-bit indices. "memoryCap" bounds the
+  // parse windows only: "meshlets" and the doubling GPU buffers grow
+  // with the mesh outside of it.
+  MeshGL(const std::string &objPath, size_t memoryCap,
+         MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  // Procedural sphere LOD chain (finest first), generated directly in
+  // the GPU buffers without going through the CPU side mesh
+  MeshGL(const std::vector<SphereShape> &lodShapes,
+         MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
+  MeshGL(const MeshData &,
+         MeshVertexLayout::Format = MeshVertexLayout::FLOAT32);
   MeshGL(const MeshGL &) = delete;
   MeshGL(MeshGL &&);
   MeshGL &operator=(const MeshGL &) = delete;
   MeshGL &operator=(MeshGL &&);
   ~MeshGL();
+
+  // Coarsest LOD whose error, scaled by "scale" (object to world) and
+  // "pixelsPerUnit" (world to screen at the object), stays within
+  // "maxPixelError" pixels. Falls back to the finest LOD.
+  uint32_t SelectLod(float scale, float pixelsPerUnit,
+                     float maxPixelError) const;
+
+  // Sets the decode uniforms of a LOD on the active program
+  // (glActiveShaderProgram) of the bound pipeline
+  void SetDecodeUniforms(uint32_t lod = 0) const;
+  // Draws a LOD, the VAO of the mesh must be bound
+  void Draw(uint32_t lod = 0) const;
+  // Fills "list" with the meshlets of a LOD that are inside the frustum
+  // of "viewProj" and, with "cullBackfacing", not backfacing to "eye"
+  // (world space)
+  void CullMeshlets(uint32_t lod, const glm::mat4 &model,
+                    const glm::mat4 &viewProj, const glm::vec3 &eye,
+                    bool cullBackfacing, MeshletDrawList &list) const;
+  // Draws the ranges of a cull, the VAO of the mesh must be bound
+  void Draw(const MeshletDrawList &) const;
+  // Size of the vertex and index buffers
+  size_t GPUBytes() const;
+  // Asset name of the buffers in GPUMemory
+  void SetMemoryLabel(const std::string &) const;
+
+private:
+  void CreateBuffers(const std::vector<MeshLodSource> &);
+  // Appends meshlets to a LOD, "indices" index "positions" and start
+  // at "indexOffset" in the index range of the LOD
+  void AppendMeshlets(uint32_t lod, uint32_t indexOffset,
+                      const std::vector<uint32_t> &indices,
+                      const std::vector<glm::vec3> &positions);
+  void ExtendBounds(const std::vector<glm::vec3> &positions);
+  void CreateVertexArray(const MeshVertexLayout &, uint32_t indexStride);
+};
+
+// GL formats of an 8 or 16-bit image with 1 to 4 channels
+struct TexelFormatGL {
+  GLenum sizedFormat = 0;
+  GLenum format = 0;
+  GLenum type = 0;
+  int channelCount = 0;
+  size_t texelSize = 0;
+
+  // Returns false for unsupported channel counts
+  static bool For(int channelCount, bool is16Bit, TexelFormatGL &out);
 };
 
 struct TextureGL {
@@ -112,19 +328,168 @@ struct TextureGL {
   };
 
   GLuint textureId = 0;
+  GLenum sizedFormat = 0;
   int width = 0;
   int height = 0;
+  // Channels of the source image
   int channelCount = 0;
+  uint32_t mipCount = 0;
+  // Finest level of the chain held by the storage, storage level "i" is
+  // level "residentLevel + i" of the "width" x "height" chain (see
+  // TextureResidency)
+  uint32_t residentLevel = 0;
+  // Size of the stored mip levels
+  size_t gpuBytes = 0;
+  // Block compressed (see BlockFormat), every level is uploaded instead
+  // of generated
+  bool compressed = false;
   //
-  TextureGL(const std::string &texPath, SampleMode, EdgeResolve);
+  // "*.ptex" containers are uploaded level by level as they are (see
+  // TextureContainer). With "compress", 8-bit images are block compressed
+  // through their cache (see TextureSource); 16-bit images are kept as
+  // is.
+  TextureGL(const std::string &texPath, SampleMode, EdgeResolve,
+            bool compress = false);
+  // Storage only (of "residentLevel" and coarser), level 0 is uploaded
+  // later (see TextureStreamer). Until "FinishUpload" the texture
+  // samples its 1x1 top mip, which is filled with "placeholder".
+  TextureGL(int width, int height, const TexelFormatGL &, SampleMode,
+            EdgeResolve, const glm::vec4 &placeholder,
+            uint32_t residentLevel = 0);
+  // Block compressed storage only, every level is uploaded later
+  TextureGL(int width, int height, int channelCount, BlockFormat::Type,
+            SampleMode, EdgeResolve, const glm::vec4 &placeholder,
+            uint32_t residentLevel = 0);
   TextureGL(const TextureGL &) = delete;
   TextureGL(TextureGL &&);
   TextureGL &operator=(const TextureGL &) = delete;
   TextureGL &operator=(TextureGL &&);
   ~TextureGL();
+
+  // Samples the full chain, once every level is uploaded
+  void FinishUpload() const;
+  // Replaces the storage by one of level "level" and coarser. The levels
+  // both storages hold are copied on the GPU and sampled, finer ones are
+  // undefined until uploaded and only sampled once the caller lowers
+  // GL_TEXTURE_BASE_LEVEL. "gpuBytes" is left to the caller.
+  void Reallocate(uint32_t level, SampleMode, EdgeResolve);
+  // Records "gpuBytes" in GPUMemory, after every change of it (keeps the
+  // current label when "label" is empty)
+  void TrackMemory(const std::string &label = {}) const;
+
+  // BC1 needs GL_EXT_texture_compression_s3tc, the others are core
+  static bool SupportsBlockFormat(BlockFormat::Type);
+  // Block format of an image with "channelCount" channels that the GL
+  // can sample (BC7 replaces BC1 when S3TC is not exposed)
+  static BlockFormat::Type BlockFormatFor(int channelCount);
+  static GLenum CompressedFormatGL(BlockFormat::Type);
+
+private:
+  void CreateStorage(GLenum sizedFormat, SampleMode, EdgeResolve);
+  void CreateFrom(const TextureSource &, SampleMode, EdgeResolve,
+                  const std::string &label);
+};
+
+// Cube map of an equirectangular image (see LoadCubeMap), sampled by
+// direction with seamless filtering across the faces. With "compress",
+// 8-bit images are block compressed, others keep 8-bit texels. Block
+// compressed faces stop at the 4x4 level, the smallest one a block
+// covers.
+struct CubeMapGL {
+  GLuint textureId = 0;
+  GLenum sizedFormat = 0;
+  int faceSize = 0;
+  // Channels of the source image
+  int channelCount = 0;
+  uint32_t mipCount = 0;
+  size_t gpuBytes = 0;
+  bool compressed = false;
+  // Full chain of the equirectangular image in the same encoding, for
+  // comparison
+  size_t equirectBytes = 0;
+
+  // Constructors, Movement & Destructor
+  CubeMapGL(const std::string &equirectPath, TextureGL::SampleMode,
+            bool compress = false);
+  CubeMapGL(const CubeMapGL &) = delete;
+  CubeMapGL(CubeMapGL &&) = delete;
+  CubeMapGL &operator=(const CubeMapGL &) = delete;
+  CubeMapGL &operator=(CubeMapGL &&) = delete;
+  ~CubeMapGL();
+};
+
+// GPU time of the commands between "Begin" and "End" (GL_TIME_ELAPSED).
+// Queries are recycled in a small ring and only read back when their
+// result is available, so timing never stalls the pipeline. Results
+// accumulate until "ResetStats".
+struct GPUTimerGL {
+  static constexpr uint32_t QUERY_COUNT = 4;
+
+  GLuint queries[QUERY_COUNT] = {};
+  uint32_t issued = 0;
+  double totalMs = 0.0;
+  uint32_t sampleCount = 0;
+  // Constructors, Movement & Destructor
+  GPUTimerGL();
+  GPUTimerGL(const GPUTimerGL &) = delete;
+  GPUTimerGL(GPUTimerGL &&) = delete;
+  GPUTimerGL &operator=(const GPUTimerGL &) = delete;
+  GPUTimerGL &operator=(GPUTimerGL &&) = delete;
+  ~GPUTimerGL();
+
+  void Begin();
+  void End();
+  double AverageMs() const {
+    return sampleCount ? totalMs / double(sampleCount) : 0.0;
+  }
+  void ResetStats() {
+    totalMs = 0.0;
+    sampleCount = 0;
+  }
 };
 
 // Inline Definitions
+inline ShaderGL::Pending::Pending(Pending &&other)
+    : type(other.type), path(std::move(other.path)),
+      constants(std::move(other.constants)), source(std::move(other.source)),
+      spirv(other.spirv), sourceHash(other.sourceHash),
+      shader(other.shader), program(other.program),
+      fromCache(other.fromCache) {
+  other.shader = 0;
+  other.program = 0;
+}
+
+inline ShaderGL::Pending &ShaderGL::Pending::operator=(Pending &&other) {
+  assert(this != &other);
+  if (shader)
+    glDeleteShader(shader);
+  if (program)
+    glDeleteProgram(program);
+  type = other.type;
+  path = std::move(other.path);
+  constants = std::move(other.constants);
+  source = std::move(other.source);
+  spirv = other.spirv;
+  sourceHash = other.sourceHash;
+  shader = other.shader;
+  program = other.program;
+  fromCache = other.fromCache;
+  other.shader = 0;
+  other.program = 0;
+  return *this;
+}
+
+inline ShaderGL::Pending::~Pending() {
+  if (shader)
+    glDeleteShader(shader);
+  if (program)
+    glDeleteProgram(program);
+}
+
+inline ShaderGL::ShaderGL(Type t, const std::string &path,
+                          const Constants &constants)
+    : ShaderGL(Submit(t, path, constants)) {}
+
 inline ShaderGL::ShaderGL(ShaderGL &&other) : shaderId(other.shaderId) {
   other.shaderId = 0;
 }
@@ -143,7 +508,11 @@ inline ShaderGL::~ShaderGL() {
 
 inline MeshGL::MeshGL(MeshGL &&other)
     : vBufferId(other.vBufferId), iBufferId(other.iBufferId),
-      vaoId(other.vaoId) {
+      vaoId(other.vaoId), indexCount(other.indexCount),
+      vertexCount(other.vertexCount), indexType(other.indexType),
+      format(other.format), lods(std::move(other.lods)),
+      meshlets(std::move(other.meshlets)), bounds(other.bounds),
+      boundingSphere(other.boundingSphere) {
   other.vBufferId = 0;
   other.iBufferId = 0;
   other.vaoId = 0;
@@ -151,36 +520,118 @@ inline MeshGL::MeshGL(MeshGL &&other)
 
 inline MeshGL &MeshGL::operator=(MeshGL &&other) {
   assert(this != &other);
+  if (vaoId)
+    glDeleteVertexArrays(1, &vaoId);
+  GPUMemory::Global().Release(GPUMemory::BUFFER, vBufferId);
+  GPUMemory::Global().Release(GPUMemory::BUFFER, iBufferId);
+  if (vBufferId)
+    glDeleteBuffers(1, &vBufferId);
+  if (iBufferId)
+    glDeleteBuffers(1, &iBufferId);
   vBufferId = other.vBufferId;
   iBufferId = other.iBufferId;
   vaoId = other.vaoId;
+  indexCount = other.indexCount;
+  vertexCount = other.vertexCount;
+  indexType = other.indexType;
+  format = other.format;
+  lods = std::move(other.lods);
+  meshlets = std::move(other.meshlets);
+  bounds = other.bounds;
+  boundingSphere = other.boundingSphere;
   other.vBufferId = 0;
   other.iBufferId = 0;
   other.vaoId = 0;
   return *this;
 }
 
+inline void MeshGL::SetDecodeUniforms(uint32_t lod) const {
+  const MeshDecode &decode = lods[lod].decode;
+  glUniform4fv(U_POS_DECODE, 1, &decode.position[0]);
+  glUniform4fv(U_UV_DECODE, 1, &decode.uv[0]);
+  glUniform1i(U_OCT_NORMALS, decode.octNormals ? 1 : 0);
+}
+
+inline void MeshGL::Draw(uint32_t lod) const {
+  const MeshLodGL &l = lods[lod];
+  size_t indexStride =
+      (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+  glDrawElementsBaseVertex(
+      GL_TRIANGLES, GLsizei(l.indexCount), indexType,
+      reinterpret_cast<const void *>(l.firstIndex * indexStride),
+      l.baseVertex);
+}
+
+inline void MeshGL::Draw(const MeshletDrawList &list) const {
+  if (list.counts.empty())
+    return;
+  glMultiDrawElementsBaseVertex(
+      GL_TRIANGLES, list.counts.data(), indexType, list.offsets.data(),
+      GLsizei(list.counts.size()), list.baseVertices.data());
+}
+
+inline size_t MeshGL::GPUBytes() const {
+  size_t indexStride =
+      (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+  return MeshVertexLayout::For(format, vertexCount).totalSize +
+         size_t(indexCount) * indexStride;
+}
+
+inline void MeshGL::SetMemoryLabel(const std::string &label) const {
+  GPUMemory::Global().SetLabel(GPUMemory::BUFFER, vBufferId, label);
+  GPUMemory::Global().SetLabel(GPUMemory::BUFFER, iBufferId, label);
+}
+
 inline MeshGL::~MeshGL() {
   if (vaoId)
     glDeleteVertexArrays(1, &vaoId);
+  GPUMemory::Global().Release(GPUMemory::BUFFER, vBufferId);
+  GPUMemory::Global().Release(GPUMemory::BUFFER, iBufferId);
   if (vBufferId)
     glDeleteBuffers(1, &vBufferId);
   if (iBufferId)
     glDeleteBuffers(1, &iBufferId);
 }
 
-inline TextureGL::TextureGL(TextureGL &&other) : textureId(other.textureId) {
+inline GPUTimerGL::GPUTimerGL() { glGenQueries(QUERY_COUNT, queries); }
+
+inline GPUTimerGL::~GPUTimerGL() { glDeleteQueries(QUERY_COUNT, queries); }
+
+inline TextureGL::TextureGL(TextureGL &&other)
+    : textureId(other.textureId), sizedFormat(other.sizedFormat),
+      width(other.width), height(other.height),
+      channelCount(other.channelCount), mipCount(other.mipCount),
+      residentLevel(other.residentLevel), gpuBytes(other.gpuBytes),
+      compressed(other.compressed) {
   other.textureId = 0;
 }
 
 inline TextureGL &TextureGL::operator=(TextureGL &&other) {
   assert(this != &other);
+  GPUMemory::Global().Release(GPUMemory::TEXTURE, textureId);
+  if (textureId)
+    glDeleteTextures(1, &textureId);
   textureId = other.textureId;
+  sizedFormat = other.sizedFormat;
+  width = other.width;
+  height = other.height;
+  channelCount = other.channelCount;
+  mipCount = other.mipCount;
+  residentLevel = other.residentLevel;
+  gpuBytes = other.gpuBytes;
+  compressed = other.compressed;
   other.textureId = 0;
   return *this;
 }
 
 inline TextureGL::~TextureGL() {
+  GPUMemory::Global().Release(GPUMemory::TEXTURE, textureId);
+  if (textureId)
+    glDeleteTextures(1, &textureId);
+}
+
+inline CubeMapGL::~CubeMapGL() {
+  GPUMemory::Global().Release(GPUMemory::TEXTURE, textureId);
   if (textureId)
     glDeleteTextures(1, &textureId);
 }
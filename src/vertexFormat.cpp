@@ -0,0 +1,280 @@
+#include "vertexFormat.h"
+#include "meshData.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    int32_t QuantizeSnorm(float v, int32_t maxValue)
+    {
+        v = std::clamp(v, -1.0f, 1.0f);
+        return int32_t(std::lround(v * float(maxValue)));
+    }
+
+    uint32_t QuantizeUnorm(float v, uint32_t maxValue)
+    {
+        v = std::clamp(v, 0.0f, 1.0f);
+        return uint32_t(std::lround(v * float(maxValue)));
+    }
+
+    template<class T>
+    void WriteAt(unsigned char* dst, const T& v)
+    {
+        std::memcpy(dst, &v, sizeof(T));
+    }
+
+    template<class T>
+    T ReadAt(const unsigned char* src)
+    {
+        T v;
+        std::memcpy(&v, src, sizeof(T));
+        return v;
+    }
+}
+
+MeshVertexLayout MeshVertexLayout::For(Format format, uint32_t vertexCount)
+{
+    MeshVertexLayout layout;
+    layout.format = format;
+    layout.vertexCount = vertexCount;
+    switch(format)
+    {
+        case FLOAT32: layout.strides = {sizeof(glm::vec3), sizeof(glm::vec3), sizeof(glm::vec2)}; break;
+        case PACKED:  layout.strides = {4 * sizeof(int16_t), sizeof(uint32_t), 2 * sizeof(uint16_t)}; break;
+    }
+    size_t offset = 0;
+    for(size_t i = 0; i < 3; i++)
+    {
+        layout.offsets[i] = offset;
+        layout.sizes[i] = layout.strides[i] * vertexCount;
+        // This may not be necessary, but align the data to 256-byte boundaries
+        offset += (layout.sizes[i] + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+    layout.totalSize = offset;
+    return layout;
+}
+
+const char* MeshVertexLayout::FormatName(Format format)
+{
+    switch(format)
+    {
+        case FLOAT32:   return "FLOAT32";
+        case PACKED:    return "PACKED";
+    }
+    return "UNKNOWN";
+}
+
+glm::vec2 OctEncode(glm::vec3 n)
+{
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(l1 == 0.0f) return glm::vec2(0.0f);
+    n /= l1;
+    glm::vec2 e(n.x, n.y);
+    if(n.z < 0.0f)
+    {
+        e.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+glm::vec3 OctDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    if(n.z < 0.0f)
+    {
+        n.x = (1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(n);
+}
+
+MeshDecode PackedDecodeFor(const glm::vec3& pMin, const glm::vec3& pMax,
+                           const glm::vec2& tMin, const glm::vec2& tMax)
+{
+    // A uniform position scale keeps the decode a single multiply-add
+    glm::vec3 center = (pMin + pMax) * 0.5f;
+    glm::vec3 halfExtent = (pMax - pMin) * 0.5f;
+    float scale = std::max({halfExtent.x, halfExtent.y, halfExtent.z});
+    if(scale == 0.0f) scale = 1.0f;
+    glm::vec2 uvScale = tMax - tMin;
+    if(uvScale.x == 0.0f) uvScale.x = 1.0f;
+    if(uvScale.y == 0.0f) uvScale.y = 1.0f;
+
+    MeshDecode decode;
+    decode.position = glm::vec4(center, scale);
+    decode.uv = glm::vec4(tMin, uvScale);
+    decode.octNormals = true;
+    return decode;
+}
+
+VertexStreamWriter VertexStreamWriter::For(const MeshVertexLayout& layout,
+                                           void* buffer, uint32_t firstVertex,
+                                           const MeshDecode& decode)
+{
+    VertexStreamWriter writer;
+    writer.format = layout.format;
+    writer.strides = layout.strides;
+    writer.decode = decode;
+    unsigned char* base = static_cast<unsigned char*>(buffer);
+    for(size_t i = 0; i < 3; i++)
+        writer.streams[i] = base + layout.offsets[i] + firstVertex * layout.strides[i];
+    return writer;
+}
+
+void VertexStreamWriter::Write(uint32_t vertex, const glm::vec3& position,
+                               const glm::vec3& normal, const glm::vec2& uv) const
+{
+    using L = MeshVertexLayout;
+    if(positions) positions[vertex] = position;
+    unsigned char* pos = streams[L::POSITION] + vertex * strides[L::POSITION];
+    unsigned char* nrm = streams[L::NORMAL] + vertex * strides[L::NORMAL];
+    unsigned char* tex = streams[L::UV] + vertex * strides[L::UV];
+    if(format == L::FLOAT32)
+    {
+        WriteAt(pos, position);
+        WriteAt(nrm, normal);
+        WriteAt(tex, uv);
+        return;
+    }
+
+    glm::vec3 p = (position - glm::vec3(decode.position)) / decode.position.w;
+    int16_t qp[4] =
+    {
+        int16_t(QuantizeSnorm(p.x, 32767)),
+        int16_t(QuantizeSnorm(p.y, 32767)),
+        int16_t(QuantizeSnorm(p.z, 32767)),
+        0
+    };
+    WriteAt(pos, qp);
+
+    // GL_INT_2_10_10_10_REV, x in the lowest bits; z/w are unused
+    glm::vec2 e = OctEncode(normal);
+    uint32_t nx = uint32_t(QuantizeSnorm(e.x, 511)) & 0x3FFu;
+    uint32_t ny = uint32_t(QuantizeSnorm(e.y, 511)) & 0x3FFu;
+    WriteAt(nrm, uint32_t(nx | (ny << 10)));
+
+    glm::vec2 t = (uv - glm::vec2(decode.uv)) / glm::vec2(decode.uv.z, decode.uv.w);
+    uint16_t qt[2] =
+    {
+        uint16_t(QuantizeUnorm(t.x, 65535)),
+        uint16_t(QuantizeUnorm(t.y, 65535))
+    };
+    WriteAt(tex, qt);
+}
+
+void IndexStreamWriter::Write(uint32_t i, uint32_t vertex) const
+{
+    if(indices) indices[i] = vertex;
+    unsigned char* dst = static_cast<unsigned char*>(data) + size_t(i) * indexStride;
+    if(indexStride == sizeof(uint16_t))
+    {
+        assert(vertex <= 0xFFFFu);
+        WriteAt(dst, uint16_t(vertex));
+    }
+    else WriteAt(dst, vertex);
+}
+
+std::vector<unsigned char> BuildVertexBlock(const MeshData& mesh,
+                                            const MeshVertexLayout& layout,
+                                            MeshDecode& decode)
+{
+    using L = MeshVertexLayout;
+    std::vector<unsigned char> block(layout.totalSize, 0);
+    unsigned char* pos = block.data() + layout.offsets[L::POSITION];
+    unsigned char* normal = block.data() + layout.offsets[L::NORMAL];
+    unsigned char* uv = block.data() + layout.offsets[L::UV];
+    decode = MeshDecode();
+
+    if(layout.format == L::FLOAT32)
+    {
+        std::memcpy(pos, mesh.positions.data(), layout.sizes[L::POSITION]);
+        std::memcpy(normal, mesh.normals.data(), layout.sizes[L::NORMAL]);
+        std::memcpy(uv, mesh.uvs.data(), layout.sizes[L::UV]);
+        return block;
+    }
+
+    // Quantization ranges from the bounds
+    glm::vec3 pMin(0.0f), pMax(0.0f);
+    glm::vec2 tMin(0.0f), tMax(1.0f);
+    if(mesh.VertexCount() != 0)
+    {
+        pMin = pMax = mesh.positions[0];
+        tMin = tMax = mesh.uvs[0];
+    }
+    for(uint32_t i = 0; i < mesh.VertexCount(); i++)
+    {
+        pMin = glm::min(pMin, mesh.positions[i]);
+        pMax = glm::max(pMax, mesh.positions[i]);
+        tMin = glm::min(tMin, mesh.uvs[i]);
+        tMax = glm::max(tMax, mesh.uvs[i]);
+    }
+    decode = PackedDecodeFor(pMin, pMax, tMin, tMax);
+
+    VertexStreamWriter writer = VertexStreamWriter::For(layout, block.data(), 0, decode);
+    for(uint32_t i = 0; i < mesh.VertexCount(); i++)
+        writer.Write(i, mesh.positions[i], mesh.normals[i], mesh.uvs[i]);
+    return block;
+}
+
+std::vector<unsigned char> BuildIndexBlock(const std::vector<uint32_t>& indices,
+                                           uint32_t indexStride)
+{
+    std::vector<unsigned char> block(indices.size() * indexStride);
+    if(indexStride == sizeof(uint32_t))
+    {
+        std::memcpy(block.data(), indices.data(), block.size());
+        return block;
+    }
+    assert(indexStride == sizeof(uint16_t));
+    for(size_t i = 0; i < indices.size(); i++)
+    {
+        assert(indices[i] <= 0xFFFFu);
+        WriteAt(block.data() + i * sizeof(uint16_t), uint16_t(indices[i]));
+    }
+    return block;
+}
+
+std::vector<glm::vec3> ReadPositions(const MeshVertexLayout& layout, const void* block,
+                                     const MeshDecode& decode)
+{
+    using L = MeshVertexLayout;
+    std::vector<glm::vec3> positions(layout.vertexCount);
+    const unsigned char* pos = (static_cast<const unsigned char*>(block) +
+                                layout.offsets[L::POSITION]);
+    if(layout.format == L::FLOAT32)
+    {
+        std::memcpy(positions.data(), pos, layout.sizes[L::POSITION]);
+        return positions;
+    }
+
+    for(uint32_t i = 0; i < layout.vertexCount; i++)
+    {
+        const unsigned char* q = pos + i * layout.strides[L::POSITION];
+        // snorm16 dequantization of the GL (-32768 maps to -1 as well)
+        glm::vec3 p(std::max(float(ReadAt<int16_t>(q + 0)) / 32767.0f, -1.0f),
+                    std::max(float(ReadAt<int16_t>(q + 2)) / 32767.0f, -1.0f),
+                    std::max(float(ReadAt<int16_t>(q + 4)) / 32767.0f, -1.0f));
+        positions[i] = glm::vec3(decode.position) + decode.position.w * p;
+    }
+    return positions;
+}
+
+std::vector<uint32_t> ReadIndices(const void* block, size_t indexCount,
+                                  uint32_t indexStride)
+{
+    std::vector<uint32_t> indices(indexCount);
+    const unsigned char* src = static_cast<const unsigned char*>(block);
+    if(indexStride == sizeof(uint32_t))
+    {
+        std::memcpy(indices.data(), src, indexCount * sizeof(uint32_t));
+        return indices;
+    }
+    assert(indexStride == sizeof(uint16_t));
+    for(size_t i = 0; i < indexCount; i++)
+        indices[i] = ReadAt<uint16_t>(src + i * sizeof(uint16_t));
+    return indices;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct MeshData;
+
+// Byte layout of MeshGL's vertex buffer. Attributes are stored as
+// planar streams (position, normal, uv), each stream starts at a
+// 256-byte aligned offset.
+//
+// FLOAT32 : vec3 position, vec3 normal, vec2 uv (32 bytes per vertex)
+// PACKED  : snorm16x3 position (+2 byte pad), octahedral normal in the
+//           x/y of a GL_INT_2_10_10_10_REV, unorm16x2 uv
+//           (16 bytes per vertex). Positions and uvs are quantized
+//           relative to the mesh bounds, see MeshDecode.
+struct MeshVertexLayout {
+  enum Format : uint32_t { FLOAT32 = 0, PACKED = 1 };
+
+  static constexpr size_t ALIGNMENT = 256;
+  static constexpr uint32_t POSITION = 0;
+  static constexpr uint32_t NORMAL = 1;
+  static constexpr uint32_t UV = 2;
+
+  Format format = FLOAT32;
+  uint32_t vertexCount = 0;
+  std::array<size_t, 3> offsets = {};
+  std::array<size_t, 3> sizes = {};
+  std::array<size_t, 3> strides = {};
+  size_t totalSize = 0;
+
+  size_t BytesPerVertex() const { return strides[0] + strides[1] + strides[2]; }
+
+  static MeshVertexLayout For(Format, uint32_t vertexCount);
+  static const char *FormatName(Format);
+};
+
+// Dequantization of the PACKED format, shaders compute
+//   position = posDecode.xyz + posDecode.w * vPos
+//   uv       = uvDecode.xy + uvDecode.zw * vUV
+// and octahedral-decode the normal when "octNormals" is set.
+// Defaults are the identity for FLOAT32.
+struct MeshDecode {
+  glm::vec4 position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  glm::vec4 uv = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+  bool octNormals = false;
+};
+
+// PACKED decode that covers positions in [posMin, posMax] and uvs in
+// [uvMin, uvMax]
+MeshDecode PackedDecodeFor(const glm::vec3 &posMin, const glm::vec3 &posMax,
+                           const glm::vec2 &uvMin, const glm::vec2 &uvMax);
+
+// Writes vertices into the planar streams of a MeshVertexLayout, e.g. in
+// a mapped GPU buffer. PACKED vertices are quantized with "decode".
+struct VertexStreamWriter {
+  MeshVertexLayout::Format format = MeshVertexLayout::FLOAT32;
+  // First vertex of each stream
+  std::array<unsigned char *, 3> streams = {};
+  std::array<size_t, 3> strides = {};
+  MeshDecode decode;
+  // Optional CPU copy of the (unquantized) positions, e.g. for meshlets
+  // of a write only GPU buffer
+  glm::vec3 *positions = nullptr;
+
+  // Streams of the vertices [firstVertex, ...) of a buffer in "layout"
+  static VertexStreamWriter For(const MeshVertexLayout &layout, void *buffer,
+                                uint32_t firstVertex, const MeshDecode &);
+  void Write(uint32_t vertex, const glm::vec3 &position,
+             const glm::vec3 &normal, const glm::vec2 &uv) const;
+};
+
+// Writes 16 or 32-bit indices
+struct IndexStreamWriter {
+  void *data = nullptr;
+  uint32_t indexStride = sizeof(uint32_t);
+  // Optional CPU copy of the indices as 32-bit
+  uint32_t *indices = nullptr;
+
+  void Write(uint32_t i, uint32_t vertex) const;
+};
+
+// Builds the vertex buffer contents of "mesh" in "layout"
+// (padding is zeroed) and returns the matching decode parameters.
+std::vector<unsigned char> BuildVertexBlock(const MeshData &mesh,
+                                            const MeshVertexLayout &layout,
+                                            MeshDecode &decode);
+
+// Index buffers use 16-bit indices when every vertex is addressable
+// with them (there is no primitive restart index to reserve).
+inline uint32_t IndexStrideFor(uint32_t vertexCount) {
+  return (vertexCount <= 0x10000u) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Builds the index buffer contents with "indexStride" byte indices
+std::vector<unsigned char> BuildIndexBlock(const std::vector<uint32_t> &indices,
+                                           uint32_t indexStride);
+
+// Reads back the (dequantized) positions of a vertex buffer in "layout"
+std::vector<glm::vec3> ReadPositions(const MeshVertexLayout &layout,
+                                     const void *block, const MeshDecode &);
+// Reads back "indexCount" 16 or 32-bit indices as 32-bit
+std::vector<uint32_t> ReadIndices(const void *block, size_t indexCount,
+                                  uint32_t indexStride);
+
+// Octahedral normal encoding (exposed for the tools)
+glm::vec2 OctEncode(glm::vec3 n);
+glm::vec3 OctDecode(glm::vec2 e);
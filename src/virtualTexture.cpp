@@ -0,0 +1,478 @@
+#include "virtualTexture.h"
+#include "gpuMemory.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    // Layout of the "VirtualTexture" uniform block (std140)
+    struct VirtualTextureParameters
+    {
+        // Level 0 width, height, level count, first feedback bit
+        int32_t     size[4];
+        // Tile size, border, cache size, feedback phase
+        int32_t     tile[4];
+        // Tiles x, tiles y, first feedback bit of the level
+        int32_t     levels[VirtualTextureFile::MAX_LEVELS][4];
+    };
+    static_assert(sizeof(VirtualTextureParameters) == 288);
+
+    // Slot x, slot y, level, valid
+    uint32_t IndirectionTexel(uint32_t x, uint32_t y, uint32_t level)
+    {
+        return x | (y << 8) | (level << 16) | (255u << 24);
+    }
+
+    uint32_t KeyTexture(uint64_t key) { return uint32_t(key >> 48); }
+    uint32_t KeyLevel(uint64_t key)   { return uint32_t(key >> 40) & 0xFF; }
+    uint32_t KeyY(uint64_t key)       { return uint32_t(key >> 20) & 0xFFFFF; }
+    uint32_t KeyX(uint64_t key)       { return uint32_t(key) & 0xFFFFF; }
+}
+
+VirtualTextureSystem::VirtualTextureSystem(size_t vramCapIn, uint32_t tileUploadsIn)
+    : vramCap(vramCapIn)
+    , tileUploads(tileUploadsIn)
+{}
+
+VirtualTextureSystem::~VirtualTextureSystem()
+{
+    // Reads point into the mapped page files
+    for(Load& l : loads)
+        l.data.wait();
+    for(Feedback& f : feedback)
+    {
+        if(f.fence) glDeleteSync(f.fence);
+        GPUMemory::Global().Release(GPUMemory::BUFFER, f.buffer);
+        if(f.buffer)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.buffer);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            glDeleteBuffers(1, &f.buffer);
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GPUMemory::Global().Release(GPUMemory::BUFFER, discardBuffer);
+    if(discardBuffer) glDeleteBuffers(1, &discardBuffer);
+    for(const std::unique_ptr<Texture>& t : textures)
+    {
+        GPUMemory::Global().Release(GPUMemory::TEXTURE, t->indirectionId);
+        GPUMemory::Global().Release(GPUMemory::BUFFER, t->parameterBuffer);
+        glDeleteTextures(1, &t->indirectionId);
+        glDeleteBuffers(1, &t->parameterBuffer);
+    }
+    GPUMemory::Global().Release(GPUMemory::TEXTURE, physicalId);
+    if(physicalId) glDeleteTextures(1, &physicalId);
+}
+
+uint64_t VirtualTextureSystem::Key(uint32_t texture, uint32_t level, uint32_t x, uint32_t y)
+{
+    return ((uint64_t(texture) << 48) | (uint64_t(level) << 40) |
+            (uint64_t(y) << 20) | uint64_t(x));
+}
+
+void VirtualTextureSystem::CreateCache(const TexelEncoding& enc, uint32_t tileSize,
+                                       uint32_t border)
+{
+    encoding = enc;
+    slotSize = tileSize + 2 * border;
+    size_t tileBytes = VirtualTextureFile::TileBytes(enc, tileSize, border);
+    if(enc.compressed)
+    {
+        if(!TextureGL::SupportsBlockFormat(enc.blockFormat))
+        {
+            std::fprintf(stderr, "%s textures are not supported by the GL!\n",
+                         BlockFormat::Name(enc.blockFormat));
+            std::exit(EXIT_FAILURE);
+        }
+        sizedFormat = TextureGL::CompressedFormatGL(enc.blockFormat);
+    }
+    else
+    {
+        if(!TexelFormatGL::For(int(enc.channelCount), false, texelFormat))
+        {
+            std::fprintf(stderr, "Unkown image type!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        sizedFormat = texelFormat.sizedFormat;
+    }
+
+    // As many slots as the cap allows, slot coordinates are 8-bit in the
+    // indirection
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    uint32_t maxSlots = std::min(255u, uint32_t(maxSize) / slotSize);
+    slotsPerSide = uint32_t(std::sqrt(double(vramCap) / double(tileBytes)));
+    slotsPerSide = std::clamp(slotsPerSide, 2u, maxSlots);
+    slots.assign(size_t(slotsPerSide) * slotsPerSide, Slot());
+
+    GLsizei size = GLsizei(slotsPerSide * slotSize);
+    glGenTextures(1, &physicalId);
+    glBindTexture(GL_TEXTURE_2D, physicalId);
+    glTexStorage2D(GL_TEXTURE_2D, 1, sizedFormat, size, size);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GPUMemory::Global().Track(GPUMemory::TEXTURE, physicalId, GPUMemory::VIRTUAL_TEXTURE,
+                              CacheBytes(), 0, "virtual texture cache");
+    std::printf("Virtual texture cache: %ux%u tiles of %ux%u %s, %.2f MiB\n",
+                slotsPerSide, slotsPerSide, slotSize, slotSize, enc.Name().c_str(),
+                double(CacheBytes()) / (1024.0 * 1024.0));
+}
+
+void VirtualTextureSystem::CreateFeedback()
+{
+    for(Feedback& f : feedback)
+    {
+        if(f.fence) glDeleteSync(f.fence);
+        GPUMemory::Global().Release(GPUMemory::BUFFER, f.buffer);
+        if(f.buffer)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.buffer);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            glDeleteBuffers(1, &f.buffer);
+        }
+        f = Feedback();
+    }
+    GPUMemory::Global().Release(GPUMemory::BUFFER, discardBuffer);
+    if(discardBuffer) glDeleteBuffers(1, &discardBuffer);
+
+    static constexpr GLbitfield Flags = (GL_MAP_READ_BIT | GL_MAP_WRITE_BIT |
+                                         GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    GLsizeiptr size = GLsizeiptr(feedbackWords * sizeof(uint32_t));
+    std::vector<uint32_t> zeros(feedbackWords, 0);
+    for(Feedback& f : feedback)
+    {
+        glGenBuffers(1, &f.buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.buffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, size, zeros.data(), Flags);
+        f.bits = static_cast<uint32_t*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0,
+                                                         size, Flags));
+        if(!f.bits)
+        {
+            std::printf("Unable to map the virtual texture feedback buffer!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        GPUMemory::Global().Track(GPUMemory::BUFFER, f.buffer, GPUMemory::VIRTUAL_TEXTURE,
+                                  size_t(size), 0, "virtual texture feedback");
+    }
+    glGenBuffers(1, &discardBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, discardBuffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, size, nullptr, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GPUMemory::Global().Track(GPUMemory::BUFFER, discardBuffer, GPUMemory::VIRTUAL_TEXTURE,
+                              size_t(size), 0, "virtual texture feedback");
+    current = -1;
+}
+
+uint32_t VirtualTextureSystem::Add(const std::string& path)
+{
+    auto t = std::make_unique<Texture>();
+    if(!t->file.Open(path))
+    {
+        std::fprintf(stderr, "Unable to read virtual texture \"%s\"\n", path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    const VirtualTextureFile& file = t->file;
+    if(textures.empty())
+        CreateCache(file.encoding, file.tileSize, file.border);
+    else if(!(file.encoding == encoding) ||
+            file.tileSize + 2 * file.border != slotSize ||
+            file.border != textures[0]->file.border)
+    {
+        std::fprintf(stderr, "Virtual texture \"%s\" does not match the tiles of the "
+                             "cache (%s, %u + %u border)\n", path.c_str(),
+                     encoding.Name().c_str(), textures[0]->file.tileSize,
+                     textures[0]->file.border);
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Feedback bits, after the ones of the other textures
+    t->id = uint32_t(textures.size());
+    if(!textures.empty())
+    {
+        const Texture& last = *textures.back();
+        t->bitOffset = last.bitOffset + last.file.TileCount();
+    }
+    uint32_t levelCount = uint32_t(file.levels.size());
+    uint32_t bits = 0;
+    for(const VirtualTextureFile::Level& l : file.levels)
+    {
+        t->levelBits.push_back(bits);
+        bits += l.tilesX * l.tilesY;
+    }
+    feedbackWords = (t->bitOffset + bits + 31) / 32;
+    CreateFeedback();
+
+    // Indirection, a texel per tile of every level
+    t->indirection.resize(levelCount);
+    for(uint32_t l = 0; l < levelCount; l++)
+        t->indirection[l].assign(size_t(file.levels[l].tilesX) * file.levels[l].tilesY, 0);
+    glGenTextures(1, &t->indirectionId);
+    glBindTexture(GL_TEXTURE_2D, t->indirectionId);
+    glTexStorage2D(GL_TEXTURE_2D, GLsizei(levelCount), GL_RGBA8UI,
+                   GLsizei(file.levels[0].tilesX), GLsizei(file.levels[0].tilesY));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    size_t indirectionBytes = 0;
+    for(const std::vector<uint32_t>& level : t->indirection)
+        indirectionBytes += level.size() * sizeof(uint32_t);
+    GPUMemory::Global().Track(GPUMemory::TEXTURE, t->indirectionId, GPUMemory::VIRTUAL_TEXTURE,
+                              indirectionBytes, 0, path);
+
+    glGenBuffers(1, &t->parameterBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, t->parameterBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(VirtualTextureParameters), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GPUMemory::Global().Track(GPUMemory::BUFFER, t->parameterBuffer, GPUMemory::VIRTUAL_TEXTURE,
+                              sizeof(VirtualTextureParameters), 0, path);
+
+    // The single tile of the coarsest level is always resident
+    textures.push_back(std::move(t));
+    Texture& added = *textures.back();
+    uint32_t coarsest = levelCount - 1;
+    int slot = AllocateSlot();
+    Upload(Key(added.id, coarsest, 0, 0), uint32_t(slot), added.file.Tile(coarsest, 0, 0));
+    slots[size_t(slot)].pinned = true;
+    UpdateIndirection(added);
+    return added.id;
+}
+
+void VirtualTextureSystem::Bind(uint32_t id) const
+{
+    const Texture& t = *textures[id];
+    glActiveTexture(GL_TEXTURE0 + T_PHYSICAL);
+    glBindTexture(GL_TEXTURE_2D, physicalId);
+    glActiveTexture(GL_TEXTURE0 + T_INDIRECTION);
+    glBindTexture(GL_TEXTURE_2D, t.indirectionId);
+    glActiveTexture(GL_TEXTURE0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, B_PARAMETERS, t.parameterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, B_FEEDBACK,
+                     (current >= 0) ? feedback[current].buffer : discardBuffer);
+}
+
+void VirtualTextureSystem::ReadFeedback(const uint32_t* bits)
+{
+    for(uint32_t w = 0; w < feedbackWords; w++)
+    {
+        for(uint32_t word = bits[w]; word != 0; word &= word - 1)
+        {
+            uint32_t bit = w * 32 + uint32_t(std::countr_zero(word));
+            // Texture, level and tile of the bit
+            size_t ti = textures.size();
+            while(ti-- > 0 && textures[ti]->bitOffset > bit) {}
+            const Texture& t = *textures[ti];
+            uint32_t index = bit - t.bitOffset;
+            uint32_t level = uint32_t(t.levelBits.size());
+            while(level-- > 0 && t.levelBits[level] > index) {}
+            index -= t.levelBits[level];
+            const VirtualTextureFile::Level& l = t.file.levels[level];
+            uint64_t key = Key(t.id, level, index % l.tilesX, index / l.tilesX);
+
+            auto resident = residentSlots.find(key);
+            if(resident != residentSlots.end())
+                slots[resident->second].lastUse = frame;
+            else if(requested.insert(key).second)
+            {
+                requests.push_back(key);
+                stats.requestedTiles++;
+            }
+        }
+    }
+}
+
+int VirtualTextureSystem::AllocateSlot()
+{
+    // A free slot, or the least recently used one that the last feedback
+    // frames did not ask for
+    int best = -1;
+    for(size_t i = 0; i < slots.size(); i++)
+    {
+        const Slot& s = slots[i];
+        if(s.key == EMPTY_KEY) return int(i);
+        if(s.pinned || s.lastUse + FEEDBACK_FRAMES + 1 >= frame) continue;
+        if(best < 0 || s.lastUse < slots[size_t(best)].lastUse)
+            best = int(i);
+    }
+    return best;
+}
+
+void VirtualTextureSystem::Upload(uint64_t key, uint32_t slot, const unsigned char* tile)
+{
+    Slot& s = slots[slot];
+    if(s.key != EMPTY_KEY)
+    {
+        residentSlots.erase(s.key);
+        textures[KeyTexture(s.key)]->dirty = true;
+        stats.evictions++;
+    }
+    s.key = key;
+    s.lastUse = frame;
+    residentSlots[key] = slot;
+    textures[KeyTexture(key)]->dirty = true;
+
+    GLint x = GLint((slot % slotsPerSide) * slotSize);
+    GLint y = GLint((slot / slotsPerSide) * slotSize);
+    glBindTexture(GL_TEXTURE_2D, physicalId);
+    if(encoding.compressed)
+    {
+        GLsizei size = GLsizei(VirtualTextureFile::TileBytes(encoding, slotSize, 0));
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, GLsizei(slotSize), GLsizei(slotSize),
+                                  sizedFormat, size, tile);
+    }
+    else
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, GLsizei(slotSize), GLsizei(slotSize),
+                        texelFormat.format, texelFormat.type, tile);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    stats.uploadedTiles++;
+}
+
+void VirtualTextureSystem::UpdateIndirection(Texture& t)
+{
+    // Coarse to fine, tiles that are not resident inherit the entry of
+    // the tile above them
+    const std::vector<VirtualTextureFile::Level>& levels = t.file.levels;
+    glBindTexture(GL_TEXTURE_2D, t.indirectionId);
+    for(uint32_t l = uint32_t(levels.size()); l-- > 0;)
+    {
+        const VirtualTextureFile::Level& level = levels[l];
+        std::vector<uint32_t>& texels = t.indirection[l];
+        for(uint32_t y = 0; y < level.tilesY; y++)
+        {
+            for(uint32_t x = 0; x < level.tilesX; x++)
+            {
+                uint32_t& texel = texels[size_t(y) * level.tilesX + x];
+                auto resident = residentSlots.find(Key(t.id, l, x, y));
+                if(resident != residentSlots.end())
+                    texel = IndirectionTexel(resident->second % slotsPerSide,
+                                             resident->second / slotsPerSide, l);
+                else if(l + 1 < levels.size())
+                    texel = t.indirection[l + 1][size_t(y >> 1) * levels[l + 1].tilesX +
+                                                 (x >> 1)];
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, GLint(l), 0, 0, GLsizei(level.tilesX),
+                        GLsizei(level.tilesY), GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                        texels.data());
+    }
+    t.dirty = false;
+}
+
+void VirtualTextureSystem::BeginFrame()
+{
+    if(textures.empty()) return;
+
+    // Feedback the GPU is done with
+    for(Feedback& f : feedback)
+    {
+        if(!f.fence) continue;
+        GLenum status = glClientWaitSync(f.fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+        glDeleteSync(f.fence);
+        f.fence = nullptr;
+        ReadFeedback(f.bits);
+        std::memset(f.bits, 0, feedbackWords * sizeof(uint32_t));
+    }
+
+    // Reads of the missing tiles, coarse levels first since they cover
+    // the most texels
+    std::stable_sort(requests.begin(), requests.end(), [](uint64_t a, uint64_t b)
+    {
+        return KeyLevel(a) > KeyLevel(b);
+    });
+    size_t started = 0;
+    while(started < requests.size() && loads.size() < 2 * size_t(tileUploads))
+    {
+        uint64_t key = requests[started++];
+        const Texture& t = *textures[KeyTexture(key)];
+        const unsigned char* tile = t.file.Tile(KeyLevel(key), KeyX(key), KeyY(key));
+        size_t size = t.file.tileBytes;
+        loads.push_back(Load{key, ThreadPool::Global().Submit([tile, size]()
+        {
+            return std::vector<unsigned char>(tile, tile + size);
+        })});
+    }
+    requests.erase(requests.begin(), requests.begin() + std::ptrdiff_t(started));
+
+    // Uploads of the tiles that were read
+    using namespace std::chrono_literals;
+    uint32_t uploads = 0;
+    for(auto it = loads.begin(); it != loads.end() && uploads < tileUploads;)
+    {
+        if(it->data.wait_for(0s) != std::future_status::ready)
+        {
+            it++;
+            continue;
+        }
+        std::vector<unsigned char> tile = it->data.get();
+        requested.erase(it->key);
+        int slot = AllocateSlot();
+        if(slot < 0)
+            stats.droppedTiles++;
+        else
+        {
+            Upload(it->key, uint32_t(slot), tile.data());
+            uploads++;
+        }
+        it = loads.erase(it);
+    }
+    for(const std::unique_ptr<Texture>& t : textures)
+        if(t->dirty) UpdateIndirection(*t);
+
+    // Feedback of this frame, into a buffer that is not in flight
+    current = -1;
+    for(uint32_t i = 0; i < FEEDBACK_FRAMES && current < 0; i++)
+        if(!feedback[i].fence) current = int(i);
+
+    // Parameters, with the pixels that record feedback this frame
+    for(const std::unique_ptr<Texture>& t : textures)
+    {
+        const VirtualTextureFile& file = t->file;
+        VirtualTextureParameters p = {};
+        p.size[0] = int32_t(file.width);
+        p.size[1] = int32_t(file.height);
+        p.size[2] = int32_t(file.levels.size());
+        p.size[3] = int32_t(t->bitOffset);
+        p.tile[0] = int32_t(file.tileSize);
+        p.tile[1] = int32_t(file.border);
+        p.tile[2] = int32_t(slotsPerSide * slotSize);
+        p.tile[3] = int32_t(frame % 16);
+        for(size_t l = 0; l < file.levels.size(); l++)
+        {
+            p.levels[l][0] = int32_t(file.levels[l].tilesX);
+            p.levels[l][1] = int32_t(file.levels[l].tilesY);
+            p.levels[l][2] = int32_t(t->levelBits[l]);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, t->parameterBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(VirtualTextureParameters), &p);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void VirtualTextureSystem::EndFrame()
+{
+    if(current >= 0)
+    {
+        // Shader writes must reach the persistent mapping before the fence
+        glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+        feedback[current].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current = -1;
+    }
+    frame++;
+}
+
+size_t VirtualTextureSystem::CacheBytes() const
+{
+    return slots.size() * VirtualTextureFile::TileBytes(encoding, slotSize, 0);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "utility.h"
+#include "virtualTextureFile.h"
+
+// Software virtual texturing: samples page files far larger than the GPU
+// memory through a fixed size cache of their tiles.
+//
+// - The physical cache is a single texture of "tile + 2 * border" sized
+//   slots, as many as fit in "vramCap". Slots are recycled least
+//   recently used first; the coarsest tile of every texture is pinned,
+//   so every texel has a fallback.
+// - Each texture has an indirection texture (RGBA8UI, a texel per tile
+//   and a level per mip) holding the slot and the level of the finest
+//   resident tile that covers it; shaders map virtual coordinates to
+//   the cache through it.
+// - Shaders record the tiles they would like to sample (their level
+//   from the UV derivatives) into a feedback bit set (SSBO, a bit per
+//   tile of every texture), one pixel of each 4x4 block per frame.
+//   The bit sets are read back a few frames later (fences, persistent
+//   mapping), so the GPU never waits.
+// - Missing tiles are read from the mapped page files on the global
+//   thread pool, coarse levels first, and at most "tileUploads" tiles
+//   are uploaded per frame.
+//
+// Shaders get the bindings below by including virtualTexture.glsl.
+// Every texture must share the encoding of the first one. All functions
+// must be called on the thread that owns the GL context.
+class VirtualTextureSystem {
+public:
+  static constexpr size_t DEFAULT_VRAM_CAP = 64 * 1024 * 1024;
+  static constexpr uint32_t DEFAULT_TILE_UPLOADS = 32;
+  static constexpr uint32_t FEEDBACK_FRAMES = 3;
+  // Bindings
+  static constexpr GLuint B_FEEDBACK = 0;
+  static constexpr GLuint B_PARAMETERS = 1;
+  static constexpr GLuint T_PHYSICAL = 5;
+  static constexpr GLuint T_INDIRECTION = 6;
+
+  struct Stats {
+    // Since the last "ResetStats"
+    uint32_t requestedTiles = 0;
+    uint32_t uploadedTiles = 0;
+    uint32_t evictions = 0;
+    // Loaded tiles dropped because every slot was in use
+    uint32_t droppedTiles = 0;
+  };
+
+  // Constructors, Movement & Destructor
+  explicit VirtualTextureSystem(size_t vramCap = DEFAULT_VRAM_CAP,
+                                uint32_t tileUploads = DEFAULT_TILE_UPLOADS);
+  VirtualTextureSystem(const VirtualTextureSystem &) = delete;
+  VirtualTextureSystem(VirtualTextureSystem &&) = delete;
+  VirtualTextureSystem &operator=(const VirtualTextureSystem &) = delete;
+  VirtualTextureSystem &operator=(VirtualTextureSystem &&) = delete;
+  ~VirtualTextureSystem();
+
+  // Opens a page file, returns its id
+  uint32_t Add(const std::string &path);
+  // Binds the cache, the indirection and the parameters of texture "id"
+  // for the next draws
+  void Bind(uint32_t id) const;
+  // Reads back the finished feedback, streams tiles and selects the
+  // feedback buffer of the frame, before its draws
+  void BeginFrame();
+  // Fences the feedback of the frame, after its draws
+  void EndFrame();
+
+  uint32_t ResidentTiles() const { return uint32_t(residentSlots.size()); }
+  uint32_t SlotCount() const { return uint32_t(slots.size()); }
+  size_t CacheBytes() const;
+  const Stats &GetStats() const { return stats; }
+  void ResetStats() { stats = Stats(); }
+
+private:
+  struct Texture {
+    uint32_t id = 0;
+    VirtualTextureFile file;
+    // First bit of the texture in the feedback, per level
+    uint32_t bitOffset = 0;
+    std::vector<uint32_t> levelBits;
+    GLuint indirectionId = 0;
+    GLuint parameterBuffer = 0;
+    // Indirection texels per level (slot x, slot y, level, 255)
+    std::vector<std::vector<uint32_t>> indirection;
+    bool dirty = true;
+  };
+  struct Slot {
+    uint64_t key = EMPTY_KEY;
+    uint64_t lastUse = 0;
+    bool pinned = false;
+  };
+  struct Load {
+    uint64_t key;
+    std::future<std::vector<unsigned char>> data;
+  };
+  struct Feedback {
+    GLuint buffer = 0;
+    uint32_t *bits = nullptr;
+    GLsync fence = nullptr;
+  };
+  static constexpr uint64_t EMPTY_KEY = ~uint64_t(0);
+
+  size_t vramCap;
+  uint32_t tileUploads;
+  uint64_t frame = 1;
+  std::vector<std::unique_ptr<Texture>> textures;
+  Stats stats;
+  // Physical cache, created with the first texture
+  TexelEncoding encoding;
+  TexelFormatGL texelFormat;
+  GLenum sizedFormat = 0;
+  GLuint physicalId = 0;
+  uint32_t slotSize = 0;
+  uint32_t slotsPerSide = 0;
+  std::vector<Slot> slots;
+  std::unordered_map<uint64_t, uint32_t> residentSlots;
+  // Requested tiles that are not resident yet, and their reads
+  std::vector<uint64_t> requests;
+  std::unordered_set<uint64_t> requested;
+  std::vector<Load> loads;
+  // Feedback bit sets of the last frames, "current" is written this frame
+  // (-1: every buffer is in flight, "discard" is written instead)
+  Feedback feedback[FEEDBACK_FRAMES];
+  GLuint discardBuffer = 0;
+  int current = -1;
+  uint32_t feedbackWords = 0;
+
+  static uint64_t Key(uint32_t texture, uint32_t level, uint32_t x,
+                      uint32_t y);
+  void CreateCache(const TexelEncoding &, uint32_t tileSize,
+                   uint32_t border);
+  void CreateFeedback();
+  void ReadFeedback(const uint32_t *bits);
+  // Returns the slot of a new tile, or -1 if every slot is in use
+  int AllocateSlot();
+  void Upload(uint64_t key, uint32_t slot, const unsigned char *tile);
+  void UpdateIndirection(Texture &);
+};
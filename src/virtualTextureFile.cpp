@@ -0,0 +1,233 @@
+#include "virtualTextureFile.h"
+#include "blockCompressor.h"
+#include "mipGenerator.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace
+{
+    constexpr char VIRTUAL_TEXTURE_MAGIC[8] = {'P', 'L', 'V', 'T', 'E', 'X', '\0', '\0'};
+    constexpr size_t TILE_ALIGNMENT = 16;
+
+    // Tiles follow the header
+    struct VirtualTextureHeader
+    {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    headerSize;
+        // Texel encoding
+        uint32_t    compressed;
+        uint32_t    blockFormat;
+        uint32_t    channelCount;
+        uint32_t    bytesPerChannel;
+        // Level 0 size and tiling
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    tileSize;
+        uint32_t    border;
+        uint32_t    levelCount;
+        uint32_t    tileCount;
+        uint64_t    tileBytes;
+    };
+    static_assert(sizeof(VirtualTextureHeader) == 64);
+    static_assert(sizeof(VirtualTextureHeader) % TILE_ALIGNMENT == 0);
+
+    bool IsPowerOfTwo(uint32_t v)
+    {
+        return v != 0 && (v & (v - 1)) == 0;
+    }
+
+    // Levels down to the one of a single tile, coarsest first in the file
+    std::vector<VirtualTextureFile::Level> LevelsFor(uint32_t width, uint32_t height,
+                                                     uint32_t tileSize)
+    {
+        uint32_t tilesX = width / tileSize;
+        uint32_t tilesY = height / tileSize;
+        uint32_t levelCount = uint32_t(std::bit_width(std::max(tilesX, tilesY)));
+        std::vector<VirtualTextureFile::Level> levels(levelCount);
+        uint32_t firstTile = 0;
+        for(uint32_t l = levelCount; l-- > 0;)
+        {
+            levels[l].tilesX = std::max(tilesX >> l, 1u);
+            levels[l].tilesY = std::max(tilesY >> l, 1u);
+            levels[l].firstTile = firstTile;
+            firstTile += levels[l].tilesX * levels[l].tilesY;
+        }
+        return levels;
+    }
+
+    uint32_t TileCountOf(const std::vector<VirtualTextureFile::Level>& levels)
+    {
+        return levels[0].firstTile + levels[0].tilesX * levels[0].tilesY;
+    }
+
+    bool EncodingFrom(const VirtualTextureHeader& header, TexelEncoding& out)
+    {
+        if(header.compressed)
+        {
+            if(header.blockFormat > BlockFormat::BC7) return false;
+            out = TexelEncoding::Block(BlockFormat::Type(header.blockFormat));
+            return true;
+        }
+        if(header.channelCount < 1 || header.channelCount > 4 || header.bytesPerChannel != 1)
+            return false;
+        out = TexelEncoding::Raw(header.channelCount, header.bytesPerChannel);
+        return true;
+    }
+}
+
+std::string VirtualTextureFile::PathFor(const std::string& imagePath)
+{
+    return std::filesystem::path(imagePath).replace_extension(EXTENSION).generic_string();
+}
+
+size_t VirtualTextureFile::TileBytes(const TexelEncoding& encoding, uint32_t tileSize,
+                                     uint32_t border)
+{
+    size_t slot = tileSize + 2 * border;
+    if(encoding.compressed)
+    {
+        size_t blocks = slot / BlockFormat::BLOCK_DIM;
+        return blocks * blocks * BlockFormat::BlockSize(encoding.blockFormat);
+    }
+    return slot * slot * encoding.channelCount * encoding.bytesPerChannel;
+}
+
+bool VirtualTextureFile::Write(const std::string& path, const unsigned char* pixels,
+                               uint32_t width, uint32_t height, uint32_t channelCount,
+                               const TexelEncoding& encoding, uint32_t tileSize,
+                               uint32_t border)
+{
+    uint32_t slotSize = tileSize + 2 * border;
+    if(!IsPowerOfTwo(width) || !IsPowerOfTwo(height) || !IsPowerOfTwo(tileSize) ||
+       width < tileSize || height < tileSize)
+    {
+        std::fprintf(stderr, "Virtual textures need power of two sizes of at least the "
+                             "tile size (%ux%u, tiles of %u)\n", width, height, tileSize);
+        return false;
+    }
+    if(encoding.compressed && slotSize % BlockFormat::BLOCK_DIM != 0)
+    {
+        std::fprintf(stderr, "Tiles of %u texels with a border of %u are not whole "
+                             "blocks\n", tileSize, border);
+        return false;
+    }
+    if(!encoding.compressed &&
+       (encoding.channelCount != channelCount || encoding.bytesPerChannel != 1))
+    {
+        std::fprintf(stderr, "Raw virtual textures keep the 8-bit channels of the "
+                             "image\n");
+        return false;
+    }
+    std::vector<Level> levels = LevelsFor(width, height, tileSize);
+    if(levels.size() > MAX_LEVELS)
+    {
+        std::fprintf(stderr, "Virtual textures have at most %u levels\n", MAX_LEVELS);
+        return false;
+    }
+
+    MipChain mips = GenerateMips(pixels, width, height, channelCount);
+    size_t tileBytes = TileBytes(encoding, tileSize, border);
+    std::vector<unsigned char> tiles(size_t(TileCountOf(levels)) * tileBytes);
+    for(uint32_t l = 0; l < levels.size(); l++)
+    {
+        const unsigned char* src = (l == 0) ? pixels : mips.Pixels(l - 1);
+        int levelWidth = int(std::max(width >> l, 1u));
+        int levelHeight = int(std::max(height >> l, 1u));
+        const Level& level = levels[l];
+        ThreadPool::Global().ParallelFor(level.tilesX * level.tilesY, [&](uint32_t i)
+        {
+            uint32_t tx = i % level.tilesX;
+            uint32_t ty = i / level.tilesX;
+            // Tile and border, wrapped horizontally and clamped vertically
+            std::vector<unsigned char> texels(size_t(slotSize) * slotSize * channelCount);
+            for(uint32_t y = 0; y < slotSize; y++)
+            {
+                int sy = std::clamp(int(ty * tileSize + y) - int(border), 0, levelHeight - 1);
+                for(uint32_t x = 0; x < slotSize; x++)
+                {
+                    int sx = int(tx * tileSize + x) - int(border);
+                    sx = ((sx % levelWidth) + levelWidth) % levelWidth;
+                    std::memcpy(texels.data() + (size_t(y) * slotSize + x) * channelCount,
+                                src + (size_t(sy) * size_t(levelWidth) + size_t(sx)) * channelCount,
+                                channelCount);
+                }
+            }
+            unsigned char* out = tiles.data() + size_t(level.firstTile + i) * tileBytes;
+            if(encoding.compressed)
+                CompressLevel(encoding.blockFormat, texels.data(), slotSize, slotSize,
+                              channelCount, out);
+            else
+                std::memcpy(out, texels.data(), tileBytes);
+        });
+    }
+
+    VirtualTextureHeader header = {};
+    std::memcpy(header.magic, VIRTUAL_TEXTURE_MAGIC, sizeof(VIRTUAL_TEXTURE_MAGIC));
+    header.version         = VERSION;
+    header.headerSize      = sizeof(VirtualTextureHeader);
+    header.compressed      = encoding.compressed ? 1 : 0;
+    header.blockFormat     = encoding.blockFormat;
+    header.channelCount    = encoding.channelCount;
+    header.bytesPerChannel = encoding.bytesPerChannel;
+    header.width           = width;
+    header.height          = height;
+    header.tileSize        = tileSize;
+    header.border          = border;
+    header.levelCount      = uint32_t(levels.size());
+    header.tileCount       = TileCountOf(levels);
+    header.tileBytes       = tileBytes;
+    return WriteFileAtomic(path, {{&header, sizeof(VirtualTextureHeader)},
+                                  {tiles.data(), tiles.size()}});
+}
+
+bool VirtualTextureFile::Open(const std::string& path)
+{
+    file = MappedFile(path);
+    if(!file.IsOpen()) return false;
+
+    auto Reject = [&](const char* reason)
+    {
+        std::printf("[WARNING]: Virtual texture \"%s\" is %s.\n", path.c_str(), reason);
+        file = MappedFile();
+        return false;
+    };
+
+    VirtualTextureHeader header;
+    if(file.size < sizeof(VirtualTextureHeader)) return Reject("corrupt");
+    std::memcpy(&header, file.data, sizeof(VirtualTextureHeader));
+    if(std::memcmp(header.magic, VIRTUAL_TEXTURE_MAGIC, sizeof(VIRTUAL_TEXTURE_MAGIC)) != 0 ||
+       header.headerSize != sizeof(VirtualTextureHeader))
+        return Reject("corrupt");
+    if(header.version != VERSION)
+        return Reject("from an older version");
+
+    TexelEncoding enc;
+    if(!EncodingFrom(header, enc) || !IsPowerOfTwo(header.width) ||
+       !IsPowerOfTwo(header.height) || !IsPowerOfTwo(header.tileSize) ||
+       header.width < header.tileSize || header.height < header.tileSize)
+        return Reject("corrupt");
+
+    // The layout must be exactly the one the writer produces
+    std::vector<Level> layout = LevelsFor(header.width, header.height, header.tileSize);
+    size_t bytes = TileBytes(enc, header.tileSize, header.border);
+    if(header.levelCount != layout.size() || layout.size() > MAX_LEVELS ||
+       header.tileCount != TileCountOf(layout) || header.tileBytes != bytes ||
+       file.size != sizeof(VirtualTextureHeader) + size_t(header.tileCount) * bytes)
+        return Reject("corrupt");
+
+    encoding = enc;
+    width = header.width;
+    height = header.height;
+    tileSize = header.tileSize;
+    border = header.border;
+    levels = std::move(layout);
+    tileBytes = bytes;
+    tiles = reinterpret_cast<const unsigned char*>(file.data) + sizeof(VirtualTextureHeader);
+    return true;
+}
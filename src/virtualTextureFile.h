@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fileIO.h"
+#include "textureContainer.h"
+
+// Tiled page file of a virtual texture ("*.vtex"). Every level of the
+// mip chain is cut into square tiles of "tileSize" texels, each stored
+// with a "border" of its neighbors on every side (wrapped horizontally,
+// clamped vertically, as equirectangular maps are sampled) so that
+// bilinear filtering never reads another tile. Levels stop at the one
+// that fits in a single tile; tiles are in the texel encoding of the
+// physical cache (raw or blocks), coarsest level first and row major
+// (bottom row first) within a level, all of the same size.
+//
+// Images must have power of two sizes of at least "tileSize". Page files
+// are far too large to checksum on open, only their layout is checked.
+struct VirtualTextureFile {
+  static constexpr uint32_t VERSION = 1;
+  static constexpr const char *EXTENSION = ".vtex";
+  static constexpr uint32_t DEFAULT_TILE_SIZE = 128;
+  static constexpr uint32_t DEFAULT_BORDER = 4;
+  static constexpr uint32_t MAX_LEVELS = 16;
+
+  struct Level {
+    uint32_t tilesX = 0;
+    uint32_t tilesY = 0;
+    // Index of the first tile of the level in the file
+    uint32_t firstTile = 0;
+  };
+
+  MappedFile file;
+  TexelEncoding encoding;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t tileSize = 0;
+  uint32_t border = 0;
+  std::vector<Level> levels;
+  size_t tileBytes = 0;
+  const unsigned char *tiles = nullptr;
+
+  // "textures/earth_32k.jpg" -> "textures/earth_32k.vtex"
+  static std::string PathFor(const std::string &imagePath);
+  // Stored size of a tile (with its border) in "encoding"
+  static size_t TileBytes(const TexelEncoding &, uint32_t tileSize,
+                          uint32_t border);
+  // Cuts a tightly packed 8-bit image (rows bottom first) and its box
+  // filtered mips into tiles. Raw encodings must have the channel count
+  // of the image; block formats need sizes in whole blocks. Returns
+  // false, with a message, for unsupported sizes or on I/O failure.
+  static bool Write(const std::string &path, const unsigned char *pixels,
+                    uint32_t width, uint32_t height, uint32_t channelCount,
+                    const TexelEncoding &,
+                    uint32_t tileSize = DEFAULT_TILE_SIZE,
+                    uint32_t border = DEFAULT_BORDER);
+
+  // Maps a page file, returns false (with a warning when the file
+  // exists) if it is missing or corrupt
+  bool Open(const std::string &path);
+
+  uint32_t TileCount() const {
+    if (levels.empty())
+      return 0;
+    return levels[0].firstTile + levels[0].tilesX * levels[0].tilesY;
+  }
+
+  const unsigned char *Tile(uint32_t level, uint32_t x, uint32_t y) const {
+    const Level &l = levels[level];
+    return tiles + size_t(l.firstTile + y * l.tilesX + x) * tileBytes;
+  }
+};
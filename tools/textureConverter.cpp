@@ -0,0 +1,167 @@
+// Converts images into GPU ready texture containers (see
+// TextureContainer), the renderer maps them and uploads their levels as
+// they are, with no image decode or mip generation at startup.
+//
+//   texture_converter [--format auto|raw|bc1|bc4|bc5|bc7]
+//                     [--virtual [--tile-size <texels>]] <image|pack>...
+//
+// "auto" (the default) picks the block format the renderer would use
+// for the channel count: BC4, BC5, BC1 or BC7. BC1 needs S3TC on the
+// GL side, use "bc7" for drivers without it. "raw" keeps the 8-bit
+// texels. Mips are box filtered (see GenerateMips). Texture packs
+// ("*.texpack", see TexturePack) are converted from their images, with
+// their channels filtered as data.
+//
+// Containers are written next to the images, "textures/moon.jpg"
+// becomes "textures/moon.ptex". "--virtual" writes tiled page files
+// instead ("textures/moon.vtex", see VirtualTextureFile) for images too
+// large for the GPU, which need power of two sizes.
+#include "textureContainer.h"
+#include "texturePack.h"
+#include "virtualTextureFile.h"
+
+#include <stb_image.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+static bool EncodingFor(const std::string& name, int channelCount, TexelEncoding& out)
+{
+    if(name == "auto") out = TexelEncoding::Block(BlockFormat::ForChannelCount(channelCount));
+    else if(name == "raw") out = TexelEncoding::Raw(uint32_t(channelCount), 1);
+    else if(name == "bc1") out = TexelEncoding::Block(BlockFormat::BC1);
+    else if(name == "bc4") out = TexelEncoding::Block(BlockFormat::BC4);
+    else if(name == "bc5") out = TexelEncoding::Block(BlockFormat::BC5);
+    else if(name == "bc7") out = TexelEncoding::Block(BlockFormat::BC7);
+    else return false;
+    return true;
+}
+
+static void PrintUsage()
+{
+    std::fprintf(stderr, "Usage: texture_converter [--format auto|raw|bc1|bc4|bc5|bc7] "
+                         "[--virtual [--tile-size <texels>]] <image|pack>...\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    std::string formatName = "auto";
+    bool writeVirtual = false;
+    uint32_t tileSize = VirtualTextureFile::DEFAULT_TILE_SIZE;
+    std::vector<std::string> images;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--format" && i + 1 < argc)
+            formatName = argv[++i];
+        else if(arg == "--virtual")
+            writeVirtual = true;
+        else if(arg == "--tile-size" && i + 1 < argc)
+            tileSize = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        else if(arg.rfind("--", 0) == 0)
+        {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+        else images.push_back(arg);
+    }
+    TexelEncoding probe;
+    if(images.empty() || !EncodingFor(formatName, 4, probe))
+    {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Same orientation as the renderer (bottom row first)
+    stbi_set_flip_vertically_on_load(1);
+    int failed = 0;
+    for(const std::string& path : images)
+    {
+        auto start = std::chrono::steady_clock::now();
+        int w = 0, h = 0, c = 0;
+        std::unique_ptr<unsigned char, void(*)(void*)> decoded(nullptr, stbi_image_free);
+        std::vector<unsigned char> packed;
+        const unsigned char* pixels = nullptr;
+        MipFilter filter;
+        if(TexturePack::IsPackPath(path))
+        {
+            TexturePack pack;
+            uint32_t pw = 0, ph = 0;
+            if(!pack.Read(path) || (packed = pack.Pack(pw, ph)).empty())
+            {
+                std::fprintf(stderr, "Unable to read texture pack \"%s\"\n", path.c_str());
+                failed++;
+                continue;
+            }
+            if(writeVirtual)
+            {
+                std::fprintf(stderr, "Texture pack \"%s\" can not be written as a virtual "
+                                     "texture\n", path.c_str());
+                failed++;
+                continue;
+            }
+            w = int(pw);
+            h = int(ph);
+            c = int(pack.channels.size());
+            pixels = packed.data();
+            filter = pack.Filter();
+        }
+        else
+        {
+            bool is16Bit = stbi_is_16_bit(path.c_str());
+            decoded.reset(stbi_load(path.c_str(), &w, &h, &c, 0));
+            if(!decoded)
+            {
+                std::fprintf(stderr, "Unable to read image \"%s\"\n", path.c_str());
+                failed++;
+                continue;
+            }
+            if(is16Bit)
+                std::printf("[WARNING]: Image \"%s\" is 16-bit, it is stored with 8-bit "
+                            "channels.\n", path.c_str());
+            pixels = decoded.get();
+            filter = MipFilter::For(uint32_t(c));
+        }
+
+        TexelEncoding encoding;
+        EncodingFor(formatName, c, encoding);
+        if(writeVirtual)
+        {
+            std::string outPath = VirtualTextureFile::PathFor(path);
+            bool written = VirtualTextureFile::Write(outPath, pixels, uint32_t(w), uint32_t(h),
+                                                     uint32_t(c), encoding, tileSize);
+            if(!written)
+            {
+                std::fprintf(stderr, "Unable to write \"%s\"\n", outPath.c_str());
+                failed++;
+                continue;
+            }
+            double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            std::printf("\"%s\" -> \"%s\": %s %dx%d, tiles of %u texels (%.0f ms)\n",
+                        path.c_str(), outPath.c_str(), encoding.Name().c_str(), w, h,
+                        tileSize, ms);
+            continue;
+        }
+        TextureImage image = EncodeTexture(pixels, uint32_t(w), uint32_t(h),
+                                           uint32_t(c), encoding, filter);
+
+        std::string outPath = TextureContainer::PathFor(path);
+        if(!TextureContainer::Write(outPath, image))
+        {
+            std::fprintf(stderr, "Unable to write \"%s\"\n", outPath.c_str());
+            failed++;
+            continue;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                              start).count();
+        std::printf("\"%s\" -> \"%s\": %s %dx%d, %zu levels, %.2f MiB (%.0f ms)\n",
+                    path.c_str(), outPath.c_str(), encoding.Name().c_str(), w, h,
+                    image.levels.size(), double(image.data.size()) / (1024.0 * 1024.0), ms);
+    }
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,22 +1,40 @@
 #version 430
+#ifdef GL_SPIRV
+#extension GL_GOOGLE_include_directive : require
+#endif
 
+#define IN_TEX_COORD layout(location = 0)
 #define OUT_FBO layout(location = 0)
 #define T_TEXTURE layout(binding = 0)
+#define T_SKY layout(binding = 3)
+#define U_CUBE_MAP layout(location = 10)
 
-in vec3 fTexCoord;
+in IN_TEX_COORD vec3 fTexCoord;
 out OUT_FBO vec4 fboColor;
 
 uniform T_TEXTURE sampler2D tTexture;
+// Cube map of the same image (see CubeMapGL), sampled when "uCubeMap" is set
+uniform T_SKY samplerCube tSky;
+U_CUBE_MAP uniform int uCubeMap;
+
+#include "virtualTexture.glsl"
 
 void main(void)
 {
 	// Convert 3D direction to spherical UV coordinates for equirectangular texture
 	vec3 dir = normalize(fTexCoord);
+	// Cube maps are sampled by the direction itself
+	if (uCubeMap != 0)
+	{
+		fboColor = vec4(texture(tSky, dir).rgb, 1.0);
+		return;
+	}
 	
 	// Spherical to UV mapping
 	float u = 0.5 + atan(dir.z, dir.x) / (2.0 * 3.14159265359);
 	float v = 0.5 - asin(clamp(dir.y, -1.0, 1.0)) / 3.14159265359;
 	
-	vec3 color = texture(tTexture, vec2(u, v)).rgb;
+	vec2 uv = vec2(u, v);
+	vec3 color = (uVirtual != 0) ? SampleVirtual(uv).rgb : texture(tTexture, uv).rgb;
 	fboColor = vec4(color, 1.0);
 }
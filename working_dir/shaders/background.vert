@@ -2,13 +2,15 @@
 
 #define IN_POS layout(location = 0)
 
+#define OUT_TEX_COORD layout(location = 0)
+
 #define U_TRANSFORM_MODEL layout(location = 0)
 #define U_TRANSFORM_VIEW layout(location = 1)
 #define U_TRANSFORM_PROJ layout(location = 2)
 
 in IN_POS vec3 vPos;
 
-out vec3 fTexCoord;
+out OUT_TEX_COORD vec3 fTexCoord;
 out gl_PerVertex {vec4 gl_Position;};
 
 U_TRANSFORM_MODEL uniform mat4 uModel;
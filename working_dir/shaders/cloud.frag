@@ -33,7 +33,8 @@ uniform T_CLOUD sampler2D tCloud;
 
 void main(void)
 {
-	// Sample cloud texture (alpha channel contains cloud opacity)
+	// Sample cloud texture (alpha channel contains cloud opacity, it is the
+	// Earth surface pack)
 	vec4 cloudSample = texture(tCloud, fUV);
 
 	// Normalize interpolated normal
@@ -1,4 +1,7 @@
 #version 430
+#ifdef GL_SPIRV
+#extension GL_GOOGLE_include_directive : require
+#endif
 /*
 	File Name	: earth.frag
 	Description	: Earth-specific fragment shader with special effects and shadows
@@ -12,15 +15,13 @@
 #define OUT_FBO			layout(location = 0)
 
 #define T_ALBEDO		layout(binding = 0)
-#define T_SPECULAR		layout(binding = 1)
-#define T_NIGHT			layout(binding = 2)
+#define T_SURFACE		layout(binding = 1)
 #define T_SHADOW_MAP	layout(binding = 4)
 
 #define U_LIGHT_DIR		layout(location = 4)
 #define U_LIGHT_COLOR	layout(location = 5)
 #define U_EYE_POS		layout(location = 6)
 #define U_LIGHT_VP		layout(location = 7)
-#define U_USE_SHADOWS	layout(location = 8)
 
 // Input
 in IN_UV		 vec2 fUV;
@@ -35,20 +36,41 @@ U_LIGHT_DIR		uniform vec3 uLightDir;
 U_LIGHT_COLOR	uniform vec3 uLightColor;
 U_EYE_POS		uniform vec3 uEyePos;
 U_LIGHT_VP		uniform mat4 uLightVP;
-U_USE_SHADOWS	uniform int uUseShadows;
+
+// Specialization constants (see ShaderGL::Constant), folded when the
+// program is created. GLSL sources get them as macros instead.
+#ifdef GL_SPIRV
+layout(constant_id = 0) const bool USE_SHADOWS = true;
+layout(constant_id = 1) const float SPECULAR_POWER_LOW = 8.0;
+layout(constant_id = 2) const float SPECULAR_POWER_HIGH = 64.0;
+#else
+#ifndef USE_SHADOWS
+#define USE_SHADOWS true
+#endif
+#ifndef SPECULAR_POWER_LOW
+#define SPECULAR_POWER_LOW 8.0
+#endif
+#ifndef SPECULAR_POWER_HIGH
+#define SPECULAR_POWER_HIGH 64.0
+#endif
+#endif
 
 // Textures
 uniform T_ALBEDO sampler2D tAlbedo;
-uniform T_SPECULAR sampler2D tSpecular;
-uniform T_NIGHT sampler2D tNight;
+// Specular mask (r), night light intensity (g), see 2k_earth_surface.texpack
+uniform T_SURFACE sampler2D tSurface;
 uniform T_SHADOW_MAP sampler2D tShadowMap;
 
+#include "virtualTexture.glsl"
+
 void main(void)
 {
 	// Sample textures
-	vec3 albedo = texture(tAlbedo, fUV).rgb;
-	float specularMask = texture(tSpecular, fUV).r;
-	vec3 nightLights = texture(tNight, fUV).rgb;
+	vec3 albedo = (uVirtual != 0) ? SampleVirtual(fUV).rgb : texture(tAlbedo, fUV).rgb;
+	vec4 surface = texture(tSurface, fUV);
+	float specularMask = surface.r;
+	// City lights are a warm white
+	vec3 nightLights = surface.g * vec3(1.0, 1.0, 0.8);
 
 	// Normalize interpolated normal
 	vec3 N = normalize(fNormal);
@@ -67,7 +89,7 @@ void main(void)
 
 	// Shadow calculation
 	float shadow = 0.0;
-	if (uUseShadows > 0)
+	if (USE_SHADOWS)
 	{
 		vec4 lightSpacePos = uLightVP * vec4(fWorldPos, 1.0);
 		vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
@@ -83,9 +105,7 @@ void main(void)
 	vec3 diffuse = diffuseTerm * albedo * uLightColor * (1.0 - shadow);
 
 	// Specular component with specular map
-	float specularPowerLow = 8.0;
-	float specularPowerHigh = 64.0;
-	float specularPower = mix(specularPowerLow, specularPowerHigh, specularMask);
+	float specularPower = mix(SPECULAR_POWER_LOW, SPECULAR_POWER_HIGH, specularMask);
 	float specularIntensity = mix(0.1, 0.8, specularMask);
 
 	float specularTerm = pow(max(dot(N, H), 0.0), specularPower);
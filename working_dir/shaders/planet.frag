@@ -18,7 +18,6 @@
 #define U_LIGHT_COLOR	layout(location = 5)
 #define U_EYE_POS		layout(location = 6)
 #define U_LIGHT_VP		layout(location = 7)
-#define U_USE_SHADOWS	layout(location = 8)
 
 // Input
 in IN_UV		 vec2 fUV;
@@ -33,7 +32,20 @@ U_LIGHT_DIR		uniform vec3 uLightDir;
 U_LIGHT_COLOR	uniform vec3 uLightColor;
 U_EYE_POS		uniform vec3 uEyePos;
 U_LIGHT_VP		uniform mat4 uLightVP;
-U_USE_SHADOWS	uniform int uUseShadows;
+
+// Specialization constants (see ShaderGL::Constant), folded when the
+// program is created. GLSL sources get them as macros instead.
+#ifdef GL_SPIRV
+layout(constant_id = 0) const bool USE_SHADOWS = true;
+layout(constant_id = 1) const float SPECULAR_POWER = 32.0;
+#else
+#ifndef USE_SHADOWS
+#define USE_SHADOWS true
+#endif
+#ifndef SPECULAR_POWER
+#define SPECULAR_POWER 32.0
+#endif
+#endif
 
 // Textures
 uniform T_ALBEDO sampler2D tAlbedo;
@@ -61,7 +73,7 @@ void main(void)
 
 	// Shadow calculation
 	float shadow = 0.0;
-	if (uUseShadows > 0)
+	if (USE_SHADOWS)
 	{
 		vec4 lightSpacePos = uLightVP * vec4(fWorldPos, 1.0);
 		vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
@@ -82,8 +94,7 @@ void main(void)
 	vec3 diffuse = diffuseTerm * albedo * uLightColor * (1.0 - shadow);
 
 	// Specular component
-	float specularPower = 32.0;
-	float specularTerm = pow(max(dot(N, H), 0.0), specularPower);
+	float specularTerm = pow(max(dot(N, H), 0.0), SPECULAR_POWER);
 	vec3 specular = specularTerm * uLightColor * 0.5 * (1.0 - shadow);
 
 	// Combine all components
@@ -17,6 +17,9 @@
 #define U_TRANSFORM_VIEW	layout(location = 1)
 #define U_TRANSFORM_PROJ	layout(location = 2)
 #define U_TRANSFORM_NORMAL	layout(location = 3)
+#define U_POS_DECODE		layout(location = 9)
+#define U_UV_DECODE			layout(location = 10)
+#define U_OCT_NORMALS		layout(location = 11)
 
 // Input
 in IN_POS	 vec3 vPos;
@@ -34,17 +37,36 @@ U_TRANSFORM_MODEL	uniform mat4 uModel;
 U_TRANSFORM_VIEW	uniform mat4 uView;
 U_TRANSFORM_PROJ	uniform mat4 uProjection;
 U_TRANSFORM_NORMAL  uniform mat3 uNormalMatrix;
+// Packed vertex decode (identity for float vertices)
+U_POS_DECODE		uniform vec4 uPosDecode;
+U_UV_DECODE			uniform vec4 uUVDecode;
+U_OCT_NORMALS		uniform int uOctNormals;
+
+vec3 OctDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0)
+	{
+		vec2 s = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(e.yx)) * s;
+	}
+	return normalize(n);
+}
 
 void main(void)
 {
+	// Decode the vertex
+	vec3 pos = uPosDecode.xyz + uPosDecode.w * vPos;
+	vec3 normal = (uOctNormals != 0) ? OctDecode(vNormal.xy) : vNormal;
+
 	// Pass UV coordinates
-	fUV = vUV;
+	fUV = uUVDecode.xy + uUVDecode.zw * vUV;
 
 	// Transform normal to world space
-	fNormal = normalize(uNormalMatrix * vNormal);
+	fNormal = normalize(uNormalMatrix * normal);
 
 	// Calculate world position
-	vec4 worldPos = uModel * vec4(vPos, 1.0);
+	vec4 worldPos = uModel * vec4(pos, 1.0);
 	fWorldPos = worldPos.xyz;
 
 	// Calculate clip space position
@@ -4,10 +4,12 @@
 	Description	: Shadow pass fragment shader
 */
 
+#define IN_DEPTH	layout(location = 0)
+
 #define OUT_FBO	layout(location = 0)
 
 // Input
-in float fDepth;
+in IN_DEPTH float fDepth;
 
 // Output
 out OUT_FBO float fboDepth;
@@ -6,23 +6,29 @@
 
 #define IN_POS			layout(location = 0)
 
+#define OUT_DEPTH		layout(location = 0)
+
 #define U_TRANSFORM_MODEL	layout(location = 0)
 #define U_LIGHT_VP			layout(location = 7)
+#define U_POS_DECODE		layout(location = 9)
 
 // Input
 in IN_POS vec3 vPos;
 
 // Output
 out gl_PerVertex {vec4 gl_Position;};
-out float fDepth;
+out OUT_DEPTH float fDepth;
 
 // Uniforms
 U_TRANSFORM_MODEL	uniform mat4 uModel;
 U_LIGHT_VP			uniform mat4 uLightVP;
+// Packed vertex decode (identity for float vertices)
+U_POS_DECODE		uniform vec4 uPosDecode;
 
 void main(void)
 {
-	vec4 worldPos = uModel * vec4(vPos, 1.0);
+	vec3 pos = uPosDecode.xyz + uPosDecode.w * vPos;
+	vec4 worldPos = uModel * vec4(pos, 1.0);
 	vec4 lightSpacePos = uLightVP * worldPos;
 	
 	gl_Position = lightSpacePos;
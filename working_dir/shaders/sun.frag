@@ -1,9 +1,10 @@
 #version 430
 
+#define IN_UV layout(location = 0)
 #define OUT_FBO layout(location = 0)
 #define T_TEXTURE layout(binding = 0)
 
-in vec2 fUV;
+in IN_UV vec2 fUV;
 out OUT_FBO vec4 fboColor;
 
 uniform T_TEXTURE sampler2D tTexture;
@@ -3,6 +3,8 @@
 #define IN_POS layout(location = 0)
 #define IN_UV layout(location = 2)
 
+#define OUT_UV layout(location = 0)
+
 #define U_TRANSFORM_MODEL layout(location = 0)
 #define U_TRANSFORM_VIEW layout(location = 1)
 #define U_TRANSFORM_PROJ layout(location = 2)
@@ -10,7 +12,7 @@
 in IN_POS vec3 vPos;
 in IN_UV vec2 vUV;
 
-out vec2 fUV;
+out OUT_UV vec2 fUV;
 out gl_PerVertex {vec4 gl_Position;};
 
 U_TRANSFORM_MODEL uniform mat4 uModel;
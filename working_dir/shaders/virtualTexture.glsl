@@ -0,0 +1,65 @@
+/*
+	File Name	: virtualTexture.glsl
+	Description	: Virtual texture sampling shared by the earth and sky shaders,
+				  pasted by ShaderGL (glslang for the SPIR-V modules) in place of
+				  its #include line
+*/
+
+#define B_VT_FEEDBACK		layout(std430, binding = 0)
+#define B_VT_PARAMETERS		layout(std140, binding = 1)
+#define T_VT_PHYSICAL		layout(binding = 5)
+#define T_VT_INDIRECTION	layout(binding = 6)
+#define U_VIRTUAL			layout(location = 9)
+
+// Virtual texture (see VirtualTextureSystem)
+B_VT_FEEDBACK buffer VirtualTextureFeedback
+{
+	uint vtRequests[];
+};
+B_VT_PARAMETERS uniform VirtualTexture
+{
+	ivec4 vtSize;			// width, height, level count, first feedback bit
+	ivec4 vtTile;			// tile size, border, cache size, feedback phase
+	ivec4 vtLevels[16];		// tiles x, tiles y, first feedback bit
+};
+uniform T_VT_PHYSICAL sampler2D tVtPhysical;
+uniform T_VT_INDIRECTION usampler2D tVtIndirection;
+U_VIRTUAL uniform int uVirtual;
+
+vec4 SampleVirtual(vec2 uv)
+{
+	// Level of the texel footprint, across the horizontal seam too
+	vec2 dx = dFdx(uv);
+	vec2 dy = dFdy(uv);
+	vec2 dxSeam = dFdx(fract(uv + 0.5));
+	vec2 dySeam = dFdy(fract(uv + 0.5));
+	if (dot(dxSeam, dxSeam) + dot(dySeam, dySeam) < dot(dx, dx) + dot(dy, dy))
+	{
+		dx = dxSeam;
+		dy = dySeam;
+	}
+	vec2 size = vec2(vtSize.xy);
+	float footprint = max(length(dx * size), length(dy * size));
+	int level = clamp(int(floor(log2(max(footprint, 1.0)))), 0, vtSize.z - 1);
+	vec2 st = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0));
+
+	// Request the tile, from one pixel of each 4x4 block per frame
+	ivec2 tiles = vtLevels[level].xy;
+	ivec2 tile = min(ivec2(st * vec2(tiles)), tiles - 1);
+	if (all(equal(ivec2(gl_FragCoord.xy) & 3, ivec2(vtTile.w & 3, vtTile.w >> 2))))
+	{
+		int bit = vtSize.w + vtLevels[level].z + tile.y * tiles.x + tile.x;
+		atomicOr(vtRequests[bit >> 5], 1u << uint(bit & 31));
+	}
+
+	// Finest resident tile that covers the texel
+	uvec4 entry = texelFetch(tVtIndirection, tile, level);
+	int residentLevel = int(entry.z);
+	ivec2 residentTiles = vtLevels[residentLevel].xy;
+	ivec2 residentTile = min(ivec2(st * vec2(residentTiles)), residentTiles - 1);
+	vec2 levelSize = vec2(max(vtSize.xy >> residentLevel, ivec2(1)));
+	vec2 local = st * levelSize - vec2(residentTile * vtTile.x);
+	vec2 slotSize = vec2(vtTile.x + 2 * vtTile.y);
+	vec2 physical = vec2(entry.xy) * slotSize + vec2(vtTile.y) + local;
+	return textureLod(tVtPhysical, physical / float(vtTile.z), 0.0);
+}